@@ -111,7 +111,7 @@ buildableModules = {
 
     "UnitTests": { 
         "os": [], 
-        "deps": [] 
+        "deps": ["CFrameworkLib", "CppFrameworkLib"] 
     },
 
     "DesktopMirror_dxgi": { 
@@ -176,6 +176,11 @@ buildableModules = {
         "deps": ["CFrameworkLib", "CppFrameworkLib"] 
     },
 
+    "FecBenchmark": { 
+        "os": [], 
+        "deps": ["CFrameworkLib", "CppFrameworkLib"] 
+    },
+
     "CFrameworkLib": { "os": [], "deps": [] },
     "CppFrameworkLib": { "os": [], "deps": ["CFrameworkLib"] }
 }
@@ -535,9 +540,10 @@ logInfo("### Run UnitTests")
 logInfo("###############################################################")
 logInfo("")
 
-#os.chdir(buildArtifactsRoot + "/bin/")
-#call("./unittests.exe", ["--gtest_output=xml:unittests.xml"])
-#os.chdir(buildDir)
+if("UnitTests" in enabledModules):
+    os.chdir(artifactDirectory)
+    call("./unittests" + (".exe" if "windows" in platform else ""), ["--gtest_output=xml:unittests.xml"])
+    os.chdir(buildDir)
 
 
 logInfo("")
@@ -338,6 +338,26 @@ class PerformanceMonitorExport final {
         return "ViewerUnableToDecodeFrame";
       case EPerfMetric::ViewerInsufficentFrameData:
         return "ViewerInsufficentFrameData";
+      case EPerfMetric::EccMatrixCacheHits:
+        return "EccMatrixCacheHits";
+      case EPerfMetric::EccMatrixCacheMisses:
+        return "EccMatrixCacheMisses";
+      case EPerfMetric::EccRatio:
+        return "EccRatio";
+      case EPerfMetric::EccLossRate:
+        return "EccLossRate";
+      case EPerfMetric::EccBurstLength:
+        return "EccBurstLength";
+      case EPerfMetric::EccResidualFrameLoss:
+        return "EccResidualFrameLoss";
+      case EPerfMetric::PacingQueueDelay:
+        return "PacingQueueDelay";
+      case EPerfMetric::PacingMaxQueueDelay:
+        return "PacingMaxQueueDelay";
+      case EPerfMetric::PacingLateness:
+        return "PacingLateness";
+      case EPerfMetric::PacingRateAccuracy:
+        return "PacingRateAccuracy";
       case EPerfMetric::CountersEnd:
         return "CountersEnd";
       case EPerfMetric::CaptureFrameDelta:
@@ -64,6 +64,21 @@ struct EPerfMetric {
     ViewerUnableToDecodeFrame,
     ViewerInsufficentFrameData,
 
+    EccMatrixCacheHits,
+    EccMatrixCacheMisses,
+
+    // State of the ECC ratio controller, see EccController
+    EccRatio,
+    EccLossRate,
+    EccBurstLength,
+    EccResidualFrameLoss,
+
+    // Packets waiting for their turn to be sent, see PacketPacer
+    PacingQueueDelay,
+    PacingMaxQueueDelay,
+    PacingLateness,
+    PacingRateAccuracy,
+
     CountersEnd,
 
     CaptureFrameDelta,
@@ -26,34 +26,105 @@ SOFTWARE.
 #define UDPCHUNK_H
 
 #include <stdint.h>
+#include <string.h>
 
 namespace DirectRemote {
 
+// Chunks are UDP_CHUNK_SIZE bytes on the wire, unless both peers agreed on
+// a larger size in the Ping handshake, see UdpProtocol. A UdpChunk has room
+// for the largest size, which fills a 1500 byte IPv4 MTU; chunk buffers
+// only give each chunk the session's size, see UdpChunkVector.
 #define UDP_CHUNK_SIZE 512
-#define CHUNK_ECC_SIZE (UDP_CHUNK_SIZE - 16)
-#define CHUNK_PAYLOAD_SIZE (UDP_CHUNK_SIZE - 18)
-#define MAX_MESSAGE_SIZE (CHUNK_PAYLOAD_SIZE * 127)
+#define MAX_UDP_CHUNK_SIZE 1472
+#define CHUNK_ECC_OFFSET 16
+#define CHUNK_PAYLOAD_OFFSET 18
+#define CHUNK_ECC_SIZE (UDP_CHUNK_SIZE - CHUNK_ECC_OFFSET)
+#define CHUNK_PAYLOAD_SIZE (UDP_CHUNK_SIZE - CHUNK_PAYLOAD_OFFSET)
+#define MAX_CHUNK_ECC_SIZE (MAX_UDP_CHUNK_SIZE - CHUNK_ECC_OFFSET)
+#define MAX_CHUNK_PAYLOAD_SIZE (MAX_UDP_CHUNK_SIZE - CHUNK_PAYLOAD_OFFSET)
+#define MAX_MESSAGE_CHUNKS 127
+// Data chunks per message with wire format v2, whose indices are a byte.
+// cauchy_256 takes at most 256 chunks per message, ECC included, so this
+// leaves room for 64 ECC chunks on the largest messages.
+#define MAX_WIDE_MESSAGE_CHUNKS 192
+#define MAX_MESSAGE_SIZE (CHUNK_PAYLOAD_SIZE * MAX_MESSAGE_CHUNKS)
 
 struct EUdpCommand {
   enum {
     Ping = 0,
     LinkStatus = 1,
+    // Echoed by the relay at the size it came in, see UdpProtocol::connect()
+    Probe = 2,
   };
 };
 
+// What a peer understands beyond the original protocol, offered in pings
+struct EUdpFeature {
+  enum {
+    // Data chunks end after their payload on the wire, see wireChunkSize()
+    TrimmedChunks = 1 << 0,
+    // Messages may go out before their frame is complete, see msgCount
+    StreamedFrames = 1 << 1,
+    // Chunks of several frames may be mixed on the wire, see SendScheduler.
+    // The 4 bits at InterleaveShift tell over how many frames the peer
+    // spreads its own.
+    InterleavedFrames = 1 << 2,
+    InterleaveShift = 8,
+    // Data chunks go out with the header of EWireFormat::V2
+    WireFormatV2 = 1 << 3,
+    // Viewer responses carry the ConnectionMetrics of the end that sends
+    // them, see ViewerResponseEncoder::stampMetrics()
+    ViewerMetrics = 1 << 4,
+  };
+};
+
+// Headers of data and ECC chunks on the wire, see encodeChunkHeader().
+// Control packets always go out as V1, see encodeControlPacket(), so that
+// relays and peers read them before anything is agreed on. Relays only look
+// at the routing bytes and at ctrl, which are the same in memory.
+struct EWireFormat {
+  enum {
+    // 16 bytes of bit fields, with 7 bit chunk indices
+    V1 = 1,
+    // 9 to 16 bytes, byte sized chunk indices, see MAX_WIDE_MESSAGE_CHUNKS
+    V2 = 2,
+  };
+};
+
+// sessionId and the byte with isEccChunk and isControlPacket are the same
+// in every wire format, which is all a relay needs to route a datagram
+#define CHUNK_ROUTING_SIZE 7
+#define MAX_CHUNK_HEADER_SIZE 16
+
 #include "struct_pack_one.h"
 struct UdpChunk {
   uint64_t sessionId : 48;  // must be the first member
   uint64_t isEccChunk : 1;
   uint64_t isControlPacket : 1;
 
-  // ECC protected message chunks
-  uint64_t chunkIndex : 7;
-  uint64_t chunkCount : 7;
+  // ECC protected message chunks. ECC chunks have chunkIndex < chunkCount,
+  // the ECC chunk count. XOR parity chunks have chunkIndex >= chunkCount,
+  // which older receivers drop as invalid; for them chunkCount is the grid
+  // width and chunkIndex - chunkCount the parity index, see xor_parity.h.
+  // Wire format V1 only has 7 bits for both, see encodeChunkHeader().
+  uint64_t chunkIndex : 8;
+  uint64_t : 6;
 
-  uint64_t trackingId : 48;
+  // The lower 40 bits of a tracking id that fits, see isValidTrackingId()
+  uint64_t trackingId : 40;
+  uint64_t chunkCount : 8;
 
-  // there is no cross-message ECC
+  // Parity chunks protect the messages of whole frames together and are
+  // marked by msgIndex >= msgCount, which older receivers drop as invalid.
+  // For them msgIndex - msgCount is 8 * (window - 1) + log2 of the parity
+  // stride, where window is the number of frames covered, ending with this
+  // one (1 for frame parity). chunkIndex is the parity index and chunkCount
+  // the chunk count of the frame's last message.
+  //
+  // Streamed frames send their messages as they come, before the number of
+  // them is known. All chunks of those messages have msgCount 0, and only
+  // the last message and the parity tell the real count. Every message but
+  // the last one is full either way.
   uint64_t msgIndex : 8;
   uint64_t msgCount : 8;
 
@@ -61,13 +132,13 @@ struct UdpChunk {
     struct {
       uint16_t size : 15;
       uint16_t isConnected : 1;
-      unsigned char bytes[CHUNK_PAYLOAD_SIZE];
+      unsigned char bytes[MAX_CHUNK_PAYLOAD_SIZE];
     } data;
 
     struct {
       // ecc portion should cover all except sessionId (which is used for
       // routing)
-      unsigned char bytes[CHUNK_ECC_SIZE];
+      unsigned char bytes[MAX_CHUNK_ECC_SIZE];
     } ecc;
 
     struct {
@@ -77,14 +148,284 @@ struct UdpChunk {
       int32_t peerPort;
       char yourAddress[32];
       int32_t yourPort;
+      // Largest chunk size the sender got through to the relay and back,
+      // and the relay's copy of what the peer sent. Older peers and relays
+      // leave them 0, which stands for UDP_CHUNK_SIZE.
+      int32_t chunkSize;
+      int32_t peerChunkSize;
+      // EUdpFeature flags, passed on by the relay the same way
+      uint32_t features;
+      uint32_t peerFeatures;
     } ctrl;
   };
 } PACKED;
 #include "struct_pack_default.h"
 
-static_assert(sizeof(UdpChunk) == UDP_CHUNK_SIZE,
+static_assert(sizeof(UdpChunk) == MAX_UDP_CHUNK_SIZE,
               "UdpChunk is not configured correctly.");
 
+// Tracking ids that the 40 bits of UdpChunk::trackingId can hold. They are
+// signed, so that V1 can widen them to the 48 bits it always carried and
+// ids like -1 look the same to older peers.
+#define TRACKING_ID_BITS 40
+
+inline bool isValidTrackingId(int64_t trackingId) {
+  const int64_t limit = static_cast<int64_t>(1) << (TRACKING_ID_BITS - 1);
+  return (trackingId >= -limit) && (trackingId < limit);
+}
+
+// Multiples of 8 keep the ECC region one as well, which the codecs need
+inline bool isValidChunkSize(int chunkSize) {
+  return (chunkSize >= UDP_CHUNK_SIZE) && (chunkSize <= MAX_UDP_CHUNK_SIZE) &&
+         (chunkSize % 8 == 0);
+}
+
+inline int chunkEccSize(int chunkSize) {
+  return chunkSize - CHUNK_ECC_OFFSET;
+}
+
+inline int chunkPayloadSize(int chunkSize) {
+  return chunkSize - CHUNK_PAYLOAD_OFFSET;
+}
+
+// Messages of messageChunks data chunks at most, MAX_MESSAGE_CHUNKS or with
+// wire format V2 up to MAX_WIDE_MESSAGE_CHUNKS
+inline int maxMessageSize(int chunkSize,
+                          int messageChunks = MAX_MESSAGE_CHUNKS) {
+  return chunkPayloadSize(chunkSize) * messageChunks;
+}
+
+// Bytes a chunk takes on the wire when trimmed. The payload of data chunks
+// is zero beyond data.size, so they can end there and receivers fill the
+// rest in again before anything sees the chunk, see restoreChunk(). ECC
+// covers the zeros like any other byte.
+inline int wireChunkSize(const UdpChunk &chunk, int chunkSize) {
+  if (chunk.isControlPacket || chunk.isEccChunk ||
+      (chunk.data.size >= chunkPayloadSize(chunkSize))) {
+    return chunkSize;
+  }
+  return CHUNK_PAYLOAD_OFFSET + chunk.data.size;
+}
+
+// Whether "length" received bytes make up a chunk of a session with this
+// chunk size, trimmed or not. Fills in what trimming left out.
+inline bool restoreChunk(UdpChunk &chunk, int length, int chunkSize) {
+  if (length == chunkSize) {
+    return true;
+  }
+
+  if ((length < CHUNK_PAYLOAD_OFFSET) ||
+      (length != wireChunkSize(chunk, chunkSize))) {
+    return false;
+  }
+
+  memset(reinterpret_cast<unsigned char *>(&chunk) + length, 0,
+         chunkSize - length);
+  return true;
+}
+
+// Copies the part of "src" a session with this chunk size uses, nothing
+// reads a chunk beyond it. Chunk buffers have no room for more, so chunks
+// go there this way instead of by assignment.
+inline void copyChunk(UdpChunk &dst, const UdpChunk &src, int chunkSize) {
+  memcpy(&dst, &src, chunkSize);
+}
+
+// Writes the header of "chunk" in the given wire format and returns its
+// size, at most MAX_CHUNK_HEADER_SIZE. The chunk goes on from
+// CHUNK_ECC_OFFSET, so a datagram is the header followed by the chunk's
+// bytes from there to the end of wireChunkSize(). Returns -1 for chunks the
+// format cannot carry.
+//
+// V1 is the original layout of 16 bytes, with 7 bit chunk indices and a 48
+// bit tracking id, into which the 40 bits of trackingId are sign extended.
+// Chunks with chunkIndex or chunkCount beyond 127 are rejected.
+//
+// V2 starts with sessionId and a flags byte: isEccChunk, isControlPacket,
+// the format in bits 2 and 3, bit 4 for messages that are the only one of
+// their frame, and in bits 5 to 7 the number of trackingId bytes that
+// follow. Then come chunkIndex and chunkCount, and unless bit 4 is set
+// msgIndex and msgCount, a byte each.
+inline int encodeChunkHeader(const UdpChunk &chunk, int wireFormat,
+                             unsigned char *header) {
+  if (wireFormat != EWireFormat::V2) {
+    if ((chunk.chunkIndex > 0x7F) || (chunk.chunkCount > 0x7F)) {
+      return -1;
+    }
+
+    // Narrow bit fields promote to int, so they are widened first
+    const uint64_t trackingId =
+        (chunk.trackingId >> (TRACKING_ID_BITS - 1))
+            ? (chunk.trackingId | 0xFF0000000000ull)
+            : static_cast<uint64_t>(chunk.trackingId);
+    const uint64_t words[2] = {
+        chunk.sessionId | (static_cast<uint64_t>(chunk.isEccChunk) << 48) |
+            (static_cast<uint64_t>(chunk.isControlPacket) << 49) |
+            (static_cast<uint64_t>(chunk.chunkIndex) << 50) |
+            (static_cast<uint64_t>(chunk.chunkCount) << 57),
+        trackingId | (static_cast<uint64_t>(chunk.msgIndex) << 48) |
+            (static_cast<uint64_t>(chunk.msgCount) << 56)};
+
+    memcpy(header, words, sizeof(words));
+    return sizeof(words);
+  }
+
+  const bool isSingle = (chunk.msgIndex == 0) && (chunk.msgCount == 1);
+  uint64_t trackingId = chunk.trackingId;
+  int trackingBytes = 0;
+
+  while (trackingId >> (8 * trackingBytes)) {
+    trackingBytes++;
+  }
+
+  const uint64_t sessionId = chunk.sessionId;
+  memcpy(header, &sessionId, 6);
+
+  int size = 6;
+  header[size++] = static_cast<unsigned char>(
+      chunk.isEccChunk | (chunk.isControlPacket << 1) |
+      (EWireFormat::V2 << 2) | (isSingle << 4) | (trackingBytes << 5));
+
+  for (int i = 0; i < trackingBytes; i++, trackingId >>= 8) {
+    header[size++] = static_cast<unsigned char>(trackingId);
+  }
+
+  header[size++] = static_cast<unsigned char>(chunk.chunkIndex);
+  header[size++] = static_cast<unsigned char>(chunk.chunkCount);
+
+  if (!isSingle) {
+    header[size++] = static_cast<unsigned char>(chunk.msgIndex);
+    header[size++] = static_cast<unsigned char>(chunk.msgCount);
+  }
+
+  return size;
+}
+
+// Turns the "length" bytes of a datagram at &chunk, with a header of the
+// given wire format, into the chunk they were encoded from. Returns the
+// length of the chunk from there on, as if trimmed like the datagram, see
+// restoreChunk(), or -1 if the header does not fit the format, or carries a
+// tracking id that does not fit, see isValidTrackingId().
+inline int decodeChunk(UdpChunk &chunk, int length, int wireFormat) {
+  unsigned char *bytes = reinterpret_cast<unsigned char *>(&chunk);
+  uint64_t sessionId = 0;
+  uint64_t trackingId = 0;
+  int isEccChunk, isControlPacket, chunkIndex, chunkCount, msgIndex, msgCount;
+  int size;
+
+  if (wireFormat != EWireFormat::V2) {
+    uint64_t words[2];
+
+    if (length < CHUNK_ECC_OFFSET) {
+      return -1;
+    }
+
+    memcpy(words, bytes, sizeof(words));
+    sessionId = words[0] & 0xFFFFFFFFFFFFull;
+    isEccChunk = static_cast<int>((words[0] >> 48) & 1);
+    isControlPacket = static_cast<int>((words[0] >> 49) & 1);
+    chunkIndex = static_cast<int>((words[0] >> 50) & 0x7F);
+    chunkCount = static_cast<int>((words[0] >> 57) & 0x7F);
+    trackingId = words[1] & 0xFFFFFFFFFFFFull;
+    msgIndex = static_cast<int>((words[1] >> 48) & 0xFF);
+    msgCount = static_cast<int>(words[1] >> 56);
+    size = CHUNK_ECC_OFFSET;
+
+    // The bits beyond the 40 kept have to be the sign extension of them
+    const uint64_t extension = trackingId >> (TRACKING_ID_BITS - 1);
+    if ((extension != 0) && (extension != 0x1FF)) {
+      return -1;
+    }
+    trackingId &= 0xFFFFFFFFFFull;
+  } else {
+    if (length < CHUNK_ROUTING_SIZE) {
+      return -1;
+    }
+
+    const int flags = bytes[6];
+    const bool isSingle = (flags & (1 << 4)) != 0;
+    const int trackingBytes = flags >> 5;
+
+    size = CHUNK_ROUTING_SIZE + trackingBytes + (isSingle ? 2 : 4);
+
+    if ((((flags >> 2) & 3) != EWireFormat::V2) || (trackingBytes > 5) ||
+        (length < size)) {
+      return -1;
+    }
+
+    memcpy(&sessionId, bytes, 6);
+    isEccChunk = flags & 1;
+    isControlPacket = (flags >> 1) & 1;
+
+    for (int i = trackingBytes - 1; i >= 0; i--) {
+      trackingId = (trackingId << 8) | bytes[CHUNK_ROUTING_SIZE + i];
+    }
+
+    const unsigned char *indices = bytes + CHUNK_ROUTING_SIZE + trackingBytes;
+    chunkIndex = indices[0];
+    chunkCount = indices[1];
+    msgIndex = isSingle ? 0 : indices[2];
+    msgCount = isSingle ? 1 : indices[3];
+
+    memmove(bytes + CHUNK_ECC_OFFSET, bytes + size, length - size);
+  }
+
+  memset(bytes, 0, CHUNK_ECC_OFFSET);
+  chunk.sessionId = sessionId;
+  chunk.isEccChunk = static_cast<uint64_t>(isEccChunk);
+  chunk.isControlPacket = static_cast<uint64_t>(isControlPacket);
+  chunk.chunkIndex = static_cast<uint64_t>(chunkIndex);
+  chunk.chunkCount = static_cast<uint64_t>(chunkCount);
+  chunk.trackingId = trackingId;
+  chunk.msgIndex = static_cast<uint64_t>(msgIndex);
+  chunk.msgCount = static_cast<uint64_t>(msgCount);
+
+  return CHUNK_ECC_OFFSET + length - size;
+}
+
+// Writes the V1 header of a control packet over its first CHUNK_ECC_OFFSET
+// bytes, whatever the session agreed on, so that it can be sent as it is.
+// Receivers read it back with decodeChunk() and EWireFormat::V1.
+inline bool encodeControlPacket(UdpChunk &chunk) {
+  unsigned char header[MAX_CHUNK_HEADER_SIZE];
+
+  if (encodeChunkHeader(chunk, EWireFormat::V1, header) != CHUNK_ECC_OFFSET) {
+    return false;
+  }
+
+  memcpy(&chunk, header, CHUNK_ECC_OFFSET);
+  return true;
+}
+
+#define MAX_PARITY_WINDOW 4
+
+// Frames a sender may spread a frame over, see SendScheduler. Like parity
+// windows, they have to fit into the frames a receiver keeps.
+#define MAX_INTERLEAVE_FRAMES 4
+
+inline bool isParityChunk(const UdpChunk &chunk) {
+  return chunk.isEccChunk && (chunk.msgCount != 0) &&
+         (chunk.msgIndex >= chunk.msgCount);
+}
+
+// Frames covered by a parity chunk
+inline int parityWindow(const UdpChunk &chunk) {
+  return 1 + static_cast<int>(chunk.msgIndex - chunk.msgCount) / 8;
+}
+
+inline int parityStrideLog(const UdpChunk &chunk) {
+  return static_cast<int>(chunk.msgIndex - chunk.msgCount) % 8;
+}
+
+inline bool isFrameParityChunk(const UdpChunk &chunk) {
+  return isParityChunk(chunk) && (parityWindow(chunk) == 1);
+}
+
+inline bool isXorParityChunk(const UdpChunk &chunk) {
+  return chunk.isEccChunk && !isParityChunk(chunk) &&
+         (chunk.chunkIndex >= chunk.chunkCount);
+}
+
 struct ConnectionMetrics {
   int64_t lostPackets = 0;
   int64_t lostFrames = 0;
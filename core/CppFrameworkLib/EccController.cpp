@@ -0,0 +1,156 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "EccController.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+
+static const double MAX_BURST_LENGTH = 16;
+static const float RATIO_STEP = 0.01f;
+
+// Losses show up within a report, better ones only over several
+static const double RISING_WEIGHT = 0.5;
+static const double FALLING_WEIGHT = 0.1;
+static const double SHAPE_WEIGHT = 0.05;
+
+EccController::EccController(float initialRatio)
+    : ratio(initialRatio) {}
+
+EccController::EccController(float initialRatio, Options options)
+    : options(options), ratio(initialRatio) {}
+
+void EccController::onFrameSent(size_t dataChunks, size_t eccChunks,
+                                size_t msgCount) {
+  sentPackets += static_cast<int64_t>(dataChunks + eccChunks);
+
+  const double chunks = static_cast<double>(dataChunks) / std::max<size_t>(1, msgCount);
+  if (messagesPerFrame == 0) {
+    chunksPerMessage = chunks;
+    messagesPerFrame = static_cast<double>(msgCount);
+  } else {
+    chunksPerMessage += (chunks - chunksPerMessage) * SHAPE_WEIGHT;
+    messagesPerFrame += (msgCount - messagesPerFrame) * SHAPE_WEIGHT;
+  }
+}
+
+void EccController::onRepairSent(size_t eccChunks) {
+  sentPackets += static_cast<int64_t>(eccChunks);
+}
+
+void EccController::onViewerMetrics(const ConnectionMetrics &metrics) {
+  if ((sampleIncomingPackets < 0) ||
+      (metrics.incomingPackets < sampleIncomingPackets)) {
+    sampleIncomingPackets = metrics.incomingPackets;
+    sampleSentPackets = sentPackets;
+    return;
+  }
+
+  const int64_t sent = sentPackets - sampleSentPackets;
+  if (sent < options.minSamplePackets) {
+    return;
+  }
+
+  const int64_t received = metrics.incomingPackets - sampleIncomingPackets;
+  const double sample = std::max(
+      0.0, std::min(1.0, 1.0 - static_cast<double>(received) / sent));
+
+  sampleIncomingPackets = metrics.incomingPackets;
+  sampleSentPackets = sentPackets;
+
+  const double weight = (sample > lossRate) ? RISING_WEIGHT : FALLING_WEIGHT;
+  const double deviation = sample - lossRate;
+  lossRate += deviation * weight;
+  lossVariance += (deviation * deviation - lossVariance) * weight;
+
+  // Independent losses scatter by p (1 - p) / n around the rate, bursts of
+  // b losses by about b times that
+  const double binomialVariance = lossRate * (1 - lossRate) / sent;
+  burstLength = (binomialVariance > 0)
+                    ? std::max(1.0, std::min(MAX_BURST_LENGTH,
+                                             lossVariance / binomialVariance))
+                    : 1.0;
+
+  update();
+}
+
+void EccController::update() {
+  const size_t chunkCount = std::max<size_t>(
+      1, std::min<size_t>(MAX_WIDE_MESSAGE_CHUNKS,
+                          static_cast<size_t>(chunksPerMessage + 0.5)));
+  const double messages = std::max(1.0, messagesPerFrame);
+
+  for (float candidate = options.minRatio;; candidate += RATIO_STEP) {
+    const size_t eccCount =
+        PacketAssembly::eccChunkCount(chunkCount, candidate);
+
+    ratio = std::min(candidate, options.maxRatio);
+    residualFrameLoss =
+        1 - pow(1 - messageLoss(chunkCount, eccCount, lossRate, burstLength),
+                messages);
+
+    if ((residualFrameLoss <= options.targetFrameLoss) ||
+        (candidate >= options.maxRatio)) {
+      break;
+    }
+  }
+}
+
+double EccController::messageLoss(size_t chunkCount, size_t eccCount,
+                                  double lossRate, double burstLength) {
+  // Bursts start independently and each takes burstLength chunks, the
+  // message is lost once they take more than its ECC chunks
+  const size_t n = chunkCount + eccCount;
+  const double q = std::min(1.0, lossRate / std::max(1.0, burstLength));
+  const size_t tolerated = static_cast<size_t>(eccCount / burstLength);
+
+  if (q <= 0) {
+    return 0;
+  }
+  if (q >= 1) {
+    return 1;
+  }
+
+  double term = pow(1 - q, static_cast<double>(n));
+  double recovered = term;
+
+  for (size_t x = 0; (x < tolerated) && (x < n); x++) {
+    term *= static_cast<double>(n - x) / (x + 1) * q / (1 - q);
+    recovered += term;
+  }
+
+  return std::max(0.0, 1 - recovered);
+}
+
+void EccController::recordMetrics(PerformanceMonitor &perfMon) const {
+  perfMon.recordCounter(EPerfMetric::EccRatio, ratio);
+  perfMon.recordCounter(EPerfMetric::EccLossRate, lossRate);
+  perfMon.recordCounter(EPerfMetric::EccBurstLength, burstLength);
+  perfMon.recordCounter(EPerfMetric::EccResidualFrameLoss, residualFrameLoss);
+}
+}  // namespace DirectRemote
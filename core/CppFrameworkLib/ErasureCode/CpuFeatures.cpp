@@ -0,0 +1,111 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "CpuFeatures.hpp"
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+#if defined(CAT_COMPILER_MSVC)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+using namespace cat;
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+
+static void cpuid(u32 leaf, u32 subleaf, u32 regs[4]) {
+#if defined(CAT_COMPILER_MSVC)
+  int info[4];
+  __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int ii = 0; ii < 4; ++ii) {
+    regs[ii] = static_cast<u32>(info[ii]);
+  }
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switch (XCR0)
+static u64 xgetbv0() {
+#if defined(CAT_COMPILER_MSVC)
+  return _xgetbv(0);
+#else
+  u32 lo, hi;
+  __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<u64>(hi) << 32) | lo;
+#endif
+}
+
+static CpuFeatures detect() {
+  CpuFeatures result = {};
+  u32 regs[4];
+
+  cpuid(0, 0, regs);
+  const u32 max_leaf = regs[0];
+
+  if (max_leaf < 1) {
+    return result;
+  }
+
+  cpuid(1, 0, regs);
+  result.ssse3 = (regs[2] & (1u << 9)) != 0;
+
+  const bool osxsave = (regs[2] & (1u << 27)) != 0;
+  if (!osxsave || max_leaf < 7) {
+    return result;
+  }
+
+  // YMM state must be enabled by the OS before AVX2 can be used, and the
+  // opmask/ZMM state before AVX-512.
+  const u64 xcr0 = xgetbv0();
+  const bool ymm = (xcr0 & 0x06) == 0x06;
+  const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+  cpuid(7, 0, regs);
+  result.avx2 = ymm && (regs[1] & (1u << 5)) != 0;
+  result.avx512bw = zmm && (regs[1] & (1u << 16)) != 0 &&  // AVX512F
+                    (regs[1] & (1u << 30)) != 0;           // AVX512BW
+
+  return result;
+}
+
+#else
+
+static CpuFeatures detect() {
+  CpuFeatures result = {};
+#if defined(CAT_HAS_NEON)
+  result.neon = true;
+#endif
+  return result;
+}
+
+#endif
+
+const CpuFeatures &cat::cpu_features() {
+  static const CpuFeatures features = detect();
+  return features;
+}
@@ -0,0 +1,60 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef CAT_CPUFEATURES_HPP
+#define CAT_CPUFEATURES_HPP
+
+#include "Platform.hpp"
+
+// Kernels are compiled for their instruction set individually and selected at
+// runtime, so the rest of the library does not need any -m flags.
+#if defined(CAT_ISA_X86) && defined(CAT_COMPILER_GCC)
+#define CAT_HAS_X86_INTRINSICS
+#define CAT_TARGET(isa) __attribute__((target(isa)))
+#elif defined(CAT_ISA_X86) && defined(CAT_COMPILER_MSVC)
+#define CAT_HAS_X86_INTRINSICS
+#define CAT_TARGET(isa)
+#endif
+
+// NEON can not be detected portably at runtime, so it is a compile-time choice.
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CAT_HAS_NEON
+#endif
+
+namespace cat {
+
+struct CpuFeatures {
+  bool ssse3;
+  bool avx2;
+  bool avx512bw;
+  bool neon;
+};
+
+// Queried once, all later calls return the cached result
+const CpuFeatures &cpu_features();
+
+}  // namespace cat
+
+#endif  // CAT_CPUFEATURES_HPP
@@ -0,0 +1,624 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "MemMulAdd.hpp"
+#include "CpuFeatures.hpp"
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+#include <immintrin.h>
+#endif
+
+#if defined(CAT_HAS_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace cat;
+
+//// Scalar engine
+
+// 8x8 bit matrix transpose where byte i is row i
+static CAT_INLINE u64 transpose8(u64 x) {
+  u64 t;
+  t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+static void bitslice_columns(u8 *CAT_RESTRICT symbols,
+                             const u8 *CAT_RESTRICT block, int subbytes,
+                             int first, int last) {
+  for (int jj = first; jj < last; ++jj) {
+    u64 w = 0;
+    for (int ii = 0; ii < 8; ++ii) {
+      w |= static_cast<u64>(block[ii * subbytes + jj]) << (ii * 8);
+    }
+
+    w = transpose8(w);
+
+    u8 *out = symbols + jj * 8;
+    for (int ii = 0; ii < 8; ++ii) {
+      out[ii] = static_cast<u8>(w >> (ii * 8));
+    }
+  }
+}
+
+static void unbitslice_columns(u8 *CAT_RESTRICT block,
+                               const u8 *CAT_RESTRICT symbols, int subbytes,
+                               int first, int last) {
+  for (int jj = first; jj < last; ++jj) {
+    const u8 *in = symbols + jj * 8;
+    u64 w = 0;
+    for (int ii = 0; ii < 8; ++ii) {
+      w |= static_cast<u64>(in[ii]) << (ii * 8);
+    }
+
+    w = transpose8(w);
+
+    for (int ii = 0; ii < 8; ++ii) {
+      block[ii * subbytes + jj] = static_cast<u8>(w >> (ii * 8));
+    }
+  }
+}
+
+static void bitslice_scalar(u8 *CAT_RESTRICT symbols,
+                            const u8 *CAT_RESTRICT block, int bytes) {
+  bitslice_columns(symbols, block, bytes / 8, 0, bytes / 8);
+}
+
+static void unbitslice_scalar(u8 *CAT_RESTRICT block,
+                              const u8 *CAT_RESTRICT symbols, int bytes) {
+  unbitslice_columns(block, symbols, bytes / 8, 0, bytes / 8);
+}
+
+static void muladd_scalar(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                          const u8 *CAT_RESTRICT input, int bytes) {
+  for (int ii = 0; ii < bytes; ++ii) {
+    const u8 x = input[ii];
+    output[ii] ^= table[x & 15] ^ table[16 + (x >> 4)];
+  }
+}
+
+static void mul_scalar(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                       const u8 *CAT_RESTRICT input, int bytes) {
+  for (int ii = 0; ii < bytes; ++ii) {
+    const u8 x = input[ii];
+    output[ii] = table[x & 15] ^ table[16 + (x >> 4)];
+  }
+}
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+
+//// SSSE3 engine
+
+#define CAT_SSE_ISA "sse2,ssse3"
+
+CAT_TARGET(CAT_SSE_ISA)
+static CAT_INLINE __m128i transpose8_sse(__m128i x) {
+  const __m128i m1 = _mm_set1_epi64x(0x00AA00AA00AA00AALL);
+  const __m128i m2 = _mm_set1_epi64x(0x0000CCCC0000CCCCLL);
+  const __m128i m3 = _mm_set1_epi64x(0x00000000F0F0F0F0LL);
+  __m128i t;
+
+  t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 7)), m1);
+  x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 7)));
+  t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 14)), m2);
+  x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 14)));
+  t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 28)), m3);
+  x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 28)));
+  return x;
+}
+
+// 16 columns starting at column jj
+CAT_TARGET(CAT_SSE_ISA)
+static void bitslice16_sse(u8 *CAT_RESTRICT symbols,
+                           const u8 *CAT_RESTRICT block, int subbytes,
+                           int jj) {
+  const u8 *in = block + jj;
+  __m128i r[8], t[8], u[8];
+
+  for (int ii = 0; ii < 8; ++ii, in += subbytes) {
+    r[ii] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+  }
+
+  // Interleave rows so each 64-bit lane holds one column
+  for (int ii = 0; ii < 4; ++ii) {
+    t[ii * 2] = _mm_unpacklo_epi8(r[ii * 2], r[ii * 2 + 1]);
+    t[ii * 2 + 1] = _mm_unpackhi_epi8(r[ii * 2], r[ii * 2 + 1]);
+  }
+  for (int ii = 0; ii < 2; ++ii) {
+    __m128i *tt = t + ii * 4;
+    u[ii * 4] = _mm_unpacklo_epi16(tt[0], tt[2]);
+    u[ii * 4 + 1] = _mm_unpackhi_epi16(tt[0], tt[2]);
+    u[ii * 4 + 2] = _mm_unpacklo_epi16(tt[1], tt[3]);
+    u[ii * 4 + 3] = _mm_unpackhi_epi16(tt[1], tt[3]);
+  }
+
+  __m128i *out = reinterpret_cast<__m128i *>(symbols + jj * 8);
+  for (int ii = 0; ii < 4; ++ii) {
+    __m128i lo = _mm_unpacklo_epi32(u[ii], u[ii + 4]);
+    __m128i hi = _mm_unpackhi_epi32(u[ii], u[ii + 4]);
+    _mm_storeu_si128(out + ii * 2, transpose8_sse(lo));
+    _mm_storeu_si128(out + ii * 2 + 1, transpose8_sse(hi));
+  }
+}
+
+CAT_TARGET(CAT_SSE_ISA)
+static void unbitslice16_sse(u8 *CAT_RESTRICT block,
+                             const u8 *CAT_RESTRICT symbols, int subbytes,
+                             int jj) {
+  const __m128i *in = reinterpret_cast<const __m128i *>(symbols + jj * 8);
+  __m128i w[8], a[8], b[8];
+
+  // Gather the two columns of each lane as one 16-bit word per row
+  for (int ii = 0; ii < 8; ++ii) {
+    __m128i v = transpose8_sse(_mm_loadu_si128(in + ii));
+    w[ii] = _mm_unpacklo_epi8(v, _mm_unpackhi_epi64(v, v));
+  }
+
+  // 8x8 transpose of 16-bit words
+  for (int ii = 0; ii < 4; ++ii) {
+    a[ii * 2] = _mm_unpacklo_epi16(w[ii * 2], w[ii * 2 + 1]);
+    a[ii * 2 + 1] = _mm_unpackhi_epi16(w[ii * 2], w[ii * 2 + 1]);
+  }
+  for (int ii = 0; ii < 2; ++ii) {
+    __m128i *aa = a + ii * 4;
+    b[ii * 4] = _mm_unpacklo_epi32(aa[0], aa[2]);
+    b[ii * 4 + 1] = _mm_unpackhi_epi32(aa[0], aa[2]);
+    b[ii * 4 + 2] = _mm_unpacklo_epi32(aa[1], aa[3]);
+    b[ii * 4 + 3] = _mm_unpackhi_epi32(aa[1], aa[3]);
+  }
+
+  u8 *out = block + jj;
+  for (int ii = 0; ii < 4; ++ii, out += subbytes * 2) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_unpacklo_epi64(b[ii], b[ii + 4]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + subbytes),
+                     _mm_unpackhi_epi64(b[ii], b[ii + 4]));
+  }
+}
+
+// When the column count is not a multiple of the vector width, the last vector
+// is placed flush with the end.  It recomputes a few columns, which is harmless
+// since input and output never overlap.
+CAT_TARGET(CAT_SSE_ISA)
+static void bitslice_ssse3(u8 *CAT_RESTRICT symbols,
+                           const u8 *CAT_RESTRICT block, int bytes) {
+  const int subbytes = bytes / 8;
+  if (subbytes < 16) {
+    bitslice_scalar(symbols, block, bytes);
+    return;
+  }
+
+  int jj = 0;
+  for (; jj + 16 <= subbytes; jj += 16) {
+    bitslice16_sse(symbols, block, subbytes, jj);
+  }
+  if (jj < subbytes) {
+    bitslice16_sse(symbols, block, subbytes, subbytes - 16);
+  }
+}
+
+CAT_TARGET(CAT_SSE_ISA)
+static void unbitslice_ssse3(u8 *CAT_RESTRICT block,
+                             const u8 *CAT_RESTRICT symbols, int bytes) {
+  const int subbytes = bytes / 8;
+  if (subbytes < 16) {
+    unbitslice_scalar(block, symbols, bytes);
+    return;
+  }
+
+  int jj = 0;
+  for (; jj + 16 <= subbytes; jj += 16) {
+    unbitslice16_sse(block, symbols, subbytes, jj);
+  }
+  if (jj < subbytes) {
+    unbitslice16_sse(block, symbols, subbytes, subbytes - 16);
+  }
+}
+
+CAT_TARGET(CAT_SSE_ISA)
+static CAT_INLINE __m128i lookup_sse(__m128i x, __m128i tlo, __m128i thi,
+                                     __m128i mask) {
+  __m128i lo = _mm_and_si128(x, mask);
+  __m128i hi = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+  return _mm_xor_si128(_mm_shuffle_epi8(tlo, lo), _mm_shuffle_epi8(thi, hi));
+}
+
+CAT_TARGET(CAT_SSE_ISA)
+static void muladd_ssse3(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                         const u8 *CAT_RESTRICT input, int bytes) {
+  const __m128i tlo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table));
+  const __m128i thi =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table + 16));
+  const __m128i mask = _mm_set1_epi8(15);
+
+  while (bytes >= 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(output));
+    y = _mm_xor_si128(y, lookup_sse(x, tlo, thi, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output), y);
+
+    input += 16;
+    output += 16;
+    bytes -= 16;
+  }
+
+  muladd_scalar(output, table, input, bytes);
+}
+
+CAT_TARGET(CAT_SSE_ISA)
+static void mul_ssse3(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                      const u8 *CAT_RESTRICT input, int bytes) {
+  const __m128i tlo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table));
+  const __m128i thi =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table + 16));
+  const __m128i mask = _mm_set1_epi8(15);
+
+  while (bytes >= 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output),
+                     lookup_sse(x, tlo, thi, mask));
+
+    input += 16;
+    output += 16;
+    bytes -= 16;
+  }
+
+  mul_scalar(output, table, input, bytes);
+}
+
+//// AVX2 engine
+
+#define CAT_AVX2_ISA "sse2,ssse3,avx,avx2"
+
+CAT_TARGET(CAT_AVX2_ISA)
+static CAT_INLINE __m256i transpose8_avx2(__m256i x) {
+  const __m256i m1 = _mm256_set1_epi64x(0x00AA00AA00AA00AALL);
+  const __m256i m2 = _mm256_set1_epi64x(0x0000CCCC0000CCCCLL);
+  const __m256i m3 = _mm256_set1_epi64x(0x00000000F0F0F0F0LL);
+  __m256i t;
+
+  t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 7)), m1);
+  x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 7)));
+  t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 14)), m2);
+  x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 14)));
+  t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 28)), m3);
+  x = _mm256_xor_si256(x, _mm256_xor_si256(t, _mm256_slli_epi64(t, 28)));
+  return x;
+}
+
+// Same network as the SSE version, run on two groups of 16 columns at once:
+// lane 0 holds columns jj..jj+15 and lane 1 holds columns jj+16..jj+31.
+CAT_TARGET(CAT_AVX2_ISA)
+static void bitslice32_avx2(u8 *CAT_RESTRICT symbols,
+                            const u8 *CAT_RESTRICT block, int subbytes,
+                            int jj) {
+  const u8 *in = block + jj;
+  __m256i r[8], t[8], u[8];
+
+  for (int ii = 0; ii < 8; ++ii, in += subbytes) {
+    r[ii] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+  }
+
+  for (int ii = 0; ii < 4; ++ii) {
+    t[ii * 2] = _mm256_unpacklo_epi8(r[ii * 2], r[ii * 2 + 1]);
+    t[ii * 2 + 1] = _mm256_unpackhi_epi8(r[ii * 2], r[ii * 2 + 1]);
+  }
+  for (int ii = 0; ii < 2; ++ii) {
+    __m256i *tt = t + ii * 4;
+    u[ii * 4] = _mm256_unpacklo_epi16(tt[0], tt[2]);
+    u[ii * 4 + 1] = _mm256_unpackhi_epi16(tt[0], tt[2]);
+    u[ii * 4 + 2] = _mm256_unpacklo_epi16(tt[1], tt[3]);
+    u[ii * 4 + 3] = _mm256_unpackhi_epi16(tt[1], tt[3]);
+  }
+
+  u8 *out = symbols + jj * 8;
+  for (int ii = 0; ii < 4; ++ii) {
+    __m256i lo = transpose8_avx2(_mm256_unpacklo_epi32(u[ii], u[ii + 4]));
+    __m256i hi = transpose8_avx2(_mm256_unpackhi_epi32(u[ii], u[ii + 4]));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + ii * 32),
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 128 + ii * 32),
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void unbitslice32_avx2(u8 *CAT_RESTRICT block,
+                              const u8 *CAT_RESTRICT symbols, int subbytes,
+                              int jj) {
+  const u8 *in = symbols + jj * 8;
+  __m256i w[8], a[8], b[8];
+
+  for (int ii = 0; ii < 4; ++ii) {
+    __m256i lo =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + ii * 32));
+    __m256i hi = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(in + 128 + ii * 32));
+
+    __m256i v0 = transpose8_avx2(_mm256_permute2x128_si256(lo, hi, 0x20));
+    __m256i v1 = transpose8_avx2(_mm256_permute2x128_si256(lo, hi, 0x31));
+    w[ii * 2] = _mm256_unpacklo_epi8(v0, _mm256_unpackhi_epi64(v0, v0));
+    w[ii * 2 + 1] = _mm256_unpacklo_epi8(v1, _mm256_unpackhi_epi64(v1, v1));
+  }
+
+  for (int ii = 0; ii < 4; ++ii) {
+    a[ii * 2] = _mm256_unpacklo_epi16(w[ii * 2], w[ii * 2 + 1]);
+    a[ii * 2 + 1] = _mm256_unpackhi_epi16(w[ii * 2], w[ii * 2 + 1]);
+  }
+  for (int ii = 0; ii < 2; ++ii) {
+    __m256i *aa = a + ii * 4;
+    b[ii * 4] = _mm256_unpacklo_epi32(aa[0], aa[2]);
+    b[ii * 4 + 1] = _mm256_unpackhi_epi32(aa[0], aa[2]);
+    b[ii * 4 + 2] = _mm256_unpacklo_epi32(aa[1], aa[3]);
+    b[ii * 4 + 3] = _mm256_unpackhi_epi32(aa[1], aa[3]);
+  }
+
+  u8 *out = block + jj;
+  for (int ii = 0; ii < 4; ++ii, out += subbytes * 2) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                        _mm256_unpacklo_epi64(b[ii], b[ii + 4]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + subbytes),
+                        _mm256_unpackhi_epi64(b[ii], b[ii + 4]));
+  }
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void bitslice_avx2(u8 *CAT_RESTRICT symbols,
+                          const u8 *CAT_RESTRICT block, int bytes) {
+  const int subbytes = bytes / 8;
+  if (subbytes < 32) {
+    bitslice_ssse3(symbols, block, bytes);
+    return;
+  }
+
+  int jj = 0;
+  for (; jj + 32 <= subbytes; jj += 32) {
+    bitslice32_avx2(symbols, block, subbytes, jj);
+  }
+  if (jj < subbytes) {
+    bitslice32_avx2(symbols, block, subbytes, subbytes - 32);
+  }
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void unbitslice_avx2(u8 *CAT_RESTRICT block,
+                            const u8 *CAT_RESTRICT symbols, int bytes) {
+  const int subbytes = bytes / 8;
+  if (subbytes < 32) {
+    unbitslice_ssse3(block, symbols, bytes);
+    return;
+  }
+
+  int jj = 0;
+  for (; jj + 32 <= subbytes; jj += 32) {
+    unbitslice32_avx2(block, symbols, subbytes, jj);
+  }
+  if (jj < subbytes) {
+    unbitslice32_avx2(block, symbols, subbytes, subbytes - 32);
+  }
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static CAT_INLINE __m256i lookup_avx2(__m256i x, __m256i tlo, __m256i thi,
+                                      __m256i mask) {
+  __m256i lo = _mm256_and_si256(x, mask);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+  return _mm256_xor_si256(_mm256_shuffle_epi8(tlo, lo),
+                          _mm256_shuffle_epi8(thi, hi));
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void muladd_avx2(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                        const u8 *CAT_RESTRICT input, int bytes) {
+  const __m256i tlo = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+  const __m256i thi = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table + 16)));
+  const __m256i mask = _mm256_set1_epi8(15);
+
+  while (bytes >= 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(output));
+    y = _mm256_xor_si256(y, lookup_avx2(x, tlo, thi, mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output), y);
+
+    input += 32;
+    output += 32;
+    bytes -= 32;
+  }
+
+  // Leave the upper lanes clean before running legacy SSE code
+  _mm256_zeroupper();
+  muladd_ssse3(output, table, input, bytes);
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void mul_avx2(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                     const u8 *CAT_RESTRICT input, int bytes) {
+  const __m256i tlo = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+  const __m256i thi = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table + 16)));
+  const __m256i mask = _mm256_set1_epi8(15);
+
+  while (bytes >= 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                        lookup_avx2(x, tlo, thi, mask));
+
+    input += 32;
+    output += 32;
+    bytes -= 32;
+  }
+
+  _mm256_zeroupper();
+  mul_ssse3(output, table, input, bytes);
+}
+
+#endif  // CAT_HAS_X86_INTRINSICS
+
+#if defined(CAT_HAS_NEON)
+
+//// NEON engine
+
+static CAT_INLINE uint8x16_t lookup_neon(uint8x16_t x, uint8x16_t tlo,
+                                         uint8x16_t thi, uint8x16_t mask) {
+  uint8x16_t lo = vandq_u8(x, mask);
+  uint8x16_t hi = vshrq_n_u8(x, 4);
+#if defined(__aarch64__)
+  return veorq_u8(vqtbl1q_u8(tlo, lo), vqtbl1q_u8(thi, hi));
+#else
+  uint8x8x2_t tl = {{vget_low_u8(tlo), vget_high_u8(tlo)}};
+  uint8x8x2_t th = {{vget_low_u8(thi), vget_high_u8(thi)}};
+  uint8x8_t rl = veor_u8(vtbl2_u8(tl, vget_low_u8(lo)),
+                         vtbl2_u8(th, vget_low_u8(hi)));
+  uint8x8_t rh = veor_u8(vtbl2_u8(tl, vget_high_u8(lo)),
+                         vtbl2_u8(th, vget_high_u8(hi)));
+  return vcombine_u8(rl, rh);
+#endif
+}
+
+static void muladd_neon(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                        const u8 *CAT_RESTRICT input, int bytes) {
+  const uint8x16_t tlo = vld1q_u8(table);
+  const uint8x16_t thi = vld1q_u8(table + 16);
+  const uint8x16_t mask = vdupq_n_u8(15);
+
+  while (bytes >= 16) {
+    uint8x16_t y = veorq_u8(vld1q_u8(output),
+                            lookup_neon(vld1q_u8(input), tlo, thi, mask));
+    vst1q_u8(output, y);
+
+    input += 16;
+    output += 16;
+    bytes -= 16;
+  }
+
+  muladd_scalar(output, table, input, bytes);
+}
+
+static void mul_neon(u8 *CAT_RESTRICT output, const u8 *CAT_RESTRICT table,
+                     const u8 *CAT_RESTRICT input, int bytes) {
+  const uint8x16_t tlo = vld1q_u8(table);
+  const uint8x16_t thi = vld1q_u8(table + 16);
+  const uint8x16_t mask = vdupq_n_u8(15);
+
+  while (bytes >= 16) {
+    vst1q_u8(output, lookup_neon(vld1q_u8(input), tlo, thi, mask));
+
+    input += 16;
+    output += 16;
+    bytes -= 16;
+  }
+
+  mul_scalar(output, table, input, bytes);
+}
+
+#endif  // CAT_HAS_NEON
+
+//// Dispatch
+
+namespace {
+
+typedef void (*MulAddFunc)(u8 *CAT_RESTRICT, const u8 *CAT_RESTRICT,
+                           const u8 *CAT_RESTRICT, int);
+typedef void (*TransformFunc)(u8 *CAT_RESTRICT, const u8 *CAT_RESTRICT, int);
+
+struct Engine {
+  const char *name;
+  MulAddFunc muladd;
+  MulAddFunc mul;
+  TransformFunc bitslice;
+  TransformFunc unbitslice;
+};
+
+Engine select_engine() {
+  const CpuFeatures &cpu = cpu_features();
+  Engine engine = {"scalar", muladd_scalar, mul_scalar, bitslice_scalar,
+                   unbitslice_scalar};
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+  if (cpu.avx2) {
+    Engine avx2 = {"avx2", muladd_avx2, mul_avx2, bitslice_avx2,
+                   unbitslice_avx2};
+    engine = avx2;
+  } else if (cpu.ssse3) {
+    Engine ssse3 = {"ssse3", muladd_ssse3, mul_ssse3, bitslice_ssse3,
+                    unbitslice_ssse3};
+    engine = ssse3;
+  }
+#endif
+
+#if defined(CAT_HAS_NEON)
+  if (cpu.neon) {
+    Engine neon = {"neon", muladd_neon, mul_neon, bitslice_scalar,
+                   unbitslice_scalar};
+    engine = neon;
+  }
+#endif
+
+  return engine;
+}
+
+const Engine &engine() {
+  static const Engine selected = select_engine();
+  return selected;
+}
+
+}  // namespace
+
+void cat::memmuladd(void *CAT_RESTRICT voutput, const u8 *CAT_RESTRICT table,
+                    const void *CAT_RESTRICT vinput, int bytes) {
+  engine().muladd(reinterpret_cast<u8 *>(voutput), table,
+                  reinterpret_cast<const u8 *>(vinput), bytes);
+}
+
+void cat::memmul(void *CAT_RESTRICT voutput, const u8 *CAT_RESTRICT table,
+                 const void *CAT_RESTRICT vinput, int bytes) {
+  engine().mul(reinterpret_cast<u8 *>(voutput), table,
+               reinterpret_cast<const u8 *>(vinput), bytes);
+}
+
+void cat::membitslice(void *CAT_RESTRICT vsymbols,
+                      const void *CAT_RESTRICT vblock, int bytes) {
+  engine().bitslice(reinterpret_cast<u8 *>(vsymbols),
+                    reinterpret_cast<const u8 *>(vblock), bytes);
+}
+
+void cat::memunbitslice(void *CAT_RESTRICT vblock,
+                        const void *CAT_RESTRICT vsymbols, int bytes) {
+  engine().unbitslice(reinterpret_cast<u8 *>(vblock),
+                      reinterpret_cast<const u8 *>(vsymbols), bytes);
+}
+
+bool cat::memmuladd_accelerated() { return engine().muladd != muladd_scalar; }
+
+const char *cat::memmuladd_engine() { return engine().name; }
@@ -0,0 +1,77 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef CAT_MEMMULADD_HPP
+#define CAT_MEMMULADD_HPP
+
+#include "Platform.hpp"
+
+/*
+ * GF(256) multiply-accumulate on whole buffers.
+ *
+ * The Cauchy codec stores each block bit-sliced: a block is 8 sub-blocks and
+ * bit b of a byte in sub-block i belongs to the same field element as bit b of
+ * the byte at the same offset in every other sub-block.  The bitmatrix of a
+ * coefficient is therefore just some 8x8 linear map on those field elements.
+ *
+ * membitslice() gathers the field elements into one byte each ("symbols"),
+ * after which any such 8x8 map is two 16-entry lookups on the nibbles of each
+ * symbol.  That is exactly what PSHUFB (and NEON TBL) computes 16 or 32 bytes
+ * at a time, so all of encoding and decoding reduces to memmuladd() calls
+ * between two buffer transforms.
+ */
+
+namespace cat {
+
+// Lookup table for one coefficient: 16 results for the low nibble followed by
+// 16 results for the high nibble.
+static const int MULADD_TABLE_BYTES = 32;
+
+// voutput[i] ^= table(vinput[i])
+void memmuladd(void *CAT_RESTRICT voutput, const u8 *CAT_RESTRICT table,
+               const void *CAT_RESTRICT vinput, int bytes);
+
+// voutput[i] = table(vinput[i])
+void memmul(void *CAT_RESTRICT voutput, const u8 *CAT_RESTRICT table,
+            const void *CAT_RESTRICT vinput, int bytes);
+
+// Convert a bit-sliced block into one symbol per byte. bytes % 8 == 0.
+void membitslice(void *CAT_RESTRICT vsymbols, const void *CAT_RESTRICT vblock,
+                 int bytes);
+
+// Inverse of membitslice(). bytes % 8 == 0.
+void memunbitslice(void *CAT_RESTRICT vblock,
+                   const void *CAT_RESTRICT vsymbols, int bytes);
+
+// True if a vector engine was selected. Without one, the bitmatrix code in
+// cauchy_256.cpp is faster than the lookup-table fallback used here.
+bool memmuladd_accelerated();
+
+// Name of the selected engine: "avx2", "ssse3", "neon" or "scalar"
+const char *memmuladd_engine();
+
+}  // namespace cat
+
+#endif  // CAT_MEMMULADD_HPP
@@ -38,9 +38,14 @@
 #pragma clang diagnostic ignored "-Wundefined-reinterpret-cast"
 
 #include "MemXOR.hpp"
+#include "CpuFeatures.hpp"
 #include "Framework.h"
 #include <type_traits>
 
+#if defined(CAT_HAS_X86_INTRINSICS)
+#include <immintrin.h>
+#endif
+
 using namespace cat;
 
 #ifdef CAT_HAS_VECTOR_EXTENSIONS
@@ -64,8 +69,8 @@ T *remove_restrict(T CAT_RESTRICT *ptr) {
   return const_cast<T *>(ptr);
 }
 
-void cat::memxor(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT vinput,
-                 int bytes) {
+static void memxor_generic(void *CAT_RESTRICT voutput,
+                           const void *CAT_RESTRICT vinput, int bytes) {
   /*
           Often times the output is XOR'd in-place so this version is
           faster than the one below with two inputs.
@@ -163,8 +168,9 @@ void cat::memxor(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT vinput,
   }
 }
 
-void cat::memxor_set(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
-                     const void *CAT_RESTRICT vb, int bytes) {
+static void memxor_set_generic(void *CAT_RESTRICT voutput,
+                               const void *CAT_RESTRICT va,
+                               const void *CAT_RESTRICT vb, int bytes) {
 /*
         This version exists to avoid an expensive memory copy operation when
         an input block is being calculated from a row and some other blocks.
@@ -271,8 +277,9 @@ void cat::memxor_set(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
   }
 }
 
-void cat::memxor_add(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
-                     const void *CAT_RESTRICT vb, int bytes) {
+static void memxor_add_generic(void *CAT_RESTRICT voutput,
+                               const void *CAT_RESTRICT va,
+                               const void *CAT_RESTRICT vb, int bytes) {
 /*
         This version adds to the output instead of overwriting it.
 */
@@ -377,3 +384,236 @@ void cat::memxor_add(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
       break;
   }
 }
+
+/*
+        Wide engines
+
+        These use unaligned loads and stores, which cost the same as aligned
+        ones on hardware with AVX2 when the data happens to be aligned.  The
+        packet buffers keep the ECC region on a 64-byte boundary so that no
+        access splits a cache line.
+*/
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+
+#define CAT_AVX2_ISA "avx,avx2"
+#define CAT_AVX512_ISA "avx,avx2,avx512f,avx512bw"
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void memxor_avx2(void *CAT_RESTRICT voutput,
+                        const void *CAT_RESTRICT vinput, int bytes) {
+  u8 *CAT_RESTRICT output = reinterpret_cast<u8 *>(voutput);
+  const u8 *CAT_RESTRICT input = reinterpret_cast<const u8 *>(vinput);
+
+  while (bytes >= 128) {
+    for (int ii = 0; ii < 128; ii += 32) {
+      __m256i x =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + ii));
+      __m256i y =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(output + ii));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + ii),
+                          _mm256_xor_si256(x, y));
+    }
+    output += 128;
+    input += 128;
+    bytes -= 128;
+  }
+
+  while (bytes >= 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(output));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                        _mm256_xor_si256(x, y));
+    output += 32;
+    input += 32;
+    bytes -= 32;
+  }
+
+  // Leave the upper lanes clean before running legacy SSE code
+  _mm256_zeroupper();
+  memxor_generic(output, input, bytes);
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void memxor_set_avx2(void *CAT_RESTRICT voutput,
+                            const void *CAT_RESTRICT va,
+                            const void *CAT_RESTRICT vb, int bytes) {
+  u8 *CAT_RESTRICT output = reinterpret_cast<u8 *>(voutput);
+  const u8 *CAT_RESTRICT a = reinterpret_cast<const u8 *>(va);
+  const u8 *CAT_RESTRICT b = reinterpret_cast<const u8 *>(vb);
+
+  while (bytes >= 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                        _mm256_xor_si256(x, y));
+    output += 32;
+    a += 32;
+    b += 32;
+    bytes -= 32;
+  }
+
+  _mm256_zeroupper();
+  memxor_set_generic(output, a, b, bytes);
+}
+
+CAT_TARGET(CAT_AVX2_ISA)
+static void memxor_add_avx2(void *CAT_RESTRICT voutput,
+                            const void *CAT_RESTRICT va,
+                            const void *CAT_RESTRICT vb, int bytes) {
+  u8 *CAT_RESTRICT output = reinterpret_cast<u8 *>(voutput);
+  const u8 *CAT_RESTRICT a = reinterpret_cast<const u8 *>(va);
+  const u8 *CAT_RESTRICT b = reinterpret_cast<const u8 *>(vb);
+
+  while (bytes >= 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+    __m256i z = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(output));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output),
+                        _mm256_xor_si256(z, _mm256_xor_si256(x, y)));
+    output += 32;
+    a += 32;
+    b += 32;
+    bytes -= 32;
+  }
+
+  _mm256_zeroupper();
+  memxor_add_generic(output, a, b, bytes);
+}
+
+// Byte mask for the final partial vector; masked lanes are never touched, so
+// the tail can not fault even at the end of a page.
+static CAT_INLINE u64 tail_mask(int bytes) {
+  return bytes >= 64 ? ~static_cast<u64>(0)
+                     : (static_cast<u64>(1) << bytes) - 1;
+}
+
+CAT_TARGET(CAT_AVX512_ISA)
+static void memxor_avx512(void *CAT_RESTRICT voutput,
+                          const void *CAT_RESTRICT vinput, int bytes) {
+  u8 *CAT_RESTRICT output = reinterpret_cast<u8 *>(voutput);
+  const u8 *CAT_RESTRICT input = reinterpret_cast<const u8 *>(vinput);
+
+  while (bytes >= 64) {
+    __m512i x = _mm512_loadu_si512(input);
+    __m512i y = _mm512_loadu_si512(output);
+    _mm512_storeu_si512(output, _mm512_xor_si512(x, y));
+    output += 64;
+    input += 64;
+    bytes -= 64;
+  }
+
+  if (bytes > 0) {
+    const __mmask64 mask = tail_mask(bytes);
+    __m512i x = _mm512_maskz_loadu_epi8(mask, input);
+    __m512i y = _mm512_maskz_loadu_epi8(mask, output);
+    _mm512_mask_storeu_epi8(output, mask, _mm512_xor_si512(x, y));
+  }
+}
+
+CAT_TARGET(CAT_AVX512_ISA)
+static void memxor_set_avx512(void *CAT_RESTRICT voutput,
+                              const void *CAT_RESTRICT va,
+                              const void *CAT_RESTRICT vb, int bytes) {
+  u8 *CAT_RESTRICT output = reinterpret_cast<u8 *>(voutput);
+  const u8 *CAT_RESTRICT a = reinterpret_cast<const u8 *>(va);
+  const u8 *CAT_RESTRICT b = reinterpret_cast<const u8 *>(vb);
+
+  while (bytes >= 64) {
+    _mm512_storeu_si512(
+        output, _mm512_xor_si512(_mm512_loadu_si512(a), _mm512_loadu_si512(b)));
+    output += 64;
+    a += 64;
+    b += 64;
+    bytes -= 64;
+  }
+
+  if (bytes > 0) {
+    const __mmask64 mask = tail_mask(bytes);
+    __m512i x = _mm512_maskz_loadu_epi8(mask, a);
+    __m512i y = _mm512_maskz_loadu_epi8(mask, b);
+    _mm512_mask_storeu_epi8(output, mask, _mm512_xor_si512(x, y));
+  }
+}
+
+CAT_TARGET(CAT_AVX512_ISA)
+static void memxor_add_avx512(void *CAT_RESTRICT voutput,
+                              const void *CAT_RESTRICT va,
+                              const void *CAT_RESTRICT vb, int bytes) {
+  u8 *CAT_RESTRICT output = reinterpret_cast<u8 *>(voutput);
+  const u8 *CAT_RESTRICT a = reinterpret_cast<const u8 *>(va);
+  const u8 *CAT_RESTRICT b = reinterpret_cast<const u8 *>(vb);
+
+  while (bytes >= 64) {
+    // 0x96 is the truth table of a ^ b ^ c
+    __m512i x = _mm512_ternarylogic_epi64(_mm512_loadu_si512(output),
+                                          _mm512_loadu_si512(a),
+                                          _mm512_loadu_si512(b), 0x96);
+    _mm512_storeu_si512(output, x);
+    output += 64;
+    a += 64;
+    b += 64;
+    bytes -= 64;
+  }
+
+  if (bytes > 0) {
+    const __mmask64 mask = tail_mask(bytes);
+    __m512i x = _mm512_ternarylogic_epi64(
+        _mm512_maskz_loadu_epi8(mask, output), _mm512_maskz_loadu_epi8(mask, a),
+        _mm512_maskz_loadu_epi8(mask, b), 0x96);
+    _mm512_mask_storeu_epi8(output, mask, x);
+  }
+}
+
+#endif  // CAT_HAS_X86_INTRINSICS
+
+//// Dispatch
+
+static const MemXorEngine MEMXOR_ENGINES[] = {
+    {"generic", memxor_generic, memxor_set_generic, memxor_add_generic},
+#if defined(CAT_HAS_X86_INTRINSICS)
+    {"avx2", memxor_avx2, memxor_set_avx2, memxor_add_avx2},
+    {"avx512", memxor_avx512, memxor_set_avx512, memxor_add_avx512},
+#endif
+};
+
+static int supported_engine_count() {
+  int count = 1;
+#if defined(CAT_HAS_X86_INTRINSICS)
+  const CpuFeatures &cpu = cpu_features();
+  if (cpu.avx2) {
+    count = 2;
+    if (cpu.avx512bw) {
+      count = 3;
+    }
+  }
+#endif
+  return count;
+}
+
+static const MemXorEngine &memxor_engine() {
+  static const MemXorEngine &engine =
+      MEMXOR_ENGINES[supported_engine_count() - 1];
+  return engine;
+}
+
+int cat::memxor_engines(const MemXorEngine **engines) {
+  static const int count = supported_engine_count();
+  *engines = MEMXOR_ENGINES;
+  return count;
+}
+
+void cat::memxor(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT vinput,
+                 int bytes) {
+  memxor_engine().memxor(voutput, vinput, bytes);
+}
+
+void cat::memxor_set(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
+                     const void *CAT_RESTRICT vb, int bytes) {
+  memxor_engine().memxor_set(voutput, va, vb, bytes);
+}
+
+void cat::memxor_add(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
+                     const void *CAT_RESTRICT vb, int bytes) {
+  memxor_engine().memxor_add(voutput, va, vb, bytes);
+}
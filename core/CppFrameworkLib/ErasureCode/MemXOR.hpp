@@ -53,6 +53,21 @@ void memxor_set(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
 void memxor_add(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
                 const void *CAT_RESTRICT vb, int bytes);
 
+// One set of the kernels above for a particular instruction set
+struct MemXorEngine {
+  const char *name;
+  void (*memxor)(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT vinput,
+                 int bytes);
+  void (*memxor_set)(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
+                     const void *CAT_RESTRICT vb, int bytes);
+  void (*memxor_add)(void *CAT_RESTRICT voutput, const void *CAT_RESTRICT va,
+                     const void *CAT_RESTRICT vb, int bytes);
+};
+
+// Stores the engines this CPU can run, slowest first, and returns their count.
+// The functions above always use the last one.  Meant for benchmarks.
+int memxor_engines(const MemXorEngine **engines);
+
 }  // namespace cat
 
 #endif  // CAT_MEMXOR_HPP
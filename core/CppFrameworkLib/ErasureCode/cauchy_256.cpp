@@ -211,7 +211,7 @@
  * *entire* bitmatrix row in its "smart schedule" mode.  This has very limited
  * performance impact and actually hurts performance in most of my tests.
  *
- * Windowed bitmatrix multiplication is implemented in win_encode().
+ * Windowed bitmatrix multiplication is implemented in win_encode_column().
  * A variation of this window technique is also used in the decoder for speed;
  * it is done on triangular matrices during Gaussian elimination.
  */
@@ -232,8 +232,14 @@ using namespace std;
 //#include "BitMath.hpp"
 #include "MemXOR.hpp"
 #include "MemSwap.hpp"
+#include "MemMulAdd.hpp"
 using namespace cat;
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 // Constants for precomputed table for window method
 static const int PRECOMP_TABLE_SIZE = 11;   // Number of non-zero elements
 static const int PRECOMP_TABLE_THRESH = 4;  // Min recovery rows to use window
@@ -394,17 +400,16 @@ static const u8 GFC256_INV_TABLE[256] = {
 
 u8 *CAT_RESTRICT GFC256_MUL_TABLE = 0;
 u8 *CAT_RESTRICT GFC256_DIV_TABLE = 0;
+u8 *CAT_RESTRICT GFC256_MULADD_TABLE = 0;
 
 static void GFC256Init() {
   if (GFC256_MUL_TABLE) {
     return;
   }
 
-  // Allocate table memory 65KB x 2
-  GFC256_MUL_TABLE = new u8[256 * 256 * 2];
-  GFC256_DIV_TABLE = GFC256_MUL_TABLE + 256 * 256;
-
-  u8 *m = GFC256_MUL_TABLE, *d = GFC256_DIV_TABLE;
+  // Allocate table memory 65KB x 2 + 8KB
+  u8 *table = new u8[256 * 256 * 2 + 256 * MULADD_TABLE_BYTES];
+  u8 *m = table, *d = table + 256 * 256;
 
   // Unroll y = 0 subtable
   for (int x = 0; x < 256; ++x) {
@@ -433,6 +438,42 @@ static void GFC256Init() {
       d[x] = GFC256_EXP_TABLE[log_x + log_yn];
     }
   }
+
+  // Nibble tables for memmuladd(), one per 8x8 submatrix.  Row y of the
+  // submatrix for "slice" is slice * 2^y, so column x collects bit x of
+  // each row.
+  u8 *muladd = table + 256 * 256 * 2;
+  for (int slice = 0; slice < 256; ++slice, muladd += MULADD_TABLE_BYTES) {
+    u8 rows[8], columns[8] = {0};
+
+    rows[0] = static_cast<u8>(slice);
+    for (int y = 1; y < 8; ++y) {
+      rows[y] = table[(2 << 8) + rows[y - 1]];
+    }
+
+    for (int x = 0; x < 8; ++x) {
+      for (int y = 0; y < 8; ++y) {
+        columns[x] |= ((rows[y] >> x) & 1) << y;
+      }
+    }
+
+    for (int nibble = 0; nibble < 16; ++nibble) {
+      u8 lo = 0, hi = 0;
+      for (int x = 0; x < 4; ++x) {
+        if (nibble & (1 << x)) {
+          lo ^= columns[x];
+          hi ^= columns[x + 4];
+        }
+      }
+      muladd[nibble] = lo;
+      muladd[16 + nibble] = hi;
+    }
+  }
+
+  // Publish only after all tables are filled in
+  GFC256_DIV_TABLE = table + 256 * 256;
+  GFC256_MULADD_TABLE = table + 256 * 256 * 2;
+  GFC256_MUL_TABLE = table;
 }
 
 extern "C" int _cauchy_256_init(int expected_version) {
@@ -458,6 +499,11 @@ static CAT_INLINE u8 GFC256Divide(u8 x, u8 y) {
   return GFC256_DIV_TABLE[(static_cast<u32>(y) << 8) + x];
 }
 
+// return memmuladd() table for multiplying by the 8x8 submatrix of y
+static CAT_INLINE const u8 *GFC256MulAddTable(u8 y) {
+  return GFC256_MULADD_TABLE + static_cast<u32>(y) * MULADD_TABLE_BYTES;
+}
+
 //// Cauchy matrix
 
 #include "cauchy_tables_256.inc"
@@ -525,6 +571,122 @@ static const u8 *cauchy_matrix(int k, int m, int &stride,
   return matrix;
 }
 
+//// Matrix cache
+
+/*
+ * Senders use the same few (k, m) shapes for every message, so each matrix is
+ * generated once and then shared by all threads.  The shapes drift with the
+ * ECC ratio though, and all of them together take about 180 MB, so only the
+ * most recently used ones are kept, up to CAT_MATRIX_CACHE_BYTES.  Callers
+ * hold a reference while they use a matrix, which keeps it alive after it
+ * was dropped from the cache.  The lock is only held for the lookup.
+ */
+
+#define CAT_MATRIX_CACHE_BYTES (8 * 1024 * 1024)
+
+typedef std::shared_ptr<const u8> MatrixRef;
+
+struct CachedMatrix {
+  MatrixRef matrix;
+  int stride;
+  u64 last_use;
+};
+
+static std::mutex matrix_cache_lock;
+static std::unordered_map<u32, CachedMatrix> matrix_cache;
+static size_t matrix_cache_bytes = 0;
+static u64 matrix_cache_clock = 0;
+static std::atomic<u64> matrix_cache_hits(0);
+static std::atomic<u64> matrix_cache_misses(0);
+
+// Bytes a generated matrix takes in the cache
+static size_t cached_matrix_bytes(u32 key) {
+  const size_t k = key >> 16;
+  const size_t m = key & 0xFFFF;
+  return k * (m - 1) + sizeof(CachedMatrix);
+}
+
+// Precondition: m > 1.  The matrix stays valid for as long as "ref" is held.
+static const u8 *cached_cauchy_matrix(int k, int m, int &stride,
+                                      MatrixRef &ref) {
+  // Small m use the precomputed tables, which are static
+  if (m <= 6) {
+    bool dynamic_matrix;
+    ++matrix_cache_hits;
+    return cauchy_matrix(k, m, stride, 0, dynamic_matrix);
+  }
+
+  const u32 key = (static_cast<u32>(k) << 16) | static_cast<u32>(m);
+
+  std::lock_guard<std::mutex> lock(matrix_cache_lock);
+
+  auto it = matrix_cache.find(key);
+  if (it != matrix_cache.end()) {
+    ++matrix_cache_hits;
+    it->second.last_use = ++matrix_cache_clock;
+    stride = it->second.stride;
+    ref = it->second.matrix;
+    return ref.get();
+  }
+
+  ++matrix_cache_misses;
+
+  u8 stack_space[CAT_CAUCHY_MATRIX_STACK_SIZE];
+  bool dynamic_matrix;
+  const u8 *matrix = cauchy_matrix(k, m, stride, stack_space, dynamic_matrix);
+
+  // Anything on the stack needs to outlive us
+  if (!dynamic_matrix) {
+    u8 *copy = new u8[k * (m - 1)];
+    memcpy(copy, stack_space, static_cast<size_t>(k * (m - 1)));
+    matrix = copy;
+  }
+
+  // Least recently used first, there are few entries and misses are rare
+  const size_t bytes = cached_matrix_bytes(key);
+  while (!matrix_cache.empty() &&
+         (matrix_cache_bytes + bytes > CAT_MATRIX_CACHE_BYTES)) {
+    auto victim = matrix_cache.begin();
+    for (auto jt = matrix_cache.begin(); jt != matrix_cache.end(); ++jt) {
+      if (jt->second.last_use < victim->second.last_use) {
+        victim = jt;
+      }
+    }
+
+    matrix_cache_bytes -= cached_matrix_bytes(victim->first);
+    matrix_cache.erase(victim);
+  }
+
+  CachedMatrix entry;
+  entry.matrix = MatrixRef(matrix, [](const u8 *p) { delete[] p; });
+  entry.stride = stride;
+  entry.last_use = ++matrix_cache_clock;
+
+  matrix_cache_bytes += bytes;
+  ref = matrix_cache.insert(std::make_pair(key, entry)).first->second.matrix;
+  return ref.get();
+}
+
+extern "C" int cauchy_256_cache_warm(int k, int m) {
+  if ((k < 1) || (m < 1) || (k + m > 256)) {
+    return -1;
+  }
+
+  // Nothing to cache for these shapes, encoder and decoder handle them
+  // without a matrix
+  if ((k <= 1) || (m <= 1)) {
+    return 0;
+  }
+
+  GFC256Init();
+
+  int stride;
+  MatrixRef ref;
+  cached_cauchy_matrix(k, m, stride, ref);
+
+  return 0;
+}
+
 //// Decoder
 
 // Specialized fast decoder for m = 1
@@ -731,13 +893,13 @@ static void eliminate_original(Block *original[256], int original_count,
   }
 }
 
-static u64 *generate_bitmatrix(int k, Block *recovery[256], int recovery_count,
+// Fills in the bitmatrix, which needs bitmatrix_words(recovery_count) words
+static void generate_bitmatrix(int k, Block *recovery[256], int recovery_count,
                                const u8 *matrix, int stride,
-                               const u8 erasures[256], int &bitstride) {
-  // Allocate the bitmatrix
+                               const u8 erasures[256], u64 *bitmatrix,
+                               int &bitstride) {
   int bitrows = recovery_count * 8;
   bitstride = (bitrows + 63) / 64;
-  u64 *bitmatrix = new u64[bitstride * bitrows];
   u64 *bitrow = bitmatrix;
 
   // For each recovery block,
@@ -813,8 +975,6 @@ static u64 *generate_bitmatrix(int k, Block *recovery[256], int recovery_count,
     // Set the row to what the final recovered row will be
     recovery_block->row = erasures[ii];
   }
-
-  return bitmatrix;
 }
 
 /*
@@ -1276,119 +1436,489 @@ static void back_substitution(int rows, Block *recovery[256], u64 *bitmatrix,
   }
 }
 
-extern "C" int cauchy_256_decode(int k, int m, Block *blocks, int block_bytes) {
-  // If there is only one input block,
-  if (k <= 1) {
-    // The block is already the same as original data
-    blocks[0].row = 0;
-    return 0;
+/*
+ * Vectorized decoder:
+ *
+ * Each 8x8 submatrix is the transpose of multiplication by its GF(256)
+ * element, and transposition is a fixed change of basis in GF(256).  So the
+ * inverse of a bitmatrix built from Cauchy elements is built from the elements
+ * of the inverted GF(256) matrix in the same way.  That means the square matrix
+ * for the erased columns can be inverted with byte arithmetic, after which the
+ * recovered blocks are sums of memmuladd() products of the recovery data.
+ * The result is identical to what Gaussian elimination on the bitmatrix finds.
+ */
+
+#define CAT_MULADD_STACK_SIZE 16384
+
+// Returns 0 on success, -1 if the matrix is singular (it never is for valid
+// Cauchy rows, but the input comes from the network).
+static int gf256_invert(int n, u8 *matrix, u8 *inverse) {
+  for (int ii = 0; ii < n; ++ii) {
+    for (int jj = 0; jj < n; ++jj) {
+      inverse[ii * n + jj] = (ii == jj) ? 1 : 0;
+    }
   }
 
-  // For the special case of one erasure,
-  if (m == 1) {
-    cauchy_decode_m1(k, blocks, block_bytes);
-    return 0;
+  for (int col = 0; col < n; ++col) {
+    int pivot = col;
+    while (pivot < n && matrix[pivot * n + col] == 0) {
+      ++pivot;
+    }
+    if (pivot >= n) {
+      return -1;
+    }
+
+    u8 *pivot_row = matrix + col * n;
+    u8 *pivot_inv = inverse + col * n;
+
+    if (pivot != col) {
+      memswap(pivot_row, matrix + pivot * n, n);
+      memswap(pivot_inv, inverse + pivot * n, n);
+    }
+
+    const u8 scale = GFC256_INV_TABLE[pivot_row[col]];
+    for (int jj = 0; jj < n; ++jj) {
+      pivot_row[jj] = GFC256Multiply(pivot_row[jj], scale);
+      pivot_inv[jj] = GFC256Multiply(pivot_inv[jj], scale);
+    }
+
+    for (int ii = 0; ii < n; ++ii) {
+      u8 *row = matrix + ii * n;
+      const u8 factor = row[col];
+
+      if (ii == col || factor == 0) {
+        continue;
+      }
+
+      u8 *row_inv = inverse + ii * n;
+      for (int jj = 0; jj < n; ++jj) {
+        row[jj] ^= GFC256Multiply(pivot_row[jj], factor);
+        row_inv[jj] ^= GFC256Multiply(pivot_inv[jj], factor);
+      }
+    }
   }
 
-  // Sort blocks into original and recovery
-  Block *recovery[256];
-  int recovery_count;
-  Block *original[256];
-  int original_count;
-  u8 erasures[256];
-  sort_blocks(k, blocks, original, original_count, recovery, recovery_count,
-              erasures);
+  return 0;
+}
 
-  DLOG(cout << "Recovery rows(" << recovery_count << "):" << endl;
-       for (int ii = 0; ii < recovery_count; ++ii) {
-         cout << "+ Element " << ii << " fills in for erased row "
-              << (int)erasures[ii] << " with recovery row "
-              << (int)recovery[ii]->row << endl;
-       } cout
-       << "Original rows(" << original_count << "):" << endl;
-       for (int ii = 0; ii < original_count; ++ii) {
-         cout << "+ Element " << ii << " points to original row "
-              << (int)original[ii]->row << endl;
-       })
+// Element of the extended generator matrix for a recovery row and data column
+static CAT_INLINE u8 cauchy_element(int k, const u8 *matrix, int stride,
+                                    int row, int column) {
+  const int recovery_row = row - k;
+  if (recovery_row == 0) {
+    return 1;
+  }
+  return matrix[(recovery_row - 1) * stride + column];
+}
 
-  // If nothing is erased,
-  if (recovery_count <= 0) {
-    return 0;
+//// Decode matrix cache
+
+/*
+ * Under steady loss the same erasure patterns keep coming back, so the
+ * inverted square matrix is remembered for the most recent patterns.  The key
+ * is (k, m) plus the erased rows and the recovery rows used for them, in
+ * order.  Its hash picks a set of a few entries with a lock of their own, so
+ * decoders only wait on each other when their patterns land in the same set.
+ * Lookups do not allocate; a miss reuses the least recently used entry of the
+ * set and only grows its buffers when a larger pattern comes along.
+ *
+ * Building and inverting the square matrix only outweighs hashing and
+ * copying the inverse once a pattern has some size, so smaller ones skip the
+ * cache (see DecodeCacheBenchmark).
+ */
+
+#define CAT_DECODE_CACHE_MAX_SIZE 256
+#define CAT_DECODE_CACHE_WAYS 4
+#define CAT_DECODE_CACHE_MIN_ERASURES 16
+
+struct DecodeCacheEntry {
+  u64 hash;
+  u64 last_use;
+  int key_bytes;
+  int n;
+  u8 *key;      // k, m, erasures[n], recovery rows[n]
+  u8 *inverse;  // n x n
+  int key_capacity;
+  int inverse_capacity;
+};
+
+struct DecodeCacheSet {
+  std::mutex lock;
+  u64 clock;
+  DecodeCacheEntry entries[CAT_DECODE_CACHE_WAYS];
+};
+
+static DecodeCacheSet
+    decode_cache[CAT_DECODE_CACHE_MAX_SIZE / CAT_DECODE_CACHE_WAYS];
+static std::atomic<int> decode_cache_sets(64 / CAT_DECODE_CACHE_WAYS);
+static std::atomic<u64> decode_cache_hits(0);
+static std::atomic<u64> decode_cache_misses(0);
+
+static int decode_cache_key(int k, int m, Block *recovery[256], int n,
+                            const u8 erasures[256], u8 key[2 + 2 * 256],
+                            u64 &hash) {
+  int key_bytes = 0;
+  key[key_bytes++] = static_cast<u8>(k);
+  key[key_bytes++] = static_cast<u8>(m);
+  for (int ii = 0; ii < n; ++ii) {
+    key[key_bytes++] = erasures[ii];
+  }
+  for (int ii = 0; ii < n; ++ii) {
+    key[key_bytes++] = recovery[ii]->row;
   }
 
-  // Otherwise there is a restriction on what inputs we can handle
-  if ((k + m > 256) || (block_bytes % 8 != 0)) {
+  // FNV-1a
+  hash = 14695981039346656037ULL;
+  for (int ii = 0; ii < key_bytes; ++ii) {
+    hash = (hash ^ key[ii]) * 1099511628211ULL;
+  }
+
+  return key_bytes;
+}
+
+// Set for a hash, or nullptr while the cache is disabled
+static DecodeCacheSet *decode_cache_set(u64 hash) {
+  const int sets = decode_cache_sets;
+  if (sets <= 0) {
+    return nullptr;
+  }
+  return decode_cache + static_cast<int>(hash % static_cast<u64>(sets));
+}
+
+// Copies the cached inverse on a hit
+static bool decode_cache_find(DecodeCacheSet *set, const u8 *key,
+                              int key_bytes, u64 hash, int n, u8 *inverse) {
+  std::lock_guard<std::mutex> lock(set->lock);
+
+  for (int ii = 0; ii < CAT_DECODE_CACHE_WAYS; ++ii) {
+    DecodeCacheEntry &entry = set->entries[ii];
+
+    if (entry.hash == hash && entry.key_bytes == key_bytes &&
+        memcmp(entry.key, key, key_bytes) == 0) {
+      entry.last_use = ++set->clock;
+      memcpy(inverse, entry.inverse, static_cast<size_t>(n * n));
+      ++decode_cache_hits;
+      return true;
+    }
+  }
+
+  ++decode_cache_misses;
+  return false;
+}
+
+static void decode_cache_store(DecodeCacheSet *set, const u8 *key,
+                               int key_bytes, u64 hash, int n,
+                               const u8 *inverse) {
+  std::lock_guard<std::mutex> lock(set->lock);
+
+  // Empty entries have last_use = 0 and are picked first
+  DecodeCacheEntry *victim = set->entries;
+  for (int ii = 1; ii < CAT_DECODE_CACHE_WAYS; ++ii) {
+    if (set->entries[ii].last_use < victim->last_use) {
+      victim = set->entries + ii;
+    }
+  }
+
+  // Size buffers for the largest pattern this (k, m) can produce, so an
+  // entry recycled within the same shape never allocates again
+  const int max_n = key[0] < key[1] ? key[0] : key[1];
+  if (victim->key_capacity < key_bytes) {
+    delete[] victim->key;
+    victim->key = new u8[2 + 2 * max_n];
+    victim->key_capacity = 2 + 2 * max_n;
+  }
+  if (victim->inverse_capacity < n * n) {
+    delete[] victim->inverse;
+    victim->inverse = new u8[max_n * max_n];
+    victim->inverse_capacity = max_n * max_n;
+  }
+
+  memcpy(victim->key, key, key_bytes);
+  memcpy(victim->inverse, inverse, static_cast<size_t>(n * n));
+  victim->hash = hash;
+  victim->key_bytes = key_bytes;
+  victim->n = n;
+  victim->last_use = ++set->clock;
+}
+
+extern "C" int cauchy_256_cache_set_decode_size(int entries) {
+  if ((entries < 0) || (entries > CAT_DECODE_CACHE_MAX_SIZE)) {
     return -1;
   }
 
-  // The Cauchy matrix is selected in a way that has a small
-  // number of ones set in the binary representation used here.
-  // A combination of precomputation and heuristics provides a
-  // near-optimal matrix selection for each value of k, m.
+  // Nobody starts a new lookup while the sets are cleared
+  decode_cache_sets = 0;
 
-  GFC256Init();
+  // Forget everything, a pattern hashes to another set once the count changes
+  for (DecodeCacheSet &set : decode_cache) {
+    std::lock_guard<std::mutex> lock(set.lock);
 
-  const int subbytes = block_bytes / 8;
+    for (DecodeCacheEntry &entry : set.entries) {
+      entry.hash = 0;
+      entry.key_bytes = 0;
+      entry.last_use = 0;
+    }
+  }
+  decode_cache_sets =
+      (entries + CAT_DECODE_CACHE_WAYS - 1) / CAT_DECODE_CACHE_WAYS;
 
-  // Precomputation window workspace
-  u8 *precomp = 0;
-  u8 **precomp_tables[2];
-  u8 *table_stack[16 * 2];
+  return 0;
+}
 
-  // If precomputation window is being used,
-  if (recovery_count > PRECOMP_TABLE_THRESH) {
-    precomp = new u8[subbytes * PRECOMP_TABLE_SIZE * 2];
+extern "C" void cauchy_256_cache_stats(Cauchy256CacheStats *stats) {
+  stats->matrixHits = matrix_cache_hits;
+  stats->matrixMisses = matrix_cache_misses;
+  stats->decodeHits = decode_cache_hits;
+  stats->decodeMisses = decode_cache_misses;
+}
+
+// Workspace: square matrix and its inverse, then one symbol buffer per
+// recovery block plus one for the block being worked on
+static int muladd_decode_bytes(int n, int block_bytes) {
+  return n * n * 2 + (n + 1) * block_bytes;
+}
+
+// Inverse of the square matrix for the erased columns, unless this erasure
+// pattern is large enough to be cached and was seen recently
+static int muladd_inverse(int k, int m, const u8 *matrix, int stride,
+                          Block *recovery[256], int n, const u8 erasures[256],
+                          u8 *square, u8 *inverse) {
+  u8 key[2 + 2 * 256];
+  u64 hash = 0;
+  int key_bytes = 0;
+  DecodeCacheSet *set = nullptr;
+
+  if (n >= CAT_DECODE_CACHE_MIN_ERASURES) {
+    key_bytes = decode_cache_key(k, m, recovery, n, erasures, key, hash);
+    set = decode_cache_set(hash);
+  }
+
+  if (set && decode_cache_find(set, key, key_bytes, hash, n, inverse)) {
+    return 0;
+  }
 
-    precomp_tables[0] = table_stack;
-    precomp_tables[1] = table_stack + 16;
-    for (int ii = 0; ii < 16 * 2; ++ii) {
-      table_stack[ii] = 0;
+  for (int ii = 0; ii < n; ++ii) {
+    for (int jj = 0; jj < n; ++jj) {
+      square[ii * n + jj] =
+          cauchy_element(k, matrix, stride, recovery[ii]->row, erasures[jj]);
     }
+  }
 
-    // Fill in tables
-    u8 *precomp_ptr = precomp;
-    for (int ii = 0; ii < 2;
-         ++ii, precomp_ptr += subbytes * PRECOMP_TABLE_SIZE) {
-      u8 **table = precomp_tables[ii];
-
-      table[3] = precomp_ptr;
-      table[5] = precomp_ptr + subbytes;
-      table[6] = precomp_ptr + subbytes * 2;
-      table[7] = precomp_ptr + subbytes * 3;
-      for (int jj = 9; jj < 16; ++jj) {
-        table[jj] = precomp_ptr + subbytes * (jj - 5);
+  const int result = gf256_invert(n, square, inverse);
+
+  if (set && (result == 0)) {
+    decode_cache_store(set, key, key_bytes, hash, n, inverse);
+  }
+
+  return result;
+}
+
+// Recovers the erased columns from the symbols of n recovery rows that had
+// all original data eliminated, using a muladd_decode_bytes() workspace with
+// the symbols already in place
+static int muladd_solve(int k, int m, const u8 *matrix, int stride,
+                        Block *recovery[256], int n, const u8 erasures[256],
+                        int block_bytes, u8 *workspace) {
+  u8 *square = workspace;
+  u8 *inverse = square + n * n;
+  u8 *symbols = inverse + n * n;
+  u8 *temp = symbols + n * block_bytes;
+
+  const int result = muladd_inverse(k, m, matrix, stride, recovery, n,
+                                    erasures, square, inverse);
+
+  if (result == 0) {
+    // Recovery data now lives in symbols[], so blocks can be overwritten
+    for (int ii = 0; ii < n; ++ii) {
+      const u8 *row = inverse + ii * n;
+
+      memmul(temp, GFC256MulAddTable(row[0]), symbols, block_bytes);
+      for (int jj = 1; jj < n; ++jj) {
+        memmuladd(temp, GFC256MulAddTable(row[jj]),
+                  symbols + jj * block_bytes, block_bytes);
       }
+
+      memunbitslice(recovery[ii]->data, temp, block_bytes);
+      recovery[ii]->row = erasures[ii];
     }
   }
 
-  // Generate Cauchy matrix
+  return result;
+}
+
+static int muladd_decode(int k, int m, Block *original[256],
+                         int original_count, Block *recovery[256],
+                         int recovery_count, const u8 erasures[256],
+                         int block_bytes, u8 *workspace) {
+  // Look up Cauchy matrix
   int stride;
-  u8 stack_space[CAT_CAUCHY_MATRIX_STACK_SIZE];
-  bool dynamic_matrix;
-  const u8 *matrix = cauchy_matrix(k, m, stride, stack_space, dynamic_matrix);
+  MatrixRef ref;
+  const u8 *matrix = cached_cauchy_matrix(k, m, stride, ref);
 
-  // From the Cauchy matrix, each byte value can be expanded into
-  // an 8x8 submatrix containing a minimal number of ones.
-  // The rows that made it through from the original data provide
-  // some of the column values for the matrix, so those can be
-  // eliminated immediately.  This is useful because it conceptually
-  // zeroes out those eliminated matrix elements.  And so when it
-  // comes time to laborously generate the bitmatrix and solve it
-  // with Gaussian elimination, that bitmatrix can be smaller since
-  // it does not need to include these rows and columns.
+  const int n = recovery_count;
+  u8 *symbols = workspace + n * n * 2;
+  u8 *temp = symbols + n * block_bytes;
 
-  // If original data exists,
-  if (original_count > 0) {
-    // Eliminate original data from recovery rows
-    if (recovery_count > PRECOMP_TABLE_THRESH) {
-      win_original(original, original_count, recovery, recovery_count, matrix,
-                   stride, subbytes, precomp_tables);
-    } else {
-      eliminate_original(original, original_count, recovery, recovery_count,
-                         matrix, stride, subbytes);
+  for (int ii = 0; ii < n; ++ii) {
+    membitslice(symbols + ii * block_bytes, recovery[ii]->data, block_bytes);
+  }
+
+  // Eliminate original data from recovery rows
+  for (int jj = 0; jj < original_count; ++jj) {
+    const int column = original[jj]->row;
+
+    membitslice(temp, original[jj]->data, block_bytes);
+
+    for (int ii = 0; ii < n; ++ii) {
+      const u8 element =
+          cauchy_element(k, matrix, stride, recovery[ii]->row, column);
+      memmuladd(symbols + ii * block_bytes, GFC256MulAddTable(element), temp,
+                block_bytes);
+    }
+  }
+
+  return muladd_solve(k, m, matrix, stride, recovery, n, erasures,
+                      block_bytes, workspace);
+}
+
+//// Workspace
+
+/*
+ * All temporary memory the encoder and decoder need is carved out of one
+ * scratch buffer.  The _ws() entry points take it from a caller-owned
+ * workspace, so they never touch the heap once the matrix caches are warm.
+ * The plain entry points use the stack when the scratch fits, else the heap.
+ */
+
+// Partially encoded message, see "Encoder" below
+struct EncoderState {
+  int k, m, block_bytes;
+  int first_row, rows;  // recovery rows [first_row, first_row + rows)
+  int added;
+  u8 *out;  // rows recovery blocks, end to end
+  const u8 *matrix;
+  MatrixRef matrix_ref;  // keeps "matrix" alive until the next message
+  int stride;
+  u8 *scratch;
+  bool muladd;
+};
+
+struct _Cauchy256Workspace {
+  int block_bytes;
+  int scratch_bytes;
+  u64 *scratch;
+  EncoderState encoder;  // for cauchy_256_encode_begin()
+};
+
+static int bitmatrix_words(int recovery_count) {
+  const int bitrows = recovery_count * 8;
+  return ((bitrows + 63) / 64) * bitrows;
+}
+
+static int encode_scratch_bytes(int m, int block_bytes) {
+  // The windowed encoder needs 2 * PRECOMP_TABLE_SIZE subblocks, which is
+  // less than the m blocks the vectorized encoder needs whenever m > 4
+  return m * block_bytes;
+}
+
+static int decode_scratch_bytes(int recovery_count, int block_bytes) {
+  int legacy = bitmatrix_words(recovery_count) * 8;
+  if (recovery_count > PRECOMP_TABLE_THRESH) {
+    legacy += (block_bytes / 8) * PRECOMP_TABLE_SIZE * 2;
+  }
+
+  const int muladd = muladd_decode_bytes(recovery_count, block_bytes);
+  return muladd > legacy ? muladd : legacy;
+}
+
+class ScratchBuffer {
+ public:
+  ScratchBuffer() : heap_(0) {}
+  ~ScratchBuffer() { delete[] heap_; }
+
+  // Returns 0 if the workspace is too small for the request
+  u8 *get(Cauchy256Workspace *workspace, int bytes) {
+    if (workspace) {
+      return (bytes <= workspace->scratch_bytes)
+                 ? reinterpret_cast<u8 *>(workspace->scratch)
+                 : 0;
+    }
+
+    if (bytes <= static_cast<int>(sizeof(stack_))) {
+      return reinterpret_cast<u8 *>(stack_);
+    }
+
+    heap_ = new u64[(bytes + 7) / 8];
+    return reinterpret_cast<u8 *>(heap_);
+  }
+
+ private:
+  u64 stack_[CAT_MULADD_STACK_SIZE / 8];
+  u64 *heap_;
+};
+
+extern "C" Cauchy256Workspace *cauchy_256_workspace_create(int block_bytes) {
+  if (block_bytes <= 0 || (block_bytes % 8 != 0)) {
+    return 0;
+  }
+
+  // Worst cases are m = 255 for the encoder and 128 erasures for the decoder
+  int bytes = encode_scratch_bytes(255, block_bytes);
+  const int decode_bytes = decode_scratch_bytes(128, block_bytes);
+  if (decode_bytes > bytes) {
+    bytes = decode_bytes;
+  }
+
+  Cauchy256Workspace *workspace = new Cauchy256Workspace;
+  workspace->block_bytes = block_bytes;
+  workspace->scratch_bytes = bytes;
+  workspace->scratch = new u64[(bytes + 7) / 8];
+  workspace->encoder.out = 0;
+
+  return workspace;
+}
+
+extern "C" void cauchy_256_workspace_free(Cauchy256Workspace *workspace) {
+  if (workspace) {
+    delete[] workspace->scratch;
+    delete workspace;
+  }
+}
+
+// Points the window tables into precomp, which holds
+// 2 * PRECOMP_TABLE_SIZE subblocks
+static void setup_precomp_tables(u8 *precomp, int subbytes,
+                                 u8 **precomp_tables[2],
+                                 u8 *table_stack[16 * 2]) {
+  precomp_tables[0] = table_stack;
+  precomp_tables[1] = table_stack + 16;
+  for (int ii = 0; ii < 16 * 2; ++ii) {
+    table_stack[ii] = 0;
+  }
+
+  // Fill in tables
+  u8 *precomp_ptr = precomp;
+  for (int ii = 0; ii < 2;
+       ++ii, precomp_ptr += subbytes * PRECOMP_TABLE_SIZE) {
+    u8 **table = precomp_tables[ii];
+
+    table[3] = precomp_ptr;
+    table[5] = precomp_ptr + subbytes;
+    table[6] = precomp_ptr + subbytes * 2;
+    table[7] = precomp_ptr + subbytes * 3;
+    for (int jj = 9; jj < 16; ++jj) {
+      table[jj] = precomp_ptr + subbytes * (jj - 5);
     }
   }
+}
 
+// Recovers the erased columns from recovery rows that had all original data
+// eliminated.  The bitmatrix needs bitmatrix_words(recovery_count) words and
+// the tables are only used above PRECOMP_TABLE_THRESH recovery rows.
+static void bitmatrix_solve(int k, Block *recovery[256], int recovery_count,
+                            const u8 *matrix, int stride,
+                            const u8 erasures[256], int subbytes,
+                            u64 *bitmatrix, u8 **precomp_tables[2]) {
   // Now that the columns that are missing have been identified,
   // it is time to generate a bitmatrix to represent the original
   // rows that have been XOR'd together to produce the recovery data.
@@ -1397,8 +1927,8 @@ extern "C" int cauchy_256_decode(int k, int m, Block *blocks, int block_bytes) {
 
   // Generate square bitmatrix for erased columns from recovery rows
   int bitstride;
-  u64 *bitmatrix = generate_bitmatrix(k, recovery, recovery_count, matrix,
-                                      stride, erasures, bitstride);
+  generate_bitmatrix(k, recovery, recovery_count, matrix, stride, erasures,
+                     bitmatrix, bitstride);
 
   DLOG(print_matrix(bitmatrix, bitstride, recovery_count * 8);)
 
@@ -1435,26 +1965,500 @@ extern "C" int cauchy_256_decode(int k, int m, Block *blocks, int block_bytes) {
     back_substitution(recovery_count, recovery, bitmatrix, bitstride, subbytes);
   }
 
-  // Free temporary workspace
-  delete[] bitmatrix;
-  if (dynamic_matrix) {
-    delete[] matrix;
-  }
-  if (precomp) {
-    delete[] precomp;
-  }
+}
+
+static int decode(int k, int m, Block *blocks, int block_bytes,
+                  Cauchy256Workspace *workspace) {
+  // If there is only one input block,
+  if (k <= 1) {
+    // The block is already the same as original data
+    blocks[0].row = 0;
+    return 0;
+  }
+
+  // For the special case of one erasure,
+  if (m == 1) {
+    cauchy_decode_m1(k, blocks, block_bytes);
+    return 0;
+  }
+
+  // Sort blocks into original and recovery
+  Block *recovery[256];
+  int recovery_count;
+  Block *original[256];
+  int original_count;
+  u8 erasures[256];
+  sort_blocks(k, blocks, original, original_count, recovery, recovery_count,
+              erasures);
+
+  DLOG(cout << "Recovery rows(" << recovery_count << "):" << endl;
+       for (int ii = 0; ii < recovery_count; ++ii) {
+         cout << "+ Element " << ii << " fills in for erased row "
+              << (int)erasures[ii] << " with recovery row "
+              << (int)recovery[ii]->row << endl;
+       } cout
+       << "Original rows(" << original_count << "):" << endl;
+       for (int ii = 0; ii < original_count; ++ii) {
+         cout << "+ Element " << ii << " points to original row "
+              << (int)original[ii]->row << endl;
+       })
+
+  // If nothing is erased,
+  if (recovery_count <= 0) {
+    return 0;
+  }
+
+  // Otherwise there is a restriction on what inputs we can handle
+  if ((k + m > 256) || (block_bytes % 8 != 0)) {
+    return -1;
+  }
+
+  // The Cauchy matrix is selected in a way that has a small
+  // number of ones set in the binary representation used here.
+  // A combination of precomputation and heuristics provides a
+  // near-optimal matrix selection for each value of k, m.
+
+  ScratchBuffer scratch_buffer;
+  u8 *scratch = scratch_buffer.get(
+      workspace, decode_scratch_bytes(recovery_count, block_bytes));
+  if (!scratch) {
+    return -1;
+  }
+
+  GFC256Init();
+
+  if (memmuladd_accelerated()) {
+    return muladd_decode(k, m, original, original_count, recovery,
+                         recovery_count, erasures, block_bytes, scratch);
+  }
+
+  const int subbytes = block_bytes / 8;
+
+  // Bitmatrix goes first in the scratch buffer to keep it 8-byte aligned
+  u64 *bitmatrix = reinterpret_cast<u64 *>(scratch);
+
+  // Precomputation window workspace
+  u8 **precomp_tables[2];
+  u8 *table_stack[16 * 2];
+
+  // If precomputation window is being used,
+  if (recovery_count > PRECOMP_TABLE_THRESH) {
+    setup_precomp_tables(scratch + bitmatrix_words(recovery_count) * 8,
+                         subbytes, precomp_tables, table_stack);
+  }
+
+  // Look up Cauchy matrix
+  int stride;
+  MatrixRef ref;
+  const u8 *matrix = cached_cauchy_matrix(k, m, stride, ref);
+
+  // From the Cauchy matrix, each byte value can be expanded into
+  // an 8x8 submatrix containing a minimal number of ones.
+  // The rows that made it through from the original data provide
+  // some of the column values for the matrix, so those can be
+  // eliminated immediately.  This is useful because it conceptually
+  // zeroes out those eliminated matrix elements.  And so when it
+  // comes time to laborously generate the bitmatrix and solve it
+  // with Gaussian elimination, that bitmatrix can be smaller since
+  // it does not need to include these rows and columns.
+
+  // If original data exists,
+  if (original_count > 0) {
+    // Eliminate original data from recovery rows
+    if (recovery_count > PRECOMP_TABLE_THRESH) {
+      win_original(original, original_count, recovery, recovery_count, matrix,
+                   stride, subbytes, precomp_tables);
+    } else {
+      eliminate_original(original, original_count, recovery, recovery_count,
+                         matrix, stride, subbytes);
+    }
+  }
+
+  bitmatrix_solve(k, recovery, recovery_count, matrix, stride, erasures,
+                  subbytes, bitmatrix, precomp_tables);
+
+  return 0;
+}
+
+extern "C" int cauchy_256_decode(int k, int m, Block *blocks, int block_bytes) {
+  return decode(k, m, blocks, block_bytes, 0);
+}
+
+extern "C" int cauchy_256_decode_ws(int k, int m, Block *blocks,
+                                    int block_bytes,
+                                    Cauchy256Workspace *workspace) {
+  if (!workspace || block_bytes > workspace->block_bytes) {
+    return -1;
+  }
+
+  return decode(k, m, blocks, block_bytes, workspace);
+}
+
+//// Batch decoder
+
+/*
+ * The messages of a frame often lose the same rows, for example when a burst
+ * hits every message at the same position in the send order.  Their decodes
+ * then share the matrix and its inverse, and since the vectorized decoder
+ * works on every symbol byte independently, the blocks of all those messages
+ * can go through each multiply-add together: one pass over the matrix for
+ * the whole group instead of one per message, with longer runs per call.
+ */
+
+// Workspace: square matrix and its inverse, then one symbol buffer per
+// recovery block plus one for the block being worked on, each holding the
+// blocks of "count" block sets end to end
+static int muladd_batch_bytes(int n, int count, int block_bytes) {
+  return n * n * 2 + (n + 1) * count * block_bytes;
+}
+
+// Same as muladd_decode() for "count" block sets that have the same rows at
+// the same positions, with original[] and recovery[] sorted from the first
+static int muladd_decode_batch(int k, int m, Block **block_sets, int count,
+                               Block *original[256], int original_count,
+                               Block *recovery[256], int n,
+                               const u8 erasures[256], int block_bytes,
+                               u8 *workspace) {
+  int stride;
+  MatrixRef ref;
+  const u8 *matrix = cached_cauchy_matrix(k, m, stride, ref);
+
+  const int set_bytes = count * block_bytes;
+  u8 *square = workspace;
+  u8 *inverse = square + n * n;
+  u8 *symbols = inverse + n * n;
+  u8 *temp = symbols + n * set_bytes;
+  const Block *first = block_sets[0];
+
+  for (int ii = 0; ii < n; ++ii) {
+    const ptrdiff_t position = recovery[ii] - first;
+
+    for (int set = 0; set < count; ++set) {
+      membitslice(symbols + ii * set_bytes + set * block_bytes,
+                  block_sets[set][position].data, block_bytes);
+    }
+  }
+
+  // Eliminate original data from recovery rows
+  for (int jj = 0; jj < original_count; ++jj) {
+    const ptrdiff_t position = original[jj] - first;
+    const int column = original[jj]->row;
+
+    for (int set = 0; set < count; ++set) {
+      membitslice(temp + set * block_bytes, block_sets[set][position].data,
+                  block_bytes);
+    }
+
+    for (int ii = 0; ii < n; ++ii) {
+      const u8 element =
+          cauchy_element(k, matrix, stride, recovery[ii]->row, column);
+      memmuladd(symbols + ii * set_bytes, GFC256MulAddTable(element), temp,
+                set_bytes);
+    }
+  }
+
+  if (muladd_inverse(k, m, matrix, stride, recovery, n, erasures, square,
+                     inverse) != 0) {
+    return -1;
+  }
+
+  for (int ii = 0; ii < n; ++ii) {
+    const u8 *row = inverse + ii * n;
+    const ptrdiff_t position = recovery[ii] - first;
+
+    memmul(temp, GFC256MulAddTable(row[0]), symbols, set_bytes);
+    for (int jj = 1; jj < n; ++jj) {
+      memmuladd(temp, GFC256MulAddTable(row[jj]), symbols + jj * set_bytes,
+                set_bytes);
+    }
+
+    for (int set = 0; set < count; ++set) {
+      memunbitslice(block_sets[set][position].data, temp + set * block_bytes,
+                    block_bytes);
+      block_sets[set][position].row = erasures[ii];
+    }
+  }
+
+  return 0;
+}
+
+static bool same_rows(int k, const Block *a, const Block *b) {
+  for (int ii = 0; ii < k; ++ii) {
+    if (a[ii].row != b[ii].row) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+extern "C" int cauchy_256_decode_batch_ws(int k, int m, Block **block_sets,
+                                          int count, int block_bytes,
+                                          Cauchy256Workspace *workspace) {
+  if (!workspace || block_bytes > workspace->block_bytes) {
+    return -1;
+  }
+
+  int result = 0;
+
+  for (int start = 0; start < count;) {
+    Block *blocks = block_sets[start];
+    int group = 1;
+
+    if ((k > 1) && (m > 1) && (k + m <= 256) && (block_bytes % 8 == 0) &&
+        memmuladd_accelerated()) {
+      Block *recovery[256];
+      int recovery_count;
+      Block *original[256];
+      int original_count;
+      u8 erasures[256];
+      sort_blocks(k, blocks, original, original_count, recovery,
+                  recovery_count, erasures);
+
+      const int n = recovery_count;
+
+      while ((start + group < count) &&
+             (muladd_batch_bytes(n, group + 1, block_bytes) <=
+              workspace->scratch_bytes) &&
+             same_rows(k, blocks, block_sets[start + group])) {
+        ++group;
+      }
+
+      if ((n > 0) && (group > 1)) {
+        GFC256Init();
+
+        u8 *scratch = reinterpret_cast<u8 *>(workspace->scratch);
+        if (muladd_decode_batch(k, m, block_sets + start, group, original,
+                                original_count, recovery, n, erasures,
+                                block_bytes, scratch) != 0) {
+          result = -1;
+        }
+
+        start += group;
+        continue;
+      }
+
+      group = 1;
+    }
+
+    if (decode(k, m, blocks, block_bytes, workspace) != 0) {
+      result = -1;
+    }
+    start += group;
+  }
+
+  return result;
+}
+
+//// Progressive decoder
+
+/*
+ * Receivers usually have most of the original blocks long before the last
+ * block of a message arrives.  Eliminating the original data from the
+ * recovery rows is the bulk of the decoding work, so it can be done while
+ * blocks come in, which leaves only the square solve for the end:
+ *
+ * cauchy_256_reduce_init() puts a block into the reduced form (the symbol
+ * domain for the vectorized decoder, unchanged for the bitmatrix decoder), so
+ * an original block is converted once no matter how many recovery blocks it
+ * is eliminated from.  cauchy_256_reduce_add() eliminates reduced original
+ * blocks from reduced recovery blocks.  cauchy_256_reduce_solve() recovers
+ * the erased rows from as many recovery blocks once all other originals are
+ * eliminated.
+ */
+
+// The first recovery row is all ones and needs no matrix
+static const u8 *reduce_matrix(int k, int m, int &stride, MatrixRef &ref) {
+  stride = 0;
+  return (m > 1) ? cached_cauchy_matrix(k, m, stride, ref) : 0;
+}
+
+static bool reduce_valid(int k, int m, int block_bytes,
+                         Cauchy256Workspace *workspace) {
+  return workspace && (k > 1) && (m >= 1) && (k + m <= 256) &&
+         (block_bytes % 8 == 0) && (block_bytes <= workspace->block_bytes);
+}
+
+static bool is_recovery_row(int k, int m, const Block &block) {
+  return (block.row >= k) && (block.row < k + m);
+}
+
+// Bitmatrix version of eliminating one original block from a recovery block
+static void eliminate_block(int k, const u8 *matrix, int stride,
+                            const Block &original, Block &recovery,
+                            int subbytes) {
+  u8 slice = cauchy_element(k, matrix, stride, recovery.row, original.row);
+  u8 *dest = recovery.data;
+
+  // If this matrix element is an 8x8 identity matrix,
+  if (slice == 1) {
+    // XOR whole block at once
+    memxor(dest, original.data, subbytes * 8);
+    return;
+  }
+
+  // XOR in bits set in 8x8 submatrix
+  for (int bit_y = 0;; ++bit_y) {
+    const u8 *src = original.data;
+
+    for (int bit_x = 0; bit_x < 8; ++bit_x, src += subbytes) {
+      if (slice & (1 << bit_x)) {
+        memxor(dest, src, subbytes);
+      }
+    }
+
+    // Stop after 8 bits
+    if (bit_y >= 7) {
+      break;
+    }
+
+    // Calculate next slice
+    slice = GFC256Multiply(slice, 2);
+    dest += subbytes;
+  }
+}
+
+extern "C" int cauchy_256_reduce_init(int k, int m, Block *block,
+                                      int block_bytes,
+                                      Cauchy256Workspace *workspace) {
+  if (!reduce_valid(k, m, block_bytes, workspace) || (block->row >= k + m)) {
+    return -1;
+  }
+
+  GFC256Init();
+
+  if (memmuladd_accelerated()) {
+    u8 *temp = reinterpret_cast<u8 *>(workspace->scratch);
+
+    membitslice(temp, block->data, block_bytes);
+    memcpy(block->data, temp, static_cast<size_t>(block_bytes));
+  }
+
+  return 0;
+}
+
+extern "C" int cauchy_256_reduce_add(int k, int m, const Block *original,
+                                     int original_count, Block *recovery,
+                                     int recovery_count, int block_bytes,
+                                     Cauchy256Workspace *workspace) {
+  if (!reduce_valid(k, m, block_bytes, workspace)) {
+    return -1;
+  }
+  for (int jj = 0; jj < original_count; ++jj) {
+    if (original[jj].row >= k) {
+      return -1;
+    }
+  }
+  for (int ii = 0; ii < recovery_count; ++ii) {
+    if (!is_recovery_row(k, m, recovery[ii])) {
+      return -1;
+    }
+  }
+
+  GFC256Init();
+
+  int stride;
+  MatrixRef ref;
+  const u8 *matrix = reduce_matrix(k, m, stride, ref);
+  const bool muladd = memmuladd_accelerated();
+
+  for (int ii = 0; ii < recovery_count; ++ii) {
+    for (int jj = 0; jj < original_count; ++jj) {
+      if (muladd) {
+        const u8 element = cauchy_element(k, matrix, stride, recovery[ii].row,
+                                          original[jj].row);
+        memmuladd(recovery[ii].data, GFC256MulAddTable(element),
+                  original[jj].data, block_bytes);
+      } else {
+        eliminate_block(k, matrix, stride, original[jj], recovery[ii],
+                        block_bytes / 8);
+      }
+    }
+  }
+
+  return 0;
+}
+
+extern "C" int cauchy_256_reduce_solve(int k, int m, Block *recovery,
+                                       int recovery_count, const u8 *erasures,
+                                       int block_bytes,
+                                       Cauchy256Workspace *workspace) {
+  if (!reduce_valid(k, m, block_bytes, workspace) || (recovery_count > k) ||
+      (recovery_count > m) ||
+      (decode_scratch_bytes(recovery_count, block_bytes) >
+       workspace->scratch_bytes)) {
+    return -1;
+  }
+
+  Block *rows[256];
+  for (int ii = 0; ii < recovery_count; ++ii) {
+    if (!is_recovery_row(k, m, recovery[ii]) || (erasures[ii] >= k)) {
+      return -1;
+    }
+    rows[ii] = recovery + ii;
+  }
+
+  // If nothing is erased,
+  if (recovery_count <= 0) {
+    return 0;
+  }
+
+  GFC256Init();
+
+  int stride;
+  MatrixRef ref;
+  const u8 *matrix = reduce_matrix(k, m, stride, ref);
+  u8 *scratch = reinterpret_cast<u8 *>(workspace->scratch);
+
+  if (memmuladd_accelerated()) {
+    const int n = recovery_count;
+    u8 *symbols = scratch + n * n * 2;
+
+    // The blocks are overwritten with the results, so solve from a copy
+    for (int ii = 0; ii < n; ++ii) {
+      memcpy(symbols + ii * block_bytes, recovery[ii].data,
+             static_cast<size_t>(block_bytes));
+    }
+
+    return muladd_solve(k, m, matrix, stride, rows, n, erasures, block_bytes,
+                        scratch);
+  }
+
+  const int subbytes = block_bytes / 8;
+  u8 **precomp_tables[2];
+  u8 *table_stack[16 * 2];
+
+  if (recovery_count > PRECOMP_TABLE_THRESH) {
+    setup_precomp_tables(scratch + bitmatrix_words(recovery_count) * 8,
+                         subbytes, precomp_tables, table_stack);
+  }
+
+  bitmatrix_solve(k, rows, recovery_count, matrix, stride, erasures, subbytes,
+                  reinterpret_cast<u64 *>(scratch), precomp_tables);
 
   return 0;
 }
 
 //// Encoder
 
-// Windowed version of encoder
-static void win_encode(int k, int m, const u8 *matrix, int stride,
-                       const u8 **data, u8 *out, int subbytes) {
-  static const int PRECOMP_TABLE_SIZE = 11;
+/*
+ * Encoding is linear in the data blocks, so each block can be folded into
+ * the recovery rows as soon as it is available and the recovery blocks are
+ * done the moment the last one is added:
+ *
+ * Row 0 is the XOR of all blocks and is accumulated in the output.  The
+ * bitmatrix encoders XOR the 8x8 submatrices of each column into the output
+ * rows as well.  The vectorized encoder keeps rows 1..m-1 in the symbol
+ * domain in scratch memory and converts them back in encode_end().
+ *
+ * cauchy_256_encode() is encode_begin(), encode_add() for each block in
+ * order, and encode_end().
+ */
 
-  u8 *precomp = new u8[subbytes * PRECOMP_TABLE_SIZE * 2];
+// Windowed version of encoder, for one column
+static void win_encode_column(int m, const u8 *column, int stride,
+                              const u8 *data, u8 *out, int subbytes,
+                              u8 *precomp) {
   u8 *table_stack[16 * 2] = {0};
   u8 **tables[2] = {table_stack, table_stack + 16};
 
@@ -1471,162 +2475,335 @@ static void win_encode(int k, int m, const u8 *matrix, int stride,
     }
   }
 
-  // For each column to generate,
-  for (int x = 0; x < k; ++x, ++matrix) {
-    const u8 *row = matrix;
-    u8 *src = const_cast<u8 *>(data[x]);  // cast to fit table type
+  u8 *src = const_cast<u8 *>(data);  // cast to fit table type
 
-    // Fill in tables
-    for (int ii = 0; ii < 2; ++ii, src += subbytes * 4) {
-      u8 **table = tables[ii];
+  // Fill in tables
+  for (int ii = 0; ii < 2; ++ii, src += subbytes * 4) {
+    u8 **table = tables[ii];
 
-      table[1] = src;
-      table[2] = src + subbytes;
-      table[4] = src + subbytes * 2;
-      table[8] = src + subbytes * 3;
+    table[1] = src;
+    table[2] = src + subbytes;
+    table[4] = src + subbytes * 2;
+    table[8] = src + subbytes * 3;
+
+    memxor_set(table[3], table[1], table[2], subbytes);
+    memxor_set(table[6], table[2], table[4], subbytes);
+    memxor_set(table[5], table[1], table[4], subbytes);
+    memxor_set(table[7], table[1], table[6], subbytes);
+    memxor_set(table[9], table[1], table[8], subbytes);
+    memxor_set(table[12], table[4], table[8], subbytes);
+    memxor_set(table[10], table[2], table[8], subbytes);
+    memxor_set(table[11], table[3], table[8], subbytes);
+    memxor_set(table[13], table[1], table[12], subbytes);
+    memxor_set(table[14], table[2], table[12], subbytes);
+    memxor_set(table[15], table[3], table[12], subbytes);
+  }
 
-      memxor_set(table[3], table[1], table[2], subbytes);
-      memxor_set(table[6], table[2], table[4], subbytes);
-      memxor_set(table[5], table[1], table[4], subbytes);
-      memxor_set(table[7], table[1], table[6], subbytes);
-      memxor_set(table[9], table[1], table[8], subbytes);
-      memxor_set(table[12], table[4], table[8], subbytes);
-      memxor_set(table[10], table[2], table[8], subbytes);
-      memxor_set(table[11], table[3], table[8], subbytes);
-      memxor_set(table[13], table[1], table[12], subbytes);
-      memxor_set(table[14], table[2], table[12], subbytes);
-      memxor_set(table[15], table[3], table[12], subbytes);
+  // For each of the rows,
+  const u8 *row = column;
+  u8 *dest = out;
+  for (int y = 1; y < m; ++y, row += stride) {
+    u8 slice = row[0];
+
+    // Generate 8x8 submatrix and XOR in bits as needed
+    for (int bit_y = 0;; ++bit_y) {
+      int low = slice & 15;
+      int high = slice >> 4;
+
+      // Add
+      if (low && high) {
+        memxor_add(dest, tables[0][low], tables[1][high], subbytes);
+      } else if (low) {
+        memxor(dest, tables[0][low], subbytes);
+      } else {
+        memxor(dest, tables[1][high], subbytes);
+      }
+      dest += subbytes;
+
+      if (bit_y >= 7) {
+        break;
+      }
+
+      slice = GFC256Multiply(slice, 2);
     }
+  }
+}
 
-    // For each of the rows,
+// Non-windowed version of encoder, for one column
+static void bitmatrix_encode_column(int m, const u8 *column, int stride,
+                                    const u8 *src, u8 *out, int block_bytes) {
+  const int subbytes = block_bytes >> 3;
+
+  // For each remaining row to generate,
+  for (int y = 1; y < m; ++y, column += stride, out += block_bytes) {
+    u8 slice = column[0];
     u8 *dest = out;
-    for (int y = 1; y < m; ++y, row += stride) {
-      u8 slice = row[0];
 
-      // Generate 8x8 submatrix and XOR in bits as needed
-      for (int bit_y = 0;; ++bit_y) {
-        int low = slice & 15;
-        int high = slice >> 4;
+    DLOG(cout << "ENCODE: Using " << (int)slice << " at row " << y << endl;)
 
-        // Add
-        if (low && high) {
-          memxor_add(dest, tables[0][low], tables[1][high], subbytes);
-        } else if (low) {
-          memxor(dest, tables[0][low], subbytes);
-        } else {
-          memxor(dest, tables[1][high], subbytes);
-        }
-        dest += subbytes;
+    // Generate 8x8 submatrix and XOR in bits as needed
+    for (int bit_y = 0;; ++bit_y) {
+      const u8 *src_x = src;
 
-        if (bit_y >= 7) {
-          break;
+      for (int bit_x = 0; bit_x < 8; ++bit_x, src_x += subbytes) {
+        if (slice & (1 << bit_x)) {
+          memxor(dest, src_x, subbytes);
         }
+      }
 
-        slice = GFC256Multiply(slice, 2);
+      if (bit_y >= 7) {
+        break;
       }
+
+      slice = GFC256Multiply(slice, 2);
+      dest += subbytes;
     }
   }
-
-  delete[] precomp;
 }
 
-extern "C" int cauchy_256_encode(int k, int m, const u8 *data[],
-                                 void *vrecovery_blocks, int block_bytes) {
-  u8 *recovery_blocks = reinterpret_cast<u8 *>(vrecovery_blocks);
-
-  // If only one input block,
-  if (k <= 1) {
-    // For each output block,
-    for (int ii = 0; ii < m; ++ii, recovery_blocks += block_bytes) {
-      // Copy it directly to output
-      memcpy(recovery_blocks, data[0], static_cast<size_t>(block_bytes));
+// Vectorized encoder: scratch holds the bitsliced column, then the m - 1
+// row sums in the symbol domain
+static void muladd_encode_column(int m, const u8 *column, int stride,
+                                 const u8 *data, u8 *scratch, int block_bytes,
+                                 bool first) {
+  u8 *symbols = scratch;
+  u8 *sum = scratch + block_bytes;
+
+  membitslice(symbols, data, block_bytes);
+
+  // Accumulate into each of the rows
+  const u8 *row = column;
+  for (int y = 1; y < m; ++y, row += stride, sum += block_bytes) {
+    if (first) {
+      memmul(sum, GFC256MulAddTable(row[0]), symbols, block_bytes);
+    } else {
+      memmuladd(sum, GFC256MulAddTable(row[0]), symbols, block_bytes);
     }
-
-    return 0;
   }
+}
 
-  // XOR all input blocks together
-  memxor_set(recovery_blocks, data[0], data[1], block_bytes);
-
-  for (int x = 2; x < k; ++x) {
-    memxor(recovery_blocks, data[x], block_bytes);
-  }
+// Rows taken from the Cauchy matrix, that is all but the XOR row 0
+static CAT_INLINE int matrix_rows(const EncoderState &state) {
+  return state.rows - (state.first_row == 0 ? 1 : 0);
+}
 
-  // If only one recovery block needed,
-  if (m == 1) {
-    // We're already done!
+// Scratch must hold encode_scratch_bytes(matrix_rows + 1, block_bytes) unless
+// k <= 1 or no matrix rows are wanted, which need none
+static int encode_begin(EncoderState &state, int k, int m, int first_row,
+                        int rows, void *recovery_blocks, int block_bytes,
+                        u8 *scratch) {
+  state.k = k;
+  state.m = m;
+  state.first_row = first_row;
+  state.rows = rows;
+  state.block_bytes = block_bytes;
+  state.added = 0;
+  state.out = reinterpret_cast<u8 *>(recovery_blocks);
+  state.matrix = 0;
+  state.matrix_ref.reset();
+  state.stride = 0;
+  state.scratch = scratch;
+  state.muladd = false;
+
+  // Copies and XOR do not need the matrix
+  if ((k <= 1) || (matrix_rows(state) == 0)) {
     return 0;
   }
 
   // Otherwise there is a restriction on what inputs we can handle
   if ((k + m > 256) || (block_bytes % 8 != 0)) {
+    state.out = 0;
     return -1;
   }
 
   GFC256Init();
 
-  // Generate Cauchy matrix
-  int stride;
-  u8 stack_space[CAT_CAUCHY_MATRIX_STACK_SIZE];
-  bool dynamic_matrix;
-  const u8 *matrix = cauchy_matrix(k, m, stride, stack_space, dynamic_matrix);
+  // Look up Cauchy matrix
+  state.matrix = cached_cauchy_matrix(k, m, state.stride, state.matrix_ref);
+  state.muladd = memmuladd_accelerated();
 
   // The first 8 rows of the bitmatrix are always the same, 8x8 identity
   // matrices all the way across.  So we don't even bother generating those
-  // with a bitmatrix.  In fact the initial XOR for m=1 case has already
-  // taken care of these bitmatrix rows.
+  // with a bitmatrix: row 0 is just the XOR of all the blocks.
 
-  // Start on the second recovery block
-  u8 *out = recovery_blocks + block_bytes;
-  const int subbytes = block_bytes >> 3;
+  if (!state.muladd) {
+    // Clear output buffer after row 0
+    memset(state.out + block_bytes * (rows - matrix_rows(state)), 0,
+           static_cast<size_t>(block_bytes * matrix_rows(state)));
+  }
 
-  // Clear output buffer
-  memset(out, 0, static_cast<size_t>(block_bytes * (m - 1)));
+  return 0;
+}
 
-  // If the number of symbols to generate gets larger,
-  if (m > 4) {
-    // Start using a windowed approach to encoding
-    win_encode(k, m, matrix, stride, data, out, subbytes);
-  } else {
-    const u8 *row = matrix;
+static void encode_add(EncoderState &state, int index, const u8 *data) {
+  const int block_bytes = state.block_bytes;
+  const bool first = (state.added++ == 0);
+  u8 *out = state.out;
 
-    // For each remaining row to generate,
-    for (int y = 1; y < m; ++y, row += stride, out += block_bytes) {
-      const u8 *column = row;
+  // If only one input block,
+  if (state.k <= 1) {
+    // Copy it directly to each output block
+    for (int ii = 0; ii < state.rows; ++ii, out += block_bytes) {
+      memcpy(out, data, static_cast<size_t>(block_bytes));
+    }
 
-      // For each symbol column,
-      for (int x = 0; x < k; ++x, ++column) {
-        const u8 *src = data[x];
-        u8 slice = column[0];
-        u8 *dest = out;
+    return;
+  }
 
-        DLOG(cout << "ENCODE: Using " << (int)slice << " at " << x << ", " << y
-                  << endl;)
+  // XOR all input blocks together
+  if (state.first_row == 0) {
+    if (first) {
+      memcpy(out, data, static_cast<size_t>(block_bytes));
+    } else {
+      memxor(out, data, block_bytes);
+    }
 
-        // Generate 8x8 submatrix and XOR in bits as needed
-        for (int bit_y = 0;; ++bit_y) {
-          const u8 *src_x = src;
+    out += block_bytes;
+  }
 
-          for (int bit_x = 0; bit_x < 8; ++bit_x, src_x += subbytes) {
-            if (slice & (1 << bit_x)) {
-              memxor(dest, src_x, subbytes);
-            }
-          }
+  // If only the XOR row was needed, we're already done!
+  const int rows = matrix_rows(state);
+  if (rows == 0) {
+    return;
+  }
 
-          if (bit_y >= 7) {
-            break;
-          }
+  // The column encoders start at matrix row 1 and generate m - 1 rows
+  const int first_matrix_row = state.first_row > 0 ? state.first_row : 1;
+  const u8 *column =
+      state.matrix + (first_matrix_row - 1) * state.stride + index;
+
+  if (state.muladd) {
+    muladd_encode_column(rows + 1, column, state.stride, data, state.scratch,
+                         block_bytes, first);
+  } else if (rows + 1 > 4) {
+    // If the number of symbols to generate gets larger, start using a
+    // windowed approach to encoding
+    win_encode_column(rows + 1, column, state.stride, data, out,
+                      block_bytes >> 3, state.scratch);
+  } else {
+    bitmatrix_encode_column(rows + 1, column, state.stride, data, out,
+                            block_bytes);
+  }
+}
 
-          slice = GFC256Multiply(slice, 2);
-          dest += subbytes;
-        }
-      }
+// Returns 0 once all k blocks were added
+static int encode_end(EncoderState &state) {
+  if (state.added != state.k) {
+    return -1;
+  }
+
+  if (state.muladd) {
+    const int block_bytes = state.block_bytes;
+    const int rows = matrix_rows(state);
+    const u8 *sums = state.scratch + block_bytes;
+    u8 *out = state.out + block_bytes * (state.rows - rows);
+
+    for (int y = 0; y < rows; ++y, sums += block_bytes, out += block_bytes) {
+      memunbitslice(out, sums, block_bytes);
+    }
+  }
+
+  return 0;
+}
+
+static int encode(int k, int m, const u8 *data[], void *recovery_blocks,
+                  int block_bytes, Cauchy256Workspace *workspace) {
+  ScratchBuffer scratch_buffer;
+  u8 *scratch = 0;
+
+  if ((k > 1) && (m > 1)) {
+    scratch =
+        scratch_buffer.get(workspace, encode_scratch_bytes(m, block_bytes));
+    if (!scratch) {
+      return -1;
     }
   }
 
-  if (dynamic_matrix) {
-    delete[] matrix;
+  EncoderState state;
+  if (encode_begin(state, k, m, 0, m, recovery_blocks, block_bytes, scratch)) {
+    return -1;
+  }
+
+  for (int x = 0; x < k; ++x) {
+    encode_add(state, x, data[x]);
   }
 
+  return encode_end(state);
+}
+
+extern "C" int cauchy_256_encode(int k, int m, const u8 *data[],
+                                 void *recovery_blocks, int block_bytes) {
+  return encode(k, m, data, recovery_blocks, block_bytes, 0);
+}
+
+extern "C" int cauchy_256_encode_ws(int k, int m, const u8 *data[],
+                                    void *recovery_blocks, int block_bytes,
+                                    Cauchy256Workspace *workspace) {
+  if (!workspace || block_bytes > workspace->block_bytes) {
+    return -1;
+  }
+
+  return encode(k, m, data, recovery_blocks, block_bytes, workspace);
+}
+
+extern "C" int cauchy_256_encode_begin(int k, int m, void *recovery_blocks,
+                                       int block_bytes,
+                                       Cauchy256Workspace *workspace) {
+  if (!workspace || (k < 1) || (m < 1) ||
+      (block_bytes > workspace->block_bytes) ||
+      (encode_scratch_bytes(m, block_bytes) > workspace->scratch_bytes)) {
+    return -1;
+  }
+
+  return encode_begin(workspace->encoder, k, m, 0, m, recovery_blocks,
+                      block_bytes, reinterpret_cast<u8 *>(workspace->scratch));
+}
+
+extern "C" int cauchy_256_encode_rows(int k, int m, int first_row,
+                                      int row_count, const u8 *data[],
+                                      void *recovery_blocks, int block_bytes,
+                                      Cauchy256Workspace *workspace) {
+  if (!workspace || (k < 1) || (first_row < 0) || (row_count < 1) ||
+      (first_row + row_count > m) || (block_bytes > workspace->block_bytes) ||
+      (encode_scratch_bytes(row_count + 1, block_bytes) >
+       workspace->scratch_bytes)) {
+    return -1;
+  }
+
+  EncoderState state;
+  if (encode_begin(state, k, m, first_row, row_count, recovery_blocks,
+                   block_bytes, reinterpret_cast<u8 *>(workspace->scratch))) {
+    return -1;
+  }
+
+  for (int x = 0; x < k; ++x) {
+    encode_add(state, x, data[x]);
+  }
+
+  return encode_end(state);
+}
+
+extern "C" int cauchy_256_encode_add(Cauchy256Workspace *workspace, int index,
+                                     const u8 *data) {
+  EncoderState &state = workspace->encoder;
+
+  if (!state.out || (index < 0) || (index >= state.k) ||
+      (state.added >= state.k)) {
+    return -1;
+  }
+
+  encode_add(state, index, data);
   return 0;
 }
+
+extern "C" int cauchy_256_encode_end(Cauchy256Workspace *workspace) {
+  EncoderState &state = workspace->encoder;
+
+  if (!state.out) {
+    return -1;
+  }
+
+  const int result = encode_end(state);
+  state.out = 0;
+  return result;
+}
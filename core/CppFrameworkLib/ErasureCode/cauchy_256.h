@@ -108,6 +108,165 @@ extern int cauchy_256_encode(int k, int m, const unsigned char *data_ptrs[],
  */
 extern int cauchy_256_decode(int k, int m, Block *blocks, int block_bytes);
 
+/*
+ * Allocation-free encode and decode
+ *
+ * The plain functions above take temporary memory from the stack or, for
+ * larger inputs, from the heap on every call.  A workspace holds all of it
+ * instead, sized for any k + m <= 256 with blocks up to block_bytes.
+ *
+ * The _ws() variants behave exactly like their counterparts and do not
+ * allocate once the matrices for (k, m) are cached (see
+ * cauchy_256_cache_warm() below).  A workspace must not be used by two
+ * threads at once.
+ *
+ * cauchy_256_workspace_create() returns 0 if block_bytes is not a positive
+ * multiple of 8.
+ */
+typedef struct _Cauchy256Workspace Cauchy256Workspace;
+
+extern Cauchy256Workspace *cauchy_256_workspace_create(int block_bytes);
+extern void cauchy_256_workspace_free(Cauchy256Workspace *workspace);
+
+extern int cauchy_256_encode_ws(int k, int m,
+                                const unsigned char *data_ptrs[],
+                                void *recovery_blocks, int block_bytes,
+                                Cauchy256Workspace *workspace);
+extern int cauchy_256_decode_ws(int k, int m, Block *blocks, int block_bytes,
+                                Cauchy256Workspace *workspace);
+
+/*
+ * Batch decode
+ *
+ * Decodes "count" block sets of the same k, m and block size, each laid out
+ * as for cauchy_256_decode().  Consecutive sets that have the same row at
+ * every position share the matrix inverse and are decoded in one pass, so
+ * sort sets by their rows to get the most out of it.  Sets with other rows
+ * are decoded one by one.
+ *
+ * Returns 0 if every set was decoded, and any other code if one failed.
+ */
+extern int cauchy_256_decode_batch_ws(int k, int m, Block **block_sets,
+                                      int count, int block_bytes,
+                                      Cauchy256Workspace *workspace);
+
+/*
+ * Incremental encode
+ *
+ * Produces the same recovery blocks as cauchy_256_encode(), but takes the
+ * data blocks one at a time, so each block can be sent while the rest of the
+ * message is still being produced.  All the work for a block happens in
+ * cauchy_256_encode_add(); cauchy_256_encode_end() only finishes up.
+ *
+ * Call cauchy_256_encode_begin() with k, m and the output buffer, then
+ * cauchy_256_encode_add() exactly once for each index 0..k-1 in any order.
+ * The recovery blocks are valid after cauchy_256_encode_end() returns 0.
+ * The data buffers are not referenced after cauchy_256_encode_add() returns.
+ *
+ * The workspace holds the encoder state, so it can only run one incremental
+ * encode at a time, and must not be used for anything else in between.
+ *
+ * Returns 0 on success, and any other code indicates failure.
+ */
+extern int cauchy_256_encode_begin(int k, int m, void *recovery_blocks,
+                                   int block_bytes,
+                                   Cauchy256Workspace *workspace);
+extern int cauchy_256_encode_add(Cauchy256Workspace *workspace, int index,
+                                 const unsigned char *data);
+extern int cauchy_256_encode_end(Cauchy256Workspace *workspace);
+
+/*
+ * Encode selected recovery rows
+ *
+ * Produces recovery blocks first_row .. first_row + row_count - 1 of
+ * cauchy_256_encode(k, m) without computing the others, stored end-to-end in
+ * recovery_blocks.  With a large m this works as a rateless code: the
+ * encoder hands out further rows whenever more redundancy is wanted, and the
+ * decoder takes any of them for (k, m) as usual.
+ *
+ * Returns 0 on success, and any other code indicates failure.
+ */
+extern int cauchy_256_encode_rows(int k, int m, int first_row, int row_count,
+                                  const unsigned char *data_ptrs[],
+                                  void *recovery_blocks, int block_bytes,
+                                  Cauchy256Workspace *workspace);
+
+/*
+ * Progressive decode
+ *
+ * Does the work of cauchy_256_decode() while blocks arrive, so little is
+ * left to do once the last needed block is in.  Most of the decoding time
+ * goes into eliminating the received original rows from the recovery rows,
+ * and that can happen one block at a time:
+ *
+ * cauchy_256_reduce_init() converts a received block into an internal form
+ * in place.  Its contents are only meaningful to the other reduce functions
+ * afterwards, so convert a copy of original blocks that are still needed.
+ *
+ * cauchy_256_reduce_add() eliminates each of the original_count converted
+ * original blocks (row < k) from each of the recovery_count converted
+ * recovery blocks (row >= k).  Each original must be added to a recovery
+ * block at most once.
+ *
+ * cauchy_256_reduce_solve() takes as many converted recovery blocks as there
+ * are erased rows, each with all received originals added, and the erased
+ * rows in erasures[].  On return recovery[i] holds the original data of row
+ * erasures[i], and its row is set accordingly.
+ *
+ * Requires k > 1.  The workspace is only scratch space here and may be
+ * shared by any number of messages in progress, just not across threads.
+ *
+ * Returns 0 on success, and any other code indicates failure.
+ */
+extern int cauchy_256_reduce_init(int k, int m, Block *block, int block_bytes,
+                                  Cauchy256Workspace *workspace);
+extern int cauchy_256_reduce_add(int k, int m, const Block *original,
+                                 int original_count, Block *recovery,
+                                 int recovery_count, int block_bytes,
+                                 Cauchy256Workspace *workspace);
+extern int cauchy_256_reduce_solve(int k, int m, Block *recovery,
+                                   int recovery_count,
+                                   const unsigned char *erasures,
+                                   int block_bytes,
+                                   Cauchy256Workspace *workspace);
+
+/*
+ * Cauchy matrix cache
+ *
+ * The matrix for each (k, m) is generated on first use and kept until more
+ * recently used ones take its place, up to 8 MB of them.  Both encoder and
+ * decoder use it.
+ *
+ * cauchy_256_cache_warm() generates the matrix ahead of time, so the first
+ * message with that shape does not pay for it.  The cache is thread-safe.
+ *
+ * Returns 0 on success, and any other code indicates invalid parameters.
+ */
+extern int cauchy_256_cache_warm(int k, int m);
+
+/*
+ * Decode matrix cache
+ *
+ * The decoder remembers the inverted matrix for the most recent erasure
+ * patterns (which rows were lost and which recovery rows replaced them).
+ * Only patterns of 16 or more erasures are cached, below that inverting is
+ * about as cheap as a lookup.  The default size is 64 patterns, rounded up
+ * to a multiple of 4, and 0 disables the cache.
+ *
+ * Returns 0 on success, and any other code indicates an invalid size.
+ */
+extern int cauchy_256_cache_set_decode_size(int entries);
+
+typedef struct _Cauchy256CacheStats {
+  unsigned long long matrixHits;
+  unsigned long long matrixMisses;
+  unsigned long long decodeHits;
+  unsigned long long decodeMisses;
+} Cauchy256CacheStats;
+
+// Counters since process start
+extern void cauchy_256_cache_stats(Cauchy256CacheStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
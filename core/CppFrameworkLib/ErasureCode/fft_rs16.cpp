@@ -0,0 +1,803 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "fft_rs16.h"
+#include "CpuFeatures.hpp"
+#include "MemXOR.hpp"
+
+#include <string.h>
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+#include <immintrin.h>
+#endif
+
+using namespace cat;
+
+//// Field
+
+namespace {
+
+const unsigned kBits = 16;
+const unsigned kOrder = 65536;
+const unsigned kModulus = 65535;
+const unsigned kPolynomial = 0x1002D;
+
+// Each element satisfies v[i]^2 + v[i] = v[i - 1], which is what keeps the
+// formal derivative in the FFT basis down to XORs
+const u16 kCantorBasis[kBits] = {0x0001, 0xACCA, 0x3C0E, 0x163E,
+                                 0xC582, 0xED2E, 0x914C, 0x4012,
+                                 0x6C98, 0x10D8, 0x6A72, 0xB900,
+                                 0xFDB8, 0xFB34, 0xFF38, 0x991E};
+
+struct Tables {
+  // Elements are stored in Cantor basis coordinates
+  u16 log[kOrder];
+  u16 exp[kOrder];
+
+  // FFT skew factors as logarithms, kModulus stands for zero
+  u16 skew[kOrder];
+
+  // Walsh-Hadamard transform of the log table, folded to every power of two
+  // length n and stored at [n, 2n)
+  u16 log_walsh[2 * kOrder];
+};
+
+Tables tables_storage;
+
+// Addition modulo kModulus, where kModulus and 0 are the same
+CAT_INLINE u16 add_mod(unsigned a, unsigned b) {
+  const unsigned sum = a + b;
+  return static_cast<u16>(sum + (sum >> kBits));
+}
+
+CAT_INLINE u16 sub_mod(unsigned a, unsigned b) {
+  const unsigned dif = a - b;
+  return static_cast<u16>(dif + (dif >> kBits));
+}
+
+// a * exp(log_b)
+CAT_INLINE u16 mul_log(const Tables &t, u16 a, u16 log_b) {
+  return a ? t.exp[add_mod(t.log[a], log_b)] : 0;
+}
+
+// Walsh-Hadamard transform over the integers modulo kModulus
+void fwht(u16 *data, unsigned size) {
+  for (unsigned width = 1; width < size; width <<= 1) {
+    for (unsigned j = 0; j < size; j += width * 2) {
+      for (unsigned i = j; i < j + width; ++i) {
+        const u16 a = data[i];
+        const u16 b = data[i + width];
+        data[i] = add_mod(a, b);
+        data[i + width] = sub_mod(a, b);
+      }
+    }
+  }
+}
+
+bool build_tables(Tables &t) {
+  // Logarithms in the polynomial basis first
+  unsigned state = 1;
+  for (unsigned i = 0; i < kModulus; ++i) {
+    t.exp[state] = static_cast<u16>(i);
+    state <<= 1;
+    if (state >= kOrder) {
+      state ^= kPolynomial;
+    }
+  }
+  t.exp[0] = kModulus;
+
+  // Then renumber the elements by their Cantor basis coordinates
+  t.log[0] = 0;
+  for (unsigned i = 0; i < kBits; ++i) {
+    const unsigned width = 1u << i;
+    for (unsigned j = 0; j < width; ++j) {
+      t.log[j + width] = t.log[j] ^ kCantorBasis[i];
+    }
+  }
+  for (unsigned i = 0; i < kOrder; ++i) {
+    t.log[i] = t.exp[t.log[i]];
+  }
+  for (unsigned i = 0; i < kOrder; ++i) {
+    t.exp[t.log[i]] = static_cast<u16>(i);
+  }
+  t.exp[kModulus] = t.exp[0];
+
+  // Skew factors of the subspace polynomials, see the paper
+  u16 temp[kBits - 1];
+  for (unsigned i = 1; i < kBits; ++i) {
+    temp[i - 1] = static_cast<u16>(1u << i);
+  }
+
+  for (unsigned m = 0; m < kBits - 1; ++m) {
+    const unsigned step = 1u << (m + 1);
+
+    t.skew[(1u << m) - 1] = 0;
+
+    for (unsigned i = m; i < kBits - 1; ++i) {
+      const unsigned s = 1u << (i + 1);
+
+      for (unsigned j = (1u << m) - 1; j < s; j += step) {
+        t.skew[j + s] = t.skew[j] ^ temp[i];
+      }
+    }
+
+    temp[m] = static_cast<u16>(
+        kModulus - t.log[mul_log(t, temp[m], t.log[temp[m] ^ 1])]);
+
+    for (unsigned i = m + 1; i < kBits - 1; ++i) {
+      const u16 sum = add_mod(t.log[temp[i] ^ 1], temp[m]);
+      temp[i] = mul_log(t, temp[i], sum);
+    }
+  }
+
+  for (unsigned i = 0; i < kOrder; ++i) {
+    t.skew[i] = t.log[t.skew[i]];
+  }
+
+  // The decoder only transforms the first n error locations.  For those the
+  // transform of length kOrder equals the one of length n applied to the
+  // log table summed over its n-element cosets.
+  u16 *full = t.log_walsh + kOrder;
+  memcpy(full, t.log, kOrder * sizeof(u16));
+  full[0] = 0;
+  fwht(full, kOrder);
+
+  for (unsigned n = kOrder / 2; n >= 1; n >>= 1) {
+    const u16 *wide = t.log_walsh + n * 2;
+    u16 *folded = t.log_walsh + n;
+
+    for (unsigned i = 0; i < n; ++i) {
+      folded[i] = add_mod(wide[i], wide[i + n]);
+    }
+  }
+
+  return true;
+}
+
+const Tables &tables() {
+  static const bool ready = build_tables(tables_storage);
+  (void)ready;
+  return tables_storage;
+}
+
+//// Buffer kernels
+
+// Products of one constant with every value of each nibble of a symbol,
+// split into the low and high bytes of the result
+struct MulTable {
+  u8 lo[4][16];
+  u8 hi[4][16];
+};
+
+void build_mul_table(const Tables &t, u16 log_m, MulTable &table) {
+  for (int nibble = 0; nibble < 4; ++nibble) {
+    u16 products[16];
+    products[0] = 0;
+
+    for (int bit = 0; bit < 4; ++bit) {
+      const int width = 1 << bit;
+      const u16 product =
+          mul_log(t, static_cast<u16>(1u << (nibble * 4 + bit)), log_m);
+
+      for (int j = 0; j < width; ++j) {
+        products[j + width] = products[j] ^ product;
+      }
+    }
+
+    for (int j = 0; j < 16; ++j) {
+      table.lo[nibble][j] = static_cast<u8>(products[j]);
+      table.hi[nibble][j] = static_cast<u8>(products[j] >> 8);
+    }
+  }
+}
+
+// Tables for the skew factors of the first kSkewTables codeword positions,
+// which is every factor of a codeword up to that length.  Building them per
+// butterfly group would cost more than the butterflies in the lower layers.
+const unsigned kSkewTables = 4096;
+
+MulTable skew_tables_storage[kSkewTables];
+
+bool build_skew_tables(const Tables &t) {
+  for (unsigned i = 0; i < kSkewTables; ++i) {
+    build_mul_table(t, t.skew[i], skew_tables_storage[i]);
+  }
+  return true;
+}
+
+// Table for skew factor i, null if the factor is zero
+const MulTable *skew_table(const Tables &t, unsigned i, MulTable &scratch) {
+  static const bool ready = build_skew_tables(t);
+  (void)ready;
+
+  if (t.skew[i] == kModulus) {
+    return nullptr;
+  }
+  if (i < kSkewTables) {
+    return &skew_tables_storage[i];
+  }
+
+  build_mul_table(t, t.skew[i], scratch);
+  return &scratch;
+}
+
+// What a kernel does with blocks x and y and the constant c:
+//   kMul:  x = y * c
+//   kFft:  x ^= y * c, then y ^= x
+//   kIfft: y ^= x, then x ^= y * c
+// The butterflies are fused so each block pair is only streamed once.
+enum KernelOp { kMul, kFft, kIfft };
+
+CAT_INLINE void mul_symbol(u8 &rlo, u8 &rhi, u8 lo, u8 hi,
+                           const MulTable &table) {
+  rlo = table.lo[0][lo & 15] ^ table.lo[1][lo >> 4] ^ table.lo[2][hi & 15] ^
+        table.lo[3][hi >> 4];
+  rhi = table.hi[0][lo & 15] ^ table.hi[1][lo >> 4] ^ table.hi[2][hi & 15] ^
+        table.hi[3][hi >> 4];
+}
+
+template <int Op>
+void kernel_scalar(u8 *CAT_RESTRICT x, u8 *CAT_RESTRICT y,
+                   const MulTable &table, int bytes) {
+  for (int ii = 0; ii < bytes; ii += 2) {
+    u8 rlo, rhi;
+
+    if (Op == kIfft) {
+      y[ii] ^= x[ii];
+      y[ii + 1] ^= x[ii + 1];
+    }
+
+    mul_symbol(rlo, rhi, y[ii], y[ii + 1], table);
+
+    if (Op == kMul) {
+      x[ii] = rlo;
+      x[ii + 1] = rhi;
+    } else {
+      x[ii] ^= rlo;
+      x[ii + 1] ^= rhi;
+    }
+
+    if (Op == kFft) {
+      y[ii] ^= x[ii];
+      y[ii + 1] ^= x[ii + 1];
+    }
+  }
+}
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+
+// Symbols are split into a vector of low bytes and one of high bytes, after
+// which each of the four nibbles is a PSHUFB lookup per result byte
+
+#define CAT_SSE_ISA "sse2,ssse3"
+
+// Products of symbols 0-7 (from a) and 8-15 (from b), in the same layout
+CAT_TARGET(CAT_SSE_ISA)
+CAT_INLINE void mul16_ssse3(__m128i &a, __m128i &b, const __m128i *tables) {
+  const __m128i split =
+      _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  const __m128i mask = _mm_set1_epi8(15);
+
+  const __m128i sa = _mm_shuffle_epi8(a, split);
+  const __m128i sb = _mm_shuffle_epi8(b, split);
+
+  const __m128i lo = _mm_unpacklo_epi64(sa, sb);
+  const __m128i hi = _mm_unpackhi_epi64(sa, sb);
+  const __m128i n0 = _mm_and_si128(lo, mask);
+  const __m128i n1 = _mm_and_si128(_mm_srli_epi64(lo, 4), mask);
+  const __m128i n2 = _mm_and_si128(hi, mask);
+  const __m128i n3 = _mm_and_si128(_mm_srli_epi64(hi, 4), mask);
+
+  __m128i rlo = _mm_xor_si128(_mm_shuffle_epi8(tables[0], n0),
+                              _mm_shuffle_epi8(tables[1], n1));
+  rlo = _mm_xor_si128(rlo, _mm_shuffle_epi8(tables[2], n2));
+  rlo = _mm_xor_si128(rlo, _mm_shuffle_epi8(tables[3], n3));
+  __m128i rhi = _mm_xor_si128(_mm_shuffle_epi8(tables[4], n0),
+                              _mm_shuffle_epi8(tables[5], n1));
+  rhi = _mm_xor_si128(rhi, _mm_shuffle_epi8(tables[6], n2));
+  rhi = _mm_xor_si128(rhi, _mm_shuffle_epi8(tables[7], n3));
+
+  a = _mm_unpacklo_epi8(rlo, rhi);
+  b = _mm_unpackhi_epi8(rlo, rhi);
+}
+
+// One or two vectors of x and y
+template <int Op>
+CAT_TARGET(CAT_SSE_ISA)
+CAT_INLINE void step_ssse3(__m128i *x, __m128i *y, int vectors,
+                           const __m128i *tables) {
+  __m128i y0 = _mm_loadu_si128(y);
+  __m128i y1 = vectors > 1 ? _mm_loadu_si128(y + 1) : y0;
+  __m128i x0, x1;
+
+  if (Op != kMul) {
+    x0 = _mm_loadu_si128(x);
+    x1 = vectors > 1 ? _mm_loadu_si128(x + 1) : x0;
+  }
+
+  if (Op == kIfft) {
+    y0 = _mm_xor_si128(y0, x0);
+    y1 = _mm_xor_si128(y1, x1);
+    _mm_storeu_si128(y, y0);
+    if (vectors > 1) {
+      _mm_storeu_si128(y + 1, y1);
+    }
+  }
+
+  __m128i p0 = y0, p1 = y1;
+  mul16_ssse3(p0, p1, tables);
+
+  if (Op == kMul) {
+    x0 = p0;
+    x1 = p1;
+  } else {
+    x0 = _mm_xor_si128(x0, p0);
+    x1 = _mm_xor_si128(x1, p1);
+  }
+  _mm_storeu_si128(x, x0);
+  if (vectors > 1) {
+    _mm_storeu_si128(x + 1, x1);
+  }
+
+  if (Op == kFft) {
+    _mm_storeu_si128(y, _mm_xor_si128(y0, x0));
+    if (vectors > 1) {
+      _mm_storeu_si128(y + 1, _mm_xor_si128(y1, x1));
+    }
+  }
+}
+
+// Everything below 32 bytes the wider loops leave over
+template <int Op>
+CAT_TARGET(CAT_SSE_ISA)
+CAT_INLINE void tail_ssse3(u8 *CAT_RESTRICT x, u8 *CAT_RESTRICT y,
+                           const MulTable &table, const __m128i *tables,
+                           int bytes) {
+  for (; bytes >= 32; x += 32, y += 32, bytes -= 32) {
+    step_ssse3<Op>(reinterpret_cast<__m128i *>(x),
+                   reinterpret_cast<__m128i *>(y), 2, tables);
+  }
+
+  if (bytes >= 16) {
+    step_ssse3<Op>(reinterpret_cast<__m128i *>(x),
+                   reinterpret_cast<__m128i *>(y), 1, tables);
+    x += 16;
+    y += 16;
+    bytes -= 16;
+  }
+
+  if (bytes > 0) {
+    kernel_scalar<Op>(x, y, table, bytes);
+  }
+}
+
+template <int Op>
+CAT_TARGET(CAT_SSE_ISA)
+void kernel_ssse3(u8 *CAT_RESTRICT x, u8 *CAT_RESTRICT y,
+                  const MulTable &table, int bytes) {
+  __m128i tables[8];
+  for (int ii = 0; ii < 4; ++ii) {
+    tables[ii] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.lo[ii]));
+    tables[ii + 4] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.hi[ii]));
+  }
+
+  tail_ssse3<Op>(x, y, table, tables, bytes);
+}
+
+#define CAT_AVX2_ISA "sse2,ssse3,avx,avx2"
+
+// Same as the SSSE3 version on both 128-bit lanes: the first vector holds
+// symbols 0-7 and 8-15, the second 16-23 and 24-31, and unpacking restores
+// exactly that order
+CAT_TARGET(CAT_AVX2_ISA)
+CAT_INLINE void mul32_avx2(__m256i &a, __m256i &b, const __m256i *tables) {
+  const __m256i split = _mm256_setr_epi8(
+      0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10,
+      12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  const __m256i mask = _mm256_set1_epi8(15);
+
+  const __m256i sa = _mm256_shuffle_epi8(a, split);
+  const __m256i sb = _mm256_shuffle_epi8(b, split);
+
+  const __m256i lo = _mm256_unpacklo_epi64(sa, sb);
+  const __m256i hi = _mm256_unpackhi_epi64(sa, sb);
+  const __m256i n0 = _mm256_and_si256(lo, mask);
+  const __m256i n1 = _mm256_and_si256(_mm256_srli_epi64(lo, 4), mask);
+  const __m256i n2 = _mm256_and_si256(hi, mask);
+  const __m256i n3 = _mm256_and_si256(_mm256_srli_epi64(hi, 4), mask);
+
+  __m256i rlo = _mm256_xor_si256(_mm256_shuffle_epi8(tables[0], n0),
+                                 _mm256_shuffle_epi8(tables[1], n1));
+  rlo = _mm256_xor_si256(rlo, _mm256_shuffle_epi8(tables[2], n2));
+  rlo = _mm256_xor_si256(rlo, _mm256_shuffle_epi8(tables[3], n3));
+  __m256i rhi = _mm256_xor_si256(_mm256_shuffle_epi8(tables[4], n0),
+                                 _mm256_shuffle_epi8(tables[5], n1));
+  rhi = _mm256_xor_si256(rhi, _mm256_shuffle_epi8(tables[6], n2));
+  rhi = _mm256_xor_si256(rhi, _mm256_shuffle_epi8(tables[7], n3));
+
+  a = _mm256_unpacklo_epi8(rlo, rhi);
+  b = _mm256_unpackhi_epi8(rlo, rhi);
+}
+
+template <int Op>
+CAT_TARGET(CAT_AVX2_ISA)
+void kernel_avx2(u8 *CAT_RESTRICT x, u8 *CAT_RESTRICT y,
+                 const MulTable &table, int bytes) {
+  __m256i tables[8];
+  __m128i narrow[8];
+  for (int ii = 0; ii < 4; ++ii) {
+    narrow[ii] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.lo[ii]));
+    narrow[ii + 4] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(table.hi[ii]));
+  }
+  for (int ii = 0; ii < 8; ++ii) {
+    tables[ii] = _mm256_broadcastsi128_si256(narrow[ii]);
+  }
+
+  __m256i *vx = reinterpret_cast<__m256i *>(x);
+  __m256i *vy = reinterpret_cast<__m256i *>(y);
+  for (; bytes >= 64; bytes -= 64, vx += 2, vy += 2) {
+    __m256i y0 = _mm256_loadu_si256(vy);
+    __m256i y1 = _mm256_loadu_si256(vy + 1);
+    __m256i x0, x1;
+
+    if (Op != kMul) {
+      x0 = _mm256_loadu_si256(vx);
+      x1 = _mm256_loadu_si256(vx + 1);
+    }
+
+    if (Op == kIfft) {
+      y0 = _mm256_xor_si256(y0, x0);
+      y1 = _mm256_xor_si256(y1, x1);
+      _mm256_storeu_si256(vy, y0);
+      _mm256_storeu_si256(vy + 1, y1);
+    }
+
+    __m256i p0 = y0, p1 = y1;
+    mul32_avx2(p0, p1, tables);
+
+    if (Op == kMul) {
+      x0 = p0;
+      x1 = p1;
+    } else {
+      x0 = _mm256_xor_si256(x0, p0);
+      x1 = _mm256_xor_si256(x1, p1);
+    }
+    _mm256_storeu_si256(vx, x0);
+    _mm256_storeu_si256(vx + 1, x1);
+
+    if (Op == kFft) {
+      _mm256_storeu_si256(vy, _mm256_xor_si256(y0, x0));
+      _mm256_storeu_si256(vy + 1, _mm256_xor_si256(y1, x1));
+    }
+  }
+
+  tail_ssse3<Op>(reinterpret_cast<u8 *>(vx), reinterpret_cast<u8 *>(vy), table,
+                 narrow, bytes);
+}
+
+#endif  // CAT_HAS_X86_INTRINSICS
+
+typedef void (*KernelFunc)(u8 *CAT_RESTRICT, u8 *CAT_RESTRICT,
+                           const MulTable &, int);
+
+struct Engine {
+  KernelFunc mul;
+  KernelFunc fft;
+  KernelFunc ifft;
+};
+
+Engine select_engine() {
+  Engine engine = {kernel_scalar<kMul>, kernel_scalar<kFft>,
+                   kernel_scalar<kIfft>};
+
+#if defined(CAT_HAS_X86_INTRINSICS)
+  const CpuFeatures &cpu = cpu_features();
+
+  if (cpu.avx2) {
+    Engine avx2 = {kernel_avx2<kMul>, kernel_avx2<kFft>, kernel_avx2<kIfft>};
+    engine = avx2;
+  } else if (cpu.ssse3) {
+    Engine ssse3 = {kernel_ssse3<kMul>, kernel_ssse3<kFft>,
+                    kernel_ssse3<kIfft>};
+    engine = ssse3;
+  }
+#endif
+
+  return engine;
+}
+
+const Engine &engine() {
+  static const Engine selected = select_engine();
+  return selected;
+}
+
+// output = input * c
+void mul_block(const Engine &e, u8 *output, const u8 *input,
+               const MulTable &table, int bytes) {
+  e.mul(output, const_cast<u8 *>(input), table, bytes);
+}
+
+//// Transforms
+
+// Blocks [0, size) of work, block_bytes apart
+struct Blocks {
+  u8 *base;
+  int bytes;
+
+  u8 *operator[](unsigned i) const { return base + i * bytes; }
+};
+
+// Inverse FFT of blocks [0, size) taken as codeword positions
+// [offset, offset + size).  Blocks from nonzero_end on must be zero, which
+// lets the lower layers skip them.
+void ifft(const Tables &t, const Engine &e, Blocks work, unsigned size,
+          unsigned offset, unsigned nonzero_end) {
+  MulTable scratch;
+
+  for (unsigned width = 1; width < size; width <<= 1) {
+    for (unsigned j = width; (j < size) && (j - width < nonzero_end);
+         j += width * 2) {
+      const MulTable *table = skew_table(t, j + offset - 1, scratch);
+
+      for (unsigned i = j - width; i < j; ++i) {
+        if (table) {
+          e.ifft(work[i], work[i + width], *table, work.bytes);
+        } else {
+          memxor(work[i + width], work[i], work.bytes);
+        }
+      }
+    }
+
+    // A butterfly group is nonzero if either half was
+    nonzero_end = (nonzero_end + width * 2 - 1) & ~(width * 2 - 1);
+  }
+}
+
+// Forward FFT, the inverse of ifft().  With a non-null needed array only
+// outputs i with needed[i] are computed; a butterfly group only feeds the
+// outputs in its own range.
+void fft(const Tables &t, const Engine &e, Blocks work, unsigned size,
+         unsigned offset, const u8 *needed) {
+  MulTable scratch;
+
+  for (unsigned width = size >> 1; width > 0; width >>= 1) {
+    for (unsigned j = width; j < size; j += width * 2) {
+      if (needed) {
+        const u8 *first = needed + j - width;
+        const u8 *last = first + width * 2;
+        while ((first < last) && !*first) {
+          ++first;
+        }
+        if (first == last) {
+          continue;
+        }
+      }
+
+      const MulTable *table = skew_table(t, j + offset - 1, scratch);
+
+      for (unsigned i = j - width; i < j; ++i) {
+        if (table) {
+          e.fft(work[i], work[i + width], *table, work.bytes);
+        } else {
+          memxor(work[i + width], work[i], work.bytes);
+        }
+      }
+    }
+  }
+}
+
+unsigned next_pow2(unsigned x) {
+  unsigned result = 1;
+  while (result < x) {
+    result <<= 1;
+  }
+  return result;
+}
+
+bool valid_shape(int original_count, int recovery_count, int block_bytes) {
+  return (original_count > 0) && (recovery_count > 0) && (block_bytes > 0) &&
+         ((block_bytes % 2) == 0) &&
+         (static_cast<unsigned>(recovery_count) <= kOrder) &&
+         (original_count + next_pow2(recovery_count) <= kOrder);
+}
+
+}  // namespace
+
+//// API
+
+int fft_rs16_init() {
+  MulTable scratch;
+  skew_table(tables(), 0, scratch);
+  engine();
+  return 0;
+}
+
+int fft_rs16_recovery_stride(int recovery_count) {
+  return recovery_count > 0 ? static_cast<int>(next_pow2(recovery_count)) : 0;
+}
+
+int fft_rs16_encode_work_bytes(int original_count, int recovery_count,
+                               int block_bytes) {
+  if (!valid_shape(original_count, recovery_count, block_bytes)) {
+    return 0;
+  }
+
+  const unsigned m = next_pow2(recovery_count);
+  const unsigned blocks = static_cast<unsigned>(original_count) > m ? m * 2 : m;
+  return static_cast<int>(blocks) * block_bytes;
+}
+
+// The codeword is processed in runs of m originals.  Each run is interpolated
+// at its own positions, and evaluating the sum at positions [0, m) gives the
+// recovery blocks.
+int fft_rs16_encode(int original_count, int recovery_count, int block_bytes,
+                    const unsigned char **originals, unsigned char *work) {
+  if (!valid_shape(original_count, recovery_count, block_bytes) ||
+      !originals || !work) {
+    return -1;
+  }
+
+  const Tables &t = tables();
+  const Engine &e = engine();
+  const unsigned k = static_cast<unsigned>(original_count);
+  const unsigned m = next_pow2(recovery_count);
+
+  Blocks sum = {work, block_bytes};
+  Blocks run = {work + m * block_bytes, block_bytes};
+
+  for (unsigned first = 0; first < k; first += m) {
+    Blocks target = first ? run : sum;
+    const unsigned count = k - first < m ? k - first : m;
+
+    for (unsigned i = 0; i < count; ++i) {
+      memcpy(target[i], originals[first + i], block_bytes);
+    }
+    memset(target[count], 0, (m - count) * block_bytes);
+
+    ifft(t, e, target, m, m + first, count);
+
+    if (first) {
+      for (unsigned i = 0; i < m; ++i) {
+        memxor(sum[i], run[i], block_bytes);
+      }
+    }
+  }
+
+  fft(t, e, sum, m, 0, nullptr);
+  return 0;
+}
+
+int fft_rs16_decode_work_bytes(int original_count, int recovery_count,
+                               int block_bytes) {
+  if (!valid_shape(original_count, recovery_count, block_bytes)) {
+    return 0;
+  }
+
+  // Blocks, error locator and the mask of blocks to recover
+  const unsigned n = next_pow2(next_pow2(recovery_count) + original_count);
+  return static_cast<int>(n * (block_bytes + sizeof(u16) + 1));
+}
+
+// Multiplying the codeword by the error locator polynomial and taking the
+// formal derivative leaves the erased values scaled by the locator's
+// derivative, which is undone at the end.  The locator is evaluated at all
+// positions with two Walsh-Hadamard transforms of the erasure pattern.
+int fft_rs16_decode(int original_count, int recovery_count, int block_bytes,
+                    const unsigned char **originals,
+                    const unsigned char **recovery, unsigned char *work) {
+  if (!valid_shape(original_count, recovery_count, block_bytes) ||
+      !originals || !recovery || !work) {
+    return -1;
+  }
+
+  const Tables &t = tables();
+  const Engine &e = engine();
+  const unsigned k = static_cast<unsigned>(original_count);
+  const unsigned r = static_cast<unsigned>(recovery_count);
+  const unsigned m = next_pow2(r);
+  const unsigned n = next_pow2(m + k);
+
+  Blocks blocks = {work, block_bytes};
+  u16 *locator = reinterpret_cast<u16 *>(work + n * block_bytes);
+  u8 *needed = reinterpret_cast<u8 *>(locator + n);
+
+  unsigned missing = 0, available = 0;
+  for (unsigned i = 0; i < r; ++i) {
+    available += recovery[i] ? 1 : 0;
+  }
+  for (unsigned i = 0; i < k; ++i) {
+    missing += originals[i] ? 0 : 1;
+  }
+
+  if (missing == 0) {
+    return 0;
+  }
+  if (available < missing) {
+    return -1;
+  }
+
+  memset(locator, 0, n * sizeof(u16));
+  memset(needed, 0, n);
+  for (unsigned i = 0; i < r; ++i) {
+    locator[i] = recovery[i] ? 0 : 1;
+  }
+  for (unsigned i = r; i < m; ++i) {
+    locator[i] = 1;
+  }
+  for (unsigned i = 0; i < k; ++i) {
+    locator[m + i] = needed[m + i] = originals[i] ? 0 : 1;
+  }
+
+  const u16 *log_walsh = t.log_walsh + n;
+  fwht(locator, n);
+  for (unsigned i = 0; i < n; ++i) {
+    locator[i] = static_cast<u16>(
+        (static_cast<unsigned>(locator[i]) * log_walsh[i]) % kModulus);
+  }
+  fwht(locator, n);
+
+  MulTable table;
+  for (unsigned i = 0; i < n; ++i) {
+    const unsigned char *source = nullptr;
+    if (i < r) {
+      source = recovery[i];
+    } else if ((i >= m) && (i < m + k)) {
+      source = originals[i - m];
+    }
+
+    if (source) {
+      build_mul_table(t, locator[i], table);
+      mul_block(e, blocks[i], source, table, block_bytes);
+    } else {
+      memset(blocks[i], 0, block_bytes);
+    }
+  }
+
+  ifft(t, e, blocks, n, 0, m + k);
+
+  for (unsigned i = 1; i < n; ++i) {
+    const unsigned width = ((i ^ (i - 1)) + 1) >> 1;
+
+    for (unsigned j = i - width; j < i; ++j) {
+      memxor(blocks[j], blocks[j + width], block_bytes);
+    }
+  }
+
+  fft(t, e, blocks, n, 0, needed);
+
+  // Ascending order only ever overwrites blocks that were already read
+  for (unsigned i = 0; i < k; ++i) {
+    if (!originals[i]) {
+      build_mul_table(t, static_cast<u16>(kModulus - locator[m + i]), table);
+      mul_block(e, blocks[i], blocks[m + i], table, block_bytes);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef FFT_RS16_H
+#define FFT_RS16_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reed-Solomon erasure code over GF(2^16) using additive FFTs
+ *
+ * Where cauchy_256 is limited to k + m <= 256 and costs O(k * m) per block,
+ * this code takes up to 65536 blocks in total and encodes and decodes in
+ * O(n log n) block operations.  It is meant for protecting whole frames,
+ * where the number of blocks runs into the thousands.
+ *
+ * Symbols are 16-bit little endian words, so block_bytes has to be even.
+ *
+ * The recovery block count is rounded up to a power of two internally
+ * ("m" below).  The decoder needs original_count and m, not the exact
+ * recovery_count used for encoding.
+ *
+ * Based on Lin, Han and Chung, "Novel Polynomial Basis and Its Application
+ * to Reed-Solomon Erasure Codes" (FOCS 2014), in the layout of the Leopard
+ * codec: recovery blocks take codeword positions [0, m) and originals
+ * [m, m + original_count).
+ */
+
+/*
+ * Builds the field tables.  Every other call does this on first use, calling
+ * it at startup just moves the cost (a few milliseconds).
+ *
+ * Returns 0 on success, and any other code indicates failure.
+ */
+extern int fft_rs16_init();
+
+// Recovery block count rounded up the way the codec does it
+extern int fft_rs16_recovery_stride(int recovery_count);
+
+// Bytes of work memory fft_rs16_encode() needs
+extern int fft_rs16_encode_work_bytes(int original_count, int recovery_count,
+                                      int block_bytes);
+
+/*
+ * FFT encode
+ *
+ * Computes recovery_count recovery blocks from original_count blocks.
+ * Recovery block i is written to work + i * block_bytes.
+ *
+ * original_count + fft_rs16_recovery_stride(recovery_count) <= 65536
+ *
+ * Returns 0 on success, and any other code indicates failure.
+ */
+extern int fft_rs16_encode(int original_count, int recovery_count,
+                           int block_bytes, const unsigned char **originals,
+                           unsigned char *work);
+
+// Bytes of work memory fft_rs16_decode() needs
+extern int fft_rs16_decode_work_bytes(int original_count, int recovery_count,
+                                      int block_bytes);
+
+/*
+ * FFT decode
+ *
+ * originals[i] and recovery[i] are null for blocks that were not received.
+ * Any recovery_count that rounds up to the same m as the encoder's works;
+ * recovery blocks the encoder did not produce are simply missing.
+ *
+ * Missing original i is written to work + i * block_bytes.
+ *
+ * Returns 0 on success, and any other code indicates failure (e.g. fewer
+ * recovery blocks than missing originals).
+ */
+extern int fft_rs16_decode(int original_count, int recovery_count,
+                           int block_bytes, const unsigned char **originals,
+                           const unsigned char **recovery,
+                           unsigned char *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FFT_RS16_H
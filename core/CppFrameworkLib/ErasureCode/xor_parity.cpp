@@ -0,0 +1,155 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "xor_parity.h"
+#include "MemXOR.hpp"
+
+#include <string.h>
+
+using namespace cat;
+
+namespace {
+
+int row_count(int k, int columns) { return (k + columns - 1) / columns; }
+
+bool valid(int k, int columns, int block_bytes) {
+  return (k > 0) && (columns > 0) && (block_bytes > 0);
+}
+
+// Members of parity group g are first, first + step, ... below end
+void group_range(int k, int columns, int g, int &first, int &step, int &end) {
+  if (g < columns) {
+    first = g;
+    step = columns;
+    end = k;
+  } else {
+    first = (g - columns) * columns;
+    step = 1;
+    end = first + columns < k ? first + columns : k;
+  }
+}
+
+}  // namespace
+
+extern "C" int xor_parity_count(int k, int columns, int row_parity) {
+  if ((k <= 0) || (columns <= 0)) {
+    return 0;
+  }
+
+  return columns + (row_parity ? row_count(k, columns) : 0);
+}
+
+extern "C" int xor_parity_encode(int k, int columns, int row_parity,
+                                 const unsigned char **originals,
+                                 unsigned char **parity, int block_bytes) {
+  if (!valid(k, columns, block_bytes)) {
+    return -1;
+  }
+
+  // Columns past the last original have nothing to cover
+  for (int c = k; c < columns; ++c) {
+    memset(parity[c], 0, static_cast<size_t>(block_bytes));
+  }
+
+  for (int i = 0; i < k; ++i) {
+    const int column = i % columns;
+
+    if (i < columns) {
+      memcpy(parity[column], originals[i], static_cast<size_t>(block_bytes));
+    } else {
+      memxor(parity[column], originals[i], block_bytes);
+    }
+
+    if (row_parity) {
+      unsigned char *row = parity[columns + i / columns];
+
+      if (column == 0) {
+        memcpy(row, originals[i], static_cast<size_t>(block_bytes));
+      } else {
+        memxor(row, originals[i], block_bytes);
+      }
+    }
+  }
+
+  return 0;
+}
+
+extern "C" int xor_parity_decode(int k, int columns, int row_parity,
+                                 unsigned char **originals,
+                                 unsigned char *present,
+                                 const unsigned char **parity,
+                                 int block_bytes) {
+  int missing = 0;
+  for (int i = 0; i < k; ++i) {
+    missing += present[i] ? 0 : 1;
+  }
+
+  if (!valid(k, columns, block_bytes)) {
+    return missing;
+  }
+
+  const int groups = xor_parity_count(k, columns, row_parity);
+  bool progress = true;
+
+  // Peel: solving one group can leave another with a single erasure
+  while (progress && (missing > 0)) {
+    progress = false;
+
+    for (int g = 0; (g < groups) && (missing > 0); ++g) {
+      if (!parity[g]) {
+        continue;
+      }
+
+      int first, step, end, erased = -1, erasures = 0;
+      group_range(k, columns, g, first, step, end);
+
+      for (int i = first; (i < end) && (erasures < 2); i += step) {
+        if (!present[i]) {
+          erased = i;
+          erasures++;
+        }
+      }
+
+      if (erasures != 1) {
+        continue;
+      }
+
+      unsigned char *out = originals[erased];
+      memcpy(out, parity[g], static_cast<size_t>(block_bytes));
+
+      for (int i = first; i < end; i += step) {
+        if (i != erased) {
+          memxor(out, originals[i], block_bytes);
+        }
+      }
+
+      present[erased] = 1;
+      missing--;
+      progress = true;
+    }
+  }
+
+  return missing;
+}
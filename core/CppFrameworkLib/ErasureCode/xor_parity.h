@@ -0,0 +1,82 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+
+#ifndef XOR_PARITY_H
+#define XOR_PARITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * XOR parity over a grid of blocks
+ *
+ * The k originals are laid out row by row in a grid "columns" blocks wide.
+ * Parity block c < columns is the XOR of the originals i with
+ * i % columns == c, and with row parity, block columns + r is the XOR of the
+ * originals in row r.  Column parity alone is interleaved XOR, which repairs
+ * any burst of up to "columns" consecutive losses (plain XOR for one column).
+ * Both together are row/column (2D) parity.
+ *
+ * Nothing but XOR is involved, there are no matrices and no tables, so it
+ * suits messages of a few blocks where cauchy_256 setup dominates.  It is
+ * weaker than cauchy_256 with the same number of recovery blocks.
+ */
+
+// Parity blocks for k originals
+extern int xor_parity_count(int k, int columns, int row_parity);
+
+/*
+ * XOR parity encode
+ *
+ * Writes xor_parity_count() blocks, parity[i] for parity block i.
+ *
+ * Returns 0 on success, and any other code indicates failure.
+ */
+extern int xor_parity_encode(int k, int columns, int row_parity,
+                             const unsigned char **originals,
+                             unsigned char **parity, int block_bytes);
+
+/*
+ * XOR parity decode
+ *
+ * originals[i] always points to a block, present[i] is 0 where it was not
+ * received.  parity[i] is null for parity blocks that were not received.
+ * Recovered originals are written in place and marked present.  Every
+ * parity group missing a single original is solved, and again as long as
+ * that makes progress.
+ *
+ * Returns the number of originals still missing.
+ */
+extern int xor_parity_decode(int k, int columns, int row_parity,
+                             unsigned char **originals, unsigned char *present,
+                             const unsigned char **parity, int block_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // XOR_PARITY_H
@@ -23,10 +23,106 @@ SOFTWARE.
 */
 
 #include "FrameAssembly.h"
+#include "ErasureCode.h"
 
 #include <algorithm>
 
 namespace DirectRemote {
+
+// Frames held at a time: reassembling, completed ones cross-frame parity
+// can still reach, and those waiting to be picked up
+static const size_t FRAMES_IN_FLIGHT = 8 + MAX_PARITY_WINDOW;
+
+// Messages per frame the pools start out with
+static const size_t DEFAULT_POOL_MESSAGES = 4;
+
+// Keyframes are budgeted at this many average frames
+static const int64_t KEYFRAME_FACTOR = 8;
+
+FrameAssembly::FrameAssembly()
+    : messagePool(FRAMES_IN_FLIGHT * DEFAULT_POOL_MESSAGES),
+      assemblyPool(FRAMES_IN_FLIGHT * DEFAULT_POOL_MESSAGES,
+                   [this]() {
+                     return new MessageAssembly(&nodePool, &messagePool);
+                   }),
+      framePool(FRAMES_IN_FLIGHT),
+      reassembly(std::less<int64_t>(), &nodePool),
+      readyFrames(&nodePool),
+      completed(std::less<int64_t>(), &nodePool),
+      parity(std::less<ParityKey>(), &nodePool) {}
+
+FrameAssembly::~FrameAssembly() {
+  // Queued decodes run while their messages are still there
+  workers.reset();
+
+  // Frames may be held beyond this, their MessageAssemblies may not, since
+  // those use the pools
+  reassembly.clear();
+  completed.clear();
+  readyFrames.clear();
+  framePool.forEach([](ReassemblyEntry &frame) {
+    frame.msgMap.clear();
+    frame.messages.clear();
+  });
+}
+
+void FrameAssembly::ReassemblyEntry::reset() {
+  receivedMsgCount = 0;
+  msgMap.clear();
+  messages.clear();
+  data.clear();
+  lastMessageChunks = 0;
+  isOpen = false;
+
+  // Decodes of a frame that was given up may still be running. Workers that
+  // only hold on to it while they signal the last one are no reason to drop
+  // it.
+  if (pendingDecodes && (pendingDecodes.use_count() > 1)) {
+    bool isRunning;
+    {
+      std::lock_guard<std::mutex> lock(pendingDecodes->mutex);
+      isRunning = pendingDecodes->count > 0;
+    }
+
+    if (isRunning) {
+      pendingDecodes.reset();
+    }
+  }
+}
+
+void FrameAssembly::reservePools(int64_t bitrate, int frameRate) {
+  if ((bitrate <= 0) || (frameRate <= 0)) {
+    return;
+  }
+
+  const int64_t frameBytes = bitrate / 8 / frameRate;
+  const int64_t messageBytes = maxMessageSize(chunkSize, messageChunks);
+  const size_t messages = static_cast<size_t>(
+      FRAMES_IN_FLIGHT * (1 + frameBytes / messageBytes) +
+      KEYFRAME_FACTOR * frameBytes / messageBytes);
+
+  framePool.reserve(FRAMES_IN_FLIGHT);
+  assemblyPool.reserve(messages);
+  messagePool.reserve(messages);
+}
+
+PoolMetrics FrameAssembly::poolMetrics() const {
+  PoolMetrics metrics = nodePool.getMetrics();
+  metrics += messagePool.getMetrics();
+  metrics += assemblyPool.getMetrics();
+  metrics += framePool.getMetrics();
+  return metrics;
+}
+
+size_t FrameAssembly::ReassemblyEntry::messageChunks(size_t msgIndex) const {
+  if (messages[msgIndex]) {
+    return messages[msgIndex]->dataMap.size();
+  }
+
+  return (msgIndex + 1 < msgMap.size()) ? fullMessageChunks
+                                        : lastMessageChunks;
+}
+
 void FrameAssembly::cleanupHistory(ConnectionMetrics &metrics) {
   while (reassembly.size() > 5) {
     auto it = reassembly.begin();
@@ -46,10 +142,11 @@ FrameAssembly::getResassmblyEntry(int64_t trackingId,
   auto it = reassembly.find(trackingId);
 
   if (it == reassembly.end()) {
-    entry = std::make_shared<ReassemblyEntry>();
+    entry = framePool.acquire();
 
     entry->trackingId = trackingId;
     entry->receivedMsgCount = 0;
+    entry->fullMessageChunks = static_cast<size_t>(messageChunks);
 
     reassembly.insert(std::make_pair(trackingId, entry));
 
@@ -61,12 +158,49 @@ FrameAssembly::getResassmblyEntry(int64_t trackingId,
   return entry;
 }
 
+bool FrameAssembly::fitMessageCount(ReassemblyEntry &entry,
+                                    const UdpChunk &chunk) {
+  const bool isKnown = !entry.msgMap.empty() && !entry.isOpen;
+  size_t msgCount = chunk.msgCount;
+
+  if (msgCount == 0) {
+    if (isKnown) {
+      return chunk.msgIndex < entry.msgMap.size();
+    }
+
+    entry.isOpen = true;
+    msgCount = std::max(entry.msgMap.size(),
+                        static_cast<size_t>(chunk.msgIndex) + 1);
+  } else if (isKnown) {
+    return msgCount == entry.msgMap.size();
+  } else if (msgCount < entry.msgMap.size()) {
+    return false;
+  } else {
+    entry.isOpen = false;
+  }
+
+  // Messages already seen of a streamed frame keep their place
+  entry.msgMap.resize(msgCount);
+  entry.messages.resize(msgCount);
+  return true;
+}
+
 bool FrameAssembly::tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
                                    ConnectionMetrics &metrics) {
-  if (entry->receivedMsgCount == entry->msgMap.size()) {
+  if (!entry->isOpen &&
+      (entry->receivedMsgCount == entry->msgMap.size())) {
+    if (!decodeMessages(*entry)) {
+      reassembly.erase(entry->trackingId);
+      metrics.invalidFrames++;
+      return false;
+    }
+
     reassembly.erase(entry->trackingId);
+    completedTrackingId = entry->trackingId;
 
-    if (!reassembly.empty()) {
+    // Cross-frame parity and interleaving complete frames out of order on
+    // purpose
+    if (!reassembly.empty() && (parityWindow == 1)) {
       auto maxRemaining = (reassembly.rbegin())->first;
 
       if (maxRemaining > entry->trackingId) {
@@ -75,15 +209,21 @@ bool FrameAssembly::tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
       }
     }
 
-    int offset = 0;
-    for (auto msg : entry->messages) {
-      int msgSize = msg->data.size();
-      entry->data.resize(offset + msgSize);
+    size_t frameSize = 0;
+    for (const auto &msg : entry->messages) {
+      frameSize += msg->data.size();
+    }
 
-      std::copy(msg->data.begin(), msg->data.end(),
-                entry->data.begin() + offset);
+    entry->data.reserve(frameSize);
+    for (const auto &msg : entry->messages) {
+      entry->data.insert(entry->data.end(), msg->data.begin(),
+                         msg->data.end());
+    }
 
-      offset += msgSize;
+    if (parityWindow > 1) {
+      completed[entry->trackingId] = entry;
+    } else {
+      readyFrames.push_back(entry);
     }
 
     return true;
@@ -93,41 +233,566 @@ bool FrameAssembly::tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
   return false;
 }
 
-std::shared_ptr<FrameAssembly::ReassemblyEntry> FrameAssembly::process(
-    UdpChunk chunk, ConnectionMetrics &metrics) {
-  auto entry = getResassmblyEntry(chunk.trackingId, metrics);
+void FrameAssembly::processMessageChunk(ReassemblyEntry &entry,
+                                        const UdpChunk &chunk,
+                                        ConnectionMetrics &metrics) {
+  if (entry.messages[chunk.msgIndex]) {
+    return;
+  }
+
+  std::shared_ptr<MessageAssembly> msgAssembly = entry.msgMap[chunk.msgIndex];
+
+  if (!msgAssembly) {
+    msgAssembly = entry.msgMap[chunk.msgIndex] = assemblyPool.acquire();
+    msgAssembly->setProgressiveDecoding(progressiveDecoding);
+    msgAssembly->setDeferredDecoding(batchDecoding || workers);
+    msgAssembly->setChunkSize(chunkSize);
+  }
+
+  auto msg = msgAssembly->process(chunk, metrics, eccWorkspace);
+
+  if (msg) {
+    entry.messages[chunk.msgIndex] = msg;
+    entry.receivedMsgCount++;
+
+    if (workers && msg->isDeferred) {
+      decodeAsync(entry, msg);
+    }
+  }
+}
+
+void FrameAssembly::setFrameInterleaving(int frames) {
+  // Like the windows parity tells, it only grows
+  parityWindow =
+      std::max(parityWindow, std::min(MAX_INTERLEAVE_FRAMES, frames));
+}
+
+void FrameAssembly::setDecodeThreads(size_t threadCount) {
+  // Decodes still queued run before the pool is gone, with the workspace of
+  // worker 0, so every task is free again and no frame waits for them
+  workers.reset();
+  workerWorkspaces.clear();
+
+  if (threadCount == 0) {
+    return;
+  }
+
+  workers.reset(new WorkerPool(threadCount));
+
+  for (size_t i = 0; i < workers->workerCount(); i++) {
+    workerWorkspaces.emplace_back(new EccWorkspace());
+  }
+}
+
+void FrameAssembly::decodeAsync(
+    ReassemblyEntry &frame,
+    std::shared_ptr<MessageAssembly::ReassemblyEntry> msg) {
+  if (!frame.pendingDecodes) {
+    frame.pendingDecodes = std::make_shared<PendingDecodes>();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(frame.pendingDecodes->mutex);
+    frame.pendingDecodes->count++;
+  }
+
+  DecodeTask *task;
+  {
+    std::lock_guard<std::mutex> lock(taskMutex);
+
+    if (freeTasks.empty()) {
+      decodeTasks.emplace_back(new DecodeTask());
+      decodeTasks.back()->owner = this;
 
-  if (entry->msgMap.empty()) {
-    entry->msgMap.resize(chunk.msgCount);
-    entry->messages.resize(chunk.msgCount);
+      // Every task fits back in, so returning one never allocates
+      freeTasks.reserve(decodeTasks.size());
+      freeTasks.push_back(decodeTasks.back().get());
+    }
+
+    task = freeTasks.back();
+    freeTasks.pop_back();
+  }
+
+  task->pending = frame.pendingDecodes;
+  task->msg = std::move(msg);
+  workers->submit(task);
+}
+
+// The message is left alone until waitForDecodes(). One that fails stays
+// deferred, and fails again in decodeMessages().
+void FrameAssembly::DecodeTask::run(size_t worker) {
+  if (msg->tryReconstruct(*owner->workerWorkspaces[worker])) {
+    msg->isDeferred = false;
+  }
+
+  // The frame may be gone as soon as the count drops, so nothing of it is
+  // touched after that
+  std::shared_ptr<PendingDecodes> decodes = std::move(pending);
+  msg.reset();
+
+  {
+    std::lock_guard<std::mutex> lock(owner->taskMutex);
+    owner->freeTasks.push_back(this);
+  }
+
+  std::lock_guard<std::mutex> lock(decodes->mutex);
+  if (--decodes->count == 0) {
+    decodes->done.notify_all();
+  }
+}
+
+void FrameAssembly::waitForDecodes(ReassemblyEntry &frame) {
+  if (!frame.pendingDecodes) {
+    return;
+  }
+
+  auto &pending = *frame.pendingDecodes;
+  std::unique_lock<std::mutex> lock(pending.mutex);
+  pending.done.wait(lock, [&]() { return pending.count == 0; });
+}
+
+bool FrameAssembly::decodeMessages(ReassemblyEntry &frame) {
+  waitForDecodes(frame);
+  batchMessages.clear();
+
+  for (const auto &msg : frame.messages) {
+    if (msg && msg->isDeferred) {
+      batchMessages.push_back(msg.get());
+    }
+  }
+
+  if (batchMessages.empty()) {
+    return true;
+  }
+
+  const size_t count = batchMessages.size();
+  batchBlocks.resize(count * MAX_WIDE_MESSAGE_CHUNKS);
+  batchOrder.resize(count);
+
+  for (size_t i = 0; i < count; i++) {
+    Block *blocks = &batchBlocks[i * MAX_WIDE_MESSAGE_CHUNKS];
+
+    if (!batchMessages[i]->prepareDecode(blocks)) {
+      return false;
+    }
+    batchOrder[i] = i;
+  }
+
+  // Messages of the same shape that lost the same chunks end up next to
+  // each other
+  std::sort(batchOrder.begin(), batchOrder.end(), [this](size_t a, size_t b) {
+    const auto *x = batchMessages[a];
+    const auto *y = batchMessages[b];
+
+    if (x->dataMap.size() != y->dataMap.size()) {
+      return x->dataMap.size() < y->dataMap.size();
+    }
+    if (x->eccMap.size() != y->eccMap.size()) {
+      return x->eccMap.size() < y->eccMap.size();
+    }
+
+    const Block *rowsX = &batchBlocks[a * MAX_WIDE_MESSAGE_CHUNKS];
+    const Block *rowsY = &batchBlocks[b * MAX_WIDE_MESSAGE_CHUNKS];
+    for (size_t i = 0; i < x->dataMap.size(); i++) {
+      if (rowsX[i].row != rowsY[i].row) {
+        return rowsX[i].row < rowsY[i].row;
+      }
+    }
+
+    return a < b;
+  });
+
+  batchSets.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    batchSets[i] = &batchBlocks[batchOrder[i] * MAX_WIDE_MESSAGE_CHUNKS];
   }
 
-  if ((chunk.msgIndex < 0) || (chunk.msgIndex >= entry->msgMap.size())) {
+  for (size_t start = 0, end; start < count; start = end) {
+    const auto *first = batchMessages[batchOrder[start]];
+
+    for (end = start + 1; end < count; end++) {
+      const auto *msg = batchMessages[batchOrder[end]];
+
+      if ((msg->dataMap.size() != first->dataMap.size()) ||
+          (msg->eccMap.size() != first->eccMap.size())) {
+        break;
+      }
+    }
+
+    if (cauchy_256_decode_batch_ws(
+            static_cast<int>(first->dataMap.size()),
+            static_cast<int>(first->eccMap.size()), &batchSets[start],
+            static_cast<int>(end - start), first->eccBytes(),
+            eccWorkspace.get()) != 0) {
+      // Still deferred, prepareDecode() starts over from the chunks
+      return false;
+    }
+  }
+
+  for (auto *msg : batchMessages) {
+    msg->isDeferred = false;
+    msg->assemble();
+  }
+
+  return true;
+}
+
+bool FrameAssembly::isSettled(int64_t trackingId) const {
+  return (trackingId == completedTrackingId) ||
+         ((parityWindow > 1) &&
+          ((trackingId <= deliveredTrackingId) || completed.count(trackingId)));
+}
+
+void FrameAssembly::processParityChunk(const UdpChunk &chunk,
+                                       ConnectionMetrics &metrics) {
+  const int64_t trackingId = static_cast<int64_t>(chunk.trackingId);
+  const int window = DirectRemote::parityWindow(chunk);
+
+  if ((window > MAX_PARITY_WINDOW) || (chunk.chunkCount == 0)) {
     metrics.invalidPackets++;
-    return nullptr;
+    return;
+  }
+
+  parityWindow = std::max(parityWindow, window);
+
+  // Nothing left to repair in a frame parity covers alone
+  if ((window == 1) && isSettled(trackingId)) {
+    metrics.validPackets++;
+    return;
+  }
+
+  // Parity also tells the shape of its frame
+  if (!isSettled(trackingId)) {
+    auto entry = getResassmblyEntry(trackingId, metrics);
+
+    if (!fitMessageCount(*entry, chunk)) {
+      metrics.invalidPackets++;
+      return;
+    }
+
+    entry->lastMessageChunks = chunk.chunkCount;
+  }
+
+  const size_t stride = static_cast<size_t>(1) << parityStrideLog(chunk);
+  const ParityKey key(trackingId, window);
+  auto &parityEntry = parity[key];
+
+  if (parityEntry.parityMap.empty()) {
+    parityEntry.parityMap.setChunkSize(chunkSize);
+    parityEntry.parityMap.resize(stride);
+    parityEntry.hasParityChunk.resize(stride);
+  }
+
+  if ((parityEntry.parityMap.size() != stride) ||
+      (chunk.chunkIndex >= stride)) {
+    metrics.invalidPackets++;
+    return;
+  }
+
+  if (parityEntry.hasParityChunk[chunk.chunkIndex]) {
+    metrics.duplicatePackets++;
+    return;
+  }
+
+  parityEntry.hasParityChunk[chunk.chunkIndex] = true;
+  copyChunk(parityEntry.parityMap[chunk.chunkIndex], chunk,
+            parityEntry.parityMap.chunkSize());
+  parityEntry.receivedParityChunks++;
+  metrics.validPackets++;
+
+  tryDecodeWindow(key, metrics);
+}
+
+void FrameAssembly::tryDecodeWindows(int64_t trackingId,
+                                     ConnectionMetrics &metrics) {
+  for (int window = 1; window <= parityWindow; window++) {
+    for (int64_t last = trackingId; last < trackingId + window; last++) {
+      const ParityKey key(last, window);
+
+      if (parity.count(key)) {
+        tryDecodeWindow(key, metrics);
+      }
+    }
+  }
+}
+
+void FrameAssembly::tryDecodeWindow(const ParityKey &key,
+                                    ConnectionMetrics &metrics) {
+  auto parityIt = parity.find(key);
+  bool isRepairable = false;
+
+  windowFrames.clear();
+
+  for (int64_t trackingId = key.first - key.second + 1;
+       trackingId <= key.first; trackingId++) {
+    auto it = reassembly.find(trackingId);
+    ReassemblyEntry *frame = nullptr;
+
+    if (it != reassembly.end()) {
+      frame = it->second.get();
+      isRepairable = true;
+    } else if (completed.count(trackingId)) {
+      frame = completed[trackingId].get();
+    } else if (isSettled(trackingId)) {
+      // Delivered or given up, nothing to repair there
+      parity.erase(parityIt);
+      return;
+    } else {
+      return;
+    }
+
+    windowFrames.push_back(frame);
+  }
+
+  if (!isRepairable) {
+    parity.erase(parityIt);
+    return;
+  }
+
+  // Parity works on the data chunks, which deferred messages do not have yet
+  for (auto *frame : windowFrames) {
+    if (reassembly.count(frame->trackingId) && !decodeMessages(*frame)) {
+      return;
+    }
+  }
+
+  if (!decodeParity(parityIt->second)) {
+    return;
+  }
+
+  parity.erase(parityIt);
+
+  for (auto *frame : windowFrames) {
+    auto it = reassembly.find(frame->trackingId);
+
+    if ((it != reassembly.end()) &&
+        (frame->receivedMsgCount == frame->msgMap.size())) {
+      tryReconstruct(it->second, metrics);
+    }
+  }
+}
+
+bool FrameAssembly::decodeParity(const ParityEntry &entry) {
+  size_t chunkCount = 0;
+  size_t received = entry.receivedParityChunks;
+
+  windowMessages.clear();
+
+  for (auto *frame : windowFrames) {
+    if (frame->msgMap.empty() || frame->isOpen) {
+      return false;
+    }
+
+    for (size_t iMsg = 0; iMsg < frame->msgMap.size(); iMsg++) {
+      const size_t expected = frame->messageChunks(iMsg);
+      auto msg = frame->messages[iMsg];
+
+      if (expected == 0) {
+        return false;
+      }
+
+      if (msg) {
+        received += expected;
+      } else if (frame->msgMap[iMsg]) {
+        msg = frame->msgMap[iMsg]->pending(frame->trackingId);
+
+        if (msg && !msg->dataMap.empty()) {
+          if (msg->dataMap.size() != expected) {
+            return false;
+          }
+          received += msg->receivedDataChunks;
+        }
+      }
+
+      chunkCount += expected;
+      windowMessages.push_back(msg);
+    }
+  }
+
+  if (received < chunkCount) {
+    return false;
+  }
+
+  parityOriginals.assign(chunkCount, nullptr);
+  parityRecovery.assign(entry.parityMap.size(), nullptr);
+
+  for (size_t iFrame = 0, iMsgs = 0, j = 0; iFrame < windowFrames.size();
+       iFrame++) {
+    const auto *frame = windowFrames[iFrame];
+
+    for (size_t iMsg = 0; iMsg < frame->msgMap.size(); iMsg++, iMsgs++) {
+      const auto &msg = windowMessages[iMsgs];
+      const bool isComplete = static_cast<bool>(frame->messages[iMsg]);
+
+      for (size_t i = 0; i < frame->messageChunks(iMsg); i++, j++) {
+        if (msg && !msg->dataMap.empty() &&
+            (isComplete || msg->hasDataChunk[i])) {
+          parityOriginals[j] = msg->dataMap[i].ecc.bytes;
+        }
+      }
+    }
+  }
+
+  uint64_t sessionId = 0;
+  for (size_t i = 0; i < entry.parityMap.size(); i++) {
+    if (entry.hasParityChunk[i]) {
+      parityRecovery[i] = entry.parityMap[i].ecc.bytes;
+      sessionId = entry.parityMap[i].sessionId;
+    }
+  }
+
+  const int originalCount = static_cast<int>(chunkCount);
+  const int parityCount = static_cast<int>(entry.parityMap.size());
+  const int eccBytes = chunkEccSize(chunkSize);
+
+  parityWork.resize(
+      fft_rs16_decode_work_bytes(originalCount, parityCount, eccBytes));
+
+  if (fft_rs16_decode(originalCount, parityCount, eccBytes,
+                      parityOriginals.data(), parityRecovery.data(),
+                      parityWork.data()) != 0) {
+    return false;
+  }
+
+  // Recovered chunks are not packets, so they stay out of the connection's
+  // metrics
+  ConnectionMetrics recoveredMetrics;
+  UdpChunk chunk = {};
+  chunk.sessionId = sessionId;
+
+  for (size_t iFrame = 0, j = 0; iFrame < windowFrames.size(); iFrame++) {
+    auto *frame = windowFrames[iFrame];
+    const size_t msgCount = frame->msgMap.size();
+
+    chunk.trackingId = static_cast<uint64_t>(frame->trackingId);
+    chunk.msgCount = msgCount;
+
+    for (size_t iMsg = 0; iMsg < msgCount; iMsg++) {
+      const size_t expected = frame->messageChunks(iMsg);
+
+      chunk.msgIndex = iMsg;
+      chunk.chunkCount = expected;
+
+      for (size_t i = 0; i < expected; i++, j++) {
+        if (parityOriginals[j]) {
+          continue;
+        }
+
+        chunk.chunkIndex = i;
+        memcpy(chunk.ecc.bytes, &parityWork[j * eccBytes], eccBytes);
+
+        processMessageChunk(*frame, chunk, recoveredMetrics);
+      }
+    }
+  }
+
+  return true;
+}
+
+void FrameAssembly::releaseFrames(ConnectionMetrics &metrics) {
+  const int64_t horizon = newestTrackingId - parityWindow;
+
+  // No window that is still to come reaches these frames
+  while (!reassembly.empty() && (reassembly.begin()->first <= horizon)) {
+    metrics.lostFrames++;
+    reassembly.erase(reassembly.begin());
+  }
+
+  // Completed frames go out in order, once nothing older is pending
+  const int64_t oldestPending =
+      reassembly.empty() ? INT64_MAX : reassembly.begin()->first;
+
+  for (auto &frame : completed) {
+    if (frame.first >= oldestPending) {
+      break;
+    }
+
+    if (frame.first > deliveredTrackingId) {
+      readyFrames.push_back(frame.second);
+      deliveredTrackingId = frame.first;
+    }
+  }
+
+  deliveredTrackingId = std::max(deliveredTrackingId, horizon);
+
+  while (!completed.empty() && (completed.begin()->first <= horizon)) {
+    completed.erase(completed.begin());
   }
 
-  if (!entry->messages[chunk.msgIndex]) {
-    std::shared_ptr<MessageAssembly> msgAssembly =
-        entry->msgMap[chunk.msgIndex];
+  while (!parity.empty() && (parity.begin()->first.first <= horizon)) {
+    parity.erase(parity.begin());
+  }
+}
 
-    if (!msgAssembly) {
-      msgAssembly = entry->msgMap[chunk.msgIndex] =
-          std::make_shared<MessageAssembly>();
+std::shared_ptr<FrameAssembly::ReassemblyEntry> FrameAssembly::process(
+    const UdpChunk &chunk, ConnectionMetrics &metrics) {
+  const int64_t trackingId = static_cast<int64_t>(chunk.trackingId);
+
+  // A sender that starts over
+  if ((parityWindow > 1) && (trackingId + 64 < newestTrackingId)) {
+    completed.clear();
+    parity.clear();
+    reassembly.clear();
+    deliveredTrackingId = newestTrackingId = -1;
+  }
+
+  newestTrackingId = std::max(newestTrackingId, trackingId);
+
+  if (isParityChunk(chunk)) {
+    processParityChunk(chunk, metrics);
+  } else if (isSettled(trackingId)) {
+    // Leftover chunks and late repair of frames that are done
+    metrics.validPackets++;
+  } else {
+    auto entry = getResassmblyEntry(trackingId, metrics);
+
+    if (!fitMessageCount(*entry, chunk) ||
+        (chunk.msgIndex >= entry->msgMap.size())) {
+      metrics.invalidPackets++;
+      return nullptr;
     }
 
-    auto msg = msgAssembly->process(chunk, metrics);
+    if (!chunk.isEccChunk && !entry->isOpen &&
+        (static_cast<size_t>(chunk.msgIndex) + 1 == entry->msgMap.size())) {
+      entry->lastMessageChunks = chunk.chunkCount;
+    }
 
-    if (msg) {
-      entry->messages[chunk.msgIndex] = msg;
-      entry->receivedMsgCount++;
+    processMessageChunk(*entry, chunk, metrics);
+
+    if (!parity.empty()) {
+      tryDecodeWindows(trackingId, metrics);
+    }
+
+    if (reassembly.count(trackingId)) {
+      tryReconstruct(entry, metrics);
+    }
+  }
+
+  if (parityWindow > 1) {
+    releaseFrames(metrics);
+  } else {
+    // Frame parity lives as long as its frame
+    for (auto it = parity.begin(); it != parity.end();) {
+      if (reassembly.count(it->first.first)) {
+        ++it;
+      } else {
+        it = parity.erase(it);
+      }
     }
   }
 
-  if (tryReconstruct(entry, metrics)) {
-    return entry;
+  return nextReadyFrame();
+}
+
+std::shared_ptr<FrameAssembly::ReassemblyEntry>
+FrameAssembly::nextReadyFrame() {
+  if (readyFrames.empty()) {
+    return nullptr;
   }
 
-  return nullptr;
+  auto entry = readyFrames.front();
+  readyFrames.pop_front();
+
+  return entry;
 }
 }  // namespace DirectRemote
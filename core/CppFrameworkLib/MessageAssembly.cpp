@@ -29,24 +29,45 @@ SOFTWARE.
 #include <algorithm>
 
 namespace DirectRemote {
+MessageAssembly::MessageAssembly(SlabPool *nodes,
+                                 ObjectPool<ReassemblyEntry> *entries)
+    : reassembly(std::less<int64_t>(), SlabAllocator<Node>(nodes)),
+      entries(entries) {}
+
 void MessageAssembly::cleanupHistory(ConnectionMetrics &metrics) {
   while (reassembly.size() > 512) {
     auto it = reassembly.begin();
     auto entry = it->second;
 
     metrics.lostPackets += entry->dataMap.size() - entry->receivedDataChunks +
-                           entry->eccMap.size() - entry->receivedEccChunks;
+                           entry->eccMap.size() - entry->receivedEccChunks +
+                           entry->xorMap.size() - entry->receivedXorChunks;
 
     reassembly.erase(it);
   }
 }
 
 std::shared_ptr<MessageAssembly::ReassemblyEntry> MessageAssembly::process(
-    UdpChunk chunk, ConnectionMetrics &metrics) {
+    const UdpChunk &chunk, ConnectionMetrics &metrics,
+    EccWorkspace &workspace) {
+  if (isXorParityChunk(chunk)) {
+    return reassembleXorPacket(chunk, metrics, workspace);
+  }
   if (chunk.isEccChunk) {
-    return reassembleEccPacket(chunk, metrics);
+    return reassembleEccPacket(chunk, metrics, workspace);
+  }
+  return reassembleDataPacket(chunk, metrics, workspace);
+}
+
+std::shared_ptr<MessageAssembly::ReassemblyEntry> MessageAssembly::pending(
+    int64_t trackingId) const {
+  auto it = reassembly.find(trackingId);
+
+  if (it == reassembly.end()) {
+    return nullptr;
   }
-  return reassembleDataPacket(chunk, metrics);
+
+  return it->second;
 }
 
 std::shared_ptr<MessageAssembly::ReassemblyEntry>
@@ -57,9 +78,13 @@ MessageAssembly::getResassmblyEntry(int64_t trackingId,
   auto it = reassembly.find(trackingId);
 
   if (it == reassembly.end()) {
-    entry = std::make_shared<ReassemblyEntry>();
+    entry = entries ? entries->acquire() : std::make_shared<ReassemblyEntry>();
 
     entry->trackingId = trackingId;
+    entry->chunkSize = chunkSize;
+    entry->eccMap.setChunkSize(chunkSize);
+    entry->dataMap.setChunkSize(chunkSize);
+    entry->xorMap.setChunkSize(chunkSize);
     entry->receivedDataChunks = 0;
     entry->receivedEccChunks = 0;
 
@@ -74,7 +99,13 @@ MessageAssembly::getResassmblyEntry(int64_t trackingId,
 }
 
 bool MessageAssembly::tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
-                                     ConnectionMetrics &metrics) {
+                                     ConnectionMetrics &metrics,
+                                     EccWorkspace &workspace) {
+  if ((entry->receivedXorChunks > 0) &&
+      (entry->receivedDataChunks < entry->dataMap.size())) {
+    entry->recoverXor();
+  }
+
   if (entry->hasEnoughChunks()) {
     reassembly.erase(entry->trackingId);
 
@@ -87,7 +118,13 @@ bool MessageAssembly::tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
       }
     }
 
-    if (entry->tryReconstruct()) {
+    if (deferredDecoding && entry->needsDecode()) {
+      entry->isDeferred = true;
+      metrics.validPackets++;
+      return true;
+    }
+
+    if (entry->tryReconstruct(workspace)) {
       metrics.validPackets++;
       return true;
     }
@@ -101,8 +138,9 @@ bool MessageAssembly::tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
 }
 
 std::shared_ptr<MessageAssembly::ReassemblyEntry>
-MessageAssembly::reassembleEccPacket(UdpChunk chunk,
-                                     ConnectionMetrics &metrics) {
+MessageAssembly::reassembleEccPacket(const UdpChunk &chunk,
+                                     ConnectionMetrics &metrics,
+                                     EccWorkspace &workspace) {
   auto entry = getResassmblyEntry(chunk.trackingId, metrics);
 
   if (entry->eccMap.empty()) {
@@ -110,8 +148,7 @@ MessageAssembly::reassembleEccPacket(UdpChunk chunk,
     entry->hasEccChunk.resize(chunk.chunkCount);
   }
 
-  if ((chunk.chunkIndex < 0) ||
-      (chunk.chunkIndex >= entry->hasEccChunk.size())) {
+  if (chunk.chunkIndex >= entry->hasEccChunk.size()) {
     metrics.invalidPackets++;
     return nullptr;
   }
@@ -120,10 +157,14 @@ MessageAssembly::reassembleEccPacket(UdpChunk chunk,
   entry->hasEccChunk[chunk.chunkIndex] = true;
 
   if (!alreadyReceived) {
-    entry->eccMap[chunk.chunkIndex] = chunk;
+    copyChunk(entry->eccMap[chunk.chunkIndex], chunk, entry->chunkSize);
     entry->receivedEccChunks++;
 
-    if (tryReconstruct(entry, metrics)) {
+    if (progressiveDecoding) {
+      entry->reduceEccChunk(chunk.chunkIndex, workspace);
+    }
+
+    if (tryReconstruct(entry, metrics, workspace)) {
       return entry;
     }
   } else {
@@ -134,18 +175,19 @@ MessageAssembly::reassembleEccPacket(UdpChunk chunk,
 }
 
 std::shared_ptr<MessageAssembly::ReassemblyEntry>
-MessageAssembly::reassembleDataPacket(UdpChunk chunk,
-                                      ConnectionMetrics &metrics) {
+MessageAssembly::reassembleDataPacket(const UdpChunk &chunk,
+                                      ConnectionMetrics &metrics,
+                                      EccWorkspace &workspace) {
   auto entry = getResassmblyEntry(chunk.trackingId, metrics);
 
   if (entry->dataMap.empty()) {
-    entry->data.resize(chunk.chunkCount * sizeof(chunk.data.bytes));
+    entry->data.resize(chunk.chunkCount * chunkPayloadSize(entry->chunkSize));
     entry->dataMap.resize(chunk.chunkCount);
     entry->hasDataChunk.resize(chunk.chunkCount);
   }
 
-  if ((chunk.chunkIndex < 0) ||
-      (chunk.chunkIndex >= entry->hasDataChunk.size())) {
+  if ((chunk.chunkIndex >= entry->hasDataChunk.size()) ||
+      (chunk.data.size > chunkPayloadSize(entry->chunkSize))) {
     metrics.invalidPackets++;
     return nullptr;
   }
@@ -154,10 +196,14 @@ MessageAssembly::reassembleDataPacket(UdpChunk chunk,
   entry->hasDataChunk[chunk.chunkIndex] = true;
 
   if (!alreadyReceived) {
-    entry->dataMap[chunk.chunkIndex] = chunk;
+    copyChunk(entry->dataMap[chunk.chunkIndex], chunk, entry->chunkSize);
     entry->receivedDataChunks++;
 
-    if (tryReconstruct(entry, metrics)) {
+    if (progressiveDecoding) {
+      entry->reduceDataChunk(chunk.chunkIndex, workspace);
+    }
+
+    if (tryReconstruct(entry, metrics, workspace)) {
       return entry;
     }
   } else {
@@ -167,64 +213,315 @@ MessageAssembly::reassembleDataPacket(UdpChunk chunk,
   return nullptr;
 }
 
+std::shared_ptr<MessageAssembly::ReassemblyEntry>
+MessageAssembly::reassembleXorPacket(const UdpChunk &chunk,
+                                     ConnectionMetrics &metrics,
+                                     EccWorkspace &workspace) {
+  auto entry = getResassmblyEntry(chunk.trackingId, metrics);
+
+  if (!entry->xorColumns) {
+    entry->xorColumns = chunk.chunkCount;
+  }
+
+  if ((chunk.chunkCount == 0) || (chunk.chunkCount != entry->xorColumns)) {
+    metrics.invalidPackets++;
+    return nullptr;
+  }
+
+  const size_t index = chunk.chunkIndex - chunk.chunkCount;
+
+  if (index >= entry->xorMap.size()) {
+    entry->xorMap.resize(index + 1);
+    entry->hasXorChunk.resize(index + 1);
+  }
+
+  if (entry->hasXorChunk[index]) {
+    metrics.duplicatePackets++;
+    return nullptr;
+  }
+
+  entry->hasXorChunk[index] = true;
+  copyChunk(entry->xorMap[index], chunk, entry->chunkSize);
+  entry->receivedXorChunks++;
+
+  if (tryReconstruct(entry, metrics, workspace)) {
+    return entry;
+  }
+
+  return nullptr;
+}
+
+void MessageAssembly::ReassemblyEntry::recoverXor() {
+  const int K = static_cast<int>(dataMap.size());
+  const int columns = static_cast<int>(xorColumns);
+  unsigned char *originals[MAX_WIDE_MESSAGE_CHUNKS];
+  unsigned char present[MAX_WIDE_MESSAGE_CHUNKS];
+  const unsigned char *parity[256];
+
+  if (K > MAX_WIDE_MESSAGE_CHUNKS) {
+    return;
+  }
+
+  for (int i = 0; i < K; i++) {
+    originals[i] = dataMap[i].ecc.bytes;
+    present[i] = hasDataChunk[i] ? 1 : 0;
+  }
+
+  // Row parity is decoded whether it was sent or not, it is just missing
+  const size_t parityCount =
+      static_cast<size_t>(xor_parity_count(K, columns, 1));
+  for (size_t i = 0; i < parityCount; i++) {
+    parity[i] = ((i < xorMap.size()) && hasXorChunk[i]) ? xorMap[i].ecc.bytes
+                                                        : nullptr;
+  }
+
+  xor_parity_decode(K, columns, 1, originals, present, parity, eccBytes());
+
+  for (int i = 0; i < K; i++) {
+    if (present[i] && !hasDataChunk[i]) {
+      hasDataChunk[i] = true;
+      receivedDataChunks++;
+    }
+  }
+}
+
+void MessageAssembly::ReassemblyEntry::reset() {
+  chunkSize = UDP_CHUNK_SIZE;
+  eccMap.clear();
+  dataMap.clear();
+  hasDataChunk.clear();
+  hasEccChunk.clear();
+  data.clear();
+
+  isReducing = false;
+  reducedEccChunks = 0;
+  isReducedEcc.clear();
+  reducedData.clear();
+
+  xorColumns = 0;
+  receivedXorChunks = 0;
+  xorMap.clear();
+  hasXorChunk.clear();
+
+  isDeferred = false;
+}
+
 bool MessageAssembly::ReassemblyEntry::hasEnoughChunks() {
   return !dataMap.empty() &&
          (dataMap.size() <= receivedDataChunks + receivedEccChunks);
 }
 
-bool MessageAssembly::ReassemblyEntry::tryReconstruct() {
-  if (dataMap.size() > receivedDataChunks) {
-    // use ECC to reconstruct missing packets
-    std::vector<Block> recoveryBlocks;
+bool MessageAssembly::ReassemblyEntry::needsDecode() const {
+  return !isReducing && (dataMap.size() > receivedDataChunks);
+}
 
-    recoveryBlocks.resize(receivedDataChunks + receivedEccChunks);
+bool MessageAssembly::ReassemblyEntry::prepareDecode(Block *blocks) {
+  const auto K = hasDataChunk.size();
+  const auto M = hasEccChunk.size();
 
-    size_t j = 0;
-    const auto K = hasDataChunk.size();
-    const auto M = hasEccChunk.size();
+  for (size_t i = 0, iEcc = 0; i < K; i++) {
+    auto &block = blocks[i];
 
-    for (size_t i = 0, iEcc = 0; i < K; i++) {
-      auto &block = recoveryBlocks[j++];
+    block.data = dataMap[i].ecc.bytes;
 
-      if (!hasDataChunk[i]) {
-        bool hasEcc = false;
+    if (hasDataChunk[i]) {
+      block.row = static_cast<unsigned char>(i);
+      continue;
+    }
 
-        for (; iEcc < M; iEcc++) {
-          if ((hasEcc = hasEccChunk[iEcc])) {
-            break;
-          }
-        }
+    // use ECC to reconstruct missing packets
+    bool hasEcc = false;
 
-        if (!hasEcc) {
-          return false;
-        }
+    for (; iEcc < M; iEcc++) {
+      if ((hasEcc = hasEccChunk[iEcc])) {
+        break;
+      }
+    }
 
-        block.row = static_cast<unsigned char>(K + iEcc);
-        block.data = dataMap[i].ecc.bytes;
+    if (!hasEcc) {
+      return false;
+    }
 
-        memcpy(block.data, eccMap[iEcc].ecc.bytes, CHUNK_ECC_SIZE);
+    block.row = static_cast<unsigned char>(K + iEcc);
+    memcpy(block.data, eccMap[iEcc].ecc.bytes, eccBytes());
 
-        iEcc++;
+    iEcc++;
+  }
 
-        continue;
-      } else {
-        block.row = static_cast<unsigned char>(i);
-        block.data = dataMap[i].ecc.bytes;
-      }
+  return true;
+}
+
+void MessageAssembly::ReassemblyEntry::assemble() {
+  const size_t payloadBytes = chunkPayloadSize(chunkSize);
+
+  data.resize(data.size() - (payloadBytes - dataMap.back().data.size));
+
+  for (size_t i = 0; i < dataMap.size(); i++) {
+    memcpy(&data[i * payloadBytes], dataMap[i].data.bytes, payloadBytes);
+  }
+}
+
+bool MessageAssembly::ReassemblyEntry::tryReconstruct(
+    EccWorkspace &workspace) {
+  if (isReducing) {
+    if ((dataMap.size() > receivedDataChunks) && !solveReduced(workspace)) {
+      return false;
+    }
+  } else if (needsDecode()) {
+    if (!prepareDecode(workspace.blocks)) {
+      return false;
     }
 
-    cauchy_256_decode(static_cast<int>(dataMap.size()),
-                      static_cast<int>(eccMap.size()), recoveryBlocks.data(),
-                      CHUNK_ECC_SIZE);
+    cauchy_256_decode_ws(static_cast<int>(dataMap.size()),
+                         static_cast<int>(eccMap.size()), workspace.blocks,
+                         eccBytes(), workspace.get());
+  }
+
+  assemble();
+  return true;
+}
+
+bool MessageAssembly::ReassemblyEntry::startReducing(
+    EccWorkspace &workspace) {
+  const auto K = dataMap.size();
+  const auto M = eccMap.size();
+
+  // A data chunk tells the message size and an ECC chunk that the message
+  // uses cauchy_256, XOR parity never gets here
+  if (isReducing || (K <= 1) || (M == 0)) {
+    return isReducing;
   }
 
-  data.resize(data.size() - (CHUNK_PAYLOAD_SIZE - dataMap.back().data.size));
+  isReducing = true;
+  reducedData.resize(K * eccBytes());
+  isReducedEcc.assign(M, false);
 
-  for (size_t i = 0; i < dataMap.size(); i++) {
-    memcpy(&data[i * CHUNK_PAYLOAD_SIZE], dataMap[i].data.bytes,
-           CHUNK_PAYLOAD_SIZE);
+  for (size_t i = 0; i < K; i++) {
+    if (hasDataChunk[i]) {
+      reduceDataChunk(i, workspace);
+    }
+  }
+  for (size_t i = 0; i < M; i++) {
+    if (hasEccChunk[i]) {
+      reduceEccChunk(i, workspace);
+    }
   }
 
   return true;
 }
+
+void MessageAssembly::ReassemblyEntry::reduceDataChunk(
+    size_t index, EccWorkspace &workspace) {
+  const auto K = dataMap.size();
+  const auto M = eccMap.size();
+
+  if (!isReducing) {
+    startReducing(workspace);
+    return;
+  }
+
+  Block original;
+  original.row = static_cast<unsigned char>(index);
+  original.data = &reducedData[index * eccBytes()];
+  memcpy(original.data, dataMap[index].ecc.bytes, eccBytes());
+
+  cauchy_256_reduce_init(static_cast<int>(K), static_cast<int>(M), &original,
+                         eccBytes(), workspace.get());
+
+  // reduceEccChunk() keeps fewer reduced chunks than missing data chunks,
+  // as the message completes once they are equal, so none is ever dropped
+  Block *rows = workspace.blocks;
+  size_t rowCount = 0;
+  for (size_t i = 0; i < isReducedEcc.size(); i++) {
+    if (isReducedEcc[i]) {
+      rows[rowCount].row = static_cast<unsigned char>(K + i);
+      rows[rowCount].data = eccMap[i].ecc.bytes;
+      rowCount++;
+    }
+  }
+
+  if (rowCount > 0) {
+    cauchy_256_reduce_add(static_cast<int>(K), static_cast<int>(M), &original,
+                          1, rows, static_cast<int>(rowCount), eccBytes(),
+                          workspace.get());
+  }
+}
+
+void MessageAssembly::ReassemblyEntry::reduceEccChunk(
+    size_t index, EccWorkspace &workspace) {
+  const auto K = dataMap.size();
+  const auto M = eccMap.size();
+
+  if (!isReducing) {
+    startReducing(workspace);
+    return;
+  }
+
+  if (reducedEccChunks >= K - receivedDataChunks) {
+    return;
+  }
+
+  Block row;
+  row.row = static_cast<unsigned char>(K + index);
+  row.data = eccMap[index].ecc.bytes;
+
+  if (cauchy_256_reduce_init(static_cast<int>(K), static_cast<int>(M), &row,
+                             eccBytes(), workspace.get()) != 0) {
+    return;
+  }
+
+  Block *originals = workspace.blocks;
+  size_t originalCount = 0;
+  for (size_t i = 0; i < K; i++) {
+    if (hasDataChunk[i]) {
+      originals[originalCount].row = static_cast<unsigned char>(i);
+      originals[originalCount].data = &reducedData[i * eccBytes()];
+      originalCount++;
+    }
+  }
+
+  cauchy_256_reduce_add(static_cast<int>(K), static_cast<int>(M), originals,
+                        static_cast<int>(originalCount), &row, 1,
+                        eccBytes(), workspace.get());
+
+  isReducedEcc[index] = true;
+  reducedEccChunks++;
+}
+
+bool MessageAssembly::ReassemblyEntry::solveReduced(EccWorkspace &workspace) {
+  Block *recoveryBlocks = workspace.blocks;
+  unsigned char erasures[256];
+  size_t n = 0;
+
+  const auto K = hasDataChunk.size();
+  const auto M = isReducedEcc.size();
+
+  for (size_t i = 0, iEcc = 0; i < K; i++) {
+    if (hasDataChunk[i]) {
+      continue;
+    }
+
+    while ((iEcc < M) && !isReducedEcc[iEcc]) {
+      iEcc++;
+    }
+
+    if (iEcc >= M) {
+      return false;
+    }
+
+    // Solve in place of the missing chunk, like the regular decoder does
+    auto &block = recoveryBlocks[n];
+    block.row = static_cast<unsigned char>(K + iEcc);
+    block.data = dataMap[i].ecc.bytes;
+    memcpy(block.data, eccMap[iEcc].ecc.bytes, eccBytes());
+
+    erasures[n++] = static_cast<unsigned char>(i);
+    iEcc++;
+  }
+
+  return cauchy_256_reduce_solve(static_cast<int>(K),
+                                 static_cast<int>(eccMap.size()),
+                                 recoveryBlocks, static_cast<int>(n), erasures,
+                                 eccBytes(), workspace.get()) == 0;
+}
 }  // namespace DirectRemote
@@ -29,31 +29,362 @@ SOFTWARE.
 
 namespace DirectRemote {
 
+// Parity indices have to fit chunkIndex, and msgCount plus the window and
+// log2 of the parity stride have to fit msgIndex, see UdpChunk
+static const size_t MAX_FRAME_PARITY_CHUNKS = 128;
+static const int MAX_FRAME_PARITY_STRIDE_LOG = 7;
+static const int MAX_PARITY_BLOCKS = 65536;
+
+// Rows of the rateless code, as many as chunkCount can signal with wire
+// format V1 and cauchy_256 takes for a message of chunkCount data chunks.
+// V2 carries 8 bits, but the rows are fixed before the frame is sent and
+// the same frame may go out in either format, so it is 127 for both.
+static int fountainEccChunks(size_t chunkCount) {
+  return static_cast<int>(
+      std::min<size_t>(MAX_MESSAGE_CHUNKS, 256 - chunkCount));
+}
+
+// XOR parity chunk indices start after the grid width and have to fit
+// chunkIndex as well
+static const size_t MAX_XOR_COLUMNS = (MAX_MESSAGE_CHUNKS + 1) / 2;
+
+EccPolicy EccPolicy::uniform(float eccPacketsPerDataPacket) {
+  EccPolicy policy;
+
+  for (int i = 0; i < FRAME_CLASS_COUNT; i++) {
+    policy.frameRatio[i] = policy.leadingRatio[i] = eccPacketsPerDataPacket;
+  }
+  policy.leadingMessages = 0;
+
+  return policy;
+}
+
+float EccPolicy::ratio(EFrameClass frameClass) const {
+  return frameRatio[static_cast<int>(frameClass)];
+}
+
+float EccPolicy::messageRatio(EFrameClass frameClass, int msgIndex) const {
+  const int i = static_cast<int>(frameClass);
+
+  if (msgIndex < leadingMessages) {
+    return std::max(frameRatio[i], leadingRatio[i]);
+  }
+  return frameRatio[i];
+}
+
 bool PacketAssembly::processFrame(const unsigned char *bytes, int byteCount,
                                   float eccPacketsPerDataPacket) {
-  data.clear();
+  return processFrame(bytes, byteCount,
+                      EccPolicy::uniform(eccPacketsPerDataPacket),
+                      EFrameClass::Delta);
+}
+
+bool PacketAssembly::processFrame(const unsigned char *bytes, int byteCount,
+                                  EFrameClass frameClass) {
+  return processFrame(bytes, byteCount, eccPolicy, frameClass);
+}
+
+bool PacketAssembly::processFrame(const unsigned char *bytes, int byteCount,
+                                  const EccPolicy &policy,
+                                  EFrameClass frameClass) {
+  startFrameData();
+
+  const size_t capacity = data.capacity() + ecc.capacity();
+  const bool isEncoded =
+      processFrameInternal(bytes, byteCount, policy, frameClass);
+
+  // The chunk buffers are the pool of the sending side
+  if (data.capacity() + ecc.capacity() > capacity) {
+    bufferMetrics.heapAllocations++;
+  } else {
+    bufferMetrics.reuses++;
+  }
+
+  return isEncoded;
+}
+
+void PacketAssembly::reservePools(int64_t bitrate, int frameRate,
+                                  float eccPacketsPerDataPacket) {
+  if ((bitrate <= 0) || (frameRate <= 0)) {
+    return;
+  }
+
+  // Keyframes are budgeted at this many average frames
+  const int64_t KEYFRAME_FACTOR = 8;
+  const int64_t frameBytes = KEYFRAME_FACTOR * bitrate / 8 / frameRate;
+  const size_t chunks = dataChunkCount(static_cast<size_t>(frameBytes),
+                                       chunkSize);
+  const size_t messages = 1 + chunks / messageChunks;
+
+  data.reserve(chunks);
+  ecc.reserve(static_cast<size_t>(chunks * eccPacketsPerDataPacket) +
+              messages + MAX_FRAME_PARITY_CHUNKS);
+}
+
+bool PacketAssembly::processFrameInternal(const unsigned char *bytes,
+                                          int byteCount,
+                                          const EccPolicy &policy,
+                                          EFrameClass frameClass) {
   ecc.clear();
+  nextRepairRow.clear();
+  isStreaming = false;
 
-  const int msgCount = 1 + std::max(0, byteCount - 1) / MAX_MESSAGE_SIZE;
+  const int messageBytes = maxMessageSize(chunkSize, messageChunks);
+  const int msgCount = 1 + std::max(0, byteCount - 1) / messageBytes;
+  const bool protectFrame =
+      frameProtection && !fountainMode && (msgCount > 1) &&
+      (msgCount + MAX_FRAME_PARITY_STRIDE_LOG <= UINT8_MAX);
+  const bool perMessageEcc = !protectFrame && !fountainMode;
 
-  for (int i = 0, iMsg = 0; i < std::max(1, byteCount);
-       i += MAX_MESSAGE_SIZE, iMsg++) {
-    int msgSize = std::min(MAX_MESSAGE_SIZE, byteCount - i);
+  data.reserve(dataChunkCount(byteCount, chunkSize));
 
-    if (!processMessageInternal(bytes + i, msgSize, eccPacketsPerDataPacket,
-                                dataPerMessage, eccPerMessage, eccRawPerMessage,
-                                packetPtrsPerMessage)) {
+  if (workers && (msgCount > 1)) {
+    if (!processMessagesParallel(bytes, byteCount, msgCount, policy,
+                                 frameClass, perMessageEcc)) {
       return false;
     }
+  } else {
+    for (int i = 0, iMsg = 0; i < std::max(1, byteCount);
+         i += messageBytes, iMsg++) {
+      if (!appendMessage(bytes + i, std::min(messageBytes, byteCount - i),
+                         iMsg, msgCount,
+                         policy.messageRatio(frameClass, iMsg),
+                         perMessageEcc)) {
+        return false;
+      }
+    }
+  }
 
-    for (auto &p : dataPerMessage) {
-      p.msgCount = static_cast<uint64_t>(msgCount);
-      p.msgIndex = static_cast<uint64_t>(iMsg);
+  return finishFrame(msgCount, protectFrame, policy.ratio(frameClass));
+}
+
+bool PacketAssembly::appendMessage(const unsigned char *bytes, int byteCount,
+                                   int msgIndex, int msgCount,
+                                   float eccPacketsPerDataPacket,
+                                   bool perMessageEcc) {
+  const size_t first = data.size();
+
+  // Data chunks are written in place, only ECC goes through a copy
+  data.resizeUninitialized(first + dataChunkCount(byteCount, chunkSize));
+
+  if (!processMessageInternal(bytes, byteCount, eccPacketsPerDataPacket,
+                              data.span(first), eccPerMessage,
+                              perMessageEcc ? &encoder : nullptr,
+                              schemeFor(byteCount), chunkSize)) {
+    return false;
+  }
+
+  for (size_t j = first; j < data.size(); j++) {
+    data[j].msgCount = static_cast<uint64_t>(msgCount);
+    data[j].msgIndex = static_cast<uint64_t>(msgIndex);
+  }
+
+  for (auto &p : eccPerMessage) {
+    p.msgCount = static_cast<uint64_t>(msgCount);
+    p.msgIndex = static_cast<uint64_t>(msgIndex);
+
+    ecc.push_back(p);
+  }
+
+  return true;
+}
+
+bool PacketAssembly::finishFrame(int msgCount, bool protectFrame,
+                                 float eccPacketsPerDataPacket) {
+  if (fountainMode) {
+    nextRepairRow.resize(msgCount);
+
+    if (!processRepairInternal(eccPacketsPerDataPacket)) {
+      return false;
+    }
+  } else if (protectFrame &&
+             !processParity(1, msgCount, eccPacketsPerDataPacket)) {
+    return false;
+  }
+
+  return processCrossFrameParity(msgCount);
+}
+
+void PacketAssembly::beginFrame(float eccPacketsPerDataPacket) {
+  beginFrame(EccPolicy::uniform(eccPacketsPerDataPacket), EFrameClass::Delta);
+}
+
+void PacketAssembly::beginFrame(EFrameClass frameClass) {
+  beginFrame(eccPolicy, frameClass);
+}
+
+void PacketAssembly::beginFrame(const EccPolicy &policy,
+                                EFrameClass frameClass) {
+  startFrameData();
+  ecc.clear();
+  nextRepairRow.clear();
+  streamBytes.clear();
+  streamPolicy = policy;
+  streamClass = frameClass;
+  streamMsgCount = 0;
+  firstNewData = firstNewEcc = 0;
+  isStreaming = true;
+}
+
+bool PacketAssembly::appendBytes(const unsigned char *bytes, int byteCount) {
+  if (!isStreaming || (byteCount < 0)) {
+    return false;
+  }
+
+  firstNewData = data.size();
+  firstNewEcc = ecc.size();
+
+  // The last message is held back until endFrame(), which is the only one
+  // that knows it is the last. So a message goes out once a byte follows.
+  const size_t messageBytes = maxMessageSize(chunkSize, messageChunks);
+  const size_t count = static_cast<size_t>(byteCount);
+  size_t offset = 0;
+
+  if (!streamBytes.empty()) {
+    offset = std::min(count, messageBytes - streamBytes.size());
+    streamBytes.insert(streamBytes.end(), bytes, bytes + offset);
+
+    if ((offset < count) && !appendStreamedMessage(streamBytes.data())) {
+      return false;
+    }
+  }
+
+  // Whole messages straight from the caller, without a copy
+  for (; count - offset > messageBytes; offset += messageBytes) {
+    if (!appendStreamedMessage(bytes + offset)) {
+      return false;
+    }
+  }
+
+  streamBytes.insert(streamBytes.end(), bytes + offset, bytes + count);
+  return true;
+}
+
+bool PacketAssembly::appendStreamedMessage(const unsigned char *bytes) {
+  const int messageBytes = maxMessageSize(chunkSize, messageChunks);
+
+  // This one and the held back one, the count has to fit with the parity
+  if (streamMsgCount + 2 + MAX_FRAME_PARITY_STRIDE_LOG > UINT8_MAX) {
+    isStreaming = false;
+    return false;
+  }
+
+  // Before the count is known, frame protection is a given for frames of
+  // more than one message
+  if (!appendMessage(bytes, messageBytes, streamMsgCount, 0,
+                     streamPolicy.messageRatio(streamClass, streamMsgCount),
+                     !frameProtection && !fountainMode)) {
+    isStreaming = false;
+    return false;
+  }
+
+  streamMsgCount++;
+  streamBytes.clear();
+  return true;
+}
+
+bool PacketAssembly::endFrame() {
+  if (!isStreaming) {
+    return false;
+  }
+
+  firstNewData = data.size();
+  firstNewEcc = ecc.size();
+  isStreaming = false;
+
+  const int msgCount = streamMsgCount + 1;
+  const bool protectFrame = frameProtection && !fountainMode && (msgCount > 1);
+
+  if (!appendMessage(streamBytes.data(), static_cast<int>(streamBytes.size()),
+                     streamMsgCount, msgCount,
+                     streamPolicy.messageRatio(streamClass, streamMsgCount),
+                     !protectFrame && !fountainMode)) {
+    return false;
+  }
+
+  return finishFrame(msgCount, protectFrame, streamPolicy.ratio(streamClass));
+}
+
+bool PacketAssembly::setChunkSize(int chunkSize) {
+  if (!isValidChunkSize(chunkSize)) {
+    return false;
+  }
+
+  // Parity of earlier frames was computed over chunks of the old size
+  this->chunkSize = chunkSize;
+  resetCrossFrames();
+
+  // Chunk buffers shrink to the size, see UdpChunkVector
+  data.setChunkSize(chunkSize);
+  ecc.setChunkSize(chunkSize);
+  for (auto &chunks : crossFrames) {
+    chunks.setChunkSize(chunkSize);
+  }
+  return true;
+}
+
+bool PacketAssembly::setMessageChunks(int messageChunks) {
+  if ((messageChunks < 1) || (messageChunks > MAX_WIDE_MESSAGE_CHUNKS)) {
+    return false;
+  }
+
+  this->messageChunks = messageChunks;
+  return true;
+}
+
+void PacketAssembly::setEncodeThreads(size_t threadCount) {
+  workers.reset();
+  workerEncoders.clear();
+
+  if (threadCount == 0) {
+    return;
+  }
+
+  workers.reset(new WorkerPool(threadCount));
+
+  for (size_t i = 0; i < workers->workerCount(); i++) {
+    workerEncoders.emplace_back(new StreamingEncoder());
+  }
+}
 
-      data.push_back(p);
+bool PacketAssembly::processMessagesParallel(const unsigned char *bytes,
+                                             int byteCount, int msgCount,
+                                             const EccPolicy &policy,
+                                             EFrameClass frameClass,
+                                             bool perMessageEcc) {
+  const int messageBytes = maxMessageSize(chunkSize, messageChunks);
+
+  // Every message but the last one has messageChunks data chunks, so the
+  // workers can write them to their final place
+  data.resizeUninitialized(dataChunkCount(byteCount, chunkSize));
+  messageEcc.resize(msgCount);
+  isMessageEncoded.assign(msgCount, 0);
+
+  workers->run(msgCount, [&](size_t iMsg, size_t worker) {
+    const int offset = static_cast<int>(iMsg) * messageBytes;
+    const int msgSize = std::min(messageBytes, byteCount - offset);
+    ChunkSpan chunks = data.span(iMsg * messageChunks);
+
+    isMessageEncoded[iMsg] = processMessageInternal(
+        bytes + offset, msgSize,
+        policy.messageRatio(frameClass, static_cast<int>(iMsg)), chunks,
+        messageEcc[iMsg],
+        perMessageEcc ? workerEncoders[worker].get() : nullptr,
+        schemeFor(msgSize), chunkSize);
+
+    for (size_t i = 0; i < dataChunkCount(msgSize, chunkSize); i++) {
+      chunks[i].msgCount = static_cast<uint64_t>(msgCount);
+      chunks[i].msgIndex = static_cast<uint64_t>(iMsg);
     }
+  });
 
-    for (auto &p : eccPerMessage) {
+  // Joined in message order, so the worker a message went to does not show
+  for (int iMsg = 0; iMsg < msgCount; iMsg++) {
+    if (!isMessageEncoded[iMsg]) {
+      return false;
+    }
+
+    for (auto &p : messageEcc[iMsg]) {
       p.msgCount = static_cast<uint64_t>(msgCount);
       p.msgIndex = static_cast<uint64_t>(iMsg);
 
@@ -64,81 +395,344 @@ bool PacketAssembly::processFrame(const unsigned char *bytes, int byteCount,
   return true;
 }
 
-bool PacketAssembly::processMessage(const unsigned char *bytes, int byteCount,
-                                    float eccPacketsPerDataPacket) {
-  dataPerMessage.clear();
-  eccPerMessage.clear();
-  eccRawPerMessage.clear();
-  packetPtrsPerMessage.clear();
+void PacketAssembly::setCrossFrameProtection(int depth,
+                                             float eccPacketsPerDataPacket) {
+  crossFrameDepth = std::max(1, std::min(MAX_PARITY_WINDOW, depth));
+  crossFrameRatio = eccPacketsPerDataPacket;
+  resetCrossFrames();
+}
+
+void PacketAssembly::startFrameData() {
+  if (isDataKept) {
+    if (crossFrameCount == crossFrames.size()) {
+      crossFrames.emplace_back(chunkSize);
+    }
 
-  return processMessageInternal(bytes, byteCount, eccPacketsPerDataPacket, data,
-                                ecc, eccRawPerMessage, packetPtrsPerMessage);
+    // The slot's old chunks are parity of a finished window, so its memory
+    // serves the new frame
+    data.swap(crossFrames[crossFrameCount++]);
+    isDataKept = false;
+  }
+
+  data.clear();
 }
 
-bool PacketAssembly::processMessageInternal(
-    const unsigned char *bytes, size_t byteCount, float eccPacketsPerDataPacket,
-    std::vector<UdpChunk> &outData, std::vector<UdpChunk> &outEcc,
-    std::vector<unsigned char> &eccRaw,
-    std::vector<const unsigned char *> &packetPtrs) {
-  outData.clear();
-  outEcc.clear();
-  eccRaw.clear();
-  packetPtrs.clear();
+bool PacketAssembly::processCrossFrameParity(int msgCount) {
+  if (crossFrameDepth <= 1) {
+    return true;
+  }
 
-  UdpChunk chunk = {};
-  const size_t chunkCount = 1u +
-                            (std::max(static_cast<size_t>(1u), byteCount) - 1) /
-                                sizeof(chunk.data.bytes);
+  // Windows do not overlap, so all parity of a window goes to whichever of
+  // its frames took the loss
+  const int window = static_cast<int>(crossFrameCount) + 1;
 
-  if (chunkCount > 127) {
+  if (window < crossFrameDepth) {
+    isDataKept = true;
+    return true;
+  }
+
+  const bool isEncoded = processParity(window, msgCount, crossFrameRatio);
+  crossFrameCount = 0;
+
+  return isEncoded;
+}
+
+bool PacketAssembly::processRepair(float eccPacketsPerDataPacket) {
+  ecc.clear();
+
+  return processRepairInternal(eccPacketsPerDataPacket);
+}
+
+bool PacketAssembly::processRepairInternal(float eccPacketsPerDataPacket) {
+  const int eccBytes = chunkEccSize(chunkSize);
+  bool hasRepair = false;
+
+  for (size_t iMsg = 0; iMsg < nextRepairRow.size(); iMsg++) {
+    const size_t first = iMsg * messageChunks;
+    const size_t chunkCount =
+        std::min(static_cast<size_t>(messageChunks), data.size() - first);
+    const int fountainRows = fountainEccChunks(chunkCount);
+    const size_t row = nextRepairRow[iMsg];
+    const size_t rowCount =
+        std::min(eccChunkCount(chunkCount, eccPacketsPerDataPacket),
+                 fountainRows - row);
+
+    if (rowCount == 0) {
+      continue;
+    }
+
+    chunkPointers.resize(chunkCount);
+    for (size_t i = 0; i < chunkCount; i++) {
+      chunkPointers[i] = data[first + i].ecc.bytes;
+    }
+
+    repairBlocks.resize(rowCount * eccBytes);
+
+    if (cauchy_256_encode_rows(
+            static_cast<int>(chunkCount), fountainRows,
+            static_cast<int>(row), static_cast<int>(rowCount),
+            chunkPointers.data(), repairBlocks.data(), eccBytes,
+            repairWorkspace.get()) != 0) {
+      return false;
+    }
+
+    UdpChunk chunk = {};
+    chunk.isEccChunk = true;
+    chunk.chunkCount = static_cast<uint64_t>(fountainRows);
+    chunk.msgCount = static_cast<uint64_t>(nextRepairRow.size());
+    chunk.msgIndex = static_cast<uint64_t>(iMsg);
+
+    for (size_t i = 0; i < rowCount; i++) {
+      chunk.chunkIndex = static_cast<uint64_t>(row + i);
+      memcpy(chunk.ecc.bytes, &repairBlocks[i * eccBytes], eccBytes);
+
+      ecc.push_back(chunk);
+    }
+
+    nextRepairRow[iMsg] += rowCount;
+    hasRepair = true;
+  }
+
+  return hasRepair;
+}
+
+bool PacketAssembly::processParity(int window, int msgCount,
+                                   float eccPacketsPerDataPacket) {
+  // Originals are ordered by frame, message and chunk, oldest frame first
+  chunkPointers.clear();
+  for (size_t i = crossFrameCount + 1 - window; i < crossFrameCount; i++) {
+    for (const auto &chunk : crossFrames[i]) {
+      chunkPointers.push_back(chunk.ecc.bytes);
+    }
+  }
+  for (const auto &chunk : data) {
+    chunkPointers.push_back(chunk.ecc.bytes);
+  }
+
+  const int eccBytes = chunkEccSize(chunkSize);
+  const int chunkCount = static_cast<int>(chunkPointers.size());
+  const int parityCount = static_cast<int>(
+      frameParityChunkCount(chunkPointers.size(), eccPacketsPerDataPacket));
+
+  // Too much to cover, the frames go without this parity
+  if ((chunkCount + fft_rs16_recovery_stride(parityCount) >
+       MAX_PARITY_BLOCKS) ||
+      (msgCount + 8 * (window - 1) + MAX_FRAME_PARITY_STRIDE_LOG >
+       UINT8_MAX)) {
+    return true;
+  }
+
+  frameParity.resize(
+      fft_rs16_encode_work_bytes(chunkCount, parityCount, eccBytes));
+
+  if (fft_rs16_encode(chunkCount, parityCount, eccBytes,
+                      chunkPointers.data(), frameParity.data()) != 0) {
     return false;
   }
 
-  for (size_t chunkIndex = 0, offset = 0; chunkIndex < chunkCount;
-       chunkIndex++, offset += sizeof(chunk.data.bytes)) {
-    chunk.chunkCount = chunkCount;
-    chunk.chunkIndex = chunkIndex;
-    chunk.isEccChunk = false;
+  int strideLog = 0;
+  while ((1 << strideLog) < fft_rs16_recovery_stride(parityCount)) {
+    strideLog++;
+  }
 
-    chunk.data.isConnected = 1;
-    chunk.data.size =
-        std::max(static_cast<int64_t>(0),
-                 std::min(static_cast<int64_t>(byteCount - offset),
-                          static_cast<int64_t>(sizeof(chunk.data.bytes))));
+  UdpChunk chunk = {};
+  chunk.isEccChunk = true;
+  chunk.chunkCount = data.back().chunkCount;
+  chunk.msgCount = static_cast<uint64_t>(msgCount);
+  chunk.msgIndex =
+      static_cast<uint64_t>(msgCount + 8 * (window - 1) + strideLog);
 
-    memcpy(chunk.data.bytes, bytes + offset, chunk.data.size);
+  for (int i = 0; i < parityCount; i++) {
+    chunk.chunkIndex = static_cast<uint64_t>(i);
+    memcpy(chunk.ecc.bytes, &frameParity[i * eccBytes], eccBytes);
 
-    outData.push_back(chunk);
+    ecc.push_back(chunk);
   }
 
-  static_assert(((CHUNK_ECC_SIZE % 8) == 0),
-                "outEcc blocks need to be a multiple of 8.");
+  return true;
+}
 
-  packetPtrs.resize(chunkCount);
+bool PacketAssembly::processMessage(const unsigned char *bytes, int byteCount,
+                                    float eccPacketsPerDataPacket) {
+  const size_t chunkCount = dataChunkCount(byteCount, chunkSize);
 
-  outEcc.resize(std::max(
-      1u, std::min(128u, static_cast<unsigned>(chunkCount *
-                                               eccPacketsPerDataPacket))));
-  eccRaw.resize(outEcc.size() * CHUNK_ECC_SIZE);
+  startFrameData();
+  nextRepairRow.clear();
 
-  for (size_t i = 0; i < outData.size(); i++) {
-    packetPtrs[i] = outData[i].ecc.bytes;
+  if (chunkCount > static_cast<size_t>(messageChunks)) {
+    return false;
   }
 
-  cauchy_256_encode(static_cast<int>(chunkCount),
-                    static_cast<int>(outEcc.size()),
-                    reinterpret_cast<const unsigned char **>(packetPtrs.data()),
-                    eccRaw.data(), CHUNK_ECC_SIZE);
+  data.resizeUninitialized(chunkCount);
 
-  for (size_t i = 0; i < outEcc.size(); i++) {
+  return processMessageInternal(bytes, byteCount, eccPacketsPerDataPacket,
+                                data.span(), ecc, &encoder,
+                                schemeFor(byteCount), chunkSize);
+}
+
+void PacketAssembly::setSmallMessageScheme(EEccScheme scheme,
+                                           size_t maxChunks) {
+  smallMessageScheme = scheme;
+  smallMessageChunks = maxChunks;
+}
+
+EEccScheme PacketAssembly::schemeFor(size_t byteCount) const {
+  return (dataChunkCount(byteCount, chunkSize) <= smallMessageChunks) ? smallMessageScheme
+                                            : EEccScheme::Cauchy;
+}
+
+bool PacketAssembly::processXorParity(ConstChunkSpan data, size_t k,
+                                      EEccScheme scheme,
+                                      float eccPacketsPerDataPacket,
+                                      int eccBytes, UdpChunkVector &outEcc) {
+  size_t columns = std::min(
+      {eccChunkCount(k, eccPacketsPerDataPacket), k, MAX_XOR_COLUMNS});
+  int rowParity = 0;
+
+  if (scheme == EEccScheme::Xor2D) {
+    columns = 1;
+    while (columns * columns < k) {
+      columns++;
+    }
+    rowParity = 1;
+  }
+
+  const int k32 = static_cast<int>(k);
+  const int columns32 = static_cast<int>(columns);
+  const size_t parityCount =
+      static_cast<size_t>(xor_parity_count(k32, columns32, rowParity));
+
+  const unsigned char *originals[MAX_WIDE_MESSAGE_CHUNKS];
+  unsigned char *parity[MAX_WIDE_MESSAGE_CHUNKS + 1];
+
+  outEcc.resize(parityCount);
+
+  for (size_t i = 0; i < k; i++) {
+    originals[i] = data[i].ecc.bytes;
+  }
+
+  for (size_t i = 0; i < parityCount; i++) {
     auto &eccChunk = outEcc[i];
-    memcpy(eccChunk.ecc.bytes, &eccRaw[i * CHUNK_ECC_SIZE], CHUNK_ECC_SIZE);
 
-    eccChunk.chunkCount = outEcc.size();
-    eccChunk.chunkIndex = i;
     eccChunk.isEccChunk = true;
+    eccChunk.chunkCount = columns;
+    eccChunk.chunkIndex = columns + i;
+    parity[i] = eccChunk.ecc.bytes;
   }
 
-  return true;
+  return xor_parity_encode(k32, columns32, rowParity, originals, parity,
+                           eccBytes) == 0;
+}
+
+size_t PacketAssembly::dataChunkCount(size_t byteCount, int chunkSize) {
+  return 1 + (std::max(static_cast<size_t>(1), byteCount) - 1) /
+                 chunkPayloadSize(chunkSize);
+}
+
+size_t PacketAssembly::eccChunkCount(size_t chunkCount,
+                                     float eccPacketsPerDataPacket) {
+  // The ECC chunk count has to fit chunkCount with wire format V1, and
+  // cauchy_256 takes 256 chunks per message
+  const auto count = static_cast<size_t>(chunkCount * eccPacketsPerDataPacket);
+  const size_t maxCount = std::min<size_t>(
+      MAX_MESSAGE_CHUNKS, 256 - std::min<size_t>(255, chunkCount));
+  return std::max(static_cast<size_t>(1), std::min(maxCount, count));
+}
+
+size_t PacketAssembly::frameParityChunkCount(size_t chunkCount,
+                                             float eccPacketsPerDataPacket) {
+  const auto count = static_cast<size_t>(chunkCount * eccPacketsPerDataPacket);
+  return std::max(static_cast<size_t>(1),
+                  std::min(MAX_FRAME_PARITY_CHUNKS, count));
+}
+
+void PacketAssembly::warmUp(const EccPolicy &policy, bool fountainMode) {
+  for (int i = 0; i < FRAME_CLASS_COUNT; i++) {
+    warmUp(policy.frameRatio[i], fountainMode);
+
+    if ((policy.leadingMessages > 0) &&
+        (policy.leadingRatio[i] > policy.frameRatio[i])) {
+      warmUp(policy.leadingRatio[i], fountainMode);
+    }
+  }
+}
+
+void PacketAssembly::warmUp(float eccPacketsPerDataPacket,
+                            bool fountainMode) {
+  fft_rs16_init();
+
+  for (size_t chunkCount = 1; chunkCount <= MAX_WIDE_MESSAGE_CHUNKS;
+       chunkCount++) {
+    cauchy_256_cache_warm(
+        static_cast<int>(chunkCount),
+        static_cast<int>(eccChunkCount(chunkCount, eccPacketsPerDataPacket)));
+
+    if (fountainMode) {
+      cauchy_256_cache_warm(static_cast<int>(chunkCount),
+                            fountainEccChunks(chunkCount));
+    }
+  }
+}
+
+bool PacketAssembly::processMessageInternal(
+    const unsigned char *bytes, size_t byteCount, float eccPacketsPerDataPacket,
+    ChunkSpan outData, UdpChunkVector &outEcc, StreamingEncoder *encoder,
+    EEccScheme scheme, int chunkSize) {
+  outEcc.setChunkSize(chunkSize);
+  outEcc.clear();
+
+  // XOR parity is computed in one go at the end, it is cheap enough
+  const bool isXor = encoder && (scheme != EEccScheme::Cauchy);
+  if (isXor) {
+    encoder = nullptr;
+  }
+
+  const size_t payloadBytes = chunkPayloadSize(chunkSize);
+  const size_t chunkCount = dataChunkCount(byteCount, chunkSize);
+
+  if (chunkCount > MAX_WIDE_MESSAGE_CHUNKS) {
+    return false;
+  }
+
+  static_assert(((MAX_CHUNK_ECC_SIZE % 8) == 0),
+                "outEcc blocks need to be a multiple of 8.");
+
+  if (encoder &&
+      !encoder->begin(chunkCount,
+                      eccChunkCount(chunkCount, eccPacketsPerDataPacket),
+                      chunkEccSize(chunkSize))) {
+    return false;
+  }
+
+  for (size_t chunkIndex = 0, offset = 0; chunkIndex < chunkCount;
+       chunkIndex++, offset += payloadBytes) {
+    UdpChunk &chunk = outData[chunkIndex];
+    const size_t size = std::min(byteCount - std::min(byteCount, offset),
+                                 payloadBytes);
+
+    // The payload is the one copy of the frame, the codecs need it right
+    // after the size field. Nothing else is written twice.
+    memset(&chunk, 0, CHUNK_PAYLOAD_OFFSET);
+    memcpy(chunk.data.bytes, bytes + offset, size);
+    memset(chunk.data.bytes + size, 0, payloadBytes - size);
+
+    chunk.chunkCount = chunkCount;
+    chunk.chunkIndex = chunkIndex;
+    chunk.data.isConnected = 1;
+    chunk.data.size = static_cast<uint16_t>(size);
+
+    // The chunk is final from here on, its parity is accounted for
+    if (encoder) {
+      encoder->add(chunk);
+    }
+  }
+
+  if (isXor) {
+    return processXorParity(outData, chunkCount, scheme,
+                            eccPacketsPerDataPacket,
+                            chunkEccSize(chunkSize), outEcc);
+  }
+
+  return !encoder || encoder->finish(outEcc);
 }
 }  // namespace DirectRemote
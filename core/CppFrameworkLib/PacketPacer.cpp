@@ -0,0 +1,276 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "PacketPacer.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace DirectRemote {
+
+// Datagrams per send, like Socket::sendtoMany() batches them
+static const size_t BATCH_SIZE = 64;
+static const size_t INITIAL_RING_SIZE = 64;
+
+// Tokens refilled until availableAt() may come out a little short, which
+// must not keep the datagram waiting
+static const double TOKEN_SLACK = 1;
+
+TokenBucket::TokenBucket(double bytesPerSecond, double burstBytes) {
+  setRate(bytesPerSecond, burstBytes);
+  tokens = burst;
+}
+
+void TokenBucket::setRate(double bytesPerSecond, double burstBytes) {
+  rate = std::max(0.0, bytesPerSecond);
+  burst = std::max(burstBytes, static_cast<double>(MAX_UDP_CHUNK_SIZE));
+  tokens = std::min(tokens, burst);
+}
+
+void TokenBucket::refill(double now) {
+  if (now > lastTime) {
+    tokens = std::min(burst, tokens + (now - lastTime) * rate);
+    lastTime = now;
+  }
+}
+
+double TokenBucket::availableAt(size_t bytes, double now) {
+  refill(now);
+
+  if ((rate <= 0) || (tokens + TOKEN_SLACK >= bytes)) {
+    return now;
+  }
+  return now + (bytes - tokens) / rate;
+}
+
+bool TokenBucket::take(size_t bytes, double now) {
+  refill(now);
+
+  if (rate <= 0) {
+    return true;
+  }
+  if (tokens + TOKEN_SLACK < bytes) {
+    return false;
+  }
+
+  tokens -= bytes;
+  return true;
+}
+
+PacketPacer::PacketPacer(SendFunc send, double bytesPerSecond,
+                         double burstBytes)
+    : send(send),
+      bucket(bytesPerSecond, burstBytes),
+      start(Clock::now()),
+      ring(INITIAL_RING_SIZE) {
+  thread = std::thread([this]() { threadMain(); });
+}
+
+PacketPacer::~PacketPacer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  wake.notify_all();
+
+  thread.join();
+}
+
+double PacketPacer::now() const {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void PacketPacer::setRate(double bytesPerSecond, double burstBytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  bucket.setRate(bytesPerSecond, burstBytes);
+  wake.notify_all();
+}
+
+void PacketPacer::grow() {
+  std::vector<Datagram> larger(2 * ring.size());
+
+  for (size_t i = 0; i < count; i++) {
+    larger[i] = ring[(head + i) & (ring.size() - 1)];
+  }
+
+  ring.swap(larger);
+  head = 0;
+}
+
+void PacketPacer::queue(const void *const *headers, const size_t *headerSizes,
+                        const void *const *bodies, const size_t *bodySizes,
+                        size_t count) {
+  std::unique_lock<std::mutex> lock(mutex);
+  const bool wasEmpty = (this->count == 0);
+  const double queuedAt = now();
+
+  for (size_t i = 0; i < count; i++) {
+    if (this->count == ring.size()) {
+      sent.wait(lock, [this]() { return !isSending; });
+      grow();
+    }
+
+    Datagram &datagram = ring[(head + this->count) & (ring.size() - 1)];
+    datagram.queuedAt = queuedAt;
+    datagram.size = headerSizes[i] + bodySizes[i];
+    memcpy(datagram.bytes, headers[i], headerSizes[i]);
+    memcpy(datagram.bytes + headerSizes[i], bodies[i], bodySizes[i]);
+
+    this->count++;
+  }
+
+  // Otherwise the thread is waiting for tokens, which this does not change
+  if (wasEmpty) {
+    wake.notify_all();
+  }
+}
+
+void PacketPacer::clear() {
+  std::unique_lock<std::mutex> lock(mutex);
+  sent.wait(lock, [this]() { return !isSending; });
+  head = count = 0;
+  isBacklogged = false;
+}
+
+void PacketPacer::flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  sent.wait(lock, [this]() { return count == 0; });
+}
+
+size_t PacketPacer::queuedPackets() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return count;
+}
+
+void PacketPacer::threadMain() {
+  const void *datagrams[BATCH_SIZE];
+  size_t sizes[BATCH_SIZE];
+  double deadline = -1;
+  std::unique_lock<std::mutex> lock(mutex);
+
+  // Stopping still sends what is queued, see ~PacketPacer()
+  while (!isStopping || (count > 0)) {
+    if (count == 0) {
+      deadline = -1;
+      wake.wait(lock);
+      continue;
+    }
+
+    const double time = now();
+    const size_t mask = ring.size() - 1;
+    const double readyAt = bucket.availableAt(ring[head].size, time);
+
+    if (readyAt > time) {
+      deadline = readyAt;
+      const auto wakeAt = start + std::chrono::duration_cast<Clock::duration>(
+                                      std::chrono::duration<double>(readyAt));
+      wake.wait_until(lock, wakeAt);
+      continue;
+    }
+
+    if (deadline >= 0) {
+      latenessSum += time - deadline;
+      lateWakeups++;
+      deadline = -1;
+    }
+
+    // As many as there are tokens for, in one system call
+    size_t batch = 0;
+    size_t batchBytes = 0;
+    while ((batch < std::min(count, BATCH_SIZE)) &&
+           bucket.take(ring[(head + batch) & mask].size, time)) {
+      const Datagram &datagram = ring[(head + batch) & mask];
+
+      datagrams[batch] = datagram.bytes;
+      sizes[batch] = datagram.size;
+      batchBytes += datagram.size;
+      batch++;
+    }
+
+    // The ring stays put while the lock is released, see grow()
+    isSending = true;
+    lock.unlock();
+    send(datagrams, sizes, batch);
+    const double sentAt = now();
+    lock.lock();
+    isSending = false;
+
+    for (size_t i = 0; i < batch; i++) {
+      const double delay = sentAt - ring[(head + i) & mask].queuedAt;
+
+      queueDelaySum += delay;
+      metrics.maxQueueDelay = std::max(metrics.maxQueueDelay, delay);
+    }
+    metrics.packets += static_cast<int64_t>(batch);
+
+    // Only time the queue was never empty tells the rate
+    if (isBacklogged) {
+      backlogBytes += batchBytes;
+      backlogTime += time - lastSendAt;
+    }
+
+    head = (head + batch) & mask;
+    count -= batch;
+    lastSendAt = time;
+    isBacklogged = (count > 0);
+
+    sent.notify_all();
+  }
+
+  sent.notify_all();
+}
+
+PacingMetrics PacketPacer::takeMetrics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  PacingMetrics result = metrics;
+
+  if (result.packets > 0) {
+    result.meanQueueDelay = queueDelaySum / result.packets;
+  }
+  if (lateWakeups > 0) {
+    result.meanLateness = latenessSum / lateWakeups;
+  }
+  if ((backlogTime > 0) && (bucket.getRate() > 0)) {
+    result.rateAccuracy = backlogBytes / backlogTime / bucket.getRate();
+  }
+
+  metrics = PacingMetrics();
+  queueDelaySum = latenessSum = backlogBytes = backlogTime = 0;
+  lateWakeups = 0;
+
+  return result;
+}
+
+void PacketPacer::recordMetrics(PerformanceMonitor &perfMon) {
+  const PacingMetrics pacing = takeMetrics();
+
+  perfMon.recordCounter(EPerfMetric::PacingQueueDelay,
+                        pacing.meanQueueDelay * 1000);
+  perfMon.recordCounter(EPerfMetric::PacingMaxQueueDelay,
+                        pacing.maxQueueDelay * 1000);
+  perfMon.recordCounter(EPerfMetric::PacingLateness,
+                        pacing.meanLateness * 1000);
+  perfMon.recordCounter(EPerfMetric::PacingRateAccuracy, pacing.rateAccuracy);
+}
+}  // namespace DirectRemote
@@ -0,0 +1,246 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "SendScheduler.h"
+
+#include <algorithm>
+
+namespace DirectRemote {
+
+void SendScheduler::orderFrame(ChunkSpan data, ChunkSpan ecc) {
+  const size_t dataCount = data.size();
+  const size_t eccCount = ecc.size();
+
+  entries.clear();
+
+  // Chunks come grouped by message, the ECC chunks of all messages after
+  // the data chunks of all messages
+  size_t x = 0, j = 0;
+  while (x < dataCount) {
+    const uint64_t msgIndex = data[x].msgIndex;
+
+    size_t dataEnd = x;
+    while ((dataEnd < dataCount) && (data[dataEnd].msgIndex == msgIndex)) {
+      dataEnd++;
+    }
+
+    size_t eccEnd = j;
+    while ((eccEnd < eccCount) && !isParityChunk(ecc[eccEnd]) &&
+           (ecc[eccEnd].msgIndex == msgIndex)) {
+      eccEnd++;
+    }
+
+    column.clear();
+
+    const size_t step =
+        std::max<size_t>(1, (dataEnd - x) / std::max<size_t>(1, eccEnd - j));
+    for (size_t i = 0; x < dataEnd; i++) {
+      if ((i % step == 0) && (j < eccEnd)) {
+        column.push_back(&ecc[j++]);
+      } else {
+        column.push_back(&data[x++]);
+      }
+    }
+    for (; j < eccEnd; j++) {
+      column.push_back(&ecc[j]);
+    }
+
+    addColumn();
+  }
+
+  mergeColumns();
+  frameOrder.swap(order);
+
+  // Parity, which comes after the ECC chunks of all messages
+  for (; j < eccCount; j++) {
+    frameOrder.push_back(&ecc[j]);
+  }
+}
+
+void SendScheduler::addColumn() {
+  // Every column is spread over the whole time, where two meet the earlier
+  // column goes first
+  const double offset = entries.size() * 1e-12;
+
+  for (size_t i = 0; i < column.size(); i++) {
+    Entry entry;
+    entry.due = (i + 0.5) / column.size() + offset;
+    entry.chunk = column[i];
+    entries.push_back(entry);
+  }
+}
+
+void SendScheduler::mergeColumns() {
+  std::stable_sort(
+      entries.begin(), entries.end(),
+      [](const Entry &a, const Entry &b) { return a.due < b.due; });
+
+  order.clear();
+  for (const auto &entry : entries) {
+    order.push_back(entry.chunk);
+  }
+  entries.clear();
+}
+
+void SendScheduler::addHeldShare(HeldFrame &frame) {
+  const size_t begin =
+      (frame.nextShare == 1) ? 0 : frame.shareEnds[frame.nextShare - 1];
+  const size_t end = frame.shareEnds[frame.nextShare];
+
+  column.clear();
+  for (size_t i = begin; i < end; i++) {
+    column.push_back(&frame.chunks[i]);
+  }
+
+  addColumn();
+  frame.nextShare++;
+}
+
+void SendScheduler::holdFrame(size_t shareCount, size_t parityStart,
+                              int chunkSize, double now) {
+  HeldFrame &frame = held[nextSlot];
+  nextSlot = (nextSlot + 1) % MAX_INTERLEAVE_FRAMES;
+
+  frame.chunks.setChunkSize(chunkSize);
+  frame.chunks.clear();
+  frame.shareCount = shareCount;
+  frame.nextShare = 1;
+  frame.due = (holdTime > 0) ? now + holdTime : -1;
+
+  // Every share takes every shareCount-th chunk, so it covers all messages
+  for (size_t share = 1; share < shareCount; share++) {
+    for (size_t i = share; i < parityStart; i += shareCount) {
+      frame.chunks.push_back(*frameOrder[i]);
+    }
+    frame.shareEnds[share] = frame.chunks.size();
+  }
+
+  for (size_t i = parityStart; i < frameOrder.size(); i++) {
+    frame.chunks.push_back(*frameOrder[i]);
+  }
+  frame.shareEnds[shareCount - 1] = frame.chunks.size();
+}
+
+const std::vector<UdpChunk *> &SendScheduler::schedule(
+    ChunkSpan data, ChunkSpan ecc, int64_t trackingId, size_t shareCount,
+    double now) {
+  shareCount = std::max<size_t>(
+      1, std::min<size_t>(shareCount, MAX_INTERLEAVE_FRAMES));
+
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i].trackingId = trackingId;
+  }
+  for (size_t i = 0; i < ecc.size(); i++) {
+    ecc[i].trackingId = trackingId;
+  }
+
+  orderFrame(data, ecc);
+
+  const size_t parityStart = static_cast<size_t>(
+      std::find_if(frameOrder.begin(), frameOrder.end(),
+                   [](const UdpChunk *chunk) { return isParityChunk(*chunk); }) -
+      frameOrder.begin());
+
+  // Oldest frames first. The slot the frame is held in is free by now, it
+  // had at most MAX_INTERLEAVE_FRAMES - 1 shares left when it was filled.
+  for (size_t i = 0; i < MAX_INTERLEAVE_FRAMES; i++) {
+    HeldFrame &frame = held[(nextSlot + i) % MAX_INTERLEAVE_FRAMES];
+
+    if (frame.nextShare < frame.shareCount) {
+      addHeldShare(frame);
+    }
+  }
+
+  column.clear();
+  if (shareCount == 1) {
+    column.insert(column.end(), frameOrder.begin(), frameOrder.end());
+  } else {
+    for (size_t i = 0; i < parityStart; i += shareCount) {
+      column.push_back(frameOrder[i]);
+    }
+    holdFrame(shareCount, parityStart, data.chunkSize(), now);
+  }
+  addColumn();
+
+  mergeColumns();
+  return order;
+}
+
+const std::vector<UdpChunk *> &SendScheduler::flush() {
+  for (size_t i = 0; i < MAX_INTERLEAVE_FRAMES; i++) {
+    HeldFrame &frame = held[(nextSlot + i) % MAX_INTERLEAVE_FRAMES];
+
+    while (frame.nextShare < frame.shareCount) {
+      addHeldShare(frame);
+    }
+  }
+
+  mergeColumns();
+  return order;
+}
+
+const std::vector<UdpChunk *> &SendScheduler::releaseDue(double now) {
+  for (size_t i = 0; i < MAX_INTERLEAVE_FRAMES; i++) {
+    HeldFrame &frame = held[(nextSlot + i) % MAX_INTERLEAVE_FRAMES];
+
+    if ((frame.due < 0) || (frame.due > now)) {
+      continue;
+    }
+
+    while (frame.nextShare < frame.shareCount) {
+      addHeldShare(frame);
+    }
+  }
+
+  mergeColumns();
+  return order;
+}
+
+double SendScheduler::nextDue() const {
+  double due = -1;
+
+  for (const auto &frame : held) {
+    if ((frame.nextShare < frame.shareCount) && (frame.due >= 0) &&
+        ((due < 0) || (frame.due < due))) {
+      due = frame.due;
+    }
+  }
+  return due;
+}
+
+bool SendScheduler::hasHeldChunks() const {
+  for (const auto &frame : held) {
+    if (frame.nextShare < frame.shareCount) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SendScheduler::clear() {
+  for (auto &frame : held) {
+    frame.nextShare = frame.shareCount = 0;
+  }
+}
+}  // namespace DirectRemote
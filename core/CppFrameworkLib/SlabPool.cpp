@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "SlabPool.h"
+
+#include <new>
+
+namespace DirectRemote {
+
+SlabPool::~SlabPool() {
+  for (void *slab : slabs) {
+    ::operator delete(slab);
+  }
+}
+
+void SlabPool::addSlab(size_t sizeClass) {
+  const size_t blockBytes = (sizeClass + 1) * SLAB_BLOCK_ALIGNMENT;
+  unsigned char *slab =
+      static_cast<unsigned char *>(::operator new(SLAB_BYTES));
+
+  slabs.push_back(slab);
+  metrics.heapAllocations++;
+
+  for (size_t offset = 0; offset + blockBytes <= SLAB_BYTES;
+       offset += blockBytes) {
+    FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + offset);
+    block->next = freeLists[sizeClass];
+    freeLists[sizeClass] = block;
+  }
+}
+
+void *SlabPool::allocate(size_t bytes) {
+  if ((bytes == 0) || (bytes > MAX_SLAB_BLOCK)) {
+    metrics.heapAllocations++;
+    metrics.overflows++;
+    return ::operator new(bytes);
+  }
+
+  const size_t sizeClass = (bytes - 1) / SLAB_BLOCK_ALIGNMENT;
+
+  if (!freeLists[sizeClass]) {
+    addSlab(sizeClass);
+  } else {
+    metrics.reuses++;
+  }
+
+  FreeBlock *block = freeLists[sizeClass];
+  freeLists[sizeClass] = block->next;
+  return block;
+}
+
+void SlabPool::deallocate(void *ptr, size_t bytes) {
+  if ((bytes == 0) || (bytes > MAX_SLAB_BLOCK)) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  FreeBlock *block = static_cast<FreeBlock *>(ptr);
+  const size_t sizeClass = (bytes - 1) / SLAB_BLOCK_ALIGNMENT;
+
+  block->next = freeLists[sizeClass];
+  freeLists[sizeClass] = block;
+}
+}  // namespace DirectRemote
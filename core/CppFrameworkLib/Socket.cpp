@@ -24,11 +24,15 @@ SOFTWARE.
 
 #include "Socket.h"
 
+#include <algorithm>
+#include <vector>
+
 #if BOOST_OS_WINDOWS
 
 typedef int socklen_t;
 
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
 
 #else
@@ -48,6 +52,10 @@ typedef int SOCKET;
 
 #define closesocket(handle) ::close(handle)
 
+#if defined(__linux__)
+#include <sys/uio.h>
+#endif
+
 #endif
 
 #undef min
@@ -174,6 +182,110 @@ ssize_t Socket::sendto(const void *data, size_t dataSize,
                   static_cast<socklen_t>(addrSize));
 }
 
+size_t Socket::sendtoMany(const void *const *datagrams, const size_t *sizes,
+                          size_t count, SocketAddress remoteAddress) {
+#if defined(__linux__)
+  // One system call per batch, with the datagrams referenced in place
+  static const size_t BATCH_SIZE = 64;
+  auto addr = reinterpret_cast<sockaddr_in *>(remoteAddress.data);
+  mmsghdr messages[BATCH_SIZE];
+  iovec vectors[BATCH_SIZE];
+  size_t sent = 0;
+
+  while (sent < count) {
+    const size_t batch = std::min(BATCH_SIZE, count - sent);
+
+    for (size_t i = 0; i < batch; i++) {
+      vectors[i].iov_base = const_cast<void *>(datagrams[sent + i]);
+      vectors[i].iov_len = sizes[sent + i];
+
+      memset(&messages[i], 0, sizeof(messages[i]));
+      messages[i].msg_hdr.msg_name = addr;
+      messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int result = sendmmsg(static_cast<SOCKET>(handle), messages,
+                                static_cast<unsigned>(batch), 0);
+    if (result <= 0) {
+      break;
+    }
+
+    sent += static_cast<size_t>(result);
+  }
+
+  return sent;
+#else
+  size_t sent = 0;
+
+  while ((sent < count) &&
+         (sendto(datagrams[sent], sizes[sent], remoteAddress) >= 0)) {
+    sent++;
+  }
+
+  return sent;
+#endif
+}
+
+size_t Socket::sendtoMany(const void *const *headers,
+                          const size_t *headerSizes,
+                          const void *const *bodies, const size_t *bodySizes,
+                          size_t count, SocketAddress remoteAddress) {
+#if defined(__linux__)
+  // Gathered by the kernel, neither part is copied
+  static const size_t BATCH_SIZE = 64;
+  auto addr = reinterpret_cast<sockaddr_in *>(remoteAddress.data);
+  mmsghdr messages[BATCH_SIZE];
+  iovec vectors[2 * BATCH_SIZE];
+  size_t sent = 0;
+
+  while (sent < count) {
+    const size_t batch = std::min(BATCH_SIZE, count - sent);
+
+    for (size_t i = 0; i < batch; i++) {
+      vectors[2 * i].iov_base = const_cast<void *>(headers[sent + i]);
+      vectors[2 * i].iov_len = headerSizes[sent + i];
+      vectors[2 * i + 1].iov_base = const_cast<void *>(bodies[sent + i]);
+      vectors[2 * i + 1].iov_len = bodySizes[sent + i];
+
+      memset(&messages[i], 0, sizeof(messages[i]));
+      messages[i].msg_hdr.msg_name = addr;
+      messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+      messages[i].msg_hdr.msg_iov = &vectors[2 * i];
+      messages[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    const int result = sendmmsg(static_cast<SOCKET>(handle), messages,
+                                static_cast<unsigned>(batch), 0);
+    if (result <= 0) {
+      break;
+    }
+
+    sent += static_cast<size_t>(result);
+  }
+
+  return sent;
+#else
+  std::vector<unsigned char> datagram;
+  size_t sent = 0;
+
+  for (; sent < count; sent++) {
+    const auto header = static_cast<const unsigned char *>(headers[sent]);
+    const auto body = static_cast<const unsigned char *>(bodies[sent]);
+
+    datagram.assign(header, header + headerSizes[sent]);
+    datagram.insert(datagram.end(), body, body + bodySizes[sent]);
+
+    if (sendto(datagram.data(), datagram.size(), remoteAddress) < 0) {
+      break;
+    }
+  }
+
+  return sent;
+#endif
+}
+
 bool Socket::connect(SocketAddress remoteAddress) {
   return ::connect(static_cast<SOCKET>(handle),
                    reinterpret_cast<sockaddr *>(remoteAddress.data),
@@ -186,6 +298,25 @@ bool Socket::bind(SocketAddress remoteAddress) {
                 sizeof(sockaddr_in)) == 0;
 }
 
+bool Socket::setDontFragment(bool enabled) {
+#if BOOST_OS_WINDOWS
+  DWORD value = enabled ? 1 : 0;
+  return setsockopt(static_cast<SOCKET>(handle), IPPROTO_IP, IP_DONTFRAGMENT,
+                    reinterpret_cast<const char *>(&value),
+                    sizeof(value)) == 0;
+#elif defined(IP_MTU_DISCOVER)
+  int value = enabled ? IP_PMTUDISC_DO : IP_PMTUDISC_WANT;
+  return setsockopt(static_cast<SOCKET>(handle), IPPROTO_IP, IP_MTU_DISCOVER,
+                    &value, sizeof(value)) == 0;
+#elif defined(IP_DONTFRAG)
+  int value = enabled ? 1 : 0;
+  return setsockopt(static_cast<SOCKET>(handle), IPPROTO_IP, IP_DONTFRAG,
+                    &value, sizeof(value)) == 0;
+#else
+  return !enabled;
+#endif
+}
+
 void Socket::close() {
   if (handle != INVALID_SOCKET) {
     closesocket(static_cast<int>(handle));
@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "StreamingEncoder.h"
+#include "ErasureCode.h"
+
+#include <string.h>
+
+namespace DirectRemote {
+
+bool StreamingEncoder::begin(size_t dataChunkCount, size_t eccChunkCount,
+                             int eccBytes) {
+  if (isOpen) {
+    cauchy_256_encode_end(workspace.get());
+  }
+
+  this->dataChunkCount = dataChunkCount;
+  this->eccChunkCount = eccChunkCount;
+  this->eccBytes = eccBytes;
+  recovery.resize(eccChunkCount * eccBytes);
+
+  isOpen = cauchy_256_encode_begin(static_cast<int>(dataChunkCount),
+                                   static_cast<int>(eccChunkCount),
+                                   recovery.data(), eccBytes,
+                                   workspace.get()) == 0;
+  return isOpen;
+}
+
+bool StreamingEncoder::add(const UdpChunk &chunk) {
+  if (!isOpen || (chunk.chunkIndex >= dataChunkCount)) {
+    return false;
+  }
+
+  return cauchy_256_encode_add(workspace.get(),
+                               static_cast<int>(chunk.chunkIndex),
+                               chunk.ecc.bytes) == 0;
+}
+
+bool StreamingEncoder::finish(UdpChunkVector &outEcc) {
+  if (!isOpen) {
+    return false;
+  }
+
+  isOpen = false;
+  if (cauchy_256_encode_end(workspace.get()) != 0) {
+    return false;
+  }
+
+  // Chunks of the size the ECC region belongs to
+  outEcc.setChunkSize(eccBytes + CHUNK_ECC_OFFSET);
+  outEcc.resize(eccChunkCount);
+
+  for (size_t i = 0; i < eccChunkCount; i++) {
+    auto &eccChunk = outEcc[i];
+    memcpy(eccChunk.ecc.bytes, &recovery[i * eccBytes], eccBytes);
+
+    eccChunk.chunkCount = eccChunkCount;
+    eccChunk.chunkIndex = i;
+    eccChunk.isEccChunk = true;
+  }
+
+  return true;
+}
+}  // namespace DirectRemote
@@ -24,6 +24,8 @@ SOFTWARE.
 
 #include "ViewerResponseBuilder.h"
 
+#include <stddef.h>
+#include <string.h>
 #include <random>
 #include <map>
 #include <stack>
@@ -99,6 +101,17 @@ struct ViewerReponsePacket {
 static_assert(sizeof(ViewerReponsePacket) <= sizeof(UdpPayloadChunk),
               "ViewerReponsePacket is too large.");
 
+static bool isResponse(const unsigned char *bytes, size_t byteCount) {
+  int64_t magic;
+
+  if (!bytes || (byteCount < sizeof(ViewerReponsePacket))) {
+    return false;
+  }
+
+  memcpy(&magic, bytes + offsetof(ViewerReponsePacket, magic), sizeof(magic));
+  return magic == VIEWER_RESPONSE_MAGIC;
+}
+
 struct ViewerResponseEncoderImpl {
   int16_t uniquenessCounter = std::random_device()();
   int32_t clientId = std::random_device()();
@@ -238,6 +251,21 @@ void ViewerResponseEncoder::toPackets(
   }
 }
 
+bool ViewerResponseEncoder::stampMetrics(const unsigned char *bytes,
+                                         size_t byteCount,
+                                         const ConnectionMetrics &metrics,
+                                         UdpPayloadChunk &outPacket) {
+  if ((byteCount > sizeof(outPacket)) || !isResponse(bytes, byteCount)) {
+    return false;
+  }
+
+  unsigned char *packet = reinterpret_cast<unsigned char *>(&outPacket);
+  memcpy(packet, bytes, byteCount);
+  memcpy(packet + offsetof(ViewerReponsePacket, metrics), &metrics,
+         sizeof(metrics));
+  return true;
+}
+
 void ViewerResponseEncoder::trackMouseRelative(float deltaX, float deltaY) {
   pimpl->mouseDeltaX += deltaX;
   pimpl->mouseDeltaY += deltaY;
@@ -333,6 +361,18 @@ ConnectionMetrics ViewerResponseDecoder::getMetrics() { return pimpl->metrics; }
 
 int32_t ViewerResponseDecoder::getClientId() { return pimpl->clientId; }
 
+bool ViewerResponseDecoder::readMetrics(const unsigned char *bytes,
+                                        size_t byteCount,
+                                        ConnectionMetrics &outMetrics) {
+  if (!isResponse(bytes, byteCount)) {
+    return false;
+  }
+
+  memcpy(&outMetrics, bytes + offsetof(ViewerReponsePacket, metrics),
+         sizeof(outMetrics));
+  return true;
+}
+
 void ViewerResponseDecoder::parsePacket(UdpPayloadChunk packet) {
   ViewerReponsePacket p = *(reinterpret_cast<ViewerReponsePacket *>(&packet));
 
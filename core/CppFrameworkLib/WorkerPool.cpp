@@ -0,0 +1,148 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "WorkerPool.h"
+
+namespace DirectRemote {
+WorkerPool::WorkerPool(size_t threadCount) : nextJob(0) {
+  for (size_t i = 0; i < threadCount; i++) {
+    threads.emplace_back([this, i]() { threadMain(i + 1); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  wake.notify_all();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Owners of queued tasks wait for them, so they run here
+  Task *task = firstTask;
+  firstTask = lastTask = nullptr;
+  while (task) {
+    Task *next = task->next;
+    task->run(0);
+    task = next;
+  }
+}
+
+void WorkerPool::drain(size_t worker) {
+  for (size_t i; (i = nextJob.fetch_add(1)) < jobCount;) {
+    (*job)(i, worker);
+  }
+}
+
+void WorkerPool::threadMain(size_t worker) {
+  uint64_t seenGeneration = 0;
+
+  while (true) {
+    Task *task = nullptr;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() {
+        return isStopping || (generation != seenGeneration) || firstTask;
+      });
+
+      if (isStopping) {
+        return;
+      }
+
+      // Jobs of run() first, the caller is blocked on them
+      if (generation == seenGeneration) {
+        task = firstTask;
+        firstTask = task->next;
+        if (!firstTask) {
+          lastTask = nullptr;
+        }
+      } else {
+        seenGeneration = generation;
+      }
+    }
+
+    if (task) {
+      task->run(worker);
+      continue;
+    }
+
+    drain(worker);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busyThreads == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+void WorkerPool::submit(Task *task) {
+  if (threads.empty()) {
+    task->run(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    task->next = nullptr;
+
+    if (lastTask) {
+      lastTask->next = task;
+    } else {
+      firstTask = task;
+    }
+    lastTask = task;
+  }
+  wake.notify_one();
+}
+
+void WorkerPool::run(size_t count, const Job &job) {
+  if (threads.empty() || (count <= 1)) {
+    for (size_t i = 0; i < count; i++) {
+      job(i, 0);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->job = &job;
+    jobCount = count;
+    nextJob = 0;
+    busyThreads = threads.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  drain(0);
+
+  // Workers still look at job until they are done with it
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]() { return busyThreads == 0; });
+  this->job = nullptr;
+}
+}  // namespace DirectRemote
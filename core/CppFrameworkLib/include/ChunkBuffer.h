@@ -0,0 +1,366 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef CHUNKBUFFER_H
+#define CHUNKBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+
+// Widest vector the ECC kernels use (AVX-512), also a cache line
+#define CHUNK_BUFFER_ALIGNMENT 64
+
+// Places byte "Offset" of the first element on an "Alignment" boundary. The
+// original pointer is stashed right in front of the returned block.  Memory
+// comes from ::operator new, so replacing it (e.g. to count allocations)
+// covers chunk buffers too.
+template <class T, size_t Alignment, size_t Offset = 0>
+class AlignedAllocator {
+ public:
+  typedef T value_type;
+
+  template <class U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment, Offset> other;
+  };
+
+  AlignedAllocator() {}
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment, Offset> &) {}
+
+  T *allocate(size_t count) {
+    void *raw = ::operator new(count * sizeof(T) + Alignment + sizeof(void *));
+
+    const uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(void *);
+    const uintptr_t mask = Alignment - 1;
+    const uintptr_t aligned = (start + Offset + mask) & ~mask;
+    unsigned char *block = reinterpret_cast<unsigned char *>(aligned - Offset);
+
+    memcpy(block - sizeof(void *), &raw, sizeof(void *));
+    return reinterpret_cast<T *>(block);
+  }
+
+  void deallocate(T *ptr, size_t) {
+    void *raw;
+    memcpy(&raw, reinterpret_cast<unsigned char *>(ptr) - sizeof(void *),
+           sizeof(void *));
+    ::operator delete(raw);
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment, Offset> &) const {
+    return true;
+  }
+
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment, Offset> &) const {
+    return false;
+  }
+};
+
+static_assert((sizeof(UdpChunk) % CHUNK_BUFFER_ALIGNMENT) == 0,
+              "The largest chunks have to keep their stride aligned.");
+static_assert(offsetof(UdpChunk, ecc) == CHUNK_ECC_OFFSET,
+              "CHUNK_ECC_OFFSET does not match UdpChunk.");
+
+// Distance of chunks of this size in chunk storage, which keeps the ECC
+// region of every chunk aligned
+inline size_t chunkStride(int chunkSize) {
+  const size_t mask = CHUNK_BUFFER_ALIGNMENT - 1;
+  return (static_cast<size_t>(chunkSize) + mask) & ~mask;
+}
+
+// Walks chunks chunkStride() bytes apart
+template <class T>
+class ChunkIterator {
+ public:
+  typedef typename std::conditional<std::is_const<T>::value,
+                                    const unsigned char, unsigned char>::type
+      Byte;
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef typename std::remove_const<T>::type value_type;
+  typedef ptrdiff_t difference_type;
+  typedef T *pointer;
+  typedef T &reference;
+
+  ChunkIterator(Byte *chunk, size_t stride) : chunk(chunk), stride(stride) {}
+
+  T &operator*() const { return *reinterpret_cast<T *>(chunk); }
+  T *operator->() const { return reinterpret_cast<T *>(chunk); }
+  T &operator[](ptrdiff_t n) const { return *(*this + n); }
+
+  ChunkIterator &operator++() {
+    chunk += stride;
+    return *this;
+  }
+  ChunkIterator operator++(int) {
+    ChunkIterator it = *this;
+    chunk += stride;
+    return it;
+  }
+  ChunkIterator &operator--() {
+    chunk -= stride;
+    return *this;
+  }
+  ChunkIterator &operator+=(ptrdiff_t n) {
+    chunk += n * static_cast<ptrdiff_t>(stride);
+    return *this;
+  }
+  ChunkIterator operator+(ptrdiff_t n) const {
+    return ChunkIterator(chunk + n * static_cast<ptrdiff_t>(stride), stride);
+  }
+  ptrdiff_t operator-(const ChunkIterator &other) const {
+    return (chunk - other.chunk) / static_cast<ptrdiff_t>(stride);
+  }
+
+  bool operator==(const ChunkIterator &other) const {
+    return chunk == other.chunk;
+  }
+  bool operator!=(const ChunkIterator &other) const {
+    return chunk != other.chunk;
+  }
+  bool operator<(const ChunkIterator &other) const {
+    return chunk < other.chunk;
+  }
+
+ private:
+  Byte *chunk;
+  size_t stride;
+};
+
+// Some chunks of a UdpChunkVector, or all of them
+template <class T>
+class BasicChunkSpan {
+ public:
+  typedef typename ChunkIterator<T>::Byte Byte;
+
+  BasicChunkSpan() {}
+  BasicChunkSpan(Byte *first, size_t count, int chunkSize)
+      : first(first), count(count), chunkBytes(chunkSize) {}
+
+  // Chunks to const chunks
+  template <class U>
+  BasicChunkSpan(const BasicChunkSpan<U> &other)
+      : first(other.firstByte()),
+        count(other.size()),
+        chunkBytes(other.chunkSize()) {}
+
+  T &operator[](size_t i) const {
+    return *reinterpret_cast<T *>(first + i * chunkStride(chunkBytes));
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  int chunkSize() const { return chunkBytes; }
+  Byte *firstByte() const { return first; }
+
+ private:
+  Byte *first = nullptr;
+  size_t count = 0;
+  int chunkBytes = MAX_UDP_CHUNK_SIZE;
+};
+
+typedef BasicChunkSpan<UdpChunk> ChunkSpan;
+typedef BasicChunkSpan<const UdpChunk> ConstChunkSpan;
+
+// Chunk storage where the ECC region of every chunk is aligned. Chunks are
+// only chunkStride() of the session's chunk size apart, so the bytes of a
+// chunk beyond its chunk size belong to the next one. Store chunks with
+// copyChunk() or push_back(), never by assigning a whole UdpChunk; reading
+// one as a whole stays within the buffer though.
+class UdpChunkVector {
+ public:
+  typedef ChunkIterator<UdpChunk> iterator;
+  typedef ChunkIterator<const UdpChunk> const_iterator;
+
+  UdpChunkVector() {}
+  explicit UdpChunkVector(int chunkSize) { setChunkSize(chunkSize); }
+
+  UdpChunkVector(const UdpChunkVector &other)
+      : chunkBytes(other.chunkBytes) {
+    if (other.count > 0) {
+      reserve(other.count);
+      memcpy(first, other.first, other.count * stride());
+      count = other.count;
+    }
+  }
+
+  UdpChunkVector(UdpChunkVector &&other) noexcept { swap(other); }
+
+  UdpChunkVector &operator=(UdpChunkVector other) {
+    swap(other);
+    return *this;
+  }
+
+  ~UdpChunkVector() { release(first); }
+
+  void swap(UdpChunkVector &other) {
+    std::swap(first, other.first);
+    std::swap(count, other.count);
+    std::swap(capacityBytes, other.capacityBytes);
+    std::swap(chunkBytes, other.chunkBytes);
+  }
+
+  // Drops all chunks when the size changes, MAX_UDP_CHUNK_SIZE by default
+  void setChunkSize(int chunkSize) {
+    if (chunkSize != chunkBytes) {
+      chunkBytes = chunkSize;
+      count = 0;
+    }
+  }
+
+  int chunkSize() const { return chunkBytes; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  void clear() { count = 0; }
+
+  size_t capacity() const {
+    return (capacityBytes < tailBytes()) ? 0
+                                         : (capacityBytes - tailBytes()) /
+                                               stride();
+  }
+
+  void reserve(size_t chunkCount) {
+    if (chunkCount > capacity()) {
+      release(reallocate(chunkCount));
+    }
+  }
+
+  // New chunks are zeroed
+  void resize(size_t chunkCount) {
+    if (chunkCount > capacity()) {
+      reserve(std::max(chunkCount, 2 * capacity()));
+    }
+    if (chunkCount > count) {
+      memset(first + count * stride(), 0, (chunkCount - count) * stride());
+    }
+    count = chunkCount;
+  }
+
+  // Like resize(), for callers that write every byte of the new chunks up
+  // to the chunk size anyway
+  void resizeUninitialized(size_t chunkCount) {
+    if (chunkCount > capacity()) {
+      reserve(std::max(chunkCount, 2 * capacity()));
+    }
+    count = chunkCount;
+  }
+
+  void push_back(const UdpChunk &chunk) {
+    unsigned char *old = nullptr;
+
+    // "chunk" may be one of ours, so the old buffer goes after the copy
+    if (count == capacity()) {
+      old = reallocate(std::max<size_t>(8, 2 * count));
+    }
+
+    unsigned char *slot = first + count * stride();
+    memcpy(slot, &chunk, chunkBytes);
+    memset(slot + chunkBytes, 0, stride() - chunkBytes);
+    count++;
+
+    release(old);
+  }
+
+  UdpChunk &operator[](size_t i) {
+    return *reinterpret_cast<UdpChunk *>(first + i * stride());
+  }
+  const UdpChunk &operator[](size_t i) const {
+    return *reinterpret_cast<const UdpChunk *>(first + i * stride());
+  }
+
+  UdpChunk &back() { return (*this)[count - 1]; }
+  const UdpChunk &back() const { return (*this)[count - 1]; }
+
+  iterator begin() { return iterator(first, stride()); }
+  iterator end() { return iterator(first + count * stride(), stride()); }
+  const_iterator begin() const { return const_iterator(first, stride()); }
+  const_iterator end() const {
+    return const_iterator(first + count * stride(), stride());
+  }
+
+  ChunkSpan span(size_t offset = 0) {
+    return ChunkSpan(first + offset * stride(), count - offset, chunkBytes);
+  }
+  ChunkSpan span(size_t offset, size_t chunkCount) {
+    return ChunkSpan(first + offset * stride(), chunkCount, chunkBytes);
+  }
+  ConstChunkSpan span(size_t offset = 0) const {
+    return ConstChunkSpan(first + offset * stride(), count - offset,
+                          chunkBytes);
+  }
+
+ private:
+  unsigned char *first = nullptr;
+  size_t count = 0;
+  size_t capacityBytes = 0;
+  int chunkBytes = MAX_UDP_CHUNK_SIZE;
+
+  typedef AlignedAllocator<unsigned char, CHUNK_BUFFER_ALIGNMENT,
+                           CHUNK_ECC_OFFSET>
+      Allocator;
+
+  size_t stride() const { return chunkStride(chunkBytes); }
+
+  // Room after the last chunk, so it can be read as a whole UdpChunk
+  size_t tailBytes() const { return sizeof(UdpChunk) - stride(); }
+
+  // Returns the old buffer, which the caller releases
+  unsigned char *reallocate(size_t chunkCount) {
+    unsigned char *old = first;
+
+    capacityBytes = chunkCount * stride() + tailBytes();
+    first = Allocator().allocate(capacityBytes);
+    if (old) {
+      memcpy(first, old, count * stride());
+    }
+
+    return old;
+  }
+
+  static void release(unsigned char *buffer) {
+    if (buffer) {
+      Allocator().deallocate(buffer, 0);
+    }
+  }
+};
+
+typedef std::vector<unsigned char,
+                    AlignedAllocator<unsigned char, CHUNK_BUFFER_ALIGNMENT>>
+    AlignedByteVector;
+}  // namespace DirectRemote
+
+#endif
@@ -0,0 +1,105 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef ECCCONTROLLER_H
+#define ECCCONTROLLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "IPerformanceMonitor.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+
+// Picks the ECC ratio from what the viewer reports back. The loss rate is
+// what the viewer received of what was sent since its last report, the
+// burst length how much more those samples scatter than independent loss
+// would. The ratio is the smallest that keeps the frame loss they predict
+// for per message ECC below the target. Not thread-safe.
+class EccController {
+ public:
+  struct Options {
+    // Frames lost despite ECC, which the ratio aims for
+    double targetFrameLoss = 0.001;
+    float minRatio = 0.02f;
+    float maxRatio = 0.5f;
+    // Packets sent before a report makes a loss sample, so that packets
+    // still on their way weigh little
+    int64_t minSamplePackets = 200;
+  };
+
+ private:
+  Options options;
+  int64_t sentPackets = 0;
+  int64_t sampleSentPackets = 0;
+  int64_t sampleIncomingPackets = -1;
+
+  // Shape of the frames sent, averaged
+  double chunksPerMessage = 0;
+  double messagesPerFrame = 0;
+
+  double lossRate = 0;
+  double lossVariance = 0;
+  double burstLength = 1;
+  double residualFrameLoss = 0;
+  float ratio;
+
+  void update();
+
+ public:
+  explicit EccController(float initialRatio);
+  EccController(float initialRatio, Options options);
+
+  // A frame of dataChunks data chunks in msgCount messages and eccChunks
+  // ECC chunks went out
+  void onFrameSent(size_t dataChunks, size_t eccChunks, size_t msgCount);
+
+  // Repair chunks that went out for a frame already sent
+  void onRepairSent(size_t eccChunks);
+
+  // Cumulative metrics of the viewer, as its responses carry them, see
+  // ViewerResponseDecoder::readMetrics(). A viewer that starts over is taken
+  // as a fresh baseline.
+  void onViewerMetrics(const ConnectionMetrics &metrics);
+
+  float eccRatio() const { return ratio; }
+  double getLossRate() const { return lossRate; }
+  double getBurstLength() const { return burstLength; }
+
+  // Frame loss the current estimates predict at the current ratio
+  double getResidualFrameLoss() const { return residualFrameLoss; }
+
+  // Records EccRatio, EccLossRate, EccBurstLength and EccResidualFrameLoss
+  void recordMetrics(PerformanceMonitor &perfMon) const;
+
+  // Probability that a message of chunkCount data and eccCount ECC chunks
+  // cannot be recovered, when chunks are lost at lossRate in bursts of
+  // burstLength
+  static double messageLoss(size_t chunkCount, size_t eccCount,
+                            double lossRate, double burstLength);
+};
+}  // namespace DirectRemote
+
+#endif
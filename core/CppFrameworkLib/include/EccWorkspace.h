@@ -0,0 +1,58 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef ECCWORKSPACE_H
+#define ECCWORKSPACE_H
+
+#include "ErasureCode.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+
+// Everything cauchy_256_encode_ws()/cauchy_256_decode_ws() need for chunk
+// sized blocks, allocated once per owner instead of once per message. Not
+// thread-safe; each encoder/decoder owns its own.
+class EccWorkspace {
+ private:
+  Cauchy256Workspace *workspace;
+
+  EccWorkspace(const EccWorkspace &) = delete;
+  EccWorkspace &operator=(const EccWorkspace &) = delete;
+
+ public:
+  // Block descriptors for one decode, k + m <= 256
+  Block blocks[256];
+
+  // Serves every chunk size. MAX_CHUNK_ECC_SIZE is a multiple of 8, so
+  // creation can not fail.
+  EccWorkspace()
+      : workspace(cauchy_256_workspace_create(MAX_CHUNK_ECC_SIZE)) {}
+
+  ~EccWorkspace() { cauchy_256_workspace_free(workspace); }
+
+  Cauchy256Workspace *get() { return workspace; }
+};
+}  // namespace DirectRemote
+
+#endif
@@ -25,37 +25,204 @@ SOFTWARE.
 #ifndef FRAMEASSEMBLY_H
 #define FRAMEASSEMBLY_H
 
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <string.h>
 #include <unordered_map>
 #include <vector>
 
+#include "EccWorkspace.h"
 #include "UdpChunk.h"
 #include "MessageAssembly.h"
+#include "SlabPool.h"
+#include "WorkerPool.h"
 
 namespace DirectRemote {
 class FrameAssembly {
  public:
+  // Messages of a frame that are decoding on worker threads
+  struct PendingDecodes {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t count = 0;
+  };
+
   struct ReassemblyEntry {
     int64_t trackingId;
-    int32_t receivedMsgCount;
+    size_t receivedMsgCount;
     std::vector<std::shared_ptr<MessageAssembly>> msgMap;
     std::vector<std::shared_ptr<MessageAssembly::ReassemblyEntry>> messages;
     std::vector<unsigned char> data;
+
+    // Chunk count of the last message, 0 until a data or parity chunk told
+    size_t lastMessageChunks = 0;
+
+    // Chunk count of every other message, see setMessageChunks()
+    size_t fullMessageChunks = MAX_MESSAGE_CHUNKS;
+
+    // Streamed frame whose message count is not known yet. Until then
+    // msgMap grows with the messages seen, see UdpChunk::msgCount.
+    bool isOpen = false;
+
+    // Null until the first message goes to a worker thread
+    std::shared_ptr<PendingDecodes> pendingDecodes;
+
+    // Data chunks of a message, 0 while unknown
+    size_t messageChunks(size_t msgIndex) const;
+
+    // Back to a fresh entry, keeping the memory, see ObjectPool
+    void reset();
   };
 
-  std::shared_ptr<ReassemblyEntry> process(UdpChunk chunk,
+  FrameAssembly();
+  ~FrameAssembly();
+
+  std::shared_ptr<ReassemblyEntry> process(const UdpChunk &chunk,
                                            ConnectionMetrics &metrics);
 
+  // Further frames that became ready along with the one process() returned.
+  // With cross-frame parity, completed frames wait for older ones that
+  // parity may still repair, and are then released together.
+  std::shared_ptr<ReassemblyEntry> nextReadyFrame();
+
+  // See MessageAssembly::setProgressiveDecoding()
+  void setProgressiveDecoding(bool enabled) { progressiveDecoding = enabled; }
+
+  // Messages that need the erasure decoder are decoded together once their
+  // frame is complete, so messages that lost the same chunks share one
+  // matrix inversion and pass, see cauchy_256_decode_batch_ws(). On by
+  // default; without it every message is decoded as soon as it can be.
+  void setBatchDecoding(bool enabled) { batchDecoding = enabled; }
+
+  // Decodes messages on threadCount threads as soon as they have enough
+  // chunks, instead of batching them at the end of the frame, so the thread
+  // calling process() keeps draining the socket while a keyframe decodes.
+  // A frame comes out of process() once its last message is in and all its
+  // decodes are done, which that call waits for. 0 turns it off.
+  void setDecodeThreads(size_t threadCount);
+
+  // Takes frames the sender spreads over up to "frames" frames, see
+  // SendScheduler. Frames stay open until that many newer ones came in, and
+  // completed frames wait for the older ones, like with cross-frame parity.
+  // 1, the default, counts chunks of older frames that come in after newer
+  // ones as out of order, which drops the newer frames.
+  void setFrameInterleaving(int frames);
+
+  // See MessageAssembly::setChunkSize()
+  void setChunkSize(int chunkSize) { this->chunkSize = chunkSize; }
+
+  // Data chunks the sender puts into every message of a frame but the last,
+  // see PacketAssembly::setMessageChunks(). Applies to frames whose first
+  // chunk arrives afterwards.
+  void setMessageChunks(int messageChunks) {
+    this->messageChunks = messageChunks;
+  }
+
+  // Sizes the pools frames and messages are recycled through for a stream
+  // of "bitrate" bits per second at "frameRate" frames per second, and fills
+  // them right away. The pools work without it, but start out small and
+  // drop what goes beyond their capacity.
+  void reservePools(int64_t bitrate, int frameRate);
+
+  // Heap allocations of the pools; once warm they stop
+  PoolMetrics poolMetrics() const;
+
  private:
+  // Parity over the frames [trackingId - window + 1, trackingId], see
+  // PacketAssembly::setFrameProtection() and setCrossFrameProtection()
+  struct ParityEntry {
+    UdpChunkVector parityMap;
+    std::vector<bool> hasParityChunk;
+    size_t receivedParityChunks = 0;
+  };
+  typedef std::pair<int64_t, int> ParityKey;  // trackingId, window
+
+  typedef std::map<int64_t, std::shared_ptr<ReassemblyEntry>,
+                   std::less<int64_t>,
+                   SlabAllocator<std::pair<const int64_t,
+                                           std::shared_ptr<ReassemblyEntry>>>>
+      FrameMap;
+
+  // Declared first, everything below may hold memory of the pools
+  SlabPool nodePool;
+  ObjectPool<MessageAssembly::ReassemblyEntry> messagePool;
+  ObjectPool<MessageAssembly> assemblyPool;
+  ObjectPool<ReassemblyEntry> framePool;
+
   void cleanupHistory(ConnectionMetrics &metrics);
-  std::map<int64_t, std::shared_ptr<ReassemblyEntry>> reassembly;
+  FrameMap reassembly;
+  EccWorkspace eccWorkspace;
+  bool progressiveDecoding = false;
+  bool batchDecoding = true;
+  int chunkSize = UDP_CHUNK_SIZE;
+  int messageChunks = MAX_MESSAGE_CHUNKS;
+  int64_t completedTrackingId = -1;
+  std::deque<std::shared_ptr<ReassemblyEntry>,
+             SlabAllocator<std::shared_ptr<ReassemblyEntry>>>
+      readyFrames;
+
+  // Cross-frame parity and interleaving keep completed frames as long as a
+  // window can reach them, and deliver frames in order up to
+  // deliveredTrackingId
+  int parityWindow = 1;
+  int64_t newestTrackingId = -1;
+  int64_t deliveredTrackingId = -1;
+  FrameMap completed;
+  std::map<ParityKey, ParityEntry, std::less<ParityKey>,
+           SlabAllocator<std::pair<const ParityKey, ParityEntry>>>
+      parity;
+
+  AlignedByteVector parityWork;
+  std::vector<const unsigned char *> parityOriginals, parityRecovery;
+  std::vector<ReassemblyEntry *> windowFrames;
+  std::vector<std::shared_ptr<MessageAssembly::ReassemblyEntry>>
+      windowMessages;
+
+  std::vector<Block> batchBlocks;
+  std::vector<Block *> batchSets;
+  std::vector<MessageAssembly::ReassemblyEntry *> batchMessages;
+  std::vector<size_t> batchOrder;
+
+  // Decode of one message on a worker thread, see decodeAsync(). Tasks go
+  // back to freeTasks once they ran, so handing one out does not allocate.
+  struct DecodeTask : WorkerPool::Task {
+    FrameAssembly *owner = nullptr;
+    std::shared_ptr<PendingDecodes> pending;
+    std::shared_ptr<MessageAssembly::ReassemblyEntry> msg;
+
+    void run(size_t worker) override;
+  };
+
+  std::mutex taskMutex;
+  std::vector<std::unique_ptr<DecodeTask>> decodeTasks;
+  std::vector<DecodeTask *> freeTasks;
+
+  // Declared after the workspaces and tasks, so the threads stop before
+  // those go
+  std::vector<std::unique_ptr<EccWorkspace>> workerWorkspaces;
+  std::unique_ptr<WorkerPool> workers;
+
+  bool isSettled(int64_t trackingId) const;
+  bool fitMessageCount(ReassemblyEntry &entry, const UdpChunk &chunk);
+  bool decodeMessages(ReassemblyEntry &frame);
+  void decodeAsync(ReassemblyEntry &frame,
+                   std::shared_ptr<MessageAssembly::ReassemblyEntry> msg);
+  void waitForDecodes(ReassemblyEntry &frame);
+  void processMessageChunk(ReassemblyEntry &entry, const UdpChunk &chunk,
+                           ConnectionMetrics &metrics);
+  void processParityChunk(const UdpChunk &chunk, ConnectionMetrics &metrics);
+  void tryDecodeWindows(int64_t trackingId, ConnectionMetrics &metrics);
+  void tryDecodeWindow(const ParityKey &key, ConnectionMetrics &metrics);
+  bool decodeParity(const ParityEntry &entry);
+  void releaseFrames(ConnectionMetrics &metrics);
   std::shared_ptr<ReassemblyEntry> reassembleEccPacket(
-      UdpChunk chunk, ConnectionMetrics &metrics);
+      const UdpChunk &chunk, ConnectionMetrics &metrics);
   std::shared_ptr<ReassemblyEntry> reassembleDataPacket(
-      UdpChunk chunk, ConnectionMetrics &metrics);
+      const UdpChunk &chunk, ConnectionMetrics &metrics);
   bool tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
                       ConnectionMetrics &metrics);
   std::shared_ptr<ReassemblyEntry> getResassmblyEntry(
@@ -32,6 +32,9 @@ SOFTWARE.
 #include <unordered_map>
 #include <vector>
 
+#include "ChunkBuffer.h"
+#include "EccWorkspace.h"
+#include "SlabPool.h"
 #include "UdpChunk.h"
 
 namespace DirectRemote {
@@ -39,28 +42,118 @@ class MessageAssembly {
  public:
   struct ReassemblyEntry {
     int64_t trackingId;
+    int chunkSize = UDP_CHUNK_SIZE;
     size_t receivedDataChunks, receivedEccChunks;
-    std::vector<UdpChunk> eccMap, dataMap;
+    UdpChunkVector eccMap, dataMap;
     std::vector<bool> hasDataChunk, hasEccChunk;
 
     std::vector<unsigned char> data;
 
+    // Progressive decoding: reduced ECC chunks have every received data
+    // chunk eliminated already. reducedData holds the converted copy of each
+    // received data chunk, so each one is only converted once. Starts with
+    // the first data and cauchy_256 ECC chunk, so XOR protected messages are
+    // never reduced.
+    bool isReducing = false;
+    size_t reducedEccChunks = 0;
+    std::vector<bool> isReducedEcc;
+    AlignedByteVector reducedData;
+
+    // XOR parity instead of ECC, see EEccScheme. xorColumns is the grid
+    // width, 0 until the first parity chunk.
+    size_t xorColumns = 0;
+    size_t receivedXorChunks = 0;
+    UdpChunkVector xorMap;
+    std::vector<bool> hasXorChunk;
+
+    // Enough chunks, but the erasure decode is left to the caller, see
+    // setDeferredDecoding()
+    bool isDeferred = false;
+
+    // Bytes of each chunk the erasure code covers
+    int eccBytes() const { return chunkEccSize(chunkSize); }
+
+    // Back to a fresh entry, keeping the memory, see ObjectPool
+    void reset();
+
     bool hasEnoughChunks();
-    bool tryReconstruct();
+    void recoverXor();
+    bool tryReconstruct(EccWorkspace &workspace);
+
+    // Missing data chunks that cauchy_256 has to recover
+    bool needsDecode() const;
+
+    // Fills blocks with the dataMap.size() descriptors cauchy_256_decode()
+    // takes, recovering in place of the missing data chunks. Call once.
+    bool prepareDecode(Block *blocks);
+
+    // Joins the decoded data chunks into data
+    void assemble();
+
+    void reduceDataChunk(size_t index, EccWorkspace &workspace);
+    void reduceEccChunk(size_t index, EccWorkspace &workspace);
+
+   private:
+    bool startReducing(EccWorkspace &workspace);
+    bool solveReduced(EccWorkspace &workspace);
   };
 
-  std::shared_ptr<ReassemblyEntry> process(UdpChunk chunk,
-                                           ConnectionMetrics &metrics);
+  // Folds chunks into the erasure decoder as they arrive, instead of
+  // decoding everything once enough chunks are in. ECC chunks are sent ahead
+  // of the last data chunks, so messages usually complete through the
+  // decoder even without loss. Only as many ECC chunks as there are data
+  // chunks missing are reduced, which bounds the work spent on ECC chunks
+  // that are not needed in the end.
+  void setProgressiveDecoding(bool enabled) { progressiveDecoding = enabled; }
+
+  // Messages that need the erasure decoder are returned with isDeferred set
+  // instead of decoded, so the caller can decode many of them at once with
+  // prepareDecode(), cauchy_256_decode_batch_ws() and assemble(). Does not
+  // apply to progressive decoding, which is done by then.
+  void setDeferredDecoding(bool enabled) { deferredDecoding = enabled; }
+
+  // Chunk size the sender uses, see PacketAssembly::setChunkSize(). Applies
+  // to messages whose first chunk arrives afterwards.
+  void setChunkSize(int chunkSize) { this->chunkSize = chunkSize; }
+
+  // Entries and map nodes come from the given pools if there are any, which
+  // have to outlive the MessageAssembly
+  explicit MessageAssembly(SlabPool *nodes = nullptr,
+                           ObjectPool<ReassemblyEntry> *entries = nullptr);
+
+  // Drops all entries, see ObjectPool
+  void reset() { reassembly.clear(); }
+
+  // The workspace is only borrowed for the call, so one can serve every
+  // message of a connection
+  std::shared_ptr<ReassemblyEntry> process(const UdpChunk &chunk,
+                                           ConnectionMetrics &metrics,
+                                           EccWorkspace &workspace);
+
+  // The entry still being reassembled for trackingId, if any
+  std::shared_ptr<ReassemblyEntry> pending(int64_t trackingId) const;
 
  private:
   void cleanupHistory(ConnectionMetrics &metrics);
-  std::map<int64_t, std::shared_ptr<ReassemblyEntry>> reassembly;
+  typedef std::pair<const int64_t, std::shared_ptr<ReassemblyEntry>> Node;
+  std::map<int64_t, std::shared_ptr<ReassemblyEntry>, std::less<int64_t>,
+           SlabAllocator<Node>>
+      reassembly;
+  ObjectPool<ReassemblyEntry> *entries;
+  bool progressiveDecoding = false;
+  bool deferredDecoding = false;
+  int chunkSize = UDP_CHUNK_SIZE;
   std::shared_ptr<ReassemblyEntry> reassembleEccPacket(
-      UdpChunk chunk, ConnectionMetrics &metrics);
+      const UdpChunk &chunk, ConnectionMetrics &metrics,
+      EccWorkspace &workspace);
   std::shared_ptr<ReassemblyEntry> reassembleDataPacket(
-      UdpChunk chunk, ConnectionMetrics &metrics);
+      const UdpChunk &chunk, ConnectionMetrics &metrics,
+      EccWorkspace &workspace);
+  std::shared_ptr<ReassemblyEntry> reassembleXorPacket(
+      const UdpChunk &chunk, ConnectionMetrics &metrics,
+      EccWorkspace &workspace);
   bool tryReconstruct(std::shared_ptr<ReassemblyEntry> entry,
-                      ConnectionMetrics &metrics);
+                      ConnectionMetrics &metrics, EccWorkspace &workspace);
   std::shared_ptr<ReassemblyEntry> getResassmblyEntry(
       int64_t trackingId, ConnectionMetrics &metrics);
 
@@ -31,33 +31,255 @@ SOFTWARE.
 #include <unordered_map>
 #include <vector>
 
+#include "ChunkBuffer.h"
 #include "IPerformanceMonitor.h"
+#include "SlabPool.h"
+#include "StreamingEncoder.h"
 #include "UdpChunk.h"
+#include "WorkerPool.h"
 
 namespace DirectRemote {
 
+// How the ECC chunks of a message are computed
+enum class EEccScheme {
+  Cauchy = 0,  // cauchy_256, repairs any losses up to the ECC chunk count
+  Xor = 1,     // interleaved XOR, one column per ECC chunk
+  Xor2D = 2,   // row and column XOR parity over a square grid
+};
+
+// What a frame is to the stream, which decides how much losing it costs
+enum class EFrameClass {
+  Delta = 0,  // costs the frame itself
+  Key = 1,    // costs the frames up to the next keyframe
+  Audio = 2,
+};
+
+#define FRAME_CLASS_COUNT 3
+
+// ECC chunks per data chunk by frame class and message position. Frames
+// with frame parity or in fountain mode have no ECC per message, they get
+// the ratio of their class for the whole frame.
+struct EccPolicy {
+  float frameRatio[FRAME_CLASS_COUNT] = {0.1f, 0.1f, 0.1f};
+  // The first leadingMessages messages of a frame get at least this, like
+  // the parameter sets (SPS/PPS) at the start of a keyframe
+  float leadingRatio[FRAME_CLASS_COUNT] = {0.1f, 0.1f, 0.1f};
+  int leadingMessages = 1;
+
+  // The same ratio for everything
+  static EccPolicy uniform(float eccPacketsPerDataPacket);
+
+  float ratio(EFrameClass frameClass) const;
+  float messageRatio(EFrameClass frameClass, int msgIndex) const;
+};
+
 class PacketAssembly {
  private:
-  std::vector<const unsigned char *> packetPtrsPerMessage;
-  std::vector<unsigned char> eccRawPerMessage;
-  std::vector<UdpChunk> dataPerMessage;
-  std::vector<UdpChunk> eccPerMessage;
+  UdpChunkVector eccPerMessage{UDP_CHUNK_SIZE};
+  StreamingEncoder encoder;
+  bool frameProtection = false;
+  AlignedByteVector frameParity;
+  std::vector<const unsigned char *> chunkPointers;
+  bool fountainMode = false;
+  EccWorkspace repairWorkspace;
+  AlignedByteVector repairBlocks;
+  std::vector<size_t> nextRepairRow;  // per message of the last frame
+  int crossFrameDepth = 1;
+  float crossFrameRatio = 0.1f;
+  // Data of the previous frames, the first crossFrameCount are in use. The
+  // data of a frame that is not the last of its window moves there when the
+  // next frame starts, trading buffers instead of copying chunks.
+  std::vector<UdpChunkVector> crossFrames;
+  size_t crossFrameCount = 0;
+  bool isDataKept = false;
+  EEccScheme smallMessageScheme = EEccScheme::Cauchy;
+  size_t smallMessageChunks = 0;
+  int chunkSize = UDP_CHUNK_SIZE;
+  int messageChunks = MAX_MESSAGE_CHUNKS;
+  EccPolicy eccPolicy;
 
-  static bool processMessageInternal(
-      const unsigned char *bytes, size_t byteCount,
-      float eccPacketsPerDataPacket, std::vector<UdpChunk> &outData,
-      std::vector<UdpChunk> &outEcc, std::vector<unsigned char> &eccRaw,
-      std::vector<const unsigned char *> &packetPtrs);
+  // Parallel encoding: one encoder per worker, chunks per message
+  std::unique_ptr<WorkerPool> workers;
+  std::vector<std::unique_ptr<StreamingEncoder>> workerEncoders;
+  std::vector<UdpChunkVector> messageEcc;
+  std::vector<char> isMessageEncoded;
+
+  PoolMetrics bufferMetrics;
+
+  // Streaming, see beginFrame(). streamBytes holds what is not sent yet,
+  // at most a message.
+  bool isStreaming = false;
+  std::vector<unsigned char> streamBytes;
+  EccPolicy streamPolicy;
+  EFrameClass streamClass = EFrameClass::Delta;
+  int streamMsgCount = 0;
+  size_t firstNewData = 0;
+  size_t firstNewEcc = 0;
+
+  // Writes the dataChunkCount() data chunks of the message to the start of
+  // outData, every byte up to the chunk size, with the payload zero after
+  // its end, see wireChunkSize(). Without an encoder only the data chunks
+  // are produced.
+  static bool processMessageInternal(const unsigned char *bytes,
+                                     size_t byteCount,
+                                     float eccPacketsPerDataPacket,
+                                     ChunkSpan outData, UdpChunkVector &outEcc,
+                                     StreamingEncoder *encoder,
+                                     EEccScheme scheme, int chunkSize);
+
+  static bool processXorParity(ConstChunkSpan data, size_t k,
+                               EEccScheme scheme,
+                               float eccPacketsPerDataPacket, int eccBytes,
+                               UdpChunkVector &outEcc);
+
+  // Parity over the data of the last "window" frames, ending with this one
+  bool processParity(int window, int msgCount, float eccPacketsPerDataPacket);
+  bool processCrossFrameParity(int msgCount);
+  // Empties "data" for the next frame, see crossFrames
+  void startFrameData();
+  bool processMessagesParallel(const unsigned char *bytes, int byteCount,
+                               int msgCount, const EccPolicy &policy,
+                               EFrameClass frameClass, bool perMessageEcc);
+  bool processRepairInternal(float eccPacketsPerDataPacket);
+  bool processFrameInternal(const unsigned char *bytes, int byteCount,
+                            const EccPolicy &policy, EFrameClass frameClass);
+  bool appendMessage(const unsigned char *bytes, int byteCount, int msgIndex,
+                     int msgCount, float eccPacketsPerDataPacket,
+                     bool perMessageEcc);
+  bool appendStreamedMessage(const unsigned char *bytes);
+  bool finishFrame(int msgCount, bool protectFrame,
+                   float eccPacketsPerDataPacket);
 
  public:
-  std::vector<UdpChunk> data;
-  std::vector<UdpChunk> ecc;
+  UdpChunkVector data{UDP_CHUNK_SIZE};
+  UdpChunkVector ecc{UDP_CHUNK_SIZE};
 
   bool processFrame(const unsigned char *bytes, int byteCount,
                     float eccPacketsPerDataPacket = 0.1f);
 
+  // Protects the frame as the policy says for its class, see setEccPolicy()
+  bool processFrame(const unsigned char *bytes, int byteCount,
+                    EFrameClass frameClass);
+  bool processFrame(const unsigned char *bytes, int byteCount,
+                    const EccPolicy &policy, EFrameClass frameClass);
+
+  // Policy of the processFrame() and beginFrame() calls that take a frame
+  // class only
+  void setEccPolicy(const EccPolicy &policy) { eccPolicy = policy; }
+  const EccPolicy &getEccPolicy() const { return eccPolicy; }
+
+  // Streams a frame whose bytes come in pieces, like the slices of a
+  // hardware encoder. appendBytes() encodes every message as soon as the
+  // bytes after it arrive, and endFrame() the last one along with frame and
+  // cross-frame parity and fountain repair. Each call leaves the chunks it
+  // added at the end of "data" and "ecc", from firstNewDataChunk() and
+  // firstNewEccChunk() on, while the chunks before stay for the parity.
+  // Messages sent before endFrame() carry no message count, which only
+  // receivers with EUdpFeature::StreamedFrames understand. Streaming does
+  // not use the encode threads. appendBytes() and endFrame() return false
+  // if the frame gets too large or none is being streamed.
+  void beginFrame(float eccPacketsPerDataPacket = 0.1f);
+  void beginFrame(EFrameClass frameClass);
+  void beginFrame(const EccPolicy &policy, EFrameClass frameClass);
+  bool appendBytes(const unsigned char *bytes, int byteCount);
+  bool endFrame();
+  size_t firstNewDataChunk() const { return firstNewData; }
+  size_t firstNewEccChunk() const { return firstNewEcc; }
+
+  // Reserves the chunk buffers for keyframes of a stream of "bitrate" bits
+  // per second at "frameRate" frames per second, so that even the first
+  // frames do not allocate. They grow as needed either way.
+  void reservePools(int64_t bitrate, int frameRate,
+                    float eccPacketsPerDataPacket = 0.1f);
+
+  // Frames that had to grow the chunk buffers, and those that did not
+  PoolMetrics poolMetrics() const { return bufferMetrics; }
+
+  // Size of the chunks on the wire, see isValidChunkSize(). Messages carry
+  // chunkPayloadSize() bytes per chunk and ECC covers chunkEccSize() bytes,
+  // so the receiver has to use the same size. Returns false for sizes out
+  // of range.
+  bool setChunkSize(int chunkSize);
+  int getChunkSize() const { return chunkSize; }
+
+  // Data chunks of every message of a frame but the last, up to
+  // MAX_WIDE_MESSAGE_CHUNKS for receivers of wire format V2. Larger messages
+  // mean fewer of them per frame, each with its own ECC. The receiver has
+  // to use the same count, see FrameAssembly::setMessageChunks(). Returns
+  // false for counts out of range.
+  bool setMessageChunks(int messageChunks);
+  int getMessageChunks() const { return messageChunks; }
+
+  // Encodes the messages of a frame on threadCount threads besides the
+  // caller, which pays off for frames of several messages, like keyframes.
+  // The chunks come out in the same order as without threads. 0 turns it
+  // off.
+  void setEncodeThreads(size_t threadCount);
+
+  // Frames of more than one message get parity over the whole frame instead
+  // of ECC per message, so the loss of a message's chunks is covered by the
+  // parity of the entire frame. Parity chunks go to "ecc" and have to be
+  // sent after the data chunks, see isFrameParityChunk().
+  void setFrameProtection(bool enabled) { frameProtection = enabled; }
+
+  // Rateless ECC: the ECC chunks of every message are rows of a code with
+  // up to MAX_MESSAGE_CHUNKS ECC chunks, as many as cauchy_256 takes next to
+  // the message's data chunks, handed out a few at a time. processFrame()
+  // emits the first rows as usual and processRepair() fresh ones for the
+  // same frame, for as long as more redundancy is wanted. Receivers see
+  // ordinary ECC chunks. Takes precedence over frame protection.
+  void setFountainMode(bool enabled) { fountainMode = enabled; }
+
+  // Fills "ecc" with the next repair chunks of the last frame, at the given
+  // ratio for each message. Returns false once all rows are used up, or
+  // outside of fountain mode. A message has at most MAX_MESSAGE_CHUNKS rows
+  // in total, including the ones processFrame() emitted, so repair is not
+  // rateless beyond that.
+  bool processRepair(float eccPacketsPerDataPacket = 0.1f);
+
+  // Parity over the data chunks of every "depth" frames together (at most
+  // MAX_PARITY_WINDOW, 1 turns it off), on top of whatever protects single
+  // frames. The parity of all frames of a window can then repair a burst
+  // that hit just one of them, at the cost of the receiver holding back
+  // completed frames for up to depth - 1 frames. Parity chunks go out with
+  // the last frame of each window, last in "ecc" like frame parity.
+  void setCrossFrameProtection(int depth, float eccPacketsPerDataPacket);
+
+  // Frames must be consecutive for cross-frame parity, so this is called
+  // whenever the next frame does not follow the last one
+  void resetCrossFrames() {
+    crossFrameCount = 0;
+    isDataKept = false;
+  }
+
   bool processMessage(const unsigned char *bytes, int byteCount,
                       float eccPacketsPerDataPacket = 0.1f);
+
+  // Messages of at most maxChunks chunks get XOR parity instead of cauchy_256
+  // ECC, which costs next to no CPU on either side, but repairs fewer loss
+  // patterns for the same number of ECC chunks. The scheme is signaled in
+  // every ECC chunk, see isXorParityChunk(). 0 chunks turns it off.
+  void setSmallMessageScheme(EEccScheme scheme, size_t maxChunks);
+
+  // Scheme a message of byteCount bytes is protected with
+  EEccScheme schemeFor(size_t byteCount) const;
+
+  // Number of data chunks a message of byteCount bytes takes
+  static size_t dataChunkCount(size_t byteCount, int chunkSize);
+
+  // Number of ECC chunks sent along with a message of chunkCount chunks
+  static size_t eccChunkCount(size_t chunkCount, float eccPacketsPerDataPacket);
+
+  // Number of parity chunks sent along with a protected frame of chunkCount
+  // data chunks
+  static size_t frameParityChunkCount(size_t chunkCount,
+                                      float eccPacketsPerDataPacket);
+
+  // Prepares the erasure code for every message shape this ratio produces,
+  // and with fountainMode also for the rateless shapes
+  static void warmUp(float eccPacketsPerDataPacket = 0.1f,
+                     bool fountainMode = false);
+  static void warmUp(const EccPolicy &policy, bool fountainMode = false);
 };
 }  // namespace DirectRemote
 
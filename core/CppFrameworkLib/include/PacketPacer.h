@@ -0,0 +1,171 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef PACKETPACER_H
+#define PACKETPACER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "IPerformanceMonitor.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+
+// Tokens of one byte each, refilled at bytesPerSecond up to burstBytes.
+// Times are seconds on any clock that does not go back. A rate of 0 lets
+// everything through. Not thread-safe.
+class TokenBucket {
+ private:
+  double rate = 0;
+  double burst = 0;
+  double tokens = 0;
+  double lastTime = 0;
+
+  void refill(double now);
+
+ public:
+  // The bucket starts out full. Bursts smaller than the largest datagram
+  // are raised to it, so every datagram fits.
+  TokenBucket(double bytesPerSecond, double burstBytes);
+
+  void setRate(double bytesPerSecond, double burstBytes);
+  double getRate() const { return rate; }
+
+  // Earliest time from "now" on that "bytes" may go out
+  double availableAt(size_t bytes, double now);
+
+  // Takes the tokens of "bytes" going out at "now", or returns false and
+  // leaves them if there are not enough
+  bool take(size_t bytes, double now);
+};
+
+// What a PacketPacer did since the last takeMetrics()
+struct PacingMetrics {
+  int64_t packets = 0;
+  // Seconds from queue() until the datagram was handed to the socket
+  double meanQueueDelay = 0;
+  double maxQueueDelay = 0;
+  // Seconds the thread woke up after the bucket allowed the next datagram
+  double meanLateness = 0;
+  // Bytes per second sent while datagrams were waiting, against the rate
+  // of the bucket; 1 is exact
+  double rateAccuracy = 0;
+};
+
+// Sends datagrams on a thread of its own at the pace of a TokenBucket, so
+// that the chunks of a large frame do not leave as one burst at line rate,
+// which shallow router and Wi-Fi queues drop the end of. Each send covers
+// as many datagrams as the bucket holds tokens for. Datagrams are copied
+// when queued, so the caller may reuse its chunks right away.
+class PacketPacer {
+ public:
+  // Sends count datagrams, see Socket::sendtoMany(), and returns how many
+  // went out
+  typedef std::function<size_t(const void *const *datagrams,
+                               const size_t *sizes, size_t count)>
+      SendFunc;
+
+ private:
+  struct Datagram {
+    double queuedAt;
+    size_t size;
+    unsigned char bytes[MAX_UDP_CHUNK_SIZE];
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  SendFunc send;
+  TokenBucket bucket;
+  const Clock::time_point start;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake, sent;
+
+  // Ring of queued datagrams, a power of two in size. The sender reads the
+  // ones it sends without the lock, so it only grows between sends.
+  std::vector<Datagram> ring;
+  size_t head = 0;
+  size_t count = 0;
+  bool isSending = false;
+  bool isStopping = false;
+
+  // Since the last takeMetrics()
+  PacingMetrics metrics;
+  double queueDelaySum = 0;
+  double latenessSum = 0;
+  int64_t lateWakeups = 0;
+  double backlogBytes = 0;
+  double backlogTime = 0;
+  double lastSendAt = 0;
+  bool isBacklogged = false;
+
+  PacketPacer(const PacketPacer &) = delete;
+  PacketPacer &operator=(const PacketPacer &) = delete;
+
+  double now() const;
+  void grow();
+  void threadMain();
+
+ public:
+  PacketPacer(SendFunc send, double bytesPerSecond, double burstBytes);
+  // Sends what is still queued, at the pace of the bucket, before the
+  // thread stops. clear() first to drop it instead.
+  ~PacketPacer();
+
+  // See TokenBucket, applies from the next datagram on
+  void setRate(double bytesPerSecond, double burstBytes);
+
+  // Queues count datagrams made of a header and a body each, like
+  // Socket::sendtoMany() takes them. Together they must not be larger than
+  // MAX_UDP_CHUNK_SIZE.
+  void queue(const void *const *headers, const size_t *headerSizes,
+             const void *const *bodies, const size_t *bodySizes,
+             size_t count);
+
+  // Drops what has not gone out yet, like when the peer changes
+  void clear();
+
+  // Returns once everything queued went out
+  void flush();
+
+  // Datagrams still waiting
+  size_t queuedPackets();
+
+  PacingMetrics takeMetrics();
+
+  // Records PacingQueueDelay, PacingMaxQueueDelay and PacingLateness in
+  // milliseconds and PacingRateAccuracy, over what went out since the last
+  // call
+  void recordMetrics(PerformanceMonitor &perfMon);
+};
+}  // namespace DirectRemote
+
+#endif
@@ -0,0 +1,118 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef SENDSCHEDULER_H
+#define SENDSCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "ChunkBuffer.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+
+// Orders chunks for the wire so that a burst of consecutive losses takes a
+// few chunks from many messages instead of many from one. The chunks of
+// every message are spread evenly over the frame, its ECC chunks evenly
+// over its data chunks, and parity goes last.
+//
+// Frames can also be split into shares that go out one per call, each
+// interleaved with the shares of the frames before and after it. That
+// delays the end of a frame by as many calls as it has shares, or until its
+// hold time is up when no calls follow, and only receivers that take
+// overlapping frames can handle it, see FrameAssembly::setFrameInterleaving().
+// Not thread-safe.
+class SendScheduler {
+ private:
+  // Copies of the shares of a frame that are still to go out, one after
+  // the other
+  struct HeldFrame {
+    UdpChunkVector chunks;
+    size_t shareEnds[MAX_INTERLEAVE_FRAMES] = {};
+    size_t shareCount = 0;
+    size_t nextShare = 0;
+    // When the shares left have to go out, see setHoldTime()
+    double due = 0;
+  };
+
+  struct Entry {
+    double due;
+    UdpChunk *chunk;
+  };
+
+  // Ring of frames, a frame's slot comes around again once all its shares
+  // are out
+  HeldFrame held[MAX_INTERLEAVE_FRAMES];
+  size_t nextSlot = 0;
+  double holdTime = 0;
+
+  std::vector<UdpChunk *> frameOrder;
+  std::vector<UdpChunk *> column;
+  std::vector<Entry> entries;
+  std::vector<UdpChunk *> order;
+
+  void orderFrame(ChunkSpan data, ChunkSpan ecc);
+  void addColumn();
+  void addHeldShare(HeldFrame &frame);
+  void holdFrame(size_t shareCount, size_t parityStart, int chunkSize,
+                 double now);
+  void mergeColumns();
+
+ public:
+  // What to send now of a frame, or a slice of one, split into shareCount
+  // shares, up to MAX_INTERLEAVE_FRAMES; 1 sends all of it now. Along with
+  // it goes the next share of every frame held back by earlier calls. All
+  // chunks are stamped with the tracking ID of their frame. The pointers
+  // are valid until the next call. "now" is in seconds on any clock that
+  // does not go back, and only matters with a hold time.
+  const std::vector<UdpChunk *> &schedule(ChunkSpan data, ChunkSpan ecc,
+                                          int64_t trackingId,
+                                          size_t shareCount = 1,
+                                          double now = 0);
+
+  // Everything still held back, for when no frame follows soon
+  const std::vector<UdpChunk *> &flush();
+
+  // The shares a frame holds back go out at the latest holdSeconds after
+  // schedule() took it, with releaseDue(). 0 holds them until later frames
+  // or flush() take them.
+  void setHoldTime(double holdSeconds) { holdTime = holdSeconds; }
+
+  // What is held back beyond its hold time at "now"
+  const std::vector<UdpChunk *> &releaseDue(double now);
+
+  // When releaseDue() has something next, or a negative time if nothing
+  // is held back for a limited time
+  double nextDue() const;
+
+  bool hasHeldChunks() const;
+
+  // Drops what is held back, like when the peer changes
+  void clear();
+};
+}  // namespace DirectRemote
+
+#endif
@@ -0,0 +1,335 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DirectRemote {
+
+// What a pool served from memory it had, and what it had to get from the
+// heap. Once a stream is warm, heapAllocations stays where it is.
+struct PoolMetrics {
+  int64_t heapAllocations = 0;
+  int64_t reuses = 0;
+  // Objects beyond the capacity of a pool, which are not kept for reuse
+  int64_t overflows = 0;
+
+  PoolMetrics &operator+=(const PoolMetrics &other) {
+    heapAllocations += other.heapAllocations;
+    reuses += other.reuses;
+    overflows += other.overflows;
+    return *this;
+  }
+};
+
+// Small blocks in size classes of SLAB_BLOCK_ALIGNMENT bytes, carved out of
+// slabs that are only returned to the heap with the pool. Freed blocks go
+// on a free list for their class. Larger blocks come from the heap. Not
+// thread-safe.
+class SlabPool {
+ public:
+  static const size_t SLAB_BLOCK_ALIGNMENT = 16;
+  static const size_t MAX_SLAB_BLOCK = 512;
+  static const size_t SLAB_BYTES = 16384;
+
+ private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  FreeBlock *freeLists[MAX_SLAB_BLOCK / SLAB_BLOCK_ALIGNMENT] = {};
+  std::vector<void *> slabs;
+  PoolMetrics metrics;
+
+  SlabPool(const SlabPool &) = delete;
+  SlabPool &operator=(const SlabPool &) = delete;
+
+  void addSlab(size_t sizeClass);
+
+ public:
+  SlabPool() {}
+  ~SlabPool();
+
+  void *allocate(size_t bytes);
+  void deallocate(void *ptr, size_t bytes);
+
+  const PoolMetrics &getMetrics() const { return metrics; }
+};
+
+// Lets standard containers take their nodes from a SlabPool. Without a pool
+// it is the plain heap.
+template <class T>
+class SlabAllocator {
+ public:
+  typedef T value_type;
+
+  template <class U>
+  struct rebind {
+    typedef SlabAllocator<U> other;
+  };
+
+  SlabPool *pool;
+
+  SlabAllocator(SlabPool *pool = nullptr) : pool(pool) {}
+
+  template <class U>
+  SlabAllocator(const SlabAllocator<U> &other) : pool(other.pool) {}
+
+  T *allocate(size_t count) {
+    if (!pool) {
+      return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    return static_cast<T *>(pool->allocate(count * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t count) {
+    if (!pool) {
+      ::operator delete(ptr);
+    } else {
+      pool->deallocate(ptr, count * sizeof(T));
+    }
+  }
+
+  template <class U>
+  bool operator==(const SlabAllocator<U> &other) const {
+    return pool == other.pool;
+  }
+
+  template <class U>
+  bool operator!=(const SlabAllocator<U> &other) const {
+    return pool != other.pool;
+  }
+};
+
+// Objects that go back to the pool when the last shared_ptr to them is
+// dropped, on whichever thread that happens, with everything they allocated
+// still in place. T::reset() prepares an object for its next use. Up to
+// "capacity" objects are kept, more are created as needed but deleted once
+// they are released. acquire() and reserve() belong to one thread, objects
+// may be released on any thread, even after the pool is gone.
+template <class T>
+class ObjectPool {
+ private:
+  // Where released objects go back to, shared with the shared_ptrs handed
+  // out so it outlives the pool if they do
+  struct Shelf {
+    std::mutex mutex;
+    std::vector<T *> idle;
+    // Control blocks of those shared_ptrs, which are all of one size
+    std::vector<void *> blocks;
+    size_t blockBytes = 0;
+    bool isClosed = false;
+
+    ~Shelf() {
+      for (void *block : blocks) {
+        ::operator delete(block);
+      }
+    }
+
+    void release(T *object) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!isClosed) {
+          idle.push_back(object);
+          return;
+        }
+      }
+
+      delete object;
+    }
+
+    void *allocateBlock(size_t bytes) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!blockBytes) {
+          blockBytes = bytes;
+        }
+
+        if ((bytes == blockBytes) && !blocks.empty()) {
+          void *block = blocks.back();
+          blocks.pop_back();
+          return block;
+        }
+      }
+
+      return ::operator new(bytes);
+    }
+
+    void deallocateBlock(void *block, size_t bytes) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if ((bytes == blockBytes) && (blocks.size() < blocks.capacity())) {
+          blocks.push_back(block);
+          return;
+        }
+      }
+
+      ::operator delete(block);
+    }
+  };
+
+  struct Release {
+    std::shared_ptr<Shelf> shelf;
+
+    void operator()(T *object) const { shelf->release(object); }
+  };
+
+  template <class U>
+  struct BlockAllocator {
+    typedef U value_type;
+
+    std::shared_ptr<Shelf> shelf;
+
+    explicit BlockAllocator(const std::shared_ptr<Shelf> &shelf)
+        : shelf(shelf) {}
+
+    template <class V>
+    BlockAllocator(const BlockAllocator<V> &other) : shelf(other.shelf) {}
+
+    U *allocate(size_t count) {
+      return static_cast<U *>(shelf->allocateBlock(count * sizeof(U)));
+    }
+
+    void deallocate(U *ptr, size_t count) {
+      shelf->deallocateBlock(ptr, count * sizeof(U));
+    }
+
+    template <class V>
+    bool operator==(const BlockAllocator<V> &other) const {
+      return shelf == other.shelf;
+    }
+
+    template <class V>
+    bool operator!=(const BlockAllocator<V> &other) const {
+      return shelf != other.shelf;
+    }
+  };
+
+  std::function<T *()> create;
+  std::shared_ptr<Shelf> shelf;
+  // Every object the pool keeps, whether in use or not
+  std::vector<T *> objects;
+  size_t capacity;
+  PoolMetrics metrics;
+
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  void keep(T *object, bool isIdle) {
+    objects.push_back(object);
+
+    // Releasing must not allocate, so the shelf has room for all of them
+    std::lock_guard<std::mutex> lock(shelf->mutex);
+    shelf->idle.reserve(objects.capacity());
+    shelf->blocks.reserve(objects.capacity());
+    if (isIdle) {
+      shelf->idle.push_back(object);
+    }
+  }
+
+ public:
+  explicit ObjectPool(size_t capacity,
+                      std::function<T *()> create = []() { return new T(); })
+      : create(create),
+        shelf(std::make_shared<Shelf>()),
+        capacity(capacity) {
+    objects.reserve(capacity);
+  }
+
+  // Objects still in use are deleted when they are released
+  ~ObjectPool() {
+    std::vector<T *> idle;
+    {
+      std::lock_guard<std::mutex> lock(shelf->mutex);
+      shelf->isClosed = true;
+      idle.swap(shelf->idle);
+    }
+
+    for (T *object : idle) {
+      delete object;
+    }
+  }
+
+  // Raises the capacity and creates objects up to it right away
+  void reserve(size_t capacity) {
+    if (capacity > this->capacity) {
+      this->capacity = capacity;
+      objects.reserve(capacity);
+    }
+
+    while (objects.size() < capacity) {
+      keep(create(), true);
+      metrics.heapAllocations++;
+    }
+  }
+
+  std::shared_ptr<T> acquire() {
+    T *object = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(shelf->mutex);
+      if (!shelf->idle.empty()) {
+        object = shelf->idle.back();
+        shelf->idle.pop_back();
+      }
+    }
+
+    if (object) {
+      metrics.reuses++;
+      object->reset();
+    } else {
+      object = create();
+      metrics.heapAllocations++;
+
+      if (objects.size() >= capacity) {
+        metrics.overflows++;
+        return std::shared_ptr<T>(object);
+      }
+      keep(object, false);
+    }
+
+    return std::shared_ptr<T>(object, Release{shelf},
+                              BlockAllocator<T>(shelf));
+  }
+
+  // Every object the pool keeps, whether in use or not
+  template <class F>
+  void forEach(F f) {
+    for (T *object : objects) {
+      f(*object);
+    }
+  }
+
+  size_t getCapacity() const { return capacity; }
+  const PoolMetrics &getMetrics() const { return metrics; }
+};
+}  // namespace DirectRemote
+
+#endif
@@ -72,9 +72,26 @@ class Socket {
   ssize_t sendto(const void *data, size_t dataSize,
                  SocketAddress remoteAddress);
 
+  // Sends count datagrams straight from where they are, with as few system
+  // calls as the platform allows (sendmmsg() on Linux). Returns how many
+  // went out, which is less than count after the first that failed.
+  size_t sendtoMany(const void *const *datagrams, const size_t *sizes,
+                    size_t count, SocketAddress remoteAddress);
+
+  // The same for datagrams made of a header and a body apart from it, like
+  // chunks whose header is encoded for the wire, see encodeChunkHeader()
+  size_t sendtoMany(const void *const *headers, const size_t *headerSizes,
+                    const void *const *bodies, const size_t *bodySizes,
+                    size_t count, SocketAddress remoteAddress);
+
   bool isValid() const;
   bool connect(SocketAddress remoteAddress);
   bool bind(SocketAddress remoteAddress);
+
+  // Datagrams larger than the path MTU fail instead of being fragmented,
+  // which is what path MTU probing relies on. Returns false if the platform
+  // does not support it.
+  bool setDontFragment(bool enabled);
   Socket accept();
   void close();
   void create();
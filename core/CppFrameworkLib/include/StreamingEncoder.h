@@ -0,0 +1,65 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef STREAMINGENCODER_H
+#define STREAMINGENCODER_H
+
+#include <stddef.h>
+
+#include "ChunkBuffer.h"
+#include "EccWorkspace.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+
+// Computes the ECC chunks of a message while its data chunks are produced.
+// Each data chunk is folded into the parity when it is added, so it can go
+// out right away, and the ECC chunks are ready as soon as the last data
+// chunk was added.
+class StreamingEncoder {
+ private:
+  EccWorkspace workspace;
+  AlignedByteVector recovery;
+  size_t dataChunkCount = 0;
+  size_t eccChunkCount = 0;
+  int eccBytes = CHUNK_ECC_SIZE;
+  bool isOpen = false;
+
+ public:
+  // Starts a message with eccBytes of every chunk protected, see
+  // chunkEccSize(); any unfinished one is dropped
+  bool begin(size_t dataChunkCount, size_t eccChunkCount,
+             int eccBytes = CHUNK_ECC_SIZE);
+
+  // Takes the ECC region of a data chunk with chunkIndex set. Every index
+  // must be added exactly once, in any order.
+  bool add(const UdpChunk &chunk);
+
+  // Fills outEcc with the ECC chunks (msgCount, msgIndex and trackingId are
+  // left to the caller)
+  bool finish(UdpChunkVector &outEcc);
+};
+}  // namespace DirectRemote
+
+#endif
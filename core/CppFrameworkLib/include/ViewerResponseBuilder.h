@@ -58,6 +58,15 @@ class ViewerResponseEncoder final {
   void trackMetrics(ConnectionMetrics metrics);
 
   void toPackets(std::vector<UdpPayloadChunk> &outPackets);
+
+  // A copy of a response toPackets() made, with the metrics of the
+  // transport that keeps them. UdpProtocol stamps and reads them only
+  // between peers that offer EUdpFeature::ViewerMetrics, since responses of
+  // other senders carry zeros that would read as no loss. Returns false for
+  // bytes that are not a response, and leaves outPacket alone.
+  static bool stampMetrics(const unsigned char *bytes, size_t byteCount,
+                           const ConnectionMetrics &metrics,
+                           UdpPayloadChunk &outPacket);
 };
 
 class ViewerResponseDecoder final {
@@ -75,6 +84,11 @@ class ViewerResponseDecoder final {
   void setResponseListener(std::unique_ptr<ResponseListener> listener);
 
   void parsePacket(UdpPayloadChunk packet);
+
+  // The metrics of a response, without decoding the rest of it. Returns
+  // false for bytes that are not a response.
+  static bool readMetrics(const unsigned char *bytes, size_t byteCount,
+                          ConnectionMetrics &outMetrics);
 };
 }  // namespace DirectRemote
 
@@ -0,0 +1,96 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace DirectRemote {
+
+// A few threads that stay around for the lifetime of their owner, so work
+// can be spread over cores without starting threads each time. Not
+// thread-safe; one owner hands out work at a time.
+class WorkerPool {
+ public:
+  // Job index and the worker running it, below workerCount()
+  typedef std::function<void(size_t index, size_t worker)> Job;
+
+  // Work handed out one piece at a time. The caller owns the task and keeps
+  // it alive until it ran, so queuing one does not allocate.
+  struct Task {
+    virtual ~Task() {}
+    virtual void run(size_t worker) = 0;
+
+   private:
+    friend class WorkerPool;
+    Task *next = nullptr;
+  };
+
+ private:
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  const Job *job = nullptr;
+  size_t jobCount = 0;
+  std::atomic<size_t> nextJob;
+  size_t busyThreads = 0;
+  uint64_t generation = 0;
+  bool isStopping = false;
+  Task *firstTask = nullptr;
+  Task *lastTask = nullptr;
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  void threadMain(size_t worker);
+  void drain(size_t worker);
+
+ public:
+  // Starts threadCount threads, the thread calling run() is one more worker
+  explicit WorkerPool(size_t threadCount);
+  ~WorkerPool();
+
+  size_t workerCount() const { return threads.size() + 1; }
+
+  // Runs job for every index in [0, count) and returns once all are done.
+  // Indices are handed out in order, the calling thread takes part as
+  // worker 0.
+  void run(size_t count, const Job &job);
+
+  // Queues task for the next idle thread and returns right away. Tasks that
+  // have not started when the pool is destroyed run on the destroying
+  // thread as worker 0; without threads the task runs on the caller.
+  void submit(Task *task);
+};
+}  // namespace DirectRemote
+
+#endif
@@ -73,6 +73,7 @@ void HostNetworkAbstraction::onProfilingEvent(PerformanceMonitor profiling) {
   accumulateMetric(profiling);
 
   pending.perfMon.recordStackedTime(EPerfMetric::TimeNetworkRoundtrip);
+  recordCacheMetrics(pending.perfMon);
   accumulateMetric(pending.perfMon);
 
   if (localControlId == pending.controlId) {
@@ -96,6 +97,20 @@ void HostNetworkAbstraction::accumulateMetric(PerformanceMonitor perfMon) {
   accumulator.push_back(perfMon);
 }
 
+void HostNetworkAbstraction::recordCacheMetrics(PerformanceMonitor &perfMon) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  Cauchy256CacheStats cacheStats;
+  cauchy_256_cache_stats(&cacheStats);
+  perfMon.recordCounter(
+      EPerfMetric::EccMatrixCacheHits,
+      static_cast<double>(cacheStats.matrixHits - lastCacheStats.matrixHits));
+  perfMon.recordCounter(EPerfMetric::EccMatrixCacheMisses,
+                        static_cast<double>(cacheStats.matrixMisses -
+                                            lastCacheStats.matrixMisses));
+  lastCacheStats = cacheStats;
+}
+
 void HostNetworkAbstraction::cleanupPendingPackets() {
   auto it = pendingPackets.begin();
 
@@ -25,6 +25,7 @@ SOFTWARE.
 #ifndef HOSTNETWORKABSTRACTION_H
 #define HOSTNETWORKABSTRACTION_H
 
+#include "ErasureCode.h"
 #include "IHostProtocol.h"
 #include "IPerformanceMonitor.h"
 #include "IResponseListener.h"
@@ -47,6 +48,7 @@ class HostNetworkAbstraction : public IResponseListener {
   };
 
   ConnectionMetrics metrics;
+  Cauchy256CacheStats lastCacheStats = {};
   std::shared_ptr<HostProtocol> conn;
   InputInject inputInjector;
   int32_t localControlId = 0;
@@ -73,6 +75,10 @@ class HostNetworkAbstraction : public IResponseListener {
 
   void accumulateMetric(PerformanceMonitor perfMon);
 
+  // Cache lookups since the last call, once per profiling event so that
+  // every lookup is counted exactly once
+  void recordCacheMetrics(PerformanceMonitor &perfMon);
+
   void cleanupPendingPackets();
 
  public:
@@ -0,0 +1,187 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "EccController.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Phase {
+  const char *name;
+  double pGoodToBad, pBadToGood, lossGood, lossBad;
+};
+
+struct Result {
+  int lostFrames = 0;
+  size_t dataChunks = 0, eccChunks = 0;
+  double ratioSum = 0;
+};
+
+// One sender keeps its ratio, or its controller, through all phases. The
+// viewer reports what it received every reportInterval frames, like
+// ViewerResponseEncoder would.
+class Sender {
+ private:
+  float fixedRatio;
+  bool isAdaptive;
+  EccController controller;
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::vector<const UdpChunk *> order;
+  int64_t trackingId = 0;
+
+ public:
+  Sender(float ratio, bool isAdaptive, double targetFrameLoss)
+      : fixedRatio(ratio),
+        isAdaptive(isAdaptive),
+        controller(ratio, options(targetFrameLoss)) {}
+
+  static EccController::Options options(double targetFrameLoss) {
+    EccController::Options result;
+    result.targetFrameLoss = targetFrameLoss;
+    return result;
+  }
+
+  Result run(const Phase &phase, const std::vector<unsigned char> &frame,
+             int frames, int reportInterval) {
+    GilbertElliott channel(phase.pGoodToBad, phase.pBadToGood,
+                           phase.lossGood, phase.lossBad, 42);
+    Result result;
+
+    for (int i = 0; i < frames; i++, trackingId++) {
+      const float ratio = isAdaptive ? controller.eccRatio() : fixedRatio;
+
+      packetAssembly.setEccPolicy(EccPolicy::uniform(ratio));
+      packetAssembly.processFrame(frame.data(),
+                                  static_cast<int>(frame.size()),
+                                  EFrameClass::Delta);
+
+      const size_t msgCount = packetAssembly.data.back().msgIndex + 1;
+      controller.onFrameSent(packetAssembly.data.size(),
+                             packetAssembly.ecc.size(), msgCount);
+      result.dataChunks += packetAssembly.data.size();
+      result.eccChunks += packetAssembly.ecc.size();
+      result.ratioSum += ratio;
+
+      order.clear();
+      for (auto &chunk : packetAssembly.data) {
+        order.push_back(&chunk);
+      }
+      for (auto &chunk : packetAssembly.ecc) {
+        order.push_back(&chunk);
+      }
+
+      bool isDelivered = false;
+      for (auto *chunk : order) {
+        if (channel.nextIsLost()) {
+          continue;
+        }
+
+        UdpChunk received = *chunk;
+        received.trackingId = trackingId;
+        metrics.incomingPackets++;
+
+        for (auto entry = frameAssembly.process(received, metrics); entry;
+             entry = frameAssembly.nextReadyFrame()) {
+          isDelivered = isDelivered || (entry->trackingId == trackingId);
+        }
+      }
+
+      result.lostFrames += isDelivered ? 0 : 1;
+
+      if ((trackingId + 1) % reportInterval == 0) {
+        controller.onViewerMetrics(metrics);
+      }
+    }
+
+    return result;
+  }
+
+  const EccController &getController() const { return controller; }
+};
+}  // namespace
+
+// Usage: adaptive [--frame-bytes=30000] [--frames=3000] [--report=6]
+//                 [--target=0.001]
+//
+// Lost frames and ECC overhead through phases of changing loss, for fixed
+// ratios and for an EccController starting at 0.1. Each phase runs "frames"
+// frames, the viewer reports every "report" frames.
+int runAdaptiveEcc(int argc, char **argv) {
+  const int frameBytes =
+      static_cast<int>(option(argc, argv, "frame-bytes", 30000));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 3000));
+  const int reportInterval =
+      std::max(1, static_cast<int>(option(argc, argv, "report", 6)));
+  const double target = option(argc, argv, "target", 0.001);
+
+  const Phase phases[] = {
+      {"clean", 0, 1, 0.001, 0},
+      {"random 3%", 0, 1, 0.03, 0},
+      {"bursty", 0.01, 0.3, 0.001, 0.3},
+      {"heavy bursts", 0.02, 0.2, 0.01, 0.5},
+      {"clean again", 0, 1, 0.001, 0},
+  };
+
+  std::vector<unsigned char> frame(frameBytes);
+  std::mt19937 random(1234);
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+
+  Sender senders[] = {
+      {0.1f, false, target}, {0.25f, false, target}, {0.1f, true, target},
+  };
+  const char *names[] = {"fixed 0.1", "fixed 0.25", "adaptive"};
+
+  printf("frames of %d bytes, %d per phase, report every %d, target frame "
+         "loss %g\n",
+         frameBytes, frames, reportInterval, target);
+  printf("%-14s %-12s %8s %10s %8s %8s %8s\n", "phase", "sender", "lost",
+         "ecc/data", "ratio", "loss", "burst");
+
+  for (const auto &phase : phases) {
+    for (size_t s = 0; s < sizeof(senders) / sizeof(senders[0]); s++) {
+      Result r = senders[s].run(phase, frame, frames, reportInterval);
+      const EccController &controller = senders[s].getController();
+
+      printf("%-14s %-12s %8d %10.3f %8.3f %8.4f %8.2f\n", phase.name,
+             names[s], r.lostFrames,
+             static_cast<double>(r.eccChunks) / r.dataChunks,
+             r.ratioSum / frames, controller.getLossRate(),
+             controller.getBurstLength());
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,262 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <random>
+#include <utility>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "ChunkBuffer.h"
+#include "ErasureCode.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+#include "SlabPool.h"
+
+// Every heap allocation in the process goes through here, so the benchmark
+// can tell exactly which calls touch the heap.
+static std::atomic<uint64_t> allocationCount(0);
+
+void *operator new(size_t size) {
+  allocationCount++;
+
+  if (void *ptr = malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete[](void *ptr) noexcept { free(ptr); }
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Counts {
+  uint64_t allocations = 0;
+  uint64_t calls = 0;
+  uint64_t failures = 0;
+};
+
+// Encodes and decodes one (k, m) shape with random erasures through the
+// workspace API.  The first half of the iterations is warm-up.
+void measureShape(int k, int m, int iterations, Cauchy256Workspace *workspace,
+                  std::mt19937 &random, Counts &encode, Counts &decode) {
+  const int blockBytes = CHUNK_ECC_SIZE;
+  AlignedByteVector original(k * blockBytes), recovery(m * blockBytes);
+  AlignedByteVector received(k * blockBytes);
+  std::vector<const unsigned char *> dataPtrs(k);
+  std::vector<Block> blocks(k);
+  std::vector<int> rows(k);
+
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<unsigned char>(random());
+  }
+  for (int i = 0; i < k; i++) {
+    dataPtrs[i] = &original[i * blockBytes];
+    rows[i] = i;
+  }
+
+  cauchy_256_cache_warm(k, m);
+
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    const bool measure = iteration >= iterations / 2;
+
+    uint64_t before = allocationCount;
+    const int encodeError = cauchy_256_encode_ws(
+        k, m, dataPtrs.data(), recovery.data(), blockBytes, workspace);
+    if (measure) {
+      encode.allocations += allocationCount - before;
+      encode.calls++;
+      encode.failures += encodeError ? 1 : 0;
+    }
+
+    // Lose 1..min(k, m) random data rows and put recovery rows in their place
+    std::shuffle(rows.begin(), rows.end(), random);
+    const int lost = 1 + static_cast<int>(random() % std::min(k, m));
+
+    for (int i = 0; i < k; i++) {
+      blocks[i].data = &received[i * blockBytes];
+      blocks[i].row = static_cast<unsigned char>(i);
+      memcpy(blocks[i].data, dataPtrs[i], blockBytes);
+    }
+    for (int i = 0; i < lost; i++) {
+      Block &block = blocks[rows[i]];
+      block.row = static_cast<unsigned char>(k + i);
+      memcpy(block.data, &recovery[i * blockBytes], blockBytes);
+    }
+
+    before = allocationCount;
+    const int decodeError =
+        cauchy_256_decode_ws(k, m, blocks.data(), blockBytes, workspace);
+    if (!measure) {
+      continue;
+    }
+    decode.allocations += allocationCount - before;
+    decode.calls++;
+
+    // The m = 1 decoder leaves the row of the recovered block unchanged
+    bool valid = (decodeError == 0);
+    for (int i = 0; (i < k) && valid; i++) {
+      const int row = (m == 1) ? i : blocks[i].row;
+      valid = memcmp(blocks[i].data, dataPtrs[row], blockBytes) == 0;
+    }
+    decode.failures += valid ? 0 : 1;
+  }
+}
+
+// Sends frames through PacketAssembly and, with some chunks dropped, back
+// through FrameAssembly.  Returns allocations per frame for both sides, and
+// what their pools saw over the whole run.
+void measureFrames(int frameBytes, float ratio, double loss, int frames,
+                   double &sendPerFrame, double &receivePerFrame,
+                   uint64_t &reconstructed, PoolMetrics &sendPools,
+                   PoolMetrics &receivePools) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::vector<unsigned char> frame(frameBytes);
+  uint64_t sendAllocations = 0, receiveAllocations = 0;
+
+  for (size_t i = 0; i < frame.size(); i++) {
+    frame[i] = static_cast<unsigned char>(random());
+  }
+
+  reconstructed = 0;
+  for (int i = 0; i < frames; i++) {
+    const bool measure = i >= frames / 2;
+
+    uint64_t before = allocationCount;
+    packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+    if (measure) {
+      sendAllocations += allocationCount - before;
+    }
+
+    before = allocationCount;
+    for (auto *chunks : {&packetAssembly.data, &packetAssembly.ecc}) {
+      for (auto &chunk : *chunks) {
+        if (uniform(random) < loss) {
+          continue;
+        }
+
+        chunk.trackingId = i;
+        if (frameAssembly.process(chunk, metrics) && measure) {
+          reconstructed++;
+        }
+      }
+    }
+    if (measure) {
+      receiveAllocations += allocationCount - before;
+    }
+  }
+
+  sendPools = packetAssembly.poolMetrics();
+  receivePools = frameAssembly.poolMetrics();
+  sendPerFrame = static_cast<double>(sendAllocations) / (frames - frames / 2);
+  receivePerFrame =
+      static_cast<double>(receiveAllocations) / (frames - frames / 2);
+}
+}  // namespace
+
+// Usage: alloc [--iterations=2000] [--ratio=0.1] [--frame-bytes=200000]
+//              [--loss=0.02] [--frames=2000]
+//
+// Fails unless cauchy_256_encode_ws()/cauchy_256_decode_ws() and
+// PacketAssembly::processFrame() and FrameAssembly::process() run without
+// heap allocations once warm.
+int runAllocations(int argc, char **argv) {
+  const int iterations =
+      static_cast<int>(option(argc, argv, "iterations", 2000));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int frameBytes =
+      static_cast<int>(option(argc, argv, "frame-bytes", 200000));
+  const double loss = option(argc, argv, "loss", 0.02);
+  const int frames = static_cast<int>(option(argc, argv, "frames", 2000));
+
+  Cauchy256Workspace *workspace = cauchy_256_workspace_create(CHUNK_ECC_SIZE);
+  std::mt19937 random(42);
+  bool passed = true;
+
+  printf("%6s %6s %12s %12s %12s %12s\n", "k", "m", "encode alloc",
+         "decode alloc", "enc failed", "dec failed");
+
+  // Largest shapes first, so decode cache entries never need to grow later
+  const int shapes[][2] = {{127, 0}, {127, 128}, {64, 0},
+                           {32, 0},  {8, 0},     {2, 0}};
+  for (auto &shape : shapes) {
+    const int k = shape[0];
+    const int m = shape[1] ? shape[1]
+                           : static_cast<int>(
+                                 PacketAssembly::eccChunkCount(k, ratio));
+    Counts encode, decode;
+
+    measureShape(k, m, iterations, workspace, random, encode, decode);
+
+    printf("%6d %6d %12llu %12llu %12llu %12llu\n", k, m,
+           static_cast<unsigned long long>(encode.allocations),
+           static_cast<unsigned long long>(decode.allocations),
+           static_cast<unsigned long long>(encode.failures),
+           static_cast<unsigned long long>(decode.failures));
+
+    passed = passed && !encode.allocations && !decode.allocations &&
+             !encode.failures && !decode.failures;
+  }
+
+  cauchy_256_workspace_free(workspace);
+
+  double sendPerFrame, receivePerFrame;
+  uint64_t reconstructed;
+  PoolMetrics sendPools, receivePools;
+  measureFrames(frameBytes, ratio, loss, frames, sendPerFrame, receivePerFrame,
+                reconstructed, sendPools, receivePools);
+
+  printf("\n%d byte frames, %g loss: %.2f allocations per sent frame, "
+         "%.2f per received frame (%llu frames reconstructed)\n",
+         frameBytes, loss, sendPerFrame, receivePerFrame,
+         static_cast<unsigned long long>(reconstructed));
+
+  for (auto pools : {std::make_pair("send", &sendPools),
+                     std::make_pair("receive", &receivePools)}) {
+    printf("%s pools: %llu heap allocations, %llu reuses, %llu overflows\n",
+           pools.first,
+           static_cast<unsigned long long>(pools.second->heapAllocations),
+           static_cast<unsigned long long>(pools.second->reuses),
+           static_cast<unsigned long long>(pools.second->overflows));
+  }
+
+  passed = passed && (sendPerFrame == 0) && (receivePerFrame == 0);
+
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : -1;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
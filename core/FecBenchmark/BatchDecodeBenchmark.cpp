@@ -0,0 +1,291 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "ChunkBuffer.h"
+#include "ErasureCode.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  double singleUs = 0, batchUs = 0;
+  int failures = 0;
+};
+
+// Lost rows of one message, data rows first filled in with recovery rows
+// like MessageAssembly does
+void chooseLosses(int k, int losses, std::mt19937 &random,
+                  std::vector<int> &lost) {
+  lost.clear();
+
+  while (static_cast<int>(lost.size()) < losses) {
+    const int row = static_cast<int>(random() % k);
+
+    if (std::find(lost.begin(), lost.end(), row) == lost.end()) {
+      lost.push_back(row);
+    }
+  }
+}
+
+void fillBlocks(int k, int blockBytes, const unsigned char *original,
+                const unsigned char *recovery, const std::vector<int> &lost,
+                unsigned char *received, Block *blocks) {
+  for (int i = 0, nextEcc = 0; i < k; i++) {
+    unsigned char *dest = received + i * blockBytes;
+    blocks[i].data = dest;
+
+    if (std::find(lost.begin(), lost.end(), i) == lost.end()) {
+      blocks[i].row = static_cast<unsigned char>(i);
+      memcpy(dest, original + i * blockBytes, blockBytes);
+    } else {
+      blocks[i].row = static_cast<unsigned char>(k + nextEcc);
+      memcpy(dest, recovery + nextEcc * blockBytes, blockBytes);
+      nextEcc++;
+    }
+  }
+}
+
+Result benchmarkApi(int k, int m, int messages, int losses, bool isAligned,
+                    int iterations, Cauchy256Workspace *workspace) {
+  const int blockBytes = CHUNK_ECC_SIZE;
+  AlignedByteVector original(messages * k * blockBytes);
+  AlignedByteVector recovery(messages * m * blockBytes);
+  AlignedByteVector received(messages * k * blockBytes);
+  std::vector<const unsigned char *> dataPtrs(k);
+  std::vector<Block> blocks(messages * k);
+  std::vector<Block *> sets(messages);
+  std::vector<int> lost;
+  std::mt19937 random(42);
+  Result result;
+
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<unsigned char>(random());
+  }
+  for (int msg = 0; msg < messages; msg++) {
+    for (int i = 0; i < k; i++) {
+      dataPtrs[i] = &original[(msg * k + i) * blockBytes];
+    }
+    cauchy_256_encode_ws(k, m, dataPtrs.data(), &recovery[msg * m * blockBytes],
+                         blockBytes, workspace);
+    sets[msg] = &blocks[msg * k];
+  }
+
+  double singleSeconds = 0, batchSeconds = 0;
+
+  // One extra round warms up caches and clocks
+  for (int iteration = 0; iteration <= iterations; iteration++) {
+    for (int isBatch = 0; isBatch < 2; isBatch++) {
+      std::mt19937 lossRandom(iteration);
+
+      for (int msg = 0; msg < messages; msg++) {
+        if (!isAligned || (msg == 0)) {
+          chooseLosses(k, losses, lossRandom, lost);
+        }
+        fillBlocks(k, blockBytes, &original[msg * k * blockBytes],
+                   &recovery[msg * m * blockBytes], lost,
+                   &received[msg * k * blockBytes], sets[msg]);
+      }
+
+      const double start = nowSeconds();
+      int error = 0;
+
+      if (isBatch) {
+        error = cauchy_256_decode_batch_ws(k, m, sets.data(), messages,
+                                           blockBytes, workspace);
+      } else {
+        for (int msg = 0; msg < messages; msg++) {
+          error |= cauchy_256_decode_ws(k, m, sets[msg], blockBytes,
+                                        workspace);
+        }
+      }
+
+      const double seconds = nowSeconds() - start;
+      clobber(received.data());
+
+      if (iteration == 0) {
+        continue;
+      }
+
+      (isBatch ? batchSeconds : singleSeconds) += seconds;
+
+      // Recovered blocks stay where the recovery rows were put
+      for (int i = 0; (i < messages * k) && !error; i++) {
+        if (memcmp(blocks[i].data, &original[i * blockBytes], blockBytes) !=
+            0) {
+          error = 1;
+        }
+      }
+      result.failures += error ? 1 : 0;
+    }
+  }
+
+  result.singleUs = singleSeconds * 1e6 / iterations;
+  result.batchUs = batchSeconds * 1e6 / iterations;
+
+  return result;
+}
+
+// Receive time of a frame whose messages all lose the same data chunks
+Result benchmarkFrame(int frameBytes, float ratio, int losses, int frames) {
+  PacketAssembly packetAssembly;
+  std::vector<unsigned char> frame(frameBytes);
+  std::vector<bool> isLost(MAX_MESSAGE_CHUNKS);
+  std::mt19937 random(42);
+  Result result;
+
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+
+  packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+
+  // Only rows every message has, recoverable by the smallest message
+  size_t minChunks = MAX_MESSAGE_CHUNKS, minEcc = MAX_MESSAGE_CHUNKS;
+  for (const auto &chunk : packetAssembly.data) {
+    minChunks = std::min<size_t>(minChunks,
+                                 (chunk.msgIndex + 1 == chunk.msgCount)
+                                     ? chunk.chunkCount
+                                     : MAX_MESSAGE_CHUNKS);
+  }
+  minEcc = PacketAssembly::eccChunkCount(minChunks, ratio);
+  for (int i = 0; i < std::min<int>(losses, static_cast<int>(minEcc));) {
+    const size_t row = random() % minChunks;
+
+    if (!isLost[row]) {
+      isLost[row] = true;
+      i++;
+    }
+  }
+
+  for (int isBatch = 0; isBatch < 2; isBatch++) {
+    FrameAssembly frameAssembly;
+    ConnectionMetrics metrics;
+    double seconds = 0;
+
+    frameAssembly.setBatchDecoding(isBatch != 0);
+
+    for (int i = 0; i <= frames; i++) {
+      const double start = nowSeconds();
+      std::shared_ptr<FrameAssembly::ReassemblyEntry> entry;
+
+      for (auto chunk : packetAssembly.data) {
+        if (!isLost[chunk.chunkIndex]) {
+          chunk.trackingId = i;
+          entry = frameAssembly.process(chunk, metrics);
+        }
+      }
+      for (auto chunk : packetAssembly.ecc) {
+        chunk.trackingId = i;
+        if (!entry) {
+          entry = frameAssembly.process(chunk, metrics);
+        }
+      }
+
+      // The first frame warms up caches and clocks
+      if (i > 0) {
+        seconds += nowSeconds() - start;
+      }
+
+      if (!entry || (entry->data != frame)) {
+        result.failures++;
+      }
+    }
+
+    (isBatch ? result.batchUs : result.singleUs) = seconds * 1e6 / frames;
+  }
+
+  return result;
+}
+}  // namespace
+
+// Usage: batch [--k=127] [--ratio=0.1] [--losses=0] [--iterations=200]
+//              [--frame-bytes=1003828] [--frames=200]
+//
+// Decoding the messages of a frame one by one versus together with
+// cauchy_256_decode_batch_ws(), when every message lost the same rows
+// (aligned) and when each lost its own (scattered). Every message loses
+// --losses rows, 0 for as many as its ECC chunks repair. The frame rows feed
+// a whole frame with aligned losses through FrameAssembly, with and without
+// batch decoding.
+int runBatchDecode(int argc, char **argv) {
+  const int k = static_cast<int>(option(argc, argv, "k", MAX_MESSAGE_CHUNKS));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int lossOption = static_cast<int>(option(argc, argv, "losses", 0));
+  const int iterations =
+      static_cast<int>(option(argc, argv, "iterations", 200));
+  const int frameBytes = static_cast<int>(
+      option(argc, argv, "frame-bytes", 16 * MAX_MESSAGE_SIZE));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 200));
+
+  const int m = static_cast<int>(PacketAssembly::eccChunkCount(k, ratio));
+  const int losses = (lossOption > 0) ? std::min(lossOption, m) : m;
+
+  if ((k < 2) || (k > MAX_MESSAGE_CHUNKS) || (m < 2)) {
+    fprintf(stderr, "Need 2 <= k <= %d and at least 2 ECC chunks.\n",
+            MAX_MESSAGE_CHUNKS);
+    return -1;
+  }
+
+  PacketAssembly::warmUp(ratio);
+  Cauchy256Workspace *workspace = cauchy_256_workspace_create(CHUNK_ECC_SIZE);
+
+  printf("k=%d m=%d, %d rows lost per message\n", k, m, losses);
+  printf("%10s %9s %12s %12s %8s %7s\n", "losses", "messages", "single us",
+         "batch us", "speedup", "failed");
+
+  const int messageCounts[] = {1, 2, 4, 8, 16, 32};
+
+  for (int isAligned = 1; isAligned >= 0; isAligned--) {
+    for (int messages : messageCounts) {
+      Result r = benchmarkApi(k, m, messages, losses, isAligned != 0,
+                              iterations, workspace);
+
+      printf("%10s %9d %12.1f %12.1f %7.2fx %7d\n",
+             isAligned ? "aligned" : "scattered", messages, r.singleUs,
+             r.batchUs, r.singleUs / std::max(r.batchUs, 1e-9), r.failures);
+    }
+  }
+
+  cauchy_256_workspace_free(workspace);
+
+  Result r = benchmarkFrame(frameBytes, ratio, losses, frames);
+
+  printf("%10s %9d %12.1f %12.1f %7.2fx %7d\n", "frame",
+         (frameBytes + MAX_MESSAGE_SIZE - 1) / MAX_MESSAGE_SIZE, r.singleUs,
+         r.batchUs, r.singleUs / std::max(r.batchUs, 1e-9), r.failures);
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,182 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef FECBENCHMARK_BENCHMARK_H
+#define FECBENCHMARK_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace DirectRemote {
+namespace Benchmark {
+
+// Time stamp counter on x86, nanoseconds elsewhere
+inline uint64_t readCycles() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+    defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+inline double nowSeconds() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Keeps the optimizer from dropping work whose result is never read
+inline void clobber(const void *ptr) {
+#if defined(_MSC_VER)
+  (void)ptr;
+  _ReadWriteBarrier();
+#else
+  asm volatile("" : : "r"(ptr) : "memory");
+#endif
+}
+
+// Value of a "--name=value" or "--name value" argument, or fallback if it is
+// not given. Exits if the value is missing or not a number.
+inline double option(int argc, char **argv, const char *name,
+                     double fallback) {
+  const size_t length = strlen(name);
+
+  for (int i = 0; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if ((strncmp(arg, "--", 2) != 0) || (strncmp(arg + 2, name, length) != 0)) {
+      continue;
+    }
+
+    const char *value = nullptr;
+    if (arg[2 + length] == '=') {
+      value = arg + 3 + length;
+    } else if ((arg[2 + length] == '\0') && (i + 1 < argc)) {
+      value = argv[i + 1];
+    } else if (arg[2 + length] != '\0') {
+      continue;  // another option that starts with this name
+    }
+
+    char *end = nullptr;
+    const double result = value ? strtod(value, &end) : 0;
+
+    if (!value || (end == value) || (*end != '\0')) {
+      fprintf(stderr, "--%s needs a number, got '%s'.\n", name,
+              value ? value : "");
+      exit(-1);
+    }
+
+    return result;
+  }
+
+  return fallback;
+}
+
+// Whether a bare "--name" argument is given
+inline bool flag(int argc, char **argv, const char *name) {
+  for (int i = 0; i < argc; i++) {
+    if ((strncmp(argv[i], "--", 2) == 0) && (strcmp(argv[i] + 2, name) == 0)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Nearest-rank percentile of sorted samples, p in [0, 1]
+inline double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min(sorted.size() - 1,
+                         static_cast<size_t>(p * (sorted.size() - 1) + 0.5))];
+}
+
+// Two-state Markov loss model.  Losses in the "bad" state come in bursts,
+// which is what real links look like.
+class GilbertElliott {
+ private:
+  std::mt19937_64 random;
+  std::uniform_real_distribution<double> uniform;
+  double pGoodToBad, pBadToGood, lossGood, lossBad;
+  bool isBad = false;
+
+ public:
+  GilbertElliott(double pGoodToBad, double pBadToGood, double lossGood,
+                 double lossBad, uint64_t seed)
+      : random(seed),
+        uniform(0.0, 1.0),
+        pGoodToBad(pGoodToBad),
+        pBadToGood(pBadToGood),
+        lossGood(lossGood),
+        lossBad(lossBad) {}
+
+  bool nextIsLost() {
+    if (isBad) {
+      isBad = uniform(random) >= pBadToGood;
+    } else {
+      isBad = uniform(random) < pGoodToBad;
+    }
+
+    return uniform(random) < (isBad ? lossBad : lossGood);
+  }
+};
+
+int runAllocations(int argc, char **argv);
+int runMemXor(int argc, char **argv);
+int runProgressive(int argc, char **argv);
+int runDecodeCache(int argc, char **argv);
+int runFrameProtection(int argc, char **argv);
+int runFountain(int argc, char **argv);
+int runErasure(int argc, char **argv);
+int runXorParity(int argc, char **argv);
+int runBatchDecode(int argc, char **argv);
+int runParallelEncode(int argc, char **argv);
+int runParallelDecode(int argc, char **argv);
+int runStreaming(int argc, char **argv);
+int runEccPolicy(int argc, char **argv);
+int runAdaptiveEcc(int argc, char **argv);
+int runInterleave(int argc, char **argv);
+int runWireFormat(int argc, char **argv);
+int runPacing(int argc, char **argv);
+
+}  // namespace Benchmark
+}  // namespace DirectRemote
+
+#endif
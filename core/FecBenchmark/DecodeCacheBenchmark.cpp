@@ -0,0 +1,213 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "ChunkBuffer.h"
+#include "ErasureCode.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int decodes = 0;
+  int failures = 0;
+  double hitRate = 0;
+  double meanNs = 0, p50Ns = 0, p99Ns = 0;
+};
+
+Result simulate(int k, int m, int messages, int cacheSize, int tail,
+                double pGoodToBad, double pBadToGood, double lossGood,
+                double lossBad) {
+  const int blockBytes = CHUNK_ECC_SIZE;
+  Result result;
+
+  cauchy_256_cache_set_decode_size(cacheSize);
+
+  // Same trace for every cache size, so the runs are comparable. Bursts are
+  // also what makes erasure patterns repeat.
+  GilbertElliott channel(pGoodToBad, pBadToGood, lossGood, lossBad, 42);
+
+  AlignedByteVector original(k * blockBytes), recovery(m * blockBytes);
+  AlignedByteVector received(k * blockBytes);
+  std::vector<const unsigned char *> dataPtrs(k);
+  std::vector<Block> blocks(k);
+  std::vector<bool> lost(k + m);
+  std::vector<double> latencies;
+
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<unsigned char>(i * 31 + 7);
+  }
+  for (int i = 0; i < k; i++) {
+    dataPtrs[i] = &original[i * blockBytes];
+  }
+  cauchy_256_encode(k, m, dataPtrs.data(), recovery.data(), blockBytes);
+
+  Cauchy256CacheStats before;
+  cauchy_256_cache_stats(&before);
+
+  for (int msg = 0; msg < messages; msg++) {
+    // Same send order as UdpProtocol: ECC chunks spread across the data
+    const int step = std::max(1, k / m);
+    for (int i = 0, data = 0, ecc = 0; (data < k) || (ecc < m); i++) {
+      if (((i % step == 0) && (ecc < m)) || (data >= k)) {
+        lost[k + ecc] = (tail <= 0) && channel.nextIsLost();
+        ecc++;
+      } else {
+        // A drop-tail queue that overflows at the same point of every
+        // message loses the same data chunks each time
+        lost[data] = (tail > 0) ? (data >= k - tail) : channel.nextIsLost();
+        data++;
+      }
+    }
+
+    // Fill erased data rows with recovery rows, like MessageAssembly
+    int nextEcc = 0, missing = 0;
+    bool decodable = true;
+    for (int i = 0; i < k; i++) {
+      unsigned char *dest = &received[i * blockBytes];
+      blocks[i].data = dest;
+
+      if (!lost[i]) {
+        blocks[i].row = static_cast<unsigned char>(i);
+        memcpy(dest, &original[i * blockBytes], blockBytes);
+        continue;
+      }
+
+      missing++;
+      while ((nextEcc < m) && lost[k + nextEcc]) {
+        nextEcc++;
+      }
+      if (nextEcc >= m) {
+        decodable = false;
+        break;
+      }
+
+      blocks[i].row = static_cast<unsigned char>(k + nextEcc);
+      memcpy(dest, &recovery[nextEcc * blockBytes], blockBytes);
+      nextEcc++;
+    }
+
+    if (!decodable || !missing) {
+      continue;
+    }
+
+    const double start = nowSeconds();
+    const int error = cauchy_256_decode(k, m, blocks.data(), blockBytes);
+    latencies.push_back((nowSeconds() - start) * 1e9);
+
+    // Recovered blocks stay where the recovery rows were put
+    result.decodes++;
+    for (int i = 0; (i < k) && !error; i++) {
+      if (memcmp(blocks[i].data, &original[i * blockBytes], blockBytes) != 0) {
+        result.failures++;
+        break;
+      }
+    }
+    if (error) {
+      result.failures++;
+    }
+  }
+
+  Cauchy256CacheStats after;
+  cauchy_256_cache_stats(&after);
+
+  const double hits = static_cast<double>(after.decodeHits - before.decodeHits);
+  const double lookups =
+      hits + static_cast<double>(after.decodeMisses - before.decodeMisses);
+  result.hitRate = lookups > 0 ? hits / lookups : 0;
+
+  std::sort(latencies.begin(), latencies.end());
+  for (double ns : latencies) {
+    result.meanNs += ns / latencies.size();
+  }
+  result.p50Ns = percentile(latencies, 0.5);
+  result.p99Ns = percentile(latencies, 0.99);
+
+  return result;
+}
+}  // namespace
+
+// Usage: decode-cache [--chunks=64] [--ratio=0.1] [--messages=100000]
+//                     [--cache=64] [--p-gb=0.01] [--p-bg=0.3]
+//                     [--loss-good=0.001] [--loss-bad=0.3] [--tail=0]
+//
+// Runs the same loss trace once with the cache disabled and once enabled.
+// --tail=N drops the last N data chunks of every message instead of using
+// the Gilbert-Elliott channel. Only patterns of 16 or more erasures are
+// cached, so for example --chunks=127 --ratio=0.5 --tail=48 shows the cache
+// at work.
+int runDecodeCache(int argc, char **argv) {
+  const int k = static_cast<int>(option(argc, argv, "chunks", 64));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int messages = static_cast<int>(option(argc, argv, "messages", 100000));
+  const int cacheSize = static_cast<int>(option(argc, argv, "cache", 64));
+  const double pGoodToBad = option(argc, argv, "p-gb", 0.01);
+  const double pBadToGood = option(argc, argv, "p-bg", 0.3);
+  const double lossGood = option(argc, argv, "loss-good", 0.001);
+  const double lossBad = option(argc, argv, "loss-bad", 0.3);
+  const int tail = static_cast<int>(option(argc, argv, "tail", 0));
+
+  if ((k < 2) || (k > 127)) {
+    fprintf(stderr, "--chunks must be in [2, 127].\n");
+    return -1;
+  }
+
+  const int m = static_cast<int>(PacketAssembly::eccChunkCount(k, ratio));
+
+  if ((tail < 0) || (tail > m)) {
+    fprintf(stderr, "--tail must be in [0, %d].\n", m);
+    return -1;
+  }
+
+  if (tail > 0) {
+    printf("k=%d m=%d messages=%d, drop-tail of %d data chunks\n", k, m,
+           messages, tail);
+  } else {
+    printf("k=%d m=%d messages=%d, Gilbert-Elliott p(g->b)=%g p(b->g)=%g "
+           "loss good=%g bad=%g\n",
+           k, m, messages, pGoodToBad, pBadToGood, lossGood, lossBad);
+  }
+  printf("%6s %8s %8s %8s %10s %10s %10s\n", "cache", "decodes", "failed",
+         "hits", "mean ns", "p50 ns", "p99 ns");
+
+  const int sizes[] = {0, cacheSize};
+  for (int size : sizes) {
+    Result r = simulate(k, m, messages, size, tail, pGoodToBad, pBadToGood,
+                        lossGood, lossBad);
+
+    printf("%6d %8d %8d %7.1f%% %10.0f %10.0f %10.0f\n", size, r.decodes,
+           r.failures, r.hitRate * 100, r.meanNs, r.p50Ns, r.p99Ns);
+  }
+
+  cauchy_256_cache_set_decode_size(64);
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
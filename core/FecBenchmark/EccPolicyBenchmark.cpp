@@ -0,0 +1,168 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+#include "SendScheduler.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int usableFrames = 0;  // decoded, and so was everything they refer to
+  int lostKeyFrames = 0;
+  int lostDeltaFrames = 0;
+  size_t dataChunks = 0, eccChunks = 0;
+};
+
+struct Policy {
+  const char *name;
+  float delta, key, leading;
+};
+
+// Groups of pictures of one keyframe and gop - 1 delta frames, where a
+// frame is only usable if every frame of its group up to it arrived
+Result simulate(const Policy &policy, int keyBytes, int deltaBytes, int gop,
+                int frames, double pGoodToBad, double pBadToGood,
+                double lossGood, double lossBad) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  // Same send order as UdpProtocol::sendPackets() without interleaving
+  SendScheduler scheduler;
+  std::vector<unsigned char> frame;
+  EccPolicy eccPolicy = EccPolicy::uniform(policy.delta);
+  Result result;
+
+  eccPolicy.frameRatio[static_cast<int>(EFrameClass::Key)] = policy.key;
+  eccPolicy.leadingRatio[static_cast<int>(EFrameClass::Key)] = policy.leading;
+  eccPolicy.leadingMessages = 1;
+  packetAssembly.setEccPolicy(eccPolicy);
+
+  // Same frames and loss trace for all policies, as long as they send the
+  // same number of chunks
+  std::mt19937 random(1234);
+  GilbertElliott channel(pGoodToBad, pBadToGood, lossGood, lossBad, 42);
+  bool isGroupIntact = false;
+
+  for (int i = 0; i < frames; i++) {
+    const bool isKey = (i % gop) == 0;
+
+    frame.resize(isKey ? keyBytes : deltaBytes);
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    packetAssembly.processFrame(
+        frame.data(), static_cast<int>(frame.size()),
+        isKey ? EFrameClass::Key : EFrameClass::Delta);
+
+    result.dataChunks += packetAssembly.data.size();
+    result.eccChunks += packetAssembly.ecc.size();
+
+    bool isDelivered = false;
+    for (auto *chunk : scheduler.schedule(packetAssembly.data.span(),
+                                          packetAssembly.ecc.span(), i)) {
+      if (channel.nextIsLost()) {
+        continue;
+      }
+
+      for (auto entry = frameAssembly.process(*chunk, metrics); entry;
+           entry = frameAssembly.nextReadyFrame()) {
+        isDelivered = isDelivered ||
+                      ((entry->trackingId == i) && (entry->data == frame));
+      }
+    }
+
+    if (!isDelivered) {
+      (isKey ? result.lostKeyFrames : result.lostDeltaFrames)++;
+    }
+
+    isGroupIntact = isDelivered && (isKey || isGroupIntact);
+    result.usableFrames += isGroupIntact ? 1 : 0;
+  }
+
+  return result;
+}
+}  // namespace
+
+// Usage: policy [--key-bytes=400000] [--delta-bytes=30000] [--gop=60]
+//               [--frames=6000] [--p-gb=0.01] [--p-bg=0.3]
+//               [--loss-good=0.001] [--loss-bad=0.3]
+//
+// Usable frames under bursty loss with the same ECC ratio for all frames,
+// and with more of it on keyframes and their first message, see EccPolicy.
+// A lost keyframe takes the rest of its group of pictures with it.
+int runEccPolicy(int argc, char **argv) {
+  const int keyBytes =
+      static_cast<int>(option(argc, argv, "key-bytes", 400000));
+  const int deltaBytes =
+      static_cast<int>(option(argc, argv, "delta-bytes", 30000));
+  const int gop = std::max(1, static_cast<int>(option(argc, argv, "gop", 60)));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 6000));
+  const double pGoodToBad = option(argc, argv, "p-gb", 0.01);
+  const double pBadToGood = option(argc, argv, "p-bg", 0.3);
+  const double lossGood = option(argc, argv, "loss-good", 0.001);
+  const double lossBad = option(argc, argv, "loss-bad", 0.3);
+
+  const Policy policies[] = {
+      {"uniform 0.1", 0.1f, 0.1f, 0.1f},
+      {"uniform 0.15", 0.15f, 0.15f, 0.15f},
+      {"0.08/0.25/0.5", 0.08f, 0.25f, 0.5f},
+      {"0.1/0.25/0.5", 0.1f, 0.25f, 0.5f},
+      {"0.1/0.4/0.8", 0.1f, 0.4f, 0.8f},
+  };
+
+  for (const auto &policy : policies) {
+    PacketAssembly::warmUp(policy.delta);
+    PacketAssembly::warmUp(policy.key);
+    PacketAssembly::warmUp(policy.leading);
+  }
+
+  printf("keyframes of %d bytes every %d frames of %d bytes, Gilbert-Elliott "
+         "p(g->b)=%g p(b->g)=%g loss good=%g bad=%g\n",
+         keyBytes, gop, deltaBytes, pGoodToBad, pBadToGood, lossGood,
+         lossBad);
+  printf("%14s %8s %10s %10s %10s %10s\n", "delta/key/lead", "usable",
+         "lost key", "lost delta", "data/frm", "ecc/frm");
+
+  for (const auto &policy : policies) {
+    Result r = simulate(policy, keyBytes, deltaBytes, gop, frames, pGoodToBad,
+                        pBadToGood, lossGood, lossBad);
+
+    printf("%14s %8d %10d %10d %10.1f %10.1f\n", policy.name, r.usableFrames,
+           r.lostKeyFrames, r.lostDeltaFrames,
+           static_cast<double>(r.dataChunks) / frames,
+           static_cast<double>(r.eccChunks) / frames);
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,373 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "ChunkBuffer.h"
+#include "ErasureCode.h"
+#include "UdpChunk.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+enum class Pattern { Random, Burst, RecoveryOnly };
+
+const char *patternName(Pattern pattern) {
+  switch (pattern) {
+    case Pattern::Random:
+      return "random";
+    case Pattern::Burst:
+      return "burst";
+    case Pattern::RecoveryOnly:
+      return "recovery-only";
+  }
+  return "";
+}
+
+// Rows are initialized with the first five members, the rest starts at 0
+struct Result {
+  const char *op;
+  const char *pattern;
+  int k, m, blockBytes;
+  int samples;
+  int failures;
+  double mbPerSecond, nsPerBlock, p50Ns, p99Ns;
+};
+
+// Work of one k x m encode, about 64 MB per measurement
+int iterationsFor(int k, int m, int blockBytes, int maxIterations) {
+  const double work = static_cast<double>(k) * m * blockBytes;
+  return std::max(20, std::min(maxIterations,
+                               static_cast<int>((64 << 20) / work)));
+}
+
+void summarize(Result &result, std::vector<double> &latencies,
+               double bytesPerCall, double blocksPerCall) {
+  std::sort(latencies.begin(), latencies.end());
+
+  double meanNs = 0;
+  for (double ns : latencies) {
+    meanNs += ns / latencies.size();
+  }
+
+  result.samples = static_cast<int>(latencies.size());
+  result.p50Ns = percentile(latencies, 0.5);
+  result.p99Ns = percentile(latencies, 0.99);
+
+  if (meanNs > 0) {
+    result.mbPerSecond = bytesPerCall / meanNs * 1e3;
+    result.nsPerBlock = meanNs / std::max(1.0, blocksPerCall);
+  }
+}
+
+// Positions in the order UdpProtocol::sendPackets() puts them on the wire,
+// data blocks are 0..k-1 and recovery blocks k..k+m-1
+void sendOrder(int k, int m, std::vector<int> &order) {
+  order.clear();
+
+  const int step = std::max(1, k / m);
+  for (int i = 0, data = 0, ecc = 0; (data < k) || (ecc < m); i++) {
+    if (((i % step == 0) && (ecc < m)) || (data >= k)) {
+      order.push_back(k + ecc++);
+    } else {
+      order.push_back(data++);
+    }
+  }
+}
+
+// Always exactly as many losses as can be recovered, the cheap cases where
+// little is lost are not what limits throughput
+void chooseLosses(Pattern pattern, int k, int m, std::mt19937 &random,
+                  const std::vector<int> &order, std::vector<bool> &lost) {
+  std::fill(lost.begin(), lost.end(), false);
+
+  switch (pattern) {
+    case Pattern::Random:
+      for (int i = 0; i < m;) {
+        const int position = static_cast<int>(random() % (k + m));
+
+        if (!lost[position]) {
+          lost[position] = true;
+          i++;
+        }
+      }
+      break;
+    case Pattern::Burst: {
+      const int start = static_cast<int>(random() % (k + 1));
+
+      for (int i = 0; i < m; i++) {
+        lost[order[start + i]] = true;
+      }
+      break;
+    }
+    case Pattern::RecoveryOnly:
+      for (int i = 0; i < std::min(k, m); i++) {
+        lost[i] = true;
+      }
+      break;
+  }
+}
+
+Result benchmarkEncode(int k, int m, int blockBytes, int iterations,
+                       Cauchy256Workspace *workspace) {
+  AlignedByteVector original(k * blockBytes), recovery(m * blockBytes);
+  std::vector<const unsigned char *> dataPtrs(k);
+  std::vector<double> latencies;
+  Result result{};
+
+  result.op = "encode";
+  result.pattern = "none";
+  result.k = k;
+  result.m = m;
+  result.blockBytes = blockBytes;
+
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<unsigned char>(i * 31 + 7);
+  }
+  for (int i = 0; i < k; i++) {
+    dataPtrs[i] = &original[i * blockBytes];
+  }
+
+  // Warm up caches and clocks
+  cauchy_256_encode_ws(k, m, dataPtrs.data(), recovery.data(), blockBytes,
+                       workspace);
+
+  for (int i = 0; i < iterations; i++) {
+    const double start = nowSeconds();
+    if (cauchy_256_encode_ws(k, m, dataPtrs.data(), recovery.data(),
+                             blockBytes, workspace) != 0) {
+      result.failures++;
+    }
+    latencies.push_back((nowSeconds() - start) * 1e9);
+    clobber(recovery.data());
+  }
+
+  summarize(result, latencies, static_cast<double>(k) * blockBytes, k);
+  return result;
+}
+
+Result benchmarkDecode(int k, int m, int blockBytes, Pattern pattern,
+                       int iterations, Cauchy256Workspace *workspace) {
+  AlignedByteVector original(k * blockBytes), recovery(m * blockBytes);
+  AlignedByteVector received(k * blockBytes);
+  std::vector<const unsigned char *> dataPtrs(k);
+  std::vector<Block> blocks(k);
+  std::vector<bool> lost(k + m);
+  std::vector<int> order;
+  std::vector<double> latencies;
+  std::mt19937 random(42);
+  size_t recovered = 0;
+  Result result{};
+
+  result.op = "decode";
+  result.pattern = patternName(pattern);
+  result.k = k;
+  result.m = m;
+  result.blockBytes = blockBytes;
+
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<unsigned char>(i * 31 + 7);
+  }
+  for (int i = 0; i < k; i++) {
+    dataPtrs[i] = &original[i * blockBytes];
+  }
+  cauchy_256_encode_ws(k, m, dataPtrs.data(), recovery.data(), blockBytes,
+                       workspace);
+  sendOrder(k, m, order);
+
+  for (int iteration = 0; iteration <= iterations; iteration++) {
+    chooseLosses(pattern, k, m, random, order, lost);
+
+    // Fill erased data rows with recovery rows, like MessageAssembly
+    int nextEcc = 0, missing = 0;
+    for (int i = 0; i < k; i++) {
+      unsigned char *dest = &received[i * blockBytes];
+      blocks[i].data = dest;
+
+      if (!lost[i]) {
+        blocks[i].row = static_cast<unsigned char>(i);
+        memcpy(dest, &original[i * blockBytes], blockBytes);
+        continue;
+      }
+
+      while (lost[k + nextEcc]) {
+        nextEcc++;
+      }
+
+      blocks[i].row = static_cast<unsigned char>(k + nextEcc);
+      memcpy(dest, &recovery[nextEcc * blockBytes], blockBytes);
+      nextEcc++;
+      missing++;
+    }
+
+    if (missing == 0) {
+      continue;
+    }
+
+    const double start = nowSeconds();
+    const int error = cauchy_256_decode_ws(k, m, blocks.data(), blockBytes,
+                                           workspace);
+    const double ns = (nowSeconds() - start) * 1e9;
+
+    // The first decode warms up caches and clocks
+    if (iteration == 0) {
+      continue;
+    }
+
+    latencies.push_back(ns);
+    recovered += missing;
+
+    // Recovered blocks stay where the recovery rows were put
+    for (int i = 0; (i < k) && !error; i++) {
+      if (memcmp(blocks[i].data, &original[i * blockBytes], blockBytes) !=
+          0) {
+        result.failures++;
+        break;
+      }
+    }
+    if (error) {
+      result.failures++;
+    }
+  }
+
+  summarize(result, latencies, static_cast<double>(k) * blockBytes,
+            latencies.empty() ? 0
+                              : static_cast<double>(recovered) /
+                                    latencies.size());
+  return result;
+}
+
+void printJson(const std::vector<Result> &results) {
+  printf("[\n");
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+
+    printf("  {\"op\": \"%s\", \"pattern\": \"%s\", \"k\": %d, \"m\": %d, "
+           "\"block_bytes\": %d, \"samples\": %d, \"failures\": %d, "
+           "\"mb_per_s\": %.2f, \"ns_per_block\": %.1f, \"p50_ns\": %.0f, "
+           "\"p99_ns\": %.0f}%s\n",
+           r.op, r.pattern, r.k, r.m, r.blockBytes, r.samples, r.failures,
+           r.mbPerSecond, r.nsPerBlock, r.p50Ns, r.p99Ns,
+           (i + 1 < results.size()) ? "," : "");
+  }
+
+  printf("]\n");
+}
+}  // namespace
+
+// Usage: erasure [--k=0] [--m=0] [--block-bytes=0] [--iterations=1000]
+//                [--json]
+//
+// Encode and decode of cauchy_256 over k, m and block sizes, where 0 sweeps
+// the defaults. Decodes always lose as many blocks as can be recovered:
+// spread at random, as one burst in send order, or only data blocks so that
+// everything comes from recovery blocks. MB/s is message data per second,
+// ns/block is per data block encoded and per block recovered. --json prints
+// the rows as a JSON array instead of a table.
+int runErasure(int argc, char **argv) {
+  const int kOption = static_cast<int>(option(argc, argv, "k", 0));
+  const int mOption = static_cast<int>(option(argc, argv, "m", 0));
+  const int bytesOption = static_cast<int>(option(argc, argv, "block-bytes", 0));
+  const int maxIterations =
+      static_cast<int>(option(argc, argv, "iterations", 1000));
+  const bool json = flag(argc, argv, "json");
+
+  std::vector<int> ks = {1, 2, 4, 8, 16, 32, 64, 96, MAX_MESSAGE_CHUNKS};
+  std::vector<int> ms = {1, 4, 16, 64, 128};
+  std::vector<int> sizes = {CHUNK_ECC_SIZE, 1024, 4096};
+
+  if (kOption > 0) {
+    ks = {kOption};
+  }
+  if (mOption > 0) {
+    ms = {mOption};
+  }
+  if (bytesOption > 0) {
+    sizes = {bytesOption};
+  }
+
+  const Pattern patterns[] = {Pattern::Random, Pattern::Burst,
+                              Pattern::RecoveryOnly};
+  std::vector<Result> results;
+
+  if (!json) {
+    printf("%-7s %-14s %4s %4s %6s %10s %10s %10s %10s %7s\n", "op",
+           "pattern", "k", "m", "bytes", "MB/s", "ns/block", "p50 ns",
+           "p99 ns", "failed");
+  }
+
+  for (int blockBytes : sizes) {
+    Cauchy256Workspace *workspace = cauchy_256_workspace_create(blockBytes);
+
+    if (!workspace) {
+      fprintf(stderr, "Block size %d is not a positive multiple of 8.\n",
+              blockBytes);
+      return -1;
+    }
+
+    for (int k : ks) {
+      for (int m : ms) {
+        if ((k < 1) || (m < 1) || (k + m > 256)) {
+          continue;
+        }
+
+        const int iterations = iterationsFor(k, m, blockBytes, maxIterations);
+
+        results.push_back(
+            benchmarkEncode(k, m, blockBytes, iterations, workspace));
+
+        for (Pattern pattern : patterns) {
+          results.push_back(benchmarkDecode(k, m, blockBytes, pattern,
+                                            iterations, workspace));
+        }
+
+        for (size_t i = results.size() - 4; !json && (i < results.size());
+             i++) {
+          const Result &r = results[i];
+
+          printf("%-7s %-14s %4d %4d %6d %10.1f %10.1f %10.0f %10.0f %7d\n",
+                 r.op, r.pattern, r.k, r.m, r.blockBytes, r.mbPerSecond,
+                 r.nsPerBlock, r.p50Ns, r.p99Ns, r.failures);
+        }
+      }
+    }
+
+    cauchy_256_workspace_free(workspace);
+  }
+
+  if (json) {
+    printJson(results);
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,193 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int frames = 0;
+  int failures = 0;
+  size_t sentChunks = 0, dataChunks = 0;
+  size_t repairRounds = 0;
+};
+
+class Link {
+ private:
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  GilbertElliott &channel;
+  const std::vector<unsigned char> &frame;
+
+ public:
+  int failures = 0;
+
+  Link(GilbertElliott &channel, const std::vector<unsigned char> &frame)
+      : channel(channel), frame(frame) {}
+
+  // Returns true once the frame is complete
+  bool send(const UdpChunkVector &chunks, int64_t trackingId) {
+    for (const auto &chunk : chunks) {
+      if (channel.nextIsLost()) {
+        continue;
+      }
+
+      UdpChunk received = chunk;
+      received.trackingId = static_cast<uint64_t>(trackingId);
+
+      auto entry = frameAssembly.process(received, metrics);
+      if (entry) {
+        failures += (entry->data != frame) ? 1 : 0;
+        return true;
+      }
+    }
+
+    return false;
+  }
+};
+
+// Fixed ratio: everything goes out, whether it was needed or not
+Result simulateFixed(int frameBytes, float ratio, int frames,
+                     GilbertElliott channel) {
+  PacketAssembly packetAssembly;
+  std::vector<unsigned char> frame(frameBytes);
+  Link link(channel, frame);
+  Result result;
+
+  std::mt19937 random(1234);
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+
+  for (int i = 0; i < frames; i++) {
+    packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+    result.dataChunks += packetAssembly.data.size();
+
+    bool complete = link.send(packetAssembly.data, i);
+    complete = link.send(packetAssembly.ecc, i) || complete;
+
+    result.sentChunks +=
+        packetAssembly.data.size() + packetAssembly.ecc.size();
+    result.frames += complete ? 1 : 0;
+  }
+
+  result.failures = link.failures;
+  return result;
+}
+
+// Fountain: repair rounds of repairRatio until the frame is complete, as if
+// the viewer reported completion right away
+Result simulateFountain(int frameBytes, float ratio, float repairRatio,
+                        int frames, GilbertElliott channel) {
+  PacketAssembly packetAssembly;
+  std::vector<unsigned char> frame(frameBytes);
+  Link link(channel, frame);
+  Result result;
+
+  std::mt19937 random(1234);
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+
+  packetAssembly.setFountainMode(true);
+
+  for (int i = 0; i < frames; i++) {
+    packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+    result.dataChunks += packetAssembly.data.size();
+
+    bool complete = link.send(packetAssembly.data, i);
+    complete = link.send(packetAssembly.ecc, i) || complete;
+    result.sentChunks +=
+        packetAssembly.data.size() + packetAssembly.ecc.size();
+
+    while (!complete && packetAssembly.processRepair(repairRatio)) {
+      result.repairRounds++;
+      result.sentChunks += packetAssembly.ecc.size();
+      complete = link.send(packetAssembly.ecc, i);
+    }
+
+    result.frames += complete ? 1 : 0;
+  }
+
+  result.failures = link.failures;
+  return result;
+}
+
+void print(const char *mode, float ratio, const Result &r, int frames) {
+  printf("%10s %8.2f %8d %10.2f%% %10.2f%% %10.3f\n", mode, ratio,
+         r.failures, 100.0 * r.frames / frames,
+         100.0 * (r.sentChunks - r.dataChunks) / r.dataChunks,
+         static_cast<double>(r.repairRounds) / frames);
+}
+}  // namespace
+
+// Usage: fountain [--frame-bytes=120000] [--ratio=0.05] [--repair=0.02]
+//                 [--frames=2000] [--p-gb=0.01] [--p-bg=0.3]
+//                 [--loss-good=0.001] [--loss-bad=0.3]
+//
+// Frame completion and ECC overhead for fixed ECC ratios versus fountain
+// mode sending repair rounds until the frame is complete.
+int runFountain(int argc, char **argv) {
+  const int frameBytes =
+      static_cast<int>(option(argc, argv, "frame-bytes", 120000));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.05));
+  const float repair = static_cast<float>(option(argc, argv, "repair", 0.02));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 2000));
+  const double pGoodToBad = option(argc, argv, "p-gb", 0.01);
+  const double pBadToGood = option(argc, argv, "p-bg", 0.3);
+  const double lossGood = option(argc, argv, "loss-good", 0.001);
+  const double lossBad = option(argc, argv, "loss-bad", 0.3);
+
+  PacketAssembly::warmUp(ratio, true);
+
+  // Same loss trace for every run
+  const GilbertElliott channel(pGoodToBad, pBadToGood, lossGood, lossBad, 42);
+
+  printf("%d byte frames, Gilbert-Elliott p(g->b)=%g p(b->g)=%g "
+         "loss good=%g bad=%g\n",
+         frameBytes, pGoodToBad, pBadToGood, lossGood, lossBad);
+  printf("%10s %8s %8s %11s %11s %10s\n", "mode", "ratio", "failed",
+         "complete", "overhead", "rounds");
+
+  for (float fixed : {0.05f, 0.1f, 0.2f, 0.3f}) {
+    print("fixed", fixed, simulateFixed(frameBytes, fixed, frames, channel),
+          frames);
+  }
+
+  print("fountain", ratio,
+        simulateFountain(frameBytes, ratio, repair, frames, channel), frames);
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
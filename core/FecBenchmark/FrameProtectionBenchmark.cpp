@@ -0,0 +1,190 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int frames = 0;
+  int failures = 0;
+  int delayedFrames = 0;
+  size_t dataChunks = 0, eccChunks = 0;
+  double encodeUs = 0, receiveUs = 0;
+};
+
+struct Mode {
+  const char *name;
+  bool protectFrame;
+  int crossFrameDepth;  // per message ECC and parity split the ratio
+};
+
+// Same send orders as UdpProtocol::sendPackets()
+void sendOrder(const UdpChunkVector &data, const UdpChunkVector &ecc,
+               std::vector<const UdpChunk *> &order) {
+  order.clear();
+
+  const size_t eccCount =
+      std::find_if(ecc.begin(), ecc.end(), isParityChunk) - ecc.begin();
+  const size_t step =
+      std::max<size_t>(1, data.size() / std::max<size_t>(1, eccCount));
+  size_t j = 0;
+  for (size_t i = 0, x = 0; x < data.size(); i++) {
+    if ((i % step == 0) && (j < eccCount)) {
+      order.push_back(&ecc[j++]);
+    } else {
+      order.push_back(&data[x++]);
+    }
+  }
+  for (; j < ecc.size(); j++) {
+    order.push_back(&ecc[j]);
+  }
+}
+
+Result simulate(const Mode &mode, int frameBytes, float ratio, int frames,
+                double pGoodToBad, double pBadToGood, double lossGood,
+                double lossBad) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::vector<const UdpChunk *> order;
+  std::vector<std::vector<unsigned char>> sent(MAX_PARITY_WINDOW + 1);
+  Result result;
+
+  const bool isCross = mode.crossFrameDepth > 1;
+  const float messageRatio = isCross ? ratio / 2 : ratio;
+
+  packetAssembly.setFrameProtection(mode.protectFrame);
+  packetAssembly.setCrossFrameProtection(mode.crossFrameDepth, ratio / 2);
+
+  // Same frames and loss trace for all modes, as long as they send the same
+  // number of chunks
+  std::mt19937 random(1234);
+  GilbertElliott channel(pGoodToBad, pBadToGood, lossGood, lossBad, 42);
+  double encodeSeconds = 0, receiveSeconds = 0;
+
+  for (int i = 0; i < frames; i++) {
+    auto &frame = sent[i % sent.size()];
+
+    frame.resize(frameBytes);
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    double start = nowSeconds();
+    packetAssembly.processFrame(frame.data(), frameBytes, messageRatio);
+    encodeSeconds += nowSeconds() - start;
+
+    result.dataChunks += packetAssembly.data.size();
+    result.eccChunks += packetAssembly.ecc.size();
+    sendOrder(packetAssembly.data, packetAssembly.ecc, order);
+
+    for (auto *chunk : order) {
+      if (channel.nextIsLost()) {
+        continue;
+      }
+
+      UdpChunk received = *chunk;
+      received.trackingId = i;
+
+      start = nowSeconds();
+      auto entry = frameAssembly.process(received, metrics);
+      receiveSeconds += nowSeconds() - start;
+
+      for (; entry; entry = frameAssembly.nextReadyFrame()) {
+        result.frames++;
+
+        if (entry->trackingId != i) {
+          result.delayedFrames++;
+        }
+
+        if ((i - entry->trackingId >= static_cast<int64_t>(sent.size())) ||
+            (entry->data != sent[entry->trackingId % sent.size()])) {
+          result.failures++;
+        }
+      }
+    }
+  }
+
+  result.encodeUs = encodeSeconds * 1e6 / frames;
+  result.receiveUs = receiveSeconds * 1e6 / frames;
+
+  return result;
+}
+}  // namespace
+
+// Usage: frame [--frame-bytes=300000] [--ratio=0.1] [--frames=2000]
+//              [--p-gb=0.01] [--p-bg=0.3] [--loss-good=0.001]
+//              [--loss-bad=0.3]
+//
+// Frames delivered under bursty loss with ECC per message versus parity over
+// the whole frame, and versus parity across 2 to 4 frames, at the same ECC
+// ratio. Frames held back for parity of later frames count as delayed.
+int runFrameProtection(int argc, char **argv) {
+  const int frameBytes =
+      static_cast<int>(option(argc, argv, "frame-bytes", 300000));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 2000));
+  const double pGoodToBad = option(argc, argv, "p-gb", 0.01);
+  const double pBadToGood = option(argc, argv, "p-bg", 0.3);
+  const double lossGood = option(argc, argv, "loss-good", 0.001);
+  const double lossBad = option(argc, argv, "loss-bad", 0.3);
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("%d byte frames, ratio=%g, Gilbert-Elliott p(g->b)=%g p(b->g)=%g "
+         "loss good=%g bad=%g\n",
+         frameBytes, ratio, pGoodToBad, pBadToGood, lossGood, lossBad);
+  printf("%12s %8s %8s %8s %10s %10s %12s %12s\n", "mode", "frames",
+         "failed", "delayed", "data/frm", "ecc/frm", "encode us",
+         "receive us");
+
+  const Mode modes[] = {
+      {"per message", false, 1}, {"frame", true, 1}, {"cross 2", false, 2},
+      {"cross 3", false, 3},     {"cross 4", false, 4},
+  };
+
+  for (const auto &mode : modes) {
+    Result r = simulate(mode, frameBytes, ratio, frames, pGoodToBad,
+                        pBadToGood, lossGood, lossBad);
+
+    printf("%12s %8d %8d %8d %10.1f %10.1f %12.1f %12.1f\n", mode.name,
+           r.frames, r.failures, r.delayedFrames,
+           static_cast<double>(r.dataChunks) / frames,
+           static_cast<double>(r.eccChunks) / frames, r.encodeUs,
+           r.receiveUs);
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
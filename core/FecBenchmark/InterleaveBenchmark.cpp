@@ -0,0 +1,235 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+#include "SendScheduler.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int lostFrames = 0;
+  int lostKeyFrames = 0;
+  int outOfOrder = 0;
+  int corrupt = 0;
+};
+
+// Scheduled burst losses, or Gilbert-Elliott if burstEvery is 0
+struct LossTrace {
+  int burstLength, burstEvery;
+  double pGoodToBad, pBadToGood, lossBad;
+};
+
+class LossChannel {
+ private:
+  LossTrace trace;
+  GilbertElliott channel;
+  int64_t packet = 0;
+
+ public:
+  explicit LossChannel(const LossTrace &trace)
+      : trace(trace),
+        channel(trace.pGoodToBad, trace.pBadToGood, 0, trace.lossBad, 42) {}
+
+  bool nextIsLost() {
+    if (trace.burstEvery > 0) {
+      return (packet++ % trace.burstEvery) < trace.burstLength;
+    }
+    return channel.nextIsLost();
+  }
+};
+
+void fillFrame(std::vector<unsigned char> &frame, int index, int bytes) {
+  std::mt19937 random(index);
+
+  frame.resize(bytes);
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+}
+
+// Frames one after the other, the messages of each one after the other,
+// with their ECC chunks spread over the data chunks of the frame
+void frameOrder(UdpChunkVector &data, UdpChunkVector &ecc, int64_t trackingId,
+                std::vector<UdpChunk *> &order) {
+  order.clear();
+
+  const size_t eccCount =
+      std::find_if(ecc.begin(), ecc.end(), isParityChunk) - ecc.begin();
+  const size_t step =
+      std::max<size_t>(1, data.size() / std::max<size_t>(1, eccCount));
+  size_t j = 0;
+  for (size_t i = 0, x = 0; x < data.size(); i++) {
+    if ((i % step == 0) && (j < eccCount)) {
+      order.push_back(&ecc[j++]);
+    } else {
+      order.push_back(&data[x++]);
+    }
+  }
+  for (; j < ecc.size(); j++) {
+    order.push_back(&ecc[j]);
+  }
+
+  for (auto *chunk : order) {
+    chunk->trackingId = trackingId;
+  }
+}
+
+// shareCount 0 sends frames in frame order, otherwise SendScheduler splits
+// them into that many shares
+Result simulate(size_t shareCount, const LossTrace &trace, int keyBytes,
+                int deltaBytes, int gop, int frames, float eccRatio) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  SendScheduler scheduler;
+  ConnectionMetrics metrics;
+  LossChannel channel(trace);
+  std::vector<UdpChunk *> baseOrder;
+  std::vector<unsigned char> frame, expected;
+  std::vector<bool> isDelivered(frames);
+  int64_t lastDelivered = -1;
+  Result result;
+
+  packetAssembly.setEccPolicy(EccPolicy::uniform(eccRatio));
+  frameAssembly.setFrameInterleaving(static_cast<int>(shareCount));
+
+  auto receive = [&](const std::vector<UdpChunk *> &order) {
+    for (auto *chunk : order) {
+      if (channel.nextIsLost()) {
+        continue;
+      }
+
+      for (auto entry = frameAssembly.process(*chunk, metrics); entry;
+           entry = frameAssembly.nextReadyFrame()) {
+        const int index = static_cast<int>(entry->trackingId);
+
+        fillFrame(expected, index, (index % gop) ? deltaBytes : keyBytes);
+        if (entry->data != expected) {
+          result.corrupt++;
+          continue;
+        }
+
+        result.outOfOrder += (entry->trackingId < lastDelivered) ? 1 : 0;
+        lastDelivered = std::max(lastDelivered, entry->trackingId);
+        isDelivered[index] = true;
+      }
+    }
+  };
+
+  for (int i = 0; i < frames; i++) {
+    const bool isKey = (i % gop) == 0;
+
+    fillFrame(frame, i, isKey ? keyBytes : deltaBytes);
+    packetAssembly.processFrame(
+        frame.data(), static_cast<int>(frame.size()),
+        isKey ? EFrameClass::Key : EFrameClass::Delta);
+
+    if (shareCount == 0) {
+      frameOrder(packetAssembly.data, packetAssembly.ecc, i, baseOrder);
+      receive(baseOrder);
+    } else {
+      receive(scheduler.schedule(packetAssembly.data.span(),
+                                 packetAssembly.ecc.span(), i, shareCount));
+    }
+  }
+
+  receive(scheduler.flush());
+
+  for (int i = 0; i < frames; i++) {
+    if (!isDelivered[i]) {
+      result.lostFrames++;
+      result.lostKeyFrames += (i % gop) ? 0 : 1;
+    }
+  }
+
+  return result;
+}
+}  // namespace
+
+// Usage: interleave [--key-bytes=400000] [--delta-bytes=30000] [--gop=60]
+//                   [--frames=3000] [--ecc=0.15]
+//
+// Lost frames under burst loss, with frames sent one after the other, with
+// the messages of each frame interleaved, and with every frame spread over
+// 2 and 4 frames, see SendScheduler. Spreading over n frames delays the end
+// of a frame by n - 1 frame intervals.
+int runInterleave(int argc, char **argv) {
+  const int keyBytes =
+      static_cast<int>(option(argc, argv, "key-bytes", 400000));
+  const int deltaBytes =
+      static_cast<int>(option(argc, argv, "delta-bytes", 30000));
+  const int gop = std::max(1, static_cast<int>(option(argc, argv, "gop", 60)));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 3000));
+  const float eccRatio =
+      static_cast<float>(option(argc, argv, "ecc", 0.15));
+
+  struct Trace {
+    const char *name;
+    LossTrace trace;
+  };
+  const Trace traces[] = {
+      {"4 of every 200", {4, 200, 0, 0, 0}},
+      {"8 of every 400", {8, 400, 0, 0, 0}},
+      {"16 of every 800", {16, 800, 0, 0, 0}},
+      {"GE burst ~5", {0, 0, 0.004, 0.2, 1.0}},
+      {"GE burst ~10", {0, 0, 0.002, 0.1, 1.0}},
+  };
+
+  struct Mode {
+    const char *name;
+    size_t shareCount;
+  };
+  const Mode modes[] = {
+      {"frame order", 0},
+      {"messages", 1},
+      {"2 frames", 2},
+      {"4 frames", 4},
+  };
+
+  PacketAssembly::warmUp(eccRatio);
+
+  printf("keyframes of %d bytes every %d frames of %d bytes, ECC %g\n",
+         keyBytes, gop, deltaBytes, eccRatio);
+  printf("%-16s %-12s %8s %8s %8s %8s\n", "loss", "order", "lost",
+         "lost key", "reorder", "corrupt");
+
+  for (const auto &trace : traces) {
+    for (const auto &mode : modes) {
+      Result r = simulate(mode.shareCount, trace.trace, keyBytes, deltaBytes,
+                          gop, frames, eccRatio);
+
+      printf("%-16s %-12s %8d %8d %8d %8d\n", trace.name, mode.name,
+             r.lostFrames, r.lostKeyFrames, r.outOfOrder, r.corrupt);
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,169 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "ChunkBuffer.h"
+#include "MemSwap.hpp"
+#include "MemXOR.hpp"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+enum class Operation { Xor, XorSet, XorAdd };
+
+const char *operationName(Operation op) {
+  switch (op) {
+    case Operation::Xor:
+      return "memxor";
+    case Operation::XorSet:
+      return "memxor_set";
+    case Operation::XorAdd:
+      return "memxor_add";
+  }
+  return "";
+}
+
+void run(const cat::MemXorEngine &engine, Operation op, unsigned char *out,
+         const unsigned char *a, const unsigned char *b, int bytes) {
+  switch (op) {
+    case Operation::Xor:
+      engine.memxor(out, a, bytes);
+      break;
+    case Operation::XorSet:
+      engine.memxor_set(out, a, b, bytes);
+      break;
+    case Operation::XorAdd:
+      engine.memxor_add(out, a, b, bytes);
+      break;
+  }
+}
+}  // namespace
+
+// Usage: memxor [bytes...]
+//
+// Every size is run once with all buffers on a 64-byte boundary (as for the
+// ECC region of chunks) and once shifted by a few bytes. memswap is measured
+// the same way.
+int runMemXor(int argc, char **argv) {
+  std::vector<int> sizes;
+  for (int i = 0; i < argc; i++) {
+    sizes.push_back(atoi(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes = {CHUNK_ECC_SIZE, 4096, 65536};
+  }
+
+  const cat::MemXorEngine *engines;
+  const int engineCount = cat::memxor_engines(&engines);
+  const Operation operations[] = {Operation::Xor, Operation::XorSet,
+                                  Operation::XorAdd};
+  const int misalignments[] = {0, 5};
+
+  printf("%-8s %-11s %8s %7s %12s %8s\n", "engine", "operation", "bytes",
+         "offset", "bytes/cycle", "GB/s");
+
+  for (int bytes : sizes) {
+    if (bytes <= 0) {
+      continue;
+    }
+
+    AlignedByteVector out(bytes + CHUNK_BUFFER_ALIGNMENT);
+    AlignedByteVector a(bytes + CHUNK_BUFFER_ALIGNMENT);
+    AlignedByteVector b(bytes + CHUNK_BUFFER_ALIGNMENT);
+
+    for (size_t i = 0; i < a.size(); i++) {
+      a[i] = static_cast<unsigned char>(i * 7);
+      b[i] = static_cast<unsigned char>(i * 13);
+    }
+
+    // About 256 MB of input per measurement
+    const int iterations = std::max(1, (256 << 20) / bytes);
+
+    for (int e = 0; e < engineCount; e++) {
+      for (Operation op : operations) {
+        for (int offset : misalignments) {
+          unsigned char *pOut = out.data() + offset;
+          const unsigned char *pA = a.data() + offset;
+          const unsigned char *pB = b.data() + offset;
+
+          // Warm up caches and clocks
+          for (int i = 0; i < 1000; i++) {
+            run(engines[e], op, pOut, pA, pB, bytes);
+          }
+
+          const double startTime = nowSeconds();
+          const uint64_t startCycles = readCycles();
+
+          for (int i = 0; i < iterations; i++) {
+            run(engines[e], op, pOut, pA, pB, bytes);
+            clobber(pOut);
+          }
+
+          const uint64_t cycles = readCycles() - startCycles;
+          const double seconds = nowSeconds() - startTime;
+          const double total = static_cast<double>(bytes) * iterations;
+
+          printf("%-8s %-11s %8d %7d %12.2f %8.2f\n", engines[e].name,
+                 operationName(op), bytes, offset,
+                 total / static_cast<double>(cycles), total / seconds / 1e9);
+        }
+      }
+    }
+
+    // memswap has a single implementation, used for pivoting in the decoder
+    for (int offset : misalignments) {
+      unsigned char *pOut = out.data() + offset;
+      unsigned char *pA = a.data() + offset;
+
+      for (int i = 0; i < 1000; i++) {
+        cat::memswap(pOut, pA, bytes);
+      }
+
+      const double startTime = nowSeconds();
+      const uint64_t startCycles = readCycles();
+
+      for (int i = 0; i < iterations; i++) {
+        cat::memswap(pOut, pA, bytes);
+        clobber(pOut);
+      }
+
+      const uint64_t cycles = readCycles() - startCycles;
+      const double seconds = nowSeconds() - startTime;
+      const double total = static_cast<double>(bytes) * iterations;
+
+      printf("%-8s %-11s %8d %7d %12.2f %8.2f\n", "-", "memswap", bytes,
+             offset, total / static_cast<double>(cycles),
+             total / seconds / 1e9);
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
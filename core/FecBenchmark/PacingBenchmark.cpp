@@ -0,0 +1,246 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+#include "PacketPacer.h"
+#include "SendScheduler.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Stream {
+  double bitrate;    // bits per second of the encoder
+  int frameRate;
+  int gop;           // a keyframe of KEYFRAME_FACTOR frames every gop frames
+  float eccRatio;
+  int frames;
+};
+
+struct Path {
+  double lineRate;     // bytes per second the sender's interface takes
+  double linkRate;     // bytes per second of the bottleneck
+  double bufferBytes;  // drop-tail queue in front of it
+};
+
+struct Result {
+  int droppedPackets = 0;
+  int lostFrames = 0;
+  double meanLatency = 0;  // seconds from encoding until a frame is in
+  double maxLatency = 0;
+};
+
+const int KEYFRAME_FACTOR = 8;
+
+int frameBytes(const Stream &stream, int frame) {
+  const int bytes = static_cast<int>(stream.bitrate / 8 / stream.frameRate);
+  return (frame % stream.gop == 0) ? KEYFRAME_FACTOR * bytes : bytes;
+}
+
+// Frames through a bottleneck with a shallow queue, sent at line rate as
+// UdpProtocol did, or paced by a TokenBucket at "rate" times the bitrate.
+// Simulated time, so runs are repeatable.
+Result simulate(const Stream &stream, const Path &path, double rate,
+                double burstBytes) {
+  const int chunkSize = MAX_UDP_CHUNK_SIZE;
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  SendScheduler scheduler;
+  TokenBucket bucket(rate * stream.bitrate / 8, burstBytes);
+  std::vector<unsigned char> frame;
+  std::mt19937 random(1234);
+  double departure = 0;  // of the last packet from the sender
+  double queueBytes = 0, queueTime = 0;
+  int deliveredFrames = 0;
+  Result result;
+
+  packetAssembly.setChunkSize(chunkSize);
+  frameAssembly.setChunkSize(chunkSize);
+
+  for (int i = 0; i < stream.frames; i++) {
+    const double frameTime = static_cast<double>(i) / stream.frameRate;
+
+    frame.resize(frameBytes(stream, i));
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                                stream.eccRatio);
+
+    for (auto *chunk : scheduler.schedule(packetAssembly.data.span(),
+                                          packetAssembly.ecc.span(), i)) {
+      const size_t size = chunkSize;
+
+      departure = std::max(departure, frameTime);
+      if (rate > 0) {
+        while (!bucket.take(size, departure)) {
+          departure = bucket.availableAt(size, departure);
+        }
+      } else {
+        departure += size / path.lineRate;
+      }
+
+      // What the bottleneck sent since the last packet came in
+      queueBytes = std::max(
+          0.0, queueBytes - (departure - queueTime) * path.linkRate);
+      queueTime = departure;
+
+      if (queueBytes + size > path.bufferBytes) {
+        result.droppedPackets++;
+        continue;
+      }
+
+      queueBytes += size;
+      const double arrival = departure + queueBytes / path.linkRate;
+
+      for (auto entry = frameAssembly.process(*chunk, metrics); entry;
+           entry = frameAssembly.nextReadyFrame()) {
+        const double latency =
+            arrival - static_cast<double>(entry->trackingId) / stream.frameRate;
+
+        result.meanLatency += latency;
+        result.maxLatency = std::max(result.maxLatency, latency);
+        deliveredFrames++;
+      }
+    }
+  }
+
+  result.lostFrames = stream.frames - deliveredFrames;
+  result.meanLatency /= std::max(1, deliveredFrames);
+  return result;
+}
+
+// The same frames through a PacketPacer in real time, which sends to
+// nowhere, for how closely its thread keeps to the pace
+PacingMetrics measure(const Stream &stream, double rate, double burstBytes,
+                      double seconds) {
+  typedef std::chrono::steady_clock Clock;
+  const size_t HEADER_SIZE = CHUNK_ECC_OFFSET;
+  const size_t BODY_SIZE = MAX_UDP_CHUNK_SIZE - CHUNK_ECC_OFFSET;
+  std::vector<unsigned char> header(HEADER_SIZE), body(BODY_SIZE);
+  std::vector<const void *> headers, bodies;
+  std::vector<size_t> headerSizes, bodySizes;
+
+  PacketPacer pacer(
+      [](const void *const *datagrams, const size_t *, size_t count) {
+        clobber(datagrams);
+        return count;
+      },
+      rate * stream.bitrate / 8, burstBytes);
+
+  const auto start = Clock::now();
+  const int frames = static_cast<int>(seconds * stream.frameRate);
+
+  for (int i = 0; i < frames; i++) {
+    std::this_thread::sleep_until(
+        start + std::chrono::microseconds(1000000LL * i / stream.frameRate));
+
+    const size_t dataChunks = PacketAssembly::dataChunkCount(
+        frameBytes(stream, i), MAX_UDP_CHUNK_SIZE);
+    const size_t count =
+        dataChunks + static_cast<size_t>(dataChunks * stream.eccRatio);
+
+    headers.assign(count, header.data());
+    bodies.assign(count, body.data());
+    headerSizes.assign(count, HEADER_SIZE);
+    bodySizes.assign(count, BODY_SIZE);
+
+    pacer.queue(headers.data(), headerSizes.data(), bodies.data(),
+                bodySizes.data(), count);
+  }
+
+  pacer.flush();
+  return pacer.takeMetrics();
+}
+}  // namespace
+
+// Usage: pacing [--bitrate=20000000] [--fps=60] [--gop=60] [--ecc=0.1]
+//               [--frames=3000] [--link=40000000] [--buffer=64000]
+//               [--line-rate=1000000000] [--burst=11776] [--seconds=2]
+//
+// Frames of a --bitrate stream with a keyframe every --gop frames, sent at
+// line rate or paced at a multiple of the bitrate, through a bottleneck of
+// --link bits per second behind a drop-tail queue of --buffer bytes. Lost
+// frames are those ECC could not repair, latency runs from encoding until
+// a frame is complete. The last columns are what PacketPacer measures of
+// itself in --seconds of real time: queue delay, how late its thread woke
+// up, and the rate it kept while packets were waiting, against the set one.
+int runPacing(int argc, char **argv) {
+  Stream stream;
+  stream.bitrate = option(argc, argv, "bitrate", 20000000);
+  stream.frameRate =
+      std::max(1, static_cast<int>(option(argc, argv, "fps", 60)));
+  stream.gop = std::max(1, static_cast<int>(option(argc, argv, "gop", 60)));
+  stream.eccRatio = static_cast<float>(option(argc, argv, "ecc", 0.1));
+  stream.frames = static_cast<int>(option(argc, argv, "frames", 3000));
+
+  Path path;
+  path.linkRate = option(argc, argv, "link", 40000000) / 8;
+  path.bufferBytes = option(argc, argv, "buffer", 64000);
+  path.lineRate = option(argc, argv, "line-rate", 1000000000) / 8;
+
+  const double burstBytes =
+      option(argc, argv, "burst", 8 * MAX_UDP_CHUNK_SIZE);
+  const double seconds = option(argc, argv, "seconds", 2);
+
+  PacketAssembly::warmUp(stream.eccRatio);
+
+  printf("%6s %8s %7s %9s %9s %10s %10s %9s %8s\n", "pace", "dropped",
+         "lost", "mean ms", "max ms", "queue ms", "max q ms", "late ms",
+         "rate");
+
+  const double rates[] = {0, 1.25, 1.5, 2, 4};
+
+  for (double rate : rates) {
+    const Result result = simulate(stream, path, rate, burstBytes);
+
+    printf("%6.2f %8d %7d %9.1f %9.1f", rate, result.droppedPackets,
+           result.lostFrames, result.meanLatency * 1000,
+           result.maxLatency * 1000);
+
+    if (rate > 0) {
+      const PacingMetrics pacing = measure(stream, rate, burstBytes, seconds);
+
+      printf(" %10.2f %10.2f %9.3f %8.3f\n", pacing.meanQueueDelay * 1000,
+             pacing.maxQueueDelay * 1000, pacing.meanLateness * 1000,
+             pacing.rateAccuracy);
+    } else {
+      printf(" %10s %10s %9s %8s\n", "-", "-", "-", "-");
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
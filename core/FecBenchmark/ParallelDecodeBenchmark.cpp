@@ -0,0 +1,137 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int frames = 0;
+  int failures = 0;
+  double receiveUs = 0;  // per frame
+  double maxCallUs = 0;  // longest process() call
+};
+
+// Every message loses every period-th data chunk, a bit more than half of
+// what its ECC chunks repair, so each one needs the decoder
+Result measure(int frameBytes, float ratio, int frames, int threads) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::vector<unsigned char> frame(frameBytes);
+  std::mt19937 random(42);
+  Result result;
+  double seconds = 0;
+
+  frameAssembly.setDecodeThreads(threads);
+
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+  packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+
+  const int period = std::max(2, static_cast<int>(1 / (ratio * 0.6)));
+
+  for (int i = 0; i <= frames; i++) {
+    double frameSeconds = 0, maxCall = 0;
+    std::shared_ptr<FrameAssembly::ReassemblyEntry> entry;
+
+    for (auto *chunks : {&packetAssembly.data, &packetAssembly.ecc}) {
+      for (auto chunk : *chunks) {
+        if (entry || (!chunk.isEccChunk &&
+                      ((chunk.chunkIndex + i) % period == 0))) {
+          continue;
+        }
+
+        chunk.trackingId = i;
+
+        const double start = nowSeconds();
+        entry = frameAssembly.process(chunk, metrics);
+        const double call = nowSeconds() - start;
+
+        frameSeconds += call;
+        maxCall = std::max(maxCall, call);
+      }
+    }
+
+    // The first frame warms up caches and clocks
+    if (i == 0) {
+      continue;
+    }
+
+    seconds += frameSeconds;
+    result.maxCallUs = std::max(result.maxCallUs, maxCall * 1e6);
+
+    if (entry) {
+      result.frames++;
+      result.failures += (entry->data != frame) ? 1 : 0;
+    }
+  }
+
+  result.receiveUs = seconds * 1e6 / frames;
+
+  return result;
+}
+}  // namespace
+
+// Usage: parallel-decode [--frame-bytes=1003808] [--ratio=0.1]
+//                        [--frames=200] [--max-threads=8]
+//
+// Time FrameAssembly::process() spends on a frame whose messages all need
+// the decoder, with decoding on 0 to --max-threads worker threads. "max
+// call" is the longest single process() call, during which the socket is
+// not drained.
+int runParallelDecode(int argc, char **argv) {
+  const int frameBytes = static_cast<int>(
+      option(argc, argv, "frame-bytes", 16 * MAX_MESSAGE_SIZE));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 200));
+  const int maxThreads =
+      static_cast<int>(option(argc, argv, "max-threads", 8));
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("%d byte frames, ratio=%g\n", frameBytes, ratio);
+  printf("%8s %8s %8s %12s %12s\n", "threads", "frames", "failed",
+         "receive us", "max call us");
+
+  for (int threads = 0; threads <= maxThreads;
+       threads = threads ? threads * 2 : 1) {
+    Result r = measure(frameBytes, ratio, frames, threads);
+
+    printf("%8d %8d %8d %12.1f %12.1f\n", threads, r.frames, r.failures,
+           r.receiveUs, r.maxCallUs);
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,132 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+bool sameChunks(const UdpChunkVector &a, const UdpChunkVector &b) {
+  if ((a.size() != b.size()) || (a.chunkSize() != b.chunkSize())) {
+    return false;
+  }
+
+  for (size_t i = 0; i < a.size(); i++) {
+    if (memcmp(&a[i], &b[i], a.chunkSize()) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Mean and worst processFrame() time, and whether every frame came out
+// exactly as with the single threaded encoder
+void measure(int frameBytes, float ratio, int frames, int threads,
+             double &meanUs, double &maxUs, bool &isSame) {
+  PacketAssembly reference, packetAssembly;
+  std::vector<unsigned char> frame(frameBytes);
+  std::mt19937 random(42);
+  std::vector<double> latencies;
+
+  packetAssembly.setEncodeThreads(threads);
+  isSame = true;
+
+  for (int i = 0; i <= frames; i++) {
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    const double start = nowSeconds();
+    packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+    const double seconds = nowSeconds() - start;
+
+    // The first frame warms up caches and clocks
+    if (i > 0) {
+      latencies.push_back(seconds * 1e6);
+    }
+
+    reference.processFrame(frame.data(), frameBytes, ratio);
+    isSame = isSame && sameChunks(reference.data, packetAssembly.data) &&
+             sameChunks(reference.ecc, packetAssembly.ecc);
+  }
+
+  meanUs = maxUs = 0;
+  for (double us : latencies) {
+    meanUs += us / latencies.size();
+    maxUs = std::max(maxUs, us);
+  }
+}
+}  // namespace
+
+// Usage: parallel [--ratio=0.1] [--frames=200] [--max-threads=8]
+//
+// processFrame() time with messages encoded on 0 to --max-threads worker
+// threads besides the caller, for frames from one message up to large
+// keyframes. "same" tells whether the chunks match the single threaded
+// encoder byte for byte.
+int runParallelEncode(int argc, char **argv) {
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 200));
+  const int maxThreads =
+      static_cast<int>(option(argc, argv, "max-threads", 8));
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("%10s %9s %8s %10s %10s %8s %5s\n", "bytes", "messages", "threads",
+         "mean us", "max us", "speedup", "same");
+
+  const int frameSizes[] = {MAX_MESSAGE_SIZE, 4 * MAX_MESSAGE_SIZE,
+                            16 * MAX_MESSAGE_SIZE, 32 * MAX_MESSAGE_SIZE};
+
+  for (int frameBytes : frameSizes) {
+    double baseUs = 0;
+
+    for (int threads = 0; threads <= maxThreads;
+         threads = threads ? threads * 2 : 1) {
+      double meanUs, maxUs;
+      bool isSame;
+      measure(frameBytes, ratio, frames, threads, meanUs, maxUs, isSame);
+
+      if (threads == 0) {
+        baseUs = meanUs;
+      }
+
+      printf("%10d %9d %8d %10.1f %10.1f %7.2fx %5s\n", frameBytes,
+             (frameBytes + MAX_MESSAGE_SIZE - 1) / MAX_MESSAGE_SIZE, threads,
+             meanUs, maxUs, baseUs / std::max(meanUs, 1e-9),
+             isSame ? "yes" : "NO");
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,155 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int frames = 0;
+  int failures = 0;
+  double lastChunkP50Ns = 0, lastChunkP99Ns = 0, lastChunkMaxNs = 0;
+  double totalNsPerFrame = 0;
+};
+
+// Same send order as UdpProtocol::sendPackets()
+void sendOrder(const UdpChunkVector &data, const UdpChunkVector &ecc,
+               std::vector<const UdpChunk *> &order) {
+  order.clear();
+
+  const size_t step = std::max<size_t>(1, data.size() / std::max<size_t>(
+                                                            1, ecc.size()));
+  size_t j = 0;
+  for (size_t i = 0, x = 0; x < data.size(); i++) {
+    if ((i % step == 0) && (j < ecc.size())) {
+      order.push_back(&ecc[j++]);
+    } else {
+      order.push_back(&data[x++]);
+    }
+  }
+  for (; j < ecc.size(); j++) {
+    order.push_back(&ecc[j]);
+  }
+}
+
+Result simulate(bool progressive, int frameBytes, float ratio, double loss,
+                int frames) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::vector<const UdpChunk *> order;
+  std::vector<double> lastChunkNs;
+  std::vector<unsigned char> frame(frameBytes);
+  Result result;
+
+  frameAssembly.setProgressiveDecoding(progressive);
+
+  // Same frames and losses for both modes
+  std::mt19937 random(1234);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  double totalNs = 0;
+
+  for (int i = 0; i < frames; i++) {
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+    sendOrder(packetAssembly.data, packetAssembly.ecc, order);
+
+    for (auto *chunk : order) {
+      if (uniform(random) < loss) {
+        continue;
+      }
+
+      UdpChunk received = *chunk;
+      received.trackingId = i;
+
+      const double start = nowSeconds();
+      auto entry = frameAssembly.process(received, metrics);
+      const double ns = (nowSeconds() - start) * 1e9;
+      totalNs += ns;
+
+      if (entry) {
+        // Everything between this chunk arriving and the frame being ready
+        lastChunkNs.push_back(ns);
+        result.frames++;
+
+        if (entry->data != frame) {
+          result.failures++;
+        }
+        break;
+      }
+    }
+  }
+
+  std::sort(lastChunkNs.begin(), lastChunkNs.end());
+  result.lastChunkP50Ns = percentile(lastChunkNs, 0.5);
+  result.lastChunkP99Ns = percentile(lastChunkNs, 0.99);
+  result.lastChunkMaxNs = lastChunkNs.empty() ? 0 : lastChunkNs.back();
+  result.totalNsPerFrame = result.frames ? totalNs / result.frames : 0;
+
+  return result;
+}
+}  // namespace
+
+// Usage: progressive [--frame-bytes=120000] [--ratio=0.1] [--loss=0.03]
+//                    [--frames=2000]
+//
+// Time from the last needed chunk to a complete frame, with the whole decode
+// at the end versus progressive decoding.
+int runProgressive(int argc, char **argv) {
+  const int frameBytes =
+      static_cast<int>(option(argc, argv, "frame-bytes", 120000));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const double loss = option(argc, argv, "loss", 0.03);
+  const int frames = static_cast<int>(option(argc, argv, "frames", 2000));
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("%d byte frames, ratio=%g, loss=%g\n", frameBytes, ratio, loss);
+  printf("%12s %8s %8s %14s %14s %14s %14s\n", "mode", "frames", "failed",
+         "last p50 ns", "last p99 ns", "last max ns", "total ns/frame");
+
+  for (bool progressive : {false, true}) {
+    Result r = simulate(progressive, frameBytes, ratio, loss, frames);
+
+    printf("%12s %8d %8d %14.0f %14.0f %14.0f %14.0f\n",
+           progressive ? "progressive" : "at end", r.frames, r.failures,
+           r.lastChunkP50Ns, r.lastChunkP99Ns, r.lastChunkMaxNs,
+           r.totalNsPerFrame);
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,177 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Timeline {
+  double firstUs = 0;  // until the first chunk can be sent
+  double lastUs = 0;   // until the last one can
+};
+
+// Chunks of a streamed frame, without the message count that only the
+// last message carries
+bool sameChunks(const UdpChunkVector &streamed, const UdpChunkVector &whole) {
+  if ((streamed.size() != whole.size()) ||
+      (streamed.chunkSize() != whole.chunkSize())) {
+    return false;
+  }
+
+  for (size_t i = 0; i < streamed.size(); i++) {
+    UdpChunk chunk = streamed[i];
+
+    if (chunk.msgCount == 0) {
+      chunk.msgCount = whole[i].msgCount;
+    }
+    if (memcmp(&chunk, &whole[i], whole.chunkSize()) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// The encoder hands out "slices" equal slices over encodeUs, the last one
+// at encodeUs. Whole frames are packetized after that, streamed ones slice
+// by slice as they come, with the measured time of every call.
+void measure(int frameBytes, int slices, double encodeUs, float ratio,
+             int frames, Timeline &whole, Timeline &streamed, bool &isSame) {
+  PacketAssembly wholeAssembly, streamAssembly;
+  std::vector<unsigned char> frame(frameBytes);
+  std::mt19937 random(42);
+  UdpChunkVector data, ecc;
+
+  whole = streamed = Timeline();
+  isSame = true;
+
+  for (int i = 0; i <= frames; i++) {
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    double start = nowSeconds();
+    wholeAssembly.processFrame(frame.data(), frameBytes, ratio);
+    const double wholeUs = encodeUs + (nowSeconds() - start) * 1e6;
+
+    data.setChunkSize(streamAssembly.data.chunkSize());
+    ecc.setChunkSize(streamAssembly.ecc.chunkSize());
+    data.clear();
+    ecc.clear();
+    streamAssembly.beginFrame(ratio);
+
+    double readyUs = 0, firstUs = -1;
+    for (int slice = 0; slice <= slices; slice++) {
+      // The last call is endFrame(), right after the last slice came in
+      start = nowSeconds();
+      if (slice < slices) {
+        const int64_t begin = static_cast<int64_t>(frameBytes) * slice / slices;
+        const int64_t end =
+            static_cast<int64_t>(frameBytes) * (slice + 1) / slices;
+
+        streamAssembly.appendBytes(frame.data() + begin,
+                                   static_cast<int>(end - begin));
+      } else {
+        streamAssembly.endFrame();
+      }
+      const double callUs = (nowSeconds() - start) * 1e6;
+
+      const double arrivalUs =
+          encodeUs * (std::min(slice, slices - 1) + 1) / slices;
+      readyUs = std::max(readyUs, arrivalUs) + callUs;
+
+      if ((firstUs < 0) &&
+          (streamAssembly.data.size() > streamAssembly.firstNewDataChunk())) {
+        firstUs = readyUs;
+      }
+
+      for (size_t j = streamAssembly.firstNewDataChunk();
+           j < streamAssembly.data.size(); j++) {
+        data.push_back(streamAssembly.data[j]);
+      }
+      for (size_t j = streamAssembly.firstNewEccChunk();
+           j < streamAssembly.ecc.size(); j++) {
+        ecc.push_back(streamAssembly.ecc[j]);
+      }
+    }
+
+    isSame = isSame && sameChunks(data, wholeAssembly.data) &&
+             sameChunks(ecc, wholeAssembly.ecc);
+
+    // The first frame warms up caches and clocks
+    if (i > 0) {
+      whole.firstUs += wholeUs / frames;
+      whole.lastUs += wholeUs / frames;
+      streamed.firstUs += firstUs / frames;
+      streamed.lastUs += readyUs / frames;
+    }
+  }
+}
+}  // namespace
+
+// Usage: streaming [--ratio=0.1] [--frames=100] [--slices=8]
+//                  [--encode-us=8000]
+//
+// When the chunks of a frame can go out with an encoder that takes
+// --encode-us per frame and hands it out in --slices slices: all at once
+// with processFrame() after the last slice, or streamed with
+// beginFrame()/appendBytes()/endFrame(). "same" tells whether the streamed
+// chunks match processFrame() byte for byte, but for the message count.
+int runStreaming(int argc, char **argv) {
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 100));
+  const int slices = static_cast<int>(option(argc, argv, "slices", 8));
+  const double encodeUs = option(argc, argv, "encode-us", 8000);
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("%10s %9s %12s %12s %12s %12s %5s\n", "bytes", "messages",
+         "whole first", "whole last", "stream first", "stream last", "same");
+
+  const int frameSizes[] = {MAX_MESSAGE_SIZE / 2, 4 * MAX_MESSAGE_SIZE,
+                            16 * MAX_MESSAGE_SIZE, 32 * MAX_MESSAGE_SIZE};
+
+  for (int frameBytes : frameSizes) {
+    Timeline whole, streamed;
+    bool isSame;
+    measure(frameBytes, slices, encodeUs, ratio, frames, whole, streamed,
+            isSame);
+
+    printf("%10d %9d %12.1f %12.1f %12.1f %12.1f %5s\n", frameBytes,
+           (frameBytes + MAX_MESSAGE_SIZE - 1) / MAX_MESSAGE_SIZE,
+           whole.firstUs, whole.lastUs, streamed.firstUs, streamed.lastUs,
+           isSame ? "yes" : "NO");
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
@@ -0,0 +1,192 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  size_t messages = 0;     // per frame
+  size_t headerBytes = 0;  // per frame, data and ECC chunks
+  size_t wireBytes = 0;    // per frame, headers included
+  double encodeUs = 0;     // per frame, processFrame()
+  double decodeUs = 0;     // per frame, decodeChunk() and process()
+  int lostFrames = 0;
+  int badChunks = 0;  // did not come out of decodeChunk() as they went in
+};
+
+// Frames of frameBytes bytes through PacketAssembly, the wire format with
+// its message size, a channel that drops "loss" of the chunks, and
+// FrameAssembly, the way UdpProtocol sends and receives them
+Result measure(int wireFormat, int frameBytes, int chunkSize, float ratio,
+               double loss, int frames) {
+  const int messageChunks = (wireFormat == EWireFormat::V2)
+                                ? MAX_WIDE_MESSAGE_CHUNKS
+                                : MAX_MESSAGE_CHUNKS;
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::vector<unsigned char> frame(frameBytes);
+  std::mt19937 random(42);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::vector<const UdpChunk *> chunks;
+  UdpChunk datagram;
+  unsigned char header[MAX_CHUNK_HEADER_SIZE];
+  Result result;
+
+  packetAssembly.setChunkSize(chunkSize);
+  packetAssembly.setMessageChunks(messageChunks);
+  frameAssembly.setChunkSize(chunkSize);
+  frameAssembly.setMessageChunks(messageChunks);
+
+  for (int i = 0; i <= frames; i++) {
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    double start = nowSeconds();
+    packetAssembly.processFrame(frame.data(), frameBytes, ratio);
+    const double encodeUs = (nowSeconds() - start) * 1e6;
+
+    chunks.clear();
+    for (auto &chunk : packetAssembly.data) {
+      chunk.trackingId = i;
+      chunks.push_back(&chunk);
+    }
+    for (auto &chunk : packetAssembly.ecc) {
+      chunk.trackingId = i;
+      chunks.push_back(&chunk);
+    }
+
+    bool isDelivered = false;
+    double decodeUs = 0;
+
+    for (const UdpChunk *chunk : chunks) {
+      const int size = wireChunkSize(*chunk, chunkSize) - CHUNK_ECC_OFFSET;
+      const int headerSize = encodeChunkHeader(*chunk, wireFormat, header);
+
+      result.headerBytes += headerSize;
+      result.wireBytes += headerSize + size;
+
+      if (uniform(random) < loss) {
+        continue;
+      }
+
+      // What recvfrom() would put into the buffer
+      memcpy(&datagram, header, headerSize);
+      memcpy(reinterpret_cast<unsigned char *>(&datagram) + headerSize,
+             reinterpret_cast<const unsigned char *>(chunk) +
+                 CHUNK_ECC_OFFSET,
+             size);
+
+      start = nowSeconds();
+      const int length =
+          decodeChunk(datagram, headerSize + size, wireFormat);
+
+      if ((length < 0) || !restoreChunk(datagram, length, chunkSize) ||
+          (memcmp(&datagram, chunk, chunkSize) != 0)) {
+        result.badChunks++;
+        continue;
+      }
+
+      for (auto entry = frameAssembly.process(datagram, metrics); entry;
+           entry = frameAssembly.nextReadyFrame()) {
+        isDelivered = isDelivered ||
+                      ((entry->trackingId == i) && (entry->data == frame));
+      }
+      decodeUs += (nowSeconds() - start) * 1e6;
+    }
+
+    // The first frame warms up caches and clocks
+    if (i == 0) {
+      result = Result();
+      continue;
+    }
+
+    result.messages = packetAssembly.data.back().msgCount;
+    result.encodeUs += encodeUs / frames;
+    result.decodeUs += decodeUs / frames;
+    result.lostFrames += isDelivered ? 0 : 1;
+  }
+
+  result.headerBytes /= frames;
+  result.wireBytes /= frames;
+  return result;
+}
+}  // namespace
+
+// Usage: wire [--chunk-size=1472] [--ratio=0.1] [--loss=0.02]
+//             [--frames=200]
+//
+// Frames sent with wire format V1, whose messages have at most
+// MAX_MESSAGE_CHUNKS data chunks, and with V2, whose byte sized indices
+// take MAX_WIDE_MESSAGE_CHUNKS. Header bytes are those of all data and ECC
+// chunks of a frame, the times include encoding and decoding the headers.
+// "bad" counts chunks that did not survive the trip through the wire format.
+int runWireFormat(int argc, char **argv) {
+  const int chunkSize = static_cast<int>(
+      option(argc, argv, "chunk-size", MAX_UDP_CHUNK_SIZE));
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.1));
+  const double loss = option(argc, argv, "loss", 0.02);
+  const int frames = static_cast<int>(option(argc, argv, "frames", 200));
+
+  if (!isValidChunkSize(chunkSize)) {
+    fprintf(stderr, "Invalid chunk size %d.\n", chunkSize);
+    return -1;
+  }
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("%6s %9s %9s %9s %10s %10s %10s %6s %5s\n", "format", "bytes",
+         "messages", "header", "wire", "encode us", "decode us", "lost",
+         "bad");
+
+  const int frameSizes[] = {30000, 400000, 2000000};
+
+  for (int frameBytes : frameSizes) {
+    for (int wireFormat : {EWireFormat::V1, EWireFormat::V2}) {
+      const Result result =
+          measure(wireFormat, frameBytes, chunkSize, ratio, loss, frames);
+
+      printf("%6s %9d %9zu %9zu %10zu %10.1f %10.1f %6d %5d\n",
+             (wireFormat == EWireFormat::V2) ? "v2" : "v1", frameBytes,
+             result.messages, result.headerBytes, result.wireBytes,
+             result.encodeUs, result.decodeUs, result.lostFrames,
+             result.badChunks);
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
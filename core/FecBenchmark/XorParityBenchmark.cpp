@@ -0,0 +1,149 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+namespace DirectRemote {
+namespace Benchmark {
+namespace {
+struct Result {
+  int frames = 0;
+  int failures = 0;
+  double eccPerFrame = 0;
+  double encodeNs = 0, receiveNs = 0;
+};
+
+const char *schemeName(EEccScheme scheme) {
+  switch (scheme) {
+    case EEccScheme::Cauchy:
+      return "cauchy";
+    case EEccScheme::Xor:
+      return "xor";
+    case EEccScheme::Xor2D:
+      return "xor 2d";
+  }
+  return "";
+}
+
+Result simulate(EEccScheme scheme, int chunks, float ratio, int frames,
+                double loss) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::vector<unsigned char> frame(chunks * CHUNK_PAYLOAD_SIZE);
+  Result result;
+
+  packetAssembly.setSmallMessageScheme(scheme, MAX_MESSAGE_CHUNKS);
+
+  // Same frames and losses for every scheme, as long as they send the same
+  // number of chunks
+  std::mt19937 random(1234);
+  std::mt19937_64 channel(42);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  double encodeSeconds = 0, receiveSeconds = 0;
+  size_t eccChunks = 0;
+
+  for (int i = 0; i < frames; i++) {
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+
+    double start = nowSeconds();
+    packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                                ratio);
+    encodeSeconds += nowSeconds() - start;
+    eccChunks += packetAssembly.ecc.size();
+
+    for (const auto *chunks : {&packetAssembly.data, &packetAssembly.ecc}) {
+      for (const auto &chunk : *chunks) {
+        if (uniform(channel) < loss) {
+          continue;
+        }
+
+        UdpChunk received = chunk;
+        received.trackingId = i;
+
+        start = nowSeconds();
+        auto entry = frameAssembly.process(received, metrics);
+        receiveSeconds += nowSeconds() - start;
+
+        if (entry) {
+          result.frames++;
+
+          if (entry->data != frame) {
+            result.failures++;
+          }
+        }
+      }
+    }
+  }
+
+  result.eccPerFrame = static_cast<double>(eccChunks) / frames;
+  result.encodeNs = encodeSeconds * 1e9 / frames;
+  result.receiveNs = receiveSeconds * 1e9 / frames;
+
+  return result;
+}
+}  // namespace
+
+// Usage: xor [--ratio=0.25] [--frames=20000] [--loss=0.03]
+//
+// Single message frames of a few chunks under random loss, with cauchy_256
+// ECC, interleaved XOR and 2D XOR parity. Data chunks go first, then ECC.
+int runXorParity(int argc, char **argv) {
+  const float ratio = static_cast<float>(option(argc, argv, "ratio", 0.25));
+  const int frames = static_cast<int>(option(argc, argv, "frames", 20000));
+  const double loss = option(argc, argv, "loss", 0.03);
+
+  PacketAssembly::warmUp(ratio);
+
+  printf("ratio=%g, random loss=%g\n", ratio, loss);
+  printf("%6s %8s %8s %8s %8s %12s %12s\n", "chunks", "scheme", "frames",
+         "failed", "ecc/frm", "encode ns", "receive ns");
+
+  const int chunkCounts[] = {1, 2, 4, 8, 12, 16};
+  const EEccScheme schemes[] = {EEccScheme::Cauchy, EEccScheme::Xor,
+                                EEccScheme::Xor2D};
+
+  for (int chunks : chunkCounts) {
+    for (EEccScheme scheme : schemes) {
+      Result r = simulate(scheme, chunks, ratio, frames, loss);
+
+      printf("%6d %8s %8d %8d %8.1f %12.0f %12.0f\n", chunks,
+             schemeName(scheme), r.frames, r.failures, r.eccPerFrame,
+             r.encodeNs, r.receiveNs);
+    }
+  }
+
+  return 0;
+}
+}  // namespace Benchmark
+}  // namespace DirectRemote
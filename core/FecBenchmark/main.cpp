@@ -0,0 +1,104 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Benchmark.h"
+#include "ErasureCode.h"
+
+using namespace DirectRemote;
+
+namespace {
+struct BenchmarkEntry {
+  const char *name;
+  const char *description;
+  int (*run)(int argc, char **argv);
+};
+
+const BenchmarkEntry benchmarks[] = {
+    {"memxor", "bytes/cycle of each memxor engine", Benchmark::runMemXor},
+    {"decode-cache", "decode matrix cache under Gilbert-Elliott loss",
+     Benchmark::runDecodeCache},
+    {"alloc", "heap allocations on the encode and decode paths",
+     Benchmark::runAllocations},
+    {"progressive", "last chunk to frame latency, progressive decoding",
+     Benchmark::runProgressive},
+    {"frame", "frame delivery with frame or cross-frame parity",
+     Benchmark::runFrameProtection},
+    {"fountain", "completion and overhead, fountain repair vs fixed ratio",
+     Benchmark::runFountain},
+    {"erasure", "cauchy_256 encode and decode over k, m and loss patterns",
+     Benchmark::runErasure},
+    {"xor", "small messages, XOR parity vs cauchy_256",
+     Benchmark::runXorParity},
+    {"batch", "decode of many messages one by one vs batched",
+     Benchmark::runBatchDecode},
+    {"parallel", "frame encode time on a worker pool",
+     Benchmark::runParallelEncode},
+    {"parallel-decode", "frame receive time with decoding on worker threads",
+     Benchmark::runParallelDecode},
+    {"streaming", "time to the first chunk, streamed frames vs whole ones",
+     Benchmark::runStreaming},
+    {"policy", "usable frames, ECC by frame class vs one ratio",
+     Benchmark::runEccPolicy},
+    {"adaptive", "lost frames and overhead, ECC ratio from viewer feedback",
+     Benchmark::runAdaptiveEcc},
+    {"interleave", "lost frames under burst loss by send order",
+     Benchmark::runInterleave},
+    {"wire", "header bytes and messages per frame, wire format v1 vs v2",
+     Benchmark::runWireFormat},
+    {"pacing", "drops and latency behind a shallow queue, paced vs bursts",
+     Benchmark::runPacing},
+};
+
+void printUsage(const char *exe) {
+  printf("Usage: %s <benchmark> [options]\n\nBenchmarks:\n", exe);
+
+  for (auto &entry : benchmarks) {
+    printf("  %-16s %s\n", entry.name, entry.description);
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (cauchy_256_init()) {
+    fprintf(stderr, "Erasure code library failed to initialize.\n");
+    return -1;
+  }
+
+  if (argc < 2) {
+    printUsage(argv[0]);
+    return -1;
+  }
+
+  for (auto &entry : benchmarks) {
+    if (strcmp(entry.name, argv[1]) == 0) {
+      return entry.run(argc - 2, argv + 2);
+    }
+  }
+
+  printUsage(argv[0]);
+  return -1;
+}
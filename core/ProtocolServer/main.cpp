@@ -45,6 +45,12 @@ struct IdMapping {
   bool isValid = false;
   SocketAddress sourceAddr = {};
   SocketAddress targetAddr = {};
+  // Chunk size each side offered in its pings, -1 until it pinged
+  int32_t sourceChunkSize = -1;
+  int32_t targetChunkSize = -1;
+  // EUdpFeature flags each side offered
+  uint32_t sourceFeatures = 0;
+  uint32_t targetFeatures = 0;
 };
 
 int main(int argc, char **argv) {
@@ -102,7 +108,9 @@ int main(int argc, char **argv) {
 
     int msgLen = sock.recvfrom(&chunk, sizeof(chunk), sourceAddr);
 
-    if (msgLen < 0) {
+    // Routing only looks at what every wire format starts with, the rest
+    // goes through untouched, see encodeChunkHeader()
+    if (msgLen < CHUNK_ROUTING_SIZE) {
       continue;
     }
 
@@ -120,18 +128,34 @@ int main(int argc, char **argv) {
       IdMapping m = {};
       m.sourceAddr = sourceAddr;
 
+      if (chunk.isControlPacket && (chunk.ctrl.command == EUdpCommand::Ping)) {
+        m.sourceChunkSize = chunk.ctrl.chunkSize;
+        m.sourceFeatures = chunk.ctrl.features;
+      }
+
       mappings[sessionId] = m;
     } else {
       IdMapping &m = it->second;
 
       if (chunk.isControlPacket) {
         switch (chunk.ctrl.command) {
-          case EUdpCommand::Ping:
+          case EUdpCommand::Ping: {
+            const int32_t chunkSize = chunk.ctrl.chunkSize;
+            const uint32_t features = chunk.ctrl.features;
+            const bool isSource =
+                memcmp(&m.sourceAddr, &sourceAddr, sizeof(sourceAddr)) == 0;
+
+            // Both sides have to know the other's chunk size before either
+            // may send, so they agree on the size of the session
+            const bool isLinkEstablished = m.isValid &&
+                                           (m.sourceChunkSize >= 0) &&
+                                           (m.targetChunkSize >= 0);
+
             memset(chunk.ecc.bytes, 0, sizeof(chunk.ecc.bytes));
 
             chunk.ctrl.command = EUdpCommand::Ping;
             chunk.isControlPacket = 1;
-            chunk.ctrl.isLinkEstablished = m.isValid;
+            chunk.ctrl.isLinkEstablished = isLinkEstablished;
             strncpy(chunk.ctrl.yourAddress, sourceAddr.ipAddress().c_str(),
                     sizeof(chunk.ctrl.yourAddress));
             chunk.ctrl.yourPort = sourceAddr.port();
@@ -143,13 +167,26 @@ int main(int argc, char **argv) {
               }
             }
 
+            if (isSource) {
+              m.sourceChunkSize = chunkSize;
+              m.sourceFeatures = features;
+            } else if (memcmp(&m.targetAddr, &sourceAddr, sizeof(sourceAddr)) ==
+                       0) {
+              m.targetChunkSize = chunkSize;
+              m.targetFeatures = features;
+            }
+
             if (m.isValid) {
-              if (memcmp(&m.sourceAddr, &sourceAddr, sizeof(sourceAddr)) == 0) {
+              if (isSource) {
+                chunk.ctrl.peerChunkSize = m.targetChunkSize;
+                chunk.ctrl.peerFeatures = m.targetFeatures;
                 strncpy(chunk.ctrl.peerAddress,
                         m.targetAddr.ipAddress().c_str(),
                         sizeof(chunk.ctrl.peerAddress));
                 chunk.ctrl.peerPort = m.targetAddr.port();
               } else {
+                chunk.ctrl.peerChunkSize = m.sourceChunkSize;
+                chunk.ctrl.peerFeatures = m.sourceFeatures;
                 strncpy(chunk.ctrl.peerAddress,
                         m.sourceAddr.ipAddress().c_str(),
                         sizeof(chunk.ctrl.peerAddress));
@@ -166,7 +203,14 @@ int main(int argc, char **argv) {
                            "'. Waiting for peer to connect...");
             }
 
-            sock.sendto(&chunk, sizeof(chunk), sourceAddr);
+            // Older clients only take pings of exactly this size
+            sock.sendto(&chunk, UDP_CHUNK_SIZE, sourceAddr);
+            break;
+          }
+
+          case EUdpCommand::Probe:
+            // Comes back only if the path takes datagrams of this size
+            sock.sendto(&chunk, msgLen, sourceAddr);
             break;
         }
       } else {
@@ -187,7 +231,7 @@ int main(int argc, char **argv) {
             }
           }
 
-          sock.sendto(&chunk, sizeof(chunk), targetAddr);
+          sock.sendto(&chunk, msgLen, targetAddr);
         }
       }
     }
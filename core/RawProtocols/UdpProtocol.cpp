@@ -24,9 +24,20 @@ SOFTWARE.
 
 #include "UdpProtocol.h"
 #include "ILogger.h"
+#include "ViewerResponseBuilder.h"
 
 namespace DirectRemote {
 
+// Seconds of frames the pace is measured over while the bitrate is not set
+static const double PACING_MEASURE_SECONDS = 1.0;
+
+// Times of SendScheduler
+static double steadySeconds() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 void UdpProtocol::dispose() { socket.close(); }
 
 bool UdpProtocol::connect(std::string address, int64_t sessionId) {
@@ -42,9 +53,18 @@ bool UdpProtocol::connect(std::string address, int64_t sessionId) {
   socket.create();
 
   this->sessionId = sessionId;
+  probedChunkSize = UDP_CHUNK_SIZE;
+  chunkSize = UDP_CHUNK_SIZE;
+  trimChunks = false;
+  streamFrames = false;
+  interleaveFrames = 1;
+  wireFormat = EWireFormat::V1;
   state = EProtocolState::WaitingForProxy;
   recvThread = std::thread([this]() { recvThreadImpl(); });
 
+  probeChunkSize();
+  localChunkSize = probedChunkSize;
+
   // try to establish a connection
   for (int i = 0;
        ((i < 10) || (state == EProtocolState::WaitingForPeer)) && (state != EProtocolState::Connected);
@@ -52,6 +72,12 @@ bool UdpProtocol::connect(std::string address, int64_t sessionId) {
     UdpChunk ping = {};
     ping.isControlPacket = 1;
     ping.ctrl.command = EUdpCommand::Ping;
+    ping.ctrl.chunkSize = localChunkSize;
+    ping.ctrl.features =
+        EUdpFeature::TrimmedChunks | EUdpFeature::StreamedFrames |
+        EUdpFeature::InterleavedFrames | EUdpFeature::WireFormatV2 |
+        EUdpFeature::ViewerMetrics |
+        (localInterleaveFrames() << EUdpFeature::InterleaveShift);
     sendPacket(ping, 0);
 
     std::this_thread::sleep_for(std::chrono::milliseconds(333));
@@ -67,41 +93,352 @@ bool UdpProtocol::connect(std::string address, int64_t sessionId) {
     connWatcherThread = std::thread([this]() { connWatcherThreadImpl(); });
   }
 
+  if (interleaveFrames > 1) {
+    sendScheduler.setHoldTime(options.interleaveLatencyMs / 1000.0);
+    interleaveThread = std::thread([this]() { interleaveThreadImpl(); });
+  }
+
   return true;
 }
 
 void UdpProtocol::sendTo(const unsigned char *bytes, int32_t byteCount,
                          int64_t trackingId) {
-  packetAssembly.processFrame(bytes, byteCount, options.eccRatio);
-  sendPackets(packetAssembly.data, packetAssembly.ecc, trackingId);
-}
+  if (trackingId != lastTrackingId + 1) {
+    packetAssembly.resetCrossFrames();
+  }
 
-void UdpProtocol::sendPackets(std::vector<UdpChunk> &data,
-                              std::vector<UdpChunk> &ecc, int64_t trackingId) {
-  int j = 0;
-  int step = std::max(1, static_cast<int>(data.size()) /
-                             std::max(1, static_cast<int>(ecc.size())));
+  // Viewer responses report the loss this end saw, see onViewerMetrics()
+  if (exchangeMetrics && (byteCount > 0)) {
+    std::lock_guard<std::mutex> lock(metricsMutex);
 
-  for (int i = 0, x = 0; x < data.size(); i++) {
-    if ((i % step == 0) && (j < ecc.size())) {
-      sendPacket(ecc[j++], trackingId);
-    } else {
-      sendPacket(data[x++], trackingId);
+    if (ViewerResponseEncoder::stampMetrics(bytes, byteCount, reportedMetrics,
+                                            responseBuffer)) {
+      bytes = reinterpret_cast<const unsigned char *>(&responseBuffer);
     }
   }
 
-  for (; j < ecc.size(); j++) {
-    sendPacket(ecc[j], trackingId);
+  measureBitrate(byteCount);
+  applyEccRatio();
+  packetAssembly.processFrame(bytes, byteCount, appliedEccRatio);
+  reportFrameSent();
+  sendPackets(packetAssembly.data.span(), packetAssembly.ecc.span(),
+              trackingId, interleaveFrames);
+  lastTrackingId = trackingId;
+}
+
+void UdpProtocol::beginFrame(int64_t trackingId) {
+  streamTrackingId = trackingId;
+  streamBuffer.clear();
+
+  if (!streamFrames) {
+    return;
   }
+
+  if (trackingId != lastTrackingId + 1) {
+    packetAssembly.resetCrossFrames();
+  }
+
+  applyEccRatio();
+  packetAssembly.beginFrame(appliedEccRatio);
 }
 
-void UdpProtocol::sendPacket(UdpChunk packet, int64_t trackingId) {
+void UdpProtocol::appendBytes(const unsigned char *bytes, int32_t byteCount) {
+  if (!streamFrames) {
+    streamBuffer.insert(streamBuffer.end(), bytes, bytes + byteCount);
+    return;
+  }
+
+  measureBitrate(byteCount);
+  if (!packetAssembly.appendBytes(bytes, byteCount)) {
+    DR_LOG_ERROR("Frame ", streamTrackingId, " is too large to be streamed.");
+    return;
+  }
+
+  sendNewPackets();
+}
+
+void UdpProtocol::endFrame() {
+  if (!streamFrames) {
+    sendTo(streamBuffer.data(), static_cast<int32_t>(streamBuffer.size()),
+           streamTrackingId);
+    return;
+  }
+
+  if (packetAssembly.endFrame()) {
+    sendNewPackets();
+    reportFrameSent();
+  }
+
+  lastTrackingId = streamTrackingId;
+}
+
+void UdpProtocol::sendNewPackets() {
+  const size_t firstData = packetAssembly.firstNewDataChunk();
+  const size_t firstEcc = packetAssembly.firstNewEccChunk();
+
+  sendPackets(packetAssembly.data.span(firstData),
+              packetAssembly.ecc.span(firstEcc), streamTrackingId);
+}
+
+bool UdpProtocol::sendRepair(float eccRatio) {
+  if (!isValidTrackingId(lastTrackingId) ||
+      !packetAssembly.processRepair(eccRatio)) {
+    return false;
+  }
+
+  if (options.adaptiveEcc) {
+    std::lock_guard<std::mutex> lock(eccMutex);
+    eccController.onRepairSent(packetAssembly.ecc.size());
+  }
+
+  std::lock_guard<std::mutex> lock(sendMutex);
+  for (auto &chunk : packetAssembly.ecc) {
+    queuePacket(chunk, lastTrackingId);
+  }
+  flushPackets();
+  return true;
+}
+
+void UdpProtocol::applyEccRatio() {
+  if (!options.adaptiveEcc || (options.eccRatio <= 0)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(eccMutex);
+  appliedEccRatio = std::min(1.0f, eccController.eccRatio());
+}
+
+void UdpProtocol::reportFrameSent() {
+  if (!options.adaptiveEcc || packetAssembly.data.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(eccMutex);
+  eccController.onFrameSent(packetAssembly.data.size(),
+                            packetAssembly.ecc.size(),
+                            packetAssembly.data.back().msgIndex + 1);
+}
+
+void UdpProtocol::onViewerMetrics(const ConnectionMetrics &viewerMetrics) {
+  if (!options.adaptiveEcc) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(eccMutex);
+  eccController.onViewerMetrics(viewerMetrics);
+}
+
+void UdpProtocol::setPacingBitrate(int64_t bitrate) {
+  std::lock_guard<std::mutex> lock(pacerMutex);
+  isBitrateSet = true;
+  applyPacingBitrate(bitrate);
+}
+
+void UdpProtocol::applyPacingBitrate(int64_t bitrate) {
+  const double rate = options.pacingRate * bitrate / 8;
+
+  // Without a rate, chunks keep going out right away
+  if (rate <= 0) {
+    return;
+  }
+
+  if (pacer) {
+    pacer->setRate(rate, options.pacingBurstBytes);
+    return;
+  }
+
+  pacer.reset(new PacketPacer(
+      [this](const void *const *datagrams, const size_t *sizes,
+             size_t count) {
+        return socket.sendtoMany(datagrams, sizes, count, sockAddress);
+      },
+      rate, options.pacingBurstBytes));
+}
+
+void UdpProtocol::measureBitrate(int32_t byteCount) {
+  if (options.pacingRate <= 0) {
+    return;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(pacerMutex);
+
+  if (isBitrateSet) {
+    return;
+  }
+
+  if (pacingSince == std::chrono::steady_clock::time_point()) {
+    pacingSince = now;
+  }
+  pacingBytes += std::max(0, byteCount);
+
+  const double seconds =
+      std::chrono::duration<double>(now - pacingSince).count();
+  if (seconds >= PACING_MEASURE_SECONDS) {
+    applyPacingBitrate(static_cast<int64_t>(8 * pacingBytes / seconds));
+    pacingBytes = 0;
+    pacingSince = now;
+  }
+}
+
+void UdpProtocol::recordPacingMetrics(PerformanceMonitor &perfMon) {
+  std::lock_guard<std::mutex> lock(pacerMutex);
+  if (pacer) {
+    pacer->recordMetrics(perfMon);
+  }
+}
+
+void UdpProtocol::sendPackets(ChunkSpan data, ChunkSpan ecc,
+                              int64_t trackingId, size_t shareCount) {
+  if (!isValidTrackingId(trackingId)) {
+    DR_LOG_ERROR("Frame ", trackingId,
+                 " has a tracking id chunk headers cannot carry.");
+    return;
+  }
+
+  // Parity goes last, so frames only get decoded when chunks were lost
+  std::lock_guard<std::mutex> lock(sendMutex);
+  queueScheduled(sendScheduler.schedule(data, ecc, trackingId, shareCount,
+                                        steadySeconds()));
+  flushPackets();
+
+  if (shareCount > 1) {
+    sendCondition.notify_one();
+  }
+}
+
+void UdpProtocol::queueScheduled(const std::vector<UdpChunk *> &chunks) {
+  for (auto *chunk : chunks) {
+    queuePacket(*chunk, static_cast<int64_t>(chunk->trackingId));
+  }
+}
+
+uint32_t UdpProtocol::localInterleaveFrames() const {
+  const int frames =
+      1 + options.interleaveLatencyMs * options.frameRate / 1000;
+  return static_cast<uint32_t>(
+      std::max(1, std::min(MAX_INTERLEAVE_FRAMES, frames)));
+}
+
+void UdpProtocol::flushFrames() {
+  std::lock_guard<std::mutex> lock(sendMutex);
+  if (sendScheduler.hasHeldChunks()) {
+    queueScheduled(sendScheduler.flush());
+    flushPackets();
+  }
+}
+
+void UdpProtocol::queuePacket(UdpChunk &packet, int64_t trackingId) {
   packet.sessionId = sessionId;
   packet.trackingId = trackingId;
-  socket.sendto(&packet, UDP_CHUNK_SIZE, sockAddress);
+
+  int size = chunkSize;
+
+  if (packet.isControlPacket) {
+    size = UDP_CHUNK_SIZE;
+  } else if (trimChunks) {
+    size = wireChunkSize(packet, chunkSize);
+  }
+
+  // Control packets keep the layout relays and older peers know
+  const int format = packet.isControlPacket ? EWireFormat::V1 : wireFormat;
+  const size_t slot = sendHeaders.size();
+  sendHeaders.resize(slot + MAX_CHUNK_HEADER_SIZE);
+
+  const int headerSize = encodeChunkHeader(packet, format, &sendHeaders[slot]);
+  if (headerSize < 0) {
+    DR_LOG_ERROR("Chunk ", static_cast<int>(packet.chunkIndex), " of ",
+                 static_cast<int>(packet.chunkCount),
+                 " does not fit wire format ", format, ", dropped.");
+    sendHeaders.resize(slot);
+    return;
+  }
+  headerSizes.push_back(static_cast<size_t>(headerSize));
+
+  sendQueue.push_back(reinterpret_cast<unsigned char *>(&packet) +
+                      CHUNK_ECC_OFFSET);
+  sendSizes.push_back(static_cast<size_t>(size - CHUNK_ECC_OFFSET));
+}
+
+void UdpProtocol::flushPackets() {
+  // The header slots do not move any more
+  headerQueue.resize(sendQueue.size());
+  for (size_t i = 0; i < sendQueue.size(); i++) {
+    headerQueue[i] = &sendHeaders[i * MAX_CHUNK_HEADER_SIZE];
+  }
+
+  // The handshake is not paced, it has to get through before a timeout
+  std::lock_guard<std::mutex> lock(pacerMutex);
+  if (pacer && (state == EProtocolState::Connected)) {
+    pacer->queue(headerQueue.data(), headerSizes.data(), sendQueue.data(),
+                 sendSizes.data(), sendQueue.size());
+  } else {
+    socket.sendtoMany(headerQueue.data(), headerSizes.data(),
+                      sendQueue.data(), sendSizes.data(), sendQueue.size(),
+                      sockAddress);
+  }
+  sendQueue.clear();
+  sendSizes.clear();
+  sendHeaders.clear();
+  headerSizes.clear();
+}
+
+void UdpProtocol::sendPacket(UdpChunk packet, int64_t trackingId) {
+  std::lock_guard<std::mutex> lock(sendMutex);
+  queuePacket(packet, trackingId);
+  flushPackets();
 }
 
-void UdpProtocol::handleControlPacket(UdpChunk chunk) {
+void UdpProtocol::probeChunkSize() {
+  // Ethernet, PPPoE or a VPN, and the IPv6 minimum MTU
+  static const int candidates[] = {MAX_UDP_CHUNK_SIZE, 1448, 1232};
+  const int maxChunkSize = std::min(options.maxChunkSize, MAX_UDP_CHUNK_SIZE);
+
+  if ((maxChunkSize < candidates[2]) || !socket.setDontFragment(true)) {
+    return;
+  }
+
+  UdpChunk probe = {};
+  probe.sessionId = sessionId;
+  probe.isControlPacket = 1;
+  probe.ctrl.command = EUdpCommand::Probe;
+  encodeControlPacket(probe);
+
+  // The relay does not answer the first packet of a session, and probes
+  // that are too large for the path never come back. Relays that do not
+  // know probes do not answer at all, which leaves UDP_CHUNK_SIZE.
+  socket.sendto(&probe, UDP_CHUNK_SIZE, sockAddress);
+
+  for (int i = 0; (i < 3) && (state != EProtocolState::Disconnected); i++) {
+    int largest = 0;
+
+    for (int size : candidates) {
+      if ((size <= maxChunkSize) && (size > probedChunkSize)) {
+        socket.sendto(&probe, size, sockAddress);
+        largest = std::max(largest, size);
+      }
+    }
+
+    if (!largest) {
+      break;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(333));
+  }
+
+  socket.setDontFragment(false);
+
+  DR_LOG_DEBUG("Path takes chunks of ", probedChunkSize.load(), " bytes.");
+}
+
+void UdpProtocol::handleControlPacket(UdpChunk chunk, int length) {
+  if (chunk.ctrl.command == EUdpCommand::Probe) {
+    if (isValidChunkSize(length) && (length > probedChunkSize)) {
+      probedChunkSize = length;
+    }
+    return;
+  }
+
   switch (state) {
     case EProtocolState::Connected:
       DR_LOG_WARNING(
@@ -110,8 +447,42 @@ void UdpProtocol::handleControlPacket(UdpChunk chunk) {
     case EProtocolState::WaitingForPeer:
       if (chunk.ctrl.command == EUdpCommand::Ping) {
         if (chunk.ctrl.isLinkEstablished) {
+          // The relay tells each side what the other offered, so both pick
+          // the same size. Older peers and relays send 0.
+          const int peerChunkSize = chunk.ctrl.peerChunkSize;
+          chunkSize = isValidChunkSize(peerChunkSize)
+                          ? std::min(localChunkSize, peerChunkSize)
+                          : UDP_CHUNK_SIZE;
+          trimChunks =
+              (chunk.ctrl.peerFeatures & EUdpFeature::TrimmedChunks) != 0;
+          streamFrames =
+              (chunk.ctrl.peerFeatures & EUdpFeature::StreamedFrames) != 0;
+
+          if (chunk.ctrl.peerFeatures & EUdpFeature::InterleavedFrames) {
+            interleaveFrames = localInterleaveFrames();
+            messageAssembly.setFrameInterleaving(
+                (chunk.ctrl.peerFeatures >> EUdpFeature::InterleaveShift) &
+                0xF);
+          }
+
+          // Wider indices make for fewer and larger messages per frame
+          if (chunk.ctrl.peerFeatures & EUdpFeature::WireFormatV2) {
+            wireFormat = EWireFormat::V2;
+          }
+          exchangeMetrics =
+              (chunk.ctrl.peerFeatures & EUdpFeature::ViewerMetrics) != 0;
+          const int messageChunks = (wireFormat == EWireFormat::V2)
+                                        ? MAX_WIDE_MESSAGE_CHUNKS
+                                        : MAX_MESSAGE_CHUNKS;
+
+          packetAssembly.setChunkSize(chunkSize);
+          packetAssembly.setMessageChunks(messageChunks);
+          messageAssembly.setChunkSize(chunkSize);
+          messageAssembly.setMessageChunks(messageChunks);
+
           DR_LOG_DEBUG("Connection to peer '", chunk.ctrl.peerAddress, ":",
-                       chunk.ctrl.peerPort, "' established.");
+                       chunk.ctrl.peerPort, "' established, using chunks of ",
+                       chunkSize, " bytes and wire format ", wireFormat, ".");
           state = EProtocolState::Connected;
         }
       } else {
@@ -146,21 +517,62 @@ void UdpProtocol::connWatcherThreadImpl() {
   }
 }
 
+void UdpProtocol::interleaveThreadImpl() {
+  std::unique_lock<std::mutex> lock(sendMutex);
+
+  while (state != EProtocolState::Disconnected) {
+    const double due = sendScheduler.nextDue();
+    const double now = steadySeconds();
+
+    if (due < 0) {
+      sendCondition.wait(lock);
+    } else if (due > now) {
+      sendCondition.wait_for(lock, std::chrono::duration<double>(due - now));
+    } else {
+      queueScheduled(sendScheduler.releaseDue(now));
+      flushPackets();
+    }
+  }
+}
+
 void UdpProtocol::recvThreadImpl() {
   UdpChunk chunk = {};
   SocketAddress senderAddr;
 
   while (state != EProtocolState::Disconnected) {
-    int res = -1;
+    const int length =
+        static_cast<int>(socket.recvfrom(&chunk, sizeof(chunk), senderAddr));
 
-    if (socket.recvfrom(&chunk, UDP_CHUNK_SIZE, senderAddr) == UDP_CHUNK_SIZE) {
+    // Control packets look the same in every wire format
+    if (length >= CHUNK_ROUTING_SIZE) {
       if (chunk.isControlPacket) {
-        handleControlPacket(chunk);
+        if ((length >= UDP_CHUNK_SIZE) &&
+            (decodeChunk(chunk, length, EWireFormat::V1) >= 0)) {
+          handleControlPacket(chunk, length);
+        }
       } else {
         if (state == EProtocolState::Connected) {
           metrics.incomingPackets++;
 
+          // Chunks of another size or format cannot be from this session
+          const int chunkLength = decodeChunk(chunk, length, wireFormat);
+
+          if ((chunkLength < 0) ||
+              !restoreChunk(chunk, chunkLength, chunkSize)) {
+            metrics.invalidPackets++;
+            continue;
+          }
+
           processPacket(messageAssembly.process(chunk, metrics));
+
+          while (auto entry = messageAssembly.nextReadyFrame()) {
+            processPacket(entry);
+          }
+
+          if (exchangeMetrics) {
+            std::lock_guard<std::mutex> lock(metricsMutex);
+            reportedMetrics = metrics;
+          }
         } else {
           DR_LOG_DEBUG("Ignoring packet, since not connected.");
         }
@@ -177,6 +589,14 @@ void UdpProtocol::recvThreadImpl() {
 
 void UdpProtocol::processPacket(
     std::shared_ptr<FrameAssembly::ReassemblyEntry> entry) {
+  ConnectionMetrics viewerMetrics;
+
+  if (options.adaptiveEcc && exchangeMetrics && entry &&
+      ViewerResponseDecoder::readMetrics(entry->data.data(),
+                                         entry->data.size(), viewerMetrics)) {
+    onViewerMetrics(viewerMetrics);
+  }
+
   if (onReceive && entry) {
     try {
       onReceive(entry->data);
@@ -189,14 +609,52 @@ void UdpProtocol::processPacket(
   }
 }
 
+static EccController::Options eccControllerOptions(
+    const UdpProtocol::Options &options) {
+  EccController::Options eccOptions;
+  eccOptions.targetFrameLoss = options.targetFrameLoss;
+  return eccOptions;
+}
+
 UdpProtocol::UdpProtocol(Options options)
-    : socket(ESocketProtocol::Udp), options(options) {}
+    : socket(ESocketProtocol::Udp),
+      options(options),
+      eccController(options.eccRatio, eccControllerOptions(options)),
+      appliedEccRatio(options.eccRatio) {
+  PacketAssembly::warmUp(options.eccRatio, options.fountainMode);
+  messageAssembly.setProgressiveDecoding(options.progressiveDecoding);
+  messageAssembly.setDecodeThreads(std::max(0, options.decodeThreads));
+  packetAssembly.setFrameProtection(options.frameProtection);
+  packetAssembly.setFountainMode(options.fountainMode);
+  packetAssembly.setCrossFrameProtection(options.crossFrameDepth,
+                                         options.crossFrameEccRatio);
+  packetAssembly.setSmallMessageScheme(options.smallMessageScheme,
+                                       options.smallMessageChunks);
+  packetAssembly.setEncodeThreads(std::max(0, options.encodeThreads));
+
+  // At UDP_CHUNK_SIZE, which takes the most chunks per frame
+  packetAssembly.reservePools(options.bitrate, options.frameRate,
+                              options.eccRatio);
+  messageAssembly.reservePools(options.bitrate, options.frameRate);
+
+  if (options.bitrate > 0) {
+    setPacingBitrate(options.bitrate);
+  }
+}
 
 UdpProtocol::~UdpProtocol() { disconnect(); }
 
 bool UdpProtocol::isConnected() { return state == EProtocolState::Connected; }
 
 void UdpProtocol::disconnect() {
+  // What is still paced belongs to this session
+  {
+    std::lock_guard<std::mutex> lock(pacerMutex);
+    if (pacer) {
+      pacer->clear();
+    }
+  }
+
   dispose();
 
   state = EProtocolState::Disconnected;
@@ -211,6 +669,20 @@ void UdpProtocol::disconnect() {
     DR_LOG_DEBUG("Waiting for receiving thread to terminate...");
     recvThread.join();
   }
+
+  {
+    std::lock_guard<std::mutex> lock(sendMutex);
+    sendCondition.notify_all();
+  }
+
+  if (interleaveThread.joinable()) {
+    DR_LOG_DEBUG("Waiting for interleaving thread to terminate...");
+    interleaveThread.join();
+  }
+
+  // What is still held back belongs to this session
+  std::lock_guard<std::mutex> lock(sendMutex);
+  sendScheduler.clear();
 }
 
 void UdpProtocol::setReceiveHandler(
@@ -26,6 +26,8 @@ SOFTWARE.
 #define UDPPROTOCOL_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <random>
@@ -34,11 +36,15 @@ SOFTWARE.
 #include <vector>
 #include <string>
 #include <functional>
+#include <memory>
 
 #include "Framework.h"
 
+#include "EccController.h"
 #include "FrameAssembly.h"
 #include "PacketAssembly.h"
+#include "PacketPacer.h"
+#include "SendScheduler.h"
 #include "Socket.h"
 
 namespace DirectRemote {
@@ -55,6 +61,49 @@ class UdpProtocol final {
   struct Options {
     bool disableReceiveTimeout = false;
     float eccRatio = 0.1f;
+    bool progressiveDecoding = false;
+    // See PacketAssembly::setFrameProtection(), receivers always understand
+    // frame parity
+    bool frameProtection = false;
+    // See PacketAssembly::setFountainMode(), repair only goes out when the
+    // caller asks with sendRepair()
+    bool fountainMode = false;
+    // See PacketAssembly::setCrossFrameProtection(), 1 turns it off
+    int crossFrameDepth = 1;
+    float crossFrameEccRatio = 0.1f;
+    // See PacketAssembly::setSmallMessageScheme(), receivers always understand
+    // XOR parity
+    EEccScheme smallMessageScheme = EEccScheme::Cauchy;
+    int smallMessageChunks = 0;
+    // See PacketAssembly::setEncodeThreads(), 0 encodes on the caller only
+    int encodeThreads = 0;
+    // See FrameAssembly::setDecodeThreads(), 0 decodes on the receive thread
+    int decodeThreads = 0;
+    // Largest chunk size connect() probes the path for, UDP_CHUNK_SIZE turns
+    // probing off. Both peers use the smaller of their probed sizes.
+    int maxChunkSize = MAX_UDP_CHUNK_SIZE;
+    // Expected stream, see FrameAssembly::reservePools(). 0 leaves the pools
+    // to grow with the first frames.
+    int64_t bitrate = 0;
+    int frameRate = 0;
+    // Lets an EccController pick the ECC ratio from the loss viewer
+    // responses report, starting at eccRatio. Only peers that offer
+    // EUdpFeature::ViewerMetrics report it, see onViewerMetrics().
+    bool adaptiveEcc = false;
+    float targetFrameLoss = 0.001f;
+    // How much later than sendTo() the end of a frame may go out. Frames
+    // are then spread over as many of the next ones as fit in at
+    // frameRate, see SendScheduler, with peers that take it. What no later
+    // frame takes along goes out on its own once the time is up. Messages
+    // are interleaved within their frame either way.
+    int interleaveLatencyMs = 0;
+    // Sends chunks from a thread of their own at pacingRate times bitrate,
+    // with up to pacingBurstBytes back to back, so frames do not leave as
+    // bursts at line rate, see PacketPacer. 0 sends them right away. The
+    // pacer starts once there is a bitrate, this one or setPacingBitrate()'s,
+    // or else what the frames of the last second took.
+    float pacingRate = 0.0f;
+    int pacingBurstBytes = 8 * MAX_UDP_CHUNK_SIZE;
   };
 
  protected:
@@ -71,21 +120,103 @@ class UdpProtocol final {
   std::condition_variable ctrlCondition;
   Options options;
   ConnectionMetrics metrics;
+  // What viewer responses sent from here report, with
+  // EUdpFeature::ViewerMetrics. A copy of metrics, since responses go out on
+  // other threads than chunks come in.
+  std::mutex metricsMutex;
+  ConnectionMetrics reportedMetrics;
+  // Where sendTo() puts a response to stamp it
+  UdpPayloadChunk responseBuffer;
+  int64_t lastTrackingId = 0;
+  // Largest probe the relay echoed, what the pings offer, and what both
+  // peers settled on
+  std::atomic<int> probedChunkSize{UDP_CHUNK_SIZE};
+  int localChunkSize = UDP_CHUNK_SIZE;
+  int chunkSize = UDP_CHUNK_SIZE;
+  // Whether the peer takes data chunks that end after their payload
+  bool trimChunks = false;
+  // Whether the peer takes messages of frames that are not complete yet,
+  // otherwise streamed frames are buffered and sent at endFrame()
+  bool streamFrames = false;
+  // EWireFormat of data chunks, V2 if the peer takes it
+  int wireFormat = EWireFormat::V1;
+  // Whether viewer responses of both ends carry their metrics
+  bool exchangeMetrics = false;
+  int64_t streamTrackingId = 0;
+  std::vector<unsigned char> streamBuffer;
+  // Queued chunks from CHUNK_ECC_OFFSET on, and their encoded headers in
+  // slots of MAX_CHUNK_HEADER_SIZE bytes
+  std::vector<const void *> sendQueue;
+  std::vector<size_t> sendSizes;
+  std::vector<unsigned char> sendHeaders;
+  std::vector<const void *> headerQueue;
+  std::vector<size_t> headerSizes;
+  // Declared after the socket it sends on, so it stops first. Created once
+  // the bitrate is known, which may be on another thread than chunks go out.
+  std::mutex pacerMutex;
+  std::unique_ptr<PacketPacer> pacer;
+  // Frames that went out since pacingSince, while nobody set the bitrate
+  bool isBitrateSet = false;
+  int64_t pacingBytes = 0;
+  std::chrono::steady_clock::time_point pacingSince;
+  // The send queue and sendScheduler, which interleaveThread sends the
+  // shares from that are due
+  std::mutex sendMutex;
+  std::condition_variable sendCondition;
+  std::thread interleaveThread;
+  SendScheduler sendScheduler;
+  // Shares frames are split into, 1 unless the peer takes interleaving
+  size_t interleaveFrames = 1;
+  // Reports come in on other threads than frames go out
+  std::mutex eccMutex;
+  EccController eccController;
+  float appliedEccRatio;
 
   void dispose();
 
-  void sendPackets(std::vector<UdpChunk> &data, std::vector<UdpChunk> &ecc,
-                   int64_t trackingId);
+  void sendPackets(ChunkSpan data, ChunkSpan ecc, int64_t trackingId,
+                   size_t shareCount = 1);
+  void queueScheduled(const std::vector<UdpChunk *> &chunks);
+
+  // Frames a frame is spread over, from Options::interleaveLatencyMs
+  uint32_t localInterleaveFrames() const;
+
+  // What the last streaming call of packetAssembly added
+  void sendNewPackets();
 
   void sendPacket(UdpChunk packet, int64_t trackingId);
 
+  // Starts the pacer, or changes its rate, if "bitrate" is one. Takes
+  // pacerMutex held.
+  void applyPacingBitrate(int64_t bitrate);
+  // Frames of "byteCount" bytes make for the bitrate until it is set
+  void measureBitrate(int32_t byteCount);
+
+  // Takes the ratio eccController picked for the next frame, and tells it
+  // about the frame packetAssembly holds
+  void applyEccRatio();
+  void reportFrameSent();
+  // Loss the viewer saw, from a response it sent with
+  // EUdpFeature::ViewerMetrics. Only used with Options::adaptiveEcc.
+  void onViewerMetrics(const ConnectionMetrics &viewerMetrics);
+
+  // Chunks are stamped and sent from where they are, without a copy, after
+  // a header in the wire format. They have to stay put until flushPackets().
+  // Both take sendMutex held.
+  void queuePacket(UdpChunk &packet, int64_t trackingId);
+  void flushPackets();
+
+  void probeChunkSize();
+
   void recvThreadImpl();
 
   void connWatcherThreadImpl();
 
+  void interleaveThreadImpl();
+
   void processPacket(std::shared_ptr<FrameAssembly::ReassemblyEntry> entry);
 
-  void handleControlPacket(UdpChunk chunk);
+  void handleControlPacket(UdpChunk chunk, int length);
 
  public:
   UdpProtocol(Options options = {});
@@ -101,6 +232,34 @@ class UdpProtocol final {
   void sendTo(const unsigned char *bytes, int32_t byteCount,
               int64_t trackingId);
 
+  // Sends a frame while it is still being encoded, see
+  // PacketAssembly::beginFrame(). Every message goes out as soon as the bytes
+  // after it are appended, the last one with endFrame(). Peers that do not
+  // support it get the whole frame at endFrame(), like from sendTo().
+  void beginFrame(int64_t trackingId);
+  void appendBytes(const unsigned char *bytes, int32_t byteCount);
+  void endFrame();
+
+  // Sends what frame interleaving still holds back, for when no frame
+  // follows soon. It goes out on its own after Options::interleaveLatencyMs.
+  void flushFrames();
+
+  // Sends fresh repair chunks for the last frame in fountain mode, eccRatio
+  // per data chunk. Nothing calls this on its own: the viewer does not
+  // report completed frames, so it is up to the caller when more redundancy
+  // is worth the bandwidth. Returns false once the rows of the frame are
+  // used up, see PacketAssembly::processRepair(), or if there is nothing
+  // left to send.
+  bool sendRepair(float eccRatio);
+
+  // Bitrate the pace follows from now on, like when the encoder's changes,
+  // see Options::pacingRate. Hosts call it wherever they set the encoder's,
+  // until then the pace follows what frames take.
+  void setPacingBitrate(int64_t bitrate);
+
+  // See PacketPacer::recordMetrics()
+  void recordPacingMetrics(PerformanceMonitor &perfMon);
+
   void setReceiveHandler(
       std::function<void(const std::vector<unsigned char> &packet)> onReceive);
 };
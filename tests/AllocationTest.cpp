@@ -0,0 +1,227 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <atomic>
+#include <new>
+#include <random>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ChunkBuffer.h"
+#include "ErasureCode.h"
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+#include "SlabPool.h"
+
+using namespace DirectRemote;
+
+// Every heap allocation of the test binary goes through here
+static std::atomic<uint64_t> allocationCount(0);
+
+void *operator new(size_t size) {
+  allocationCount++;
+
+  if (void *ptr = malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete[](void *ptr) noexcept { free(ptr); }
+
+TEST(AllocationTest, WorkspaceCodecDoesNotAllocate) {
+  const int k = 64, m = 16, blockBytes = CHUNK_ECC_SIZE;
+  Cauchy256Workspace *workspace = cauchy_256_workspace_create(blockBytes);
+  AlignedByteVector original(k * blockBytes), recovery(m * blockBytes);
+  AlignedByteVector received(k * blockBytes);
+  std::vector<const unsigned char *> dataPtrs(k);
+  std::vector<Block> blocks(k);
+  std::mt19937 random(1);
+  uint64_t allocations = 0;
+  int errors = 0;
+
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<unsigned char>(random());
+  }
+  for (int i = 0; i < k; i++) {
+    dataPtrs[i] = &original[i * blockBytes];
+  }
+
+  cauchy_256_cache_warm(k, m);
+
+  // The first round sizes the decode cache entries for this shape
+  for (int round = 0; round < 2; round++) {
+    for (int lost = 1; lost <= m; lost++) {
+      for (int i = 0; i < k; i++) {
+        blocks[i].data = &received[i * blockBytes];
+        blocks[i].row = static_cast<unsigned char>(i);
+        memcpy(blocks[i].data, dataPtrs[i], blockBytes);
+      }
+
+      const uint64_t before = allocationCount;
+      errors += cauchy_256_encode_ws(k, m, dataPtrs.data(), recovery.data(),
+                                     blockBytes, workspace) != 0;
+      for (int i = 0; i < lost; i++) {
+        blocks[i * 3].row = static_cast<unsigned char>(k + i);
+        memcpy(blocks[i * 3].data, &recovery[i * blockBytes], blockBytes);
+      }
+      errors += cauchy_256_decode_ws(k, m, blocks.data(), blockBytes,
+                                     workspace) != 0;
+      if (round > 0) {
+        allocations += allocationCount - before;
+      }
+    }
+  }
+
+  cauchy_256_workspace_free(workspace);
+
+  EXPECT_EQ(0, errors);
+  EXPECT_EQ(0u, allocations);
+}
+
+namespace {
+void measureFramePath(size_t decodeThreads) {
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  ConnectionMetrics metrics;
+  std::mt19937 random(7);
+  std::vector<unsigned char> frame(200000);
+  uint64_t sendAllocations = 0, receiveAllocations = 0;
+  int reconstructed = 0;
+
+  frameAssembly.setDecodeThreads(decodeThreads);
+
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+
+  const int frames = 200;
+  for (int i = 0; i < frames; i++) {
+    const bool measure = i >= frames / 2;
+
+    uint64_t before = allocationCount;
+    packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                                0.1f);
+    if (measure) {
+      sendAllocations += allocationCount - before;
+    }
+
+    // Every 50th chunk lost, which the ECC of each message covers
+    before = allocationCount;
+    int sent = 0;
+    for (auto *chunks : {&packetAssembly.data, &packetAssembly.ecc}) {
+      for (auto &chunk : *chunks) {
+        if (++sent % 50 == 0) {
+          continue;
+        }
+
+        chunk.trackingId = i;
+        if (frameAssembly.process(chunk, metrics)) {
+          reconstructed++;
+        }
+      }
+    }
+    if (measure) {
+      receiveAllocations += allocationCount - before;
+    }
+  }
+
+  EXPECT_EQ(frames, reconstructed);
+  EXPECT_EQ(0u, sendAllocations);
+  EXPECT_EQ(0u, receiveAllocations);
+}
+}  // namespace
+
+TEST(AllocationTest, WarmFramePathDoesNotAllocate) { measureFramePath(0); }
+
+TEST(AllocationTest, WarmFramePathWithDecodeThreadsDoesNotAllocate) {
+  measureFramePath(2);
+}
+
+namespace {
+struct Pooled {
+  std::vector<int> values;
+  int resets = 0;
+
+  void reset() {
+    values.clear();
+    resets++;
+  }
+};
+}  // namespace
+
+TEST(AllocationTest, ObjectsReleasedOnOtherThreadsAreReused) {
+  ObjectPool<Pooled> pool(4);
+  std::vector<std::shared_ptr<Pooled>> held;
+  uint64_t allocations = 0;
+
+  pool.reserve(4);
+
+  for (int round = 0; round < 100; round++) {
+    uint64_t before = allocationCount;
+    for (int i = 0; i < 4; i++) {
+      held.push_back(pool.acquire());
+      held.back()->values.push_back(round);
+    }
+    uint64_t acquired = allocationCount - before, released = 0;
+
+    // The last references go away on another thread
+    std::thread worker([&held, &released]() {
+      const uint64_t before = allocationCount;
+      held.clear();
+      released = allocationCount - before;
+    });
+    worker.join();
+
+    if (round > 0) {
+      allocations += acquired + released;
+    }
+  }
+
+  int resets = 0;
+  pool.forEach([&resets](Pooled &object) { resets += object.resets; });
+
+  EXPECT_EQ(400, resets);
+  EXPECT_EQ(0, pool.getMetrics().overflows);
+  EXPECT_EQ(4, pool.getMetrics().heapAllocations);
+  EXPECT_EQ(0u, allocations);
+}
+
+TEST(AllocationTest, ObjectsMayOutliveTheirPool) {
+  std::shared_ptr<Pooled> object;
+  {
+    ObjectPool<Pooled> pool(1);
+    object = pool.acquire();
+  }
+
+  object->values.push_back(1);
+  object.reset();
+}
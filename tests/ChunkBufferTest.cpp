@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "ChunkBuffer.h"
+
+using namespace DirectRemote;
+
+namespace {
+UdpChunk makeChunk(int chunkIndex, unsigned char fill) {
+  UdpChunk chunk;
+  memset(&chunk, fill, sizeof(chunk));
+
+  chunk.chunkIndex = static_cast<uint64_t>(chunkIndex);
+  return chunk;
+}
+
+const unsigned char *bytesOf(const UdpChunk &chunk) {
+  return reinterpret_cast<const unsigned char *>(&chunk);
+}
+}  // namespace
+
+TEST(ChunkBufferTest, ChunksAreAsFarApartAsTheirSize) {
+  for (int chunkSize : {UDP_CHUNK_SIZE, 1232, MAX_UDP_CHUNK_SIZE}) {
+    UdpChunkVector chunks(chunkSize);
+    chunks.resize(3);
+
+    const size_t stride = chunkStride(chunkSize);
+    EXPECT_GE(stride, static_cast<size_t>(chunkSize));
+    EXPECT_LT(stride, static_cast<size_t>(chunkSize + CHUNK_BUFFER_ALIGNMENT));
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+      EXPECT_EQ(i * stride, static_cast<size_t>(bytesOf(chunks[i]) -
+                                                bytesOf(chunks[0])));
+      EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(chunks[i].ecc.bytes) %
+                        CHUNK_BUFFER_ALIGNMENT);
+    }
+  }
+}
+
+TEST(ChunkBufferTest, PushBackKeepsNeighboursIntact) {
+  UdpChunkVector chunks(UDP_CHUNK_SIZE);
+
+  for (int i = 0; i < 100; i++) {
+    chunks.push_back(makeChunk(i, static_cast<unsigned char>(i)));
+  }
+  // From the vector itself, across the growth of its buffer
+  while (chunks.size() < chunks.capacity()) {
+    chunks.push_back(chunks[0]);
+  }
+  chunks.push_back(chunks[1]);
+
+  for (size_t i = 0; i < 100; i++) {
+    const UdpChunk expected = makeChunk(static_cast<int>(i),
+                                        static_cast<unsigned char>(i));
+    EXPECT_EQ(0, memcmp(&expected, &chunks[i], UDP_CHUNK_SIZE)) << i;
+  }
+  EXPECT_EQ(0, memcmp(&chunks[1], &chunks.back(), UDP_CHUNK_SIZE));
+}
+
+TEST(ChunkBufferTest, ResizeZeroesNewChunks) {
+  UdpChunkVector chunks(UDP_CHUNK_SIZE);
+  const UdpChunk zero = {};
+
+  chunks.push_back(makeChunk(1, 0xFF));
+  chunks.clear();
+  chunks.resize(2);
+
+  for (size_t i = 0; i < chunks.size(); i++) {
+    EXPECT_EQ(0, memcmp(&zero, &chunks[i], UDP_CHUNK_SIZE));
+  }
+}
+
+TEST(ChunkBufferTest, SpansSeeTheSameChunks) {
+  UdpChunkVector chunks(1232);
+
+  for (int i = 0; i < 10; i++) {
+    chunks.push_back(makeChunk(i, 0));
+  }
+
+  ChunkSpan span = chunks.span(4);
+  ConstChunkSpan constSpan = span;
+
+  ASSERT_EQ(6u, span.size());
+  EXPECT_EQ(1232, constSpan.chunkSize());
+  for (size_t i = 0; i < span.size(); i++) {
+    EXPECT_EQ(&chunks[i + 4], &span[i]);
+    EXPECT_EQ(&chunks[i + 4], &constSpan[i]);
+  }
+  EXPECT_EQ(10, chunks.end() - chunks.begin());
+}
@@ -0,0 +1,106 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <gtest/gtest.h>
+
+#include "EccController.h"
+#include "PacketAssembly.h"
+
+using namespace DirectRemote;
+
+namespace {
+// Frames of 4 messages of 100 data chunks at the controller's ratio, with
+// a report after each that received all but "lossRate" of them
+class Link {
+ public:
+  EccController controller;
+  ConnectionMetrics viewer;
+
+  Link() : controller(0.1f) { controller.onViewerMetrics(viewer); }
+
+  void send(int frames, double lossRate) {
+    for (int i = 0; i < frames; i++) {
+      const size_t ecc =
+          4 * PacketAssembly::eccChunkCount(100, controller.eccRatio());
+
+      controller.onFrameSent(400, ecc, 4);
+      viewer.incomingPackets +=
+          static_cast<int64_t>((400 + ecc) * (1 - lossRate) + 0.5);
+      controller.onViewerMetrics(viewer);
+    }
+  }
+};
+}  // namespace
+
+TEST(EccControllerTest, RatioFollowsLoss) {
+  Link link;
+  const EccController::Options options;
+
+  link.send(50, 0.1);
+  const float lossyRatio = link.controller.eccRatio();
+  EXPECT_GT(lossyRatio, 0.1f);
+  EXPECT_NEAR(0.1, link.controller.getLossRate(), 0.01);
+  EXPECT_TRUE((link.controller.getResidualFrameLoss() <=
+               options.targetFrameLoss) ||
+              (lossyRatio == options.maxRatio));
+
+  link.send(200, 0);
+  EXPECT_FLOAT_EQ(options.minRatio, link.controller.eccRatio());
+  EXPECT_LT(link.controller.getLossRate(), 0.001);
+}
+
+TEST(EccControllerTest, RatioStaysWithinBounds) {
+  Link link;
+  const EccController::Options options;
+
+  link.send(50, 0.6);
+  EXPECT_FLOAT_EQ(options.maxRatio, link.controller.eccRatio());
+}
+
+TEST(EccControllerTest, ViewerThatStartsOverIsANewBaseline) {
+  Link link;
+
+  link.send(10, 0);
+  const float ratio = link.controller.eccRatio();
+
+  // Counts going back are no loss, only what comes after them
+  link.viewer.incomingPackets = 0;
+  link.controller.onViewerMetrics(link.viewer);
+  EXPECT_EQ(ratio, link.controller.eccRatio());
+  EXPECT_EQ(0, link.controller.getLossRate());
+}
+
+TEST(EccControllerTest, FewPacketsMakeNoSample) {
+  EccController controller(0.1f);
+  ConnectionMetrics viewer;
+
+  controller.onViewerMetrics(viewer);
+  controller.onFrameSent(50, 5, 1);
+  controller.onViewerMetrics(viewer);
+
+  // Nothing arrived, but too little went out to tell
+  EXPECT_EQ(0, controller.getLossRate());
+  EXPECT_EQ(0.1f, controller.eccRatio());
+}
@@ -0,0 +1,129 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ChunkBuffer.h"
+#include "ErasureCode.h"
+#include "UdpChunk.h"
+
+using namespace DirectRemote;
+
+namespace {
+const int K = 40, M = 10, BLOCK_BYTES = CHUNK_ECC_SIZE;
+
+// A message of K data blocks and its recovery blocks
+struct Message {
+  AlignedByteVector original, recovery;
+
+  explicit Message(std::mt19937 &random)
+      : original(K * BLOCK_BYTES), recovery(M * BLOCK_BYTES) {
+    std::vector<const unsigned char *> dataPtrs(K);
+
+    for (auto &byte : original) {
+      byte = static_cast<unsigned char>(random());
+    }
+    for (int i = 0; i < K; i++) {
+      dataPtrs[i] = &original[i * BLOCK_BYTES];
+    }
+    EXPECT_EQ(0, cauchy_256_encode(K, M, dataPtrs.data(), recovery.data(),
+                                   BLOCK_BYTES));
+  }
+
+  // What a receiver has without the data blocks in "lost", with a recovery
+  // block in the place of each
+  void receive(const std::vector<int> &lost, AlignedByteVector &storage,
+               Block *blocks) const {
+    storage.resize(K * BLOCK_BYTES);
+    memcpy(storage.data(), original.data(), storage.size());
+
+    for (int i = 0; i < K; i++) {
+      blocks[i].data = &storage[i * BLOCK_BYTES];
+      blocks[i].row = static_cast<unsigned char>(i);
+    }
+    for (size_t i = 0; i < lost.size(); i++) {
+      Block &block = blocks[lost[i]];
+      memcpy(block.data, &recovery[i * BLOCK_BYTES], BLOCK_BYTES);
+      block.row = static_cast<unsigned char>(K + i);
+    }
+  }
+};
+}  // namespace
+
+TEST(ErasureCodeTest, BatchDecodeMatchesDecodeOfEachSet) {
+  std::mt19937 random(5);
+  Cauchy256Workspace *workspace = cauchy_256_workspace_create(BLOCK_BYTES);
+
+  // Runs of sets with the same losses, which share one inverse, and sets
+  // with losses of their own
+  std::vector<std::vector<int>> patterns;
+  for (int i = 0; i < 6; i++) {
+    patterns.push_back({0, 3, 7, 20});
+  }
+  for (int i = 0; i < 3; i++) {
+    patterns.push_back({1, 2, 3, 4, 5, 6, 7, 8, 9, 39});
+  }
+  patterns.push_back({10});
+  patterns.push_back({});
+  patterns.push_back({5, 6, 30});
+
+  const int count = static_cast<int>(patterns.size());
+  std::vector<Message> messages;
+  std::vector<AlignedByteVector> batchStorage(count), singleStorage(count);
+  std::vector<Block> batchBlocks(count * K), singleBlocks(count * K);
+  std::vector<Block *> sets(count);
+
+  for (int i = 0; i < count; i++) {
+    messages.emplace_back(random);
+    messages[i].receive(patterns[i], batchStorage[i], &batchBlocks[i * K]);
+    messages[i].receive(patterns[i], singleStorage[i], &singleBlocks[i * K]);
+    sets[i] = &batchBlocks[i * K];
+  }
+
+  ASSERT_EQ(0, cauchy_256_decode_batch_ws(K, M, sets.data(), count,
+                                          BLOCK_BYTES, workspace));
+  cauchy_256_workspace_free(workspace);
+
+  for (int i = 0; i < count; i++) {
+    ASSERT_EQ(0, cauchy_256_decode(K, M, &singleBlocks[i * K], BLOCK_BYTES));
+
+    for (int j = 0; j < K; j++) {
+      const Block &batch = batchBlocks[i * K + j];
+      const Block &single = singleBlocks[i * K + j];
+
+      ASSERT_EQ(single.row, batch.row) << "set " << i << ", block " << j;
+      ASSERT_LT(batch.row, K);
+      EXPECT_EQ(0, memcmp(single.data, batch.data, BLOCK_BYTES))
+          << "set " << i << ", block " << j;
+      EXPECT_EQ(0, memcmp(&messages[i].original[batch.row * BLOCK_BYTES],
+                          batch.data, BLOCK_BYTES))
+          << "set " << i << ", block " << j;
+    }
+  }
+}
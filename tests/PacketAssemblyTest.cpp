@@ -0,0 +1,153 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "PacketAssembly.h"
+
+using namespace DirectRemote;
+
+namespace {
+std::vector<unsigned char> makeFrame(size_t bytes, unsigned seed) {
+  std::mt19937 random(seed);
+  std::vector<unsigned char> frame(bytes);
+
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+  return frame;
+}
+
+void expectSameChunks(const UdpChunkVector &expected,
+                      const UdpChunkVector &actual, const char *name) {
+  ASSERT_EQ(expected.size(), actual.size()) << name;
+
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(0, memcmp(&expected[i], &actual[i], expected.chunkSize()))
+        << name << " chunk " << i;
+  }
+}
+
+// Frame sizes from a single chunk to many messages, with a last message
+// of every length
+const size_t FRAME_SIZES[] = {1, 1000, 60000, 150001, 400000};
+}  // namespace
+
+TEST(PacketAssemblyTest, EncodeThreadsProduceTheSameChunks) {
+  for (size_t threads : {1, 2, 5}) {
+    for (bool frameProtection : {false, true}) {
+      PacketAssembly single, parallel;
+
+      single.setFrameProtection(frameProtection);
+      parallel.setFrameProtection(frameProtection);
+      parallel.setEncodeThreads(threads);
+      single.setSmallMessageScheme(EEccScheme::Xor2D, 16);
+      parallel.setSmallMessageScheme(EEccScheme::Xor2D, 16);
+
+      unsigned seed = 0;
+      for (size_t bytes : FRAME_SIZES) {
+        const std::vector<unsigned char> frame = makeFrame(bytes, seed++);
+        SCOPED_TRACE(testing::Message() << threads << " threads, " << bytes
+                                        << " bytes, frame protection "
+                                        << frameProtection);
+
+        ASSERT_TRUE(single.processFrame(frame.data(),
+                                        static_cast<int>(frame.size()), 0.2f));
+        ASSERT_TRUE(parallel.processFrame(
+            frame.data(), static_cast<int>(frame.size()), 0.2f));
+
+        expectSameChunks(single.data, parallel.data, "data");
+        expectSameChunks(single.ecc, parallel.ecc, "ecc");
+      }
+    }
+  }
+}
+
+TEST(PacketAssemblyTest, StreamedFramesMatchWholeFrames) {
+  const size_t messageBytes = maxMessageSize(UDP_CHUNK_SIZE);
+
+  for (bool frameProtection : {false, true}) {
+    PacketAssembly whole, streamed;
+    whole.setFrameProtection(frameProtection);
+    streamed.setFrameProtection(frameProtection);
+
+    unsigned seed = 0;
+    for (size_t bytes : FRAME_SIZES) {
+      const std::vector<unsigned char> frame = makeFrame(bytes, seed++);
+
+      // Slices that end on message boundaries, slices that do not, and
+      // empty ones
+      const std::vector<size_t> slicings[] = {
+          {bytes},
+          {messageBytes, messageBytes, messageBytes},
+          {1, messageBytes - 1, 0, 2 * messageBytes, 7},
+          {1000, 1000, 1000, 33333},
+      };
+
+      ASSERT_TRUE(whole.processFrame(frame.data(),
+                                     static_cast<int>(frame.size()), 0.2f));
+
+      for (const auto &slices : slicings) {
+        SCOPED_TRACE(testing::Message()
+                     << bytes << " bytes in " << slices.size()
+                     << " slices, frame protection " << frameProtection);
+
+        streamed.beginFrame(0.2f);
+        size_t offset = 0;
+        for (size_t i = 0; offset < bytes; i++) {
+          const size_t slice =
+              (i < slices.size()) ? std::min(slices[i], bytes - offset)
+                                  : bytes - offset;
+          ASSERT_TRUE(streamed.appendBytes(frame.data() + offset,
+                                           static_cast<int>(slice)));
+          offset += slice;
+        }
+        ASSERT_TRUE(streamed.endFrame());
+
+        // Messages that went out before the end carry no count
+        const uint64_t msgCount = whole.data.back().msgCount;
+        UdpChunkVector data = streamed.data, ecc = streamed.ecc;
+        for (auto *chunks : {&data, &ecc}) {
+          for (auto &chunk : *chunks) {
+            if (chunk.msgIndex < msgCount) {
+              EXPECT_TRUE((chunk.msgCount == 0) ||
+                          (static_cast<uint64_t>(chunk.msgIndex) + 1 ==
+                           msgCount));
+              chunk.msgCount = msgCount;
+            }
+          }
+        }
+
+        expectSameChunks(whole.data, data, "data");
+        expectSameChunks(whole.ecc, ecc, "ecc");
+      }
+    }
+  }
+}
@@ -0,0 +1,178 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "PacketPacer.h"
+
+using namespace DirectRemote;
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const double RATE = 500000;
+const double BURST = 5000;
+const size_t DATAGRAM_SIZE = 1000;
+const size_t HEADER_SIZE = 16;
+
+// What a PacketPacer handed to the socket, and when
+struct Recorder {
+  std::mutex mutex;
+  const Clock::time_point start = Clock::now();
+  std::vector<double> times;
+  std::vector<std::vector<unsigned char>> datagrams;
+
+  PacketPacer::SendFunc sendFunc() {
+    return [this](const void *const *bytes, const size_t *sizes,
+                  size_t count) {
+      std::lock_guard<std::mutex> lock(mutex);
+      const double now =
+          std::chrono::duration<double>(Clock::now() - start).count();
+
+      for (size_t i = 0; i < count; i++) {
+        const unsigned char *datagram =
+            static_cast<const unsigned char *>(bytes[i]);
+        times.push_back(now);
+        datagrams.emplace_back(datagram, datagram + sizes[i]);
+      }
+      return count;
+    };
+  }
+};
+
+// Queues datagrams numbered from "first" on, one header and body each
+void queue(PacketPacer &pacer, size_t first, size_t count) {
+  std::vector<std::vector<unsigned char>> headers, bodies;
+  std::vector<const void *> headerPtrs, bodyPtrs;
+  std::vector<size_t> headerSizes, bodySizes;
+
+  for (size_t i = 0; i < count; i++) {
+    headers.emplace_back(HEADER_SIZE, static_cast<unsigned char>(first + i));
+    bodies.emplace_back(DATAGRAM_SIZE - HEADER_SIZE,
+                        static_cast<unsigned char>(~(first + i)));
+  }
+  for (size_t i = 0; i < count; i++) {
+    headerPtrs.push_back(headers[i].data());
+    headerSizes.push_back(headers[i].size());
+    bodyPtrs.push_back(bodies[i].data());
+    bodySizes.push_back(bodies[i].size());
+  }
+  pacer.queue(headerPtrs.data(), headerSizes.data(), bodyPtrs.data(),
+              bodySizes.data(), count);
+}
+
+void expectInOrder(const Recorder &recorder, size_t count) {
+  ASSERT_EQ(count, recorder.datagrams.size());
+
+  for (size_t i = 0; i < count; i++) {
+    const std::vector<unsigned char> &datagram = recorder.datagrams[i];
+    ASSERT_EQ(DATAGRAM_SIZE, datagram.size());
+    EXPECT_EQ(static_cast<unsigned char>(i), datagram[0]);
+    EXPECT_EQ(static_cast<unsigned char>(~i), datagram[DATAGRAM_SIZE - 1]);
+  }
+}
+}  // namespace
+
+TEST(PacketPacerTest, TokenBucketNeverLetsMoreThanItsBurstThrough) {
+  TokenBucket bucket(RATE, BURST);
+  double taken = 0;
+
+  for (int step = 0; step <= 1000; step++) {
+    const double now = step * 0.0001;
+
+    while (bucket.take(DATAGRAM_SIZE, now)) {
+      taken += DATAGRAM_SIZE;
+    }
+    // One byte of slack, see TokenBucket::take()
+    ASSERT_LE(taken, BURST + RATE * now + 1) << "at " << now;
+  }
+  EXPECT_GE(taken, RATE * 0.1);
+}
+
+TEST(PacketPacerTest, TokenBucketRaisesSmallBurstsToOneDatagram) {
+  TokenBucket bucket(RATE, 1);
+
+  EXPECT_TRUE(bucket.take(MAX_UDP_CHUNK_SIZE, 0));
+  EXPECT_FALSE(bucket.take(MAX_UDP_CHUNK_SIZE, 0));
+  EXPECT_DOUBLE_EQ(MAX_UDP_CHUNK_SIZE / RATE,
+                   bucket.availableAt(MAX_UDP_CHUNK_SIZE, 0));
+}
+
+TEST(PacketPacerTest, SendsNoFasterThanTheBucket) {
+  Recorder recorder;
+  const size_t count = 100;
+  {
+    PacketPacer pacer(recorder.sendFunc(), RATE, BURST);
+
+    queue(pacer, 0, count);
+    pacer.flush();
+    EXPECT_EQ(0u, pacer.queuedPackets());
+    EXPECT_EQ(static_cast<int64_t>(count), pacer.takeMetrics().packets);
+  }
+
+  // The recorder started before the pacer, so its clock is never behind
+  expectInOrder(recorder, count);
+  for (size_t i = 0; i < count; i++) {
+    const double sentBytes = static_cast<double>((i + 1) * DATAGRAM_SIZE);
+    EXPECT_LE(sentBytes, BURST + RATE * recorder.times[i] + 1)
+        << "datagram " << i;
+  }
+  EXPECT_GE(recorder.times.back(), (count * DATAGRAM_SIZE - BURST) / RATE);
+}
+
+TEST(PacketPacerTest, StoppingSendsWhatIsStillQueued) {
+  Recorder recorder;
+  const size_t count = 50;
+  {
+    PacketPacer pacer(recorder.sendFunc(), RATE, BURST);
+
+    queue(pacer, 0, count);
+    EXPECT_GT(pacer.queuedPackets(), 0u);
+  }
+
+  expectInOrder(recorder, count);
+  for (size_t i = 0; i < count; i++) {
+    const double sentBytes = static_cast<double>((i + 1) * DATAGRAM_SIZE);
+    EXPECT_LE(sentBytes, BURST + RATE * recorder.times[i] + 1)
+        << "datagram " << i;
+  }
+}
+
+TEST(PacketPacerTest, ClearedDatagramsDoNotGoOut) {
+  Recorder recorder;
+  {
+    PacketPacer pacer(recorder.sendFunc(), RATE / 100, BURST);
+
+    queue(pacer, 0, 20);
+    pacer.clear();
+    EXPECT_EQ(0u, pacer.queuedPackets());
+  }
+
+  EXPECT_LT(recorder.datagrams.size(), 20u);
+}
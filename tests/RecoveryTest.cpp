@@ -0,0 +1,240 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "FrameAssembly.h"
+#include "PacketAssembly.h"
+
+using namespace DirectRemote;
+
+namespace {
+typedef std::map<int64_t, std::vector<unsigned char>> FrameMap;
+typedef std::function<bool(const UdpChunk &)> LossPattern;
+
+std::vector<unsigned char> makeFrame(size_t bytes, unsigned seed) {
+  std::mt19937 random(seed);
+  std::vector<unsigned char> frame(bytes);
+
+  for (auto &byte : frame) {
+    byte = static_cast<unsigned char>(random());
+  }
+  return frame;
+}
+
+// Hands every chunk the loss pattern keeps to the receiver and collects the
+// frames that come out
+void deliver(FrameAssembly &frameAssembly, const UdpChunkVector &chunks,
+             int64_t trackingId, const LossPattern &isLost,
+             FrameMap &received) {
+  ConnectionMetrics metrics;
+
+  for (UdpChunk chunk : chunks) {
+    if (isLost(chunk)) {
+      continue;
+    }
+
+    chunk.trackingId = static_cast<uint64_t>(trackingId);
+    for (auto entry = frameAssembly.process(chunk, metrics); entry;
+         entry = frameAssembly.nextReadyFrame()) {
+      received[entry->trackingId] = entry->data;
+    }
+  }
+}
+
+bool keepAll(const UdpChunk &) { return false; }
+
+// The first "count" data chunks of message msgIndex
+LossPattern burst(int msgIndex, int count) {
+  return [=](const UdpChunk &chunk) {
+    return !chunk.isEccChunk && (static_cast<int>(chunk.msgIndex) == msgIndex) &&
+           (static_cast<int>(chunk.chunkIndex) < count);
+  };
+}
+
+// 3 messages, a burst too long for the ECC of the message it hits
+FrameMap sendWithBurst(bool frameProtection) {
+  const std::vector<unsigned char> frame =
+      makeFrame(2 * maxMessageSize(UDP_CHUNK_SIZE) + 1000, 1);
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  FrameMap received;
+
+  packetAssembly.setFrameProtection(frameProtection);
+  packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                              0.1f);
+
+  deliver(frameAssembly, packetAssembly.data, 0, burst(1, 20), received);
+  deliver(frameAssembly, packetAssembly.ecc, 0, keepAll, received);
+
+  if (received.count(0)) {
+    EXPECT_EQ(frame, received[0]);
+  }
+  return received;
+}
+}  // namespace
+
+TEST(RecoveryTest, FrameParityRepairsBurstInOneMessage) {
+  EXPECT_EQ(0u, sendWithBurst(false).size());
+  EXPECT_EQ(1u, sendWithBurst(true).size());
+}
+
+TEST(RecoveryTest, FountainRepairCompletesFrame) {
+  const std::vector<unsigned char> frame = makeFrame(60000, 2);
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  FrameMap received;
+
+  packetAssembly.setFountainMode(true);
+  packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                              0.05f);
+
+  const LossPattern isLost = burst(0, 20);
+  deliver(frameAssembly, packetAssembly.data, 0, isLost, received);
+  deliver(frameAssembly, packetAssembly.ecc, 0, isLost, received);
+  ASSERT_EQ(0u, received.size());
+
+  int repairs = 0;
+  while (!received.count(0) && packetAssembly.processRepair(0.05f)) {
+    deliver(frameAssembly, packetAssembly.ecc, 0, isLost, received);
+    repairs++;
+  }
+
+  ASSERT_EQ(1u, received.count(0));
+  EXPECT_EQ(frame, received[0]);
+  EXPECT_GT(repairs, 0);
+}
+
+TEST(RecoveryTest, FountainRepairStopsAtTheRowLimit) {
+  const std::vector<unsigned char> frame = makeFrame(10000, 3);
+  PacketAssembly packetAssembly;
+
+  packetAssembly.setFountainMode(true);
+  packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                              0.5f);
+
+  size_t rows = packetAssembly.ecc.size();
+  while (packetAssembly.processRepair(0.5f)) {
+    rows += packetAssembly.ecc.size();
+  }
+
+  EXPECT_EQ(static_cast<size_t>(MAX_MESSAGE_CHUNKS), rows);
+}
+
+TEST(RecoveryTest, CrossFrameParityRepairsEarlierFrame) {
+  for (int depth : {1, 2, 3}) {
+    PacketAssembly packetAssembly;
+    FrameAssembly frameAssembly;
+    FrameMap sent, received;
+
+    packetAssembly.setCrossFrameProtection(depth, 0.2f);
+
+    // The receiver learns the window from the parity of the first one, so
+    // the burst hits the first frame of the second window
+    for (int i = 0; i < 2 * depth; i++) {
+      sent[i] = makeFrame(60000, 10 + i);
+      packetAssembly.processFrame(sent[i].data(),
+                                  static_cast<int>(sent[i].size()), 0.05f);
+
+      const LossPattern isLost = (i == depth) ? burst(0, 20) : keepAll;
+      deliver(frameAssembly, packetAssembly.data, i, isLost, received);
+      deliver(frameAssembly, packetAssembly.ecc, i, isLost, received);
+    }
+
+    // Without parity across frames the burst costs the frame
+    EXPECT_EQ(depth > 1, received.count(depth) == 1) << "depth " << depth;
+    for (auto &frame : received) {
+      EXPECT_EQ(sent[frame.first], frame.second) << "frame " << frame.first;
+    }
+    EXPECT_EQ(static_cast<size_t>(2 * depth - (depth > 1 ? 0 : 1)),
+              received.size())
+        << "depth " << depth;
+  }
+}
+
+TEST(RecoveryTest, DecodeThreadsMayChangeWithinAFrame) {
+  const std::vector<unsigned char> frame =
+      makeFrame(3 * maxMessageSize(UDP_CHUNK_SIZE), 4);
+  PacketAssembly packetAssembly;
+  FrameAssembly frameAssembly;
+  FrameMap received;
+
+  packetAssembly.processFrame(frame.data(), static_cast<int>(frame.size()),
+                              0.1f);
+  frameAssembly.setDecodeThreads(1);
+
+  // Every message needs a decode, the first two are queued or running when
+  // the threads change
+  for (int msgIndex = 0; msgIndex < 3; msgIndex++) {
+    const LossPattern isLost = [&](const UdpChunk &chunk) {
+      return (static_cast<int>(chunk.msgIndex) != msgIndex) ||
+             (!chunk.isEccChunk && (chunk.chunkIndex < 2));
+    };
+    deliver(frameAssembly, packetAssembly.data, 0, isLost, received);
+    deliver(frameAssembly, packetAssembly.ecc, 0, isLost, received);
+
+    if (msgIndex == 1) {
+      frameAssembly.setDecodeThreads(2);
+    }
+  }
+
+  ASSERT_EQ(1u, received.count(0));
+  EXPECT_EQ(frame, received[0]);
+}
+
+TEST(RecoveryTest, ProgressiveDecodingHandlesEitherScheme) {
+  for (int chunkSize : {UDP_CHUNK_SIZE, 1232}) {
+    PacketAssembly packetAssembly;
+    FrameAssembly frameAssembly;
+    FrameMap received;
+
+    // Messages of up to 16 chunks get XOR parity, larger ones cauchy_256
+    packetAssembly.setChunkSize(chunkSize);
+    packetAssembly.setSmallMessageScheme(EEccScheme::Xor2D, 16);
+    frameAssembly.setChunkSize(chunkSize);
+    frameAssembly.setProgressiveDecoding(true);
+
+    const size_t sizes[] = {1000, 5000, 100000, 40000};
+    for (int i = 0; i < 4; i++) {
+      const std::vector<unsigned char> frame = makeFrame(sizes[i], 20 + i);
+      packetAssembly.processFrame(frame.data(),
+                                  static_cast<int>(frame.size()), 0.2f);
+
+      // ECC ahead of the data, so reduction starts with the first chunk
+      const LossPattern isLost = [&](const UdpChunk &chunk) {
+        return !chunk.isEccChunk && (chunk.chunkIndex % 7 == 3);
+      };
+      deliver(frameAssembly, packetAssembly.ecc, i, isLost, received);
+      deliver(frameAssembly, packetAssembly.data, i, isLost, received);
+
+      ASSERT_EQ(1u, received.count(i)) << "frame " << i;
+      EXPECT_EQ(frame, received[i]) << "frame " << i;
+    }
+  }
+}
@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "PacketAssembly.h"
+#include "SendScheduler.h"
+
+using namespace DirectRemote;
+
+namespace {
+void processFrame(PacketAssembly &packetAssembly, size_t bytes) {
+  std::vector<unsigned char> frame(bytes);
+
+  for (size_t i = 0; i < bytes; i++) {
+    frame[i] = static_cast<unsigned char>(i * 13 + 5);
+  }
+  ASSERT_TRUE(packetAssembly.processFrame(
+      frame.data(), static_cast<int>(frame.size()), 0.2f));
+}
+
+// Adds every chunk to "sent", and fails for chunks that went out before
+void collect(const std::vector<UdpChunk *> &chunks,
+             std::set<std::vector<unsigned char>> &sent) {
+  for (const UdpChunk *chunk : chunks) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(chunk);
+    EXPECT_TRUE(sent.insert(std::vector<unsigned char>(
+                                bytes, bytes + UDP_CHUNK_SIZE)).second);
+  }
+}
+}  // namespace
+
+TEST(SendSchedulerTest, IsolatedFrameGoesOutWithinItsHoldTime) {
+  PacketAssembly packetAssembly;
+  SendScheduler scheduler;
+  std::set<std::vector<unsigned char>> sent;
+
+  processFrame(packetAssembly, 200000);
+  const size_t chunkCount =
+      packetAssembly.data.size() + packetAssembly.ecc.size();
+
+  scheduler.setHoldTime(0.05);
+  collect(scheduler.schedule(packetAssembly.data.span(),
+                             packetAssembly.ecc.span(), 7, 4, 10.0),
+          sent);
+
+  EXPECT_LT(sent.size(), chunkCount);
+  EXPECT_DOUBLE_EQ(10.05, scheduler.nextDue());
+  EXPECT_TRUE(scheduler.releaseDue(10.04).empty());
+
+  collect(scheduler.releaseDue(10.05), sent);
+  EXPECT_EQ(chunkCount, sent.size());
+  EXPECT_FALSE(scheduler.hasHeldChunks());
+  EXPECT_LT(scheduler.nextDue(), 0);
+}
+
+TEST(SendSchedulerTest, LaterFramesTakeSharesAlongBeforeTheyAreDue) {
+  PacketAssembly packetAssembly;
+  SendScheduler scheduler;
+  std::set<std::vector<unsigned char>> sent;
+  size_t chunkCount = 0;
+
+  scheduler.setHoldTime(1);
+  for (int i = 0; i < 4; i++) {
+    processFrame(packetAssembly, 50000 + 1000 * i);
+    chunkCount += packetAssembly.data.size() + packetAssembly.ecc.size();
+
+    collect(scheduler.schedule(packetAssembly.data.span(),
+                               packetAssembly.ecc.span(), i, 2, i * 0.01),
+            sent);
+    EXPECT_DOUBLE_EQ(i * 0.01 + 1, scheduler.nextDue()) << "frame " << i;
+  }
+
+  collect(scheduler.releaseDue(1.5), sent);
+  EXPECT_EQ(chunkCount, sent.size());
+}
+
+TEST(SendSchedulerTest, WithoutHoldTimeSharesWaitForLaterFrames) {
+  PacketAssembly packetAssembly;
+  SendScheduler scheduler;
+
+  processFrame(packetAssembly, 50000);
+  scheduler.schedule(packetAssembly.data.span(), packetAssembly.ecc.span(),
+                     1, 3, 10.0);
+
+  EXPECT_LT(scheduler.nextDue(), 0);
+  EXPECT_TRUE(scheduler.releaseDue(1000).empty());
+  EXPECT_FALSE(scheduler.flush().empty());
+  EXPECT_FALSE(scheduler.hasHeldChunks());
+}
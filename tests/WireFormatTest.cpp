@@ -0,0 +1,263 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "PacketAssembly.h"
+#include "UdpChunk.h"
+
+using namespace DirectRemote;
+
+namespace {
+UdpChunk makeChunk(int64_t trackingId, int chunkIndex, int chunkCount,
+                   int msgIndex, int msgCount, int payloadBytes) {
+  UdpChunk chunk;
+  memset(&chunk, 0, sizeof(chunk));
+
+  chunk.sessionId = 0x123456789ABCull;
+  chunk.trackingId = static_cast<uint64_t>(trackingId);
+  chunk.chunkIndex = static_cast<uint64_t>(chunkIndex);
+  chunk.chunkCount = static_cast<uint64_t>(chunkCount);
+  chunk.msgIndex = static_cast<uint64_t>(msgIndex);
+  chunk.msgCount = static_cast<uint64_t>(msgCount);
+  chunk.data.size = static_cast<uint16_t>(payloadBytes);
+  for (int i = 0; i < payloadBytes; i++) {
+    chunk.data.bytes[i] = static_cast<unsigned char>(i * 7 + 1);
+  }
+
+  return chunk;
+}
+
+// Puts "chunk" on the wire the way UdpProtocol does and reads it back in
+// place, like recvThreadImpl(). Returns the decoded length.
+int roundTrip(const UdpChunk &chunk, int wireFormat, int chunkSize,
+              UdpChunk &received, int *datagramBytes = nullptr) {
+  unsigned char datagram[MAX_CHUNK_HEADER_SIZE + MAX_UDP_CHUNK_SIZE];
+  const int headerBytes = encodeChunkHeader(chunk, wireFormat, datagram);
+  const int bodyBytes = wireChunkSize(chunk, chunkSize) - CHUNK_ECC_OFFSET;
+
+  memcpy(datagram + headerBytes,
+         reinterpret_cast<const unsigned char *>(&chunk) + CHUNK_ECC_OFFSET,
+         bodyBytes);
+
+  memset(&received, 0xAB, sizeof(received));
+  memcpy(&received, datagram, headerBytes + bodyBytes);
+  if (datagramBytes) {
+    *datagramBytes = headerBytes + bodyBytes;
+  }
+
+  return decodeChunk(received, headerBytes + bodyBytes, wireFormat);
+}
+
+void expectSameChunk(const UdpChunk &sent, const UdpChunk &received,
+                     int length) {
+  EXPECT_EQ(sent.sessionId, received.sessionId);
+  EXPECT_EQ(sent.isEccChunk, received.isEccChunk);
+  EXPECT_EQ(sent.trackingId, received.trackingId);
+  EXPECT_EQ(sent.chunkIndex, received.chunkIndex);
+  EXPECT_EQ(sent.chunkCount, received.chunkCount);
+  EXPECT_EQ(sent.msgIndex, received.msgIndex);
+  EXPECT_EQ(sent.msgCount, received.msgCount);
+  EXPECT_EQ(0, memcmp(reinterpret_cast<const unsigned char *>(&sent) +
+                          CHUNK_ECC_OFFSET,
+                      reinterpret_cast<const unsigned char *>(&received) +
+                          CHUNK_ECC_OFFSET,
+                      length - CHUNK_ECC_OFFSET));
+}
+}  // namespace
+
+TEST(WireFormatTest, V1RoundTrip) {
+  const UdpChunk sent = makeChunk(123456789, 100, 127, 3, 9, 300);
+  UdpChunk received;
+
+  const int length = roundTrip(sent, EWireFormat::V1, 1472, received);
+
+  ASSERT_EQ(wireChunkSize(sent, 1472), length);
+  ASSERT_TRUE(restoreChunk(received, length, 1472));
+  expectSameChunk(sent, received, 1472);
+}
+
+TEST(WireFormatTest, V2RoundTrip) {
+  const int64_t trackingIds[] = {0, 1, 255, 256, 70000, 0xFFFFFFFFFFll};
+
+  for (int64_t trackingId : trackingIds) {
+    for (int msgCount : {1, 4}) {
+      for (int isEcc = 0; isEcc < 2; isEcc++) {
+        UdpChunk sent = makeChunk(trackingId, 191, 192, msgCount - 1,
+                                  msgCount, isEcc ? 0 : 17);
+        sent.isEccChunk = static_cast<uint64_t>(isEcc);
+        UdpChunk received;
+
+        const int length = roundTrip(sent, EWireFormat::V2, 1232, received);
+
+        ASSERT_EQ(wireChunkSize(sent, 1232), length);
+        ASSERT_TRUE(restoreChunk(received, length, 1232));
+        expectSameChunk(sent, received, 1232);
+      }
+    }
+  }
+}
+
+TEST(WireFormatTest, V2HeaderIsCompact) {
+  UdpChunk received;
+  int datagramBytes = 0;
+
+  // Single message frames leave out msgIndex and msgCount, small tracking
+  // ids take a byte
+  const UdpChunk sent = makeChunk(5, 0, 1, 0, 1, 10);
+  roundTrip(sent, EWireFormat::V2, UDP_CHUNK_SIZE, received, &datagramBytes);
+
+  EXPECT_EQ(CHUNK_ROUTING_SIZE + 1 + 2 + CHUNK_PAYLOAD_OFFSET -
+                CHUNK_ECC_OFFSET + 10,
+            datagramBytes);
+}
+
+TEST(WireFormatTest, RoutingBytesMatchAcrossFormats) {
+  UdpChunk sent = makeChunk(77, 1, 2, 0, 1, 10);
+  sent.isEccChunk = 1;
+  unsigned char v1[MAX_CHUNK_HEADER_SIZE], v2[MAX_CHUNK_HEADER_SIZE];
+
+  encodeChunkHeader(sent, EWireFormat::V1, v1);
+  encodeChunkHeader(sent, EWireFormat::V2, v2);
+
+  EXPECT_EQ(0, memcmp(v1, v2, 6));
+  EXPECT_EQ(v1[6] & 3, v2[6] & 3);
+}
+
+TEST(WireFormatTest, RejectsTruncatedHeaders) {
+  const UdpChunk sent = makeChunk(70000, 5, 10, 2, 4, 10);
+  unsigned char header[MAX_CHUNK_HEADER_SIZE];
+  UdpChunk received;
+
+  const int v2Bytes = encodeChunkHeader(sent, EWireFormat::V2, header);
+  memcpy(&received, header, v2Bytes);
+  EXPECT_EQ(-1, decodeChunk(received, v2Bytes - 1, EWireFormat::V2));
+
+  encodeChunkHeader(sent, EWireFormat::V1, header);
+  memcpy(&received, header, MAX_CHUNK_HEADER_SIZE);
+  EXPECT_EQ(-1, decodeChunk(received, CHUNK_ECC_OFFSET - 1, EWireFormat::V1));
+}
+
+TEST(WireFormatTest, V1WidensTrackingIdsLikeBefore) {
+  const int64_t trackingIds[] = {0, 1, -1, 0x7FFFFFFFFFll, -0x8000000000ll};
+
+  for (int64_t trackingId : trackingIds) {
+    ASSERT_TRUE(isValidTrackingId(trackingId));
+
+    const UdpChunk sent = makeChunk(trackingId, 3, 5, 0, 1, 10);
+    unsigned char header[MAX_CHUNK_HEADER_SIZE];
+    uint64_t words[2];
+    UdpChunk received;
+
+    ASSERT_EQ(CHUNK_ECC_OFFSET,
+              encodeChunkHeader(sent, EWireFormat::V1, header));
+    memcpy(words, header, sizeof(words));
+    EXPECT_EQ(static_cast<uint64_t>(trackingId) & 0xFFFFFFFFFFFFull,
+              words[1] & 0xFFFFFFFFFFFFull);
+
+    const int length = roundTrip(sent, EWireFormat::V1, 512, received);
+    ASSERT_EQ(wireChunkSize(sent, 512), length);
+    expectSameChunk(sent, received, length);
+  }
+
+  EXPECT_FALSE(isValidTrackingId(0x8000000000ll));
+  EXPECT_FALSE(isValidTrackingId(-0x8000000001ll));
+}
+
+TEST(WireFormatTest, V1RejectsWhatItCannotCarry) {
+  unsigned char header[MAX_CHUNK_HEADER_SIZE];
+
+  EXPECT_EQ(-1, encodeChunkHeader(makeChunk(1, 128, 5, 0, 1, 10),
+                                  EWireFormat::V1, header));
+  EXPECT_EQ(-1, encodeChunkHeader(makeChunk(1, 3, 128, 0, 1, 10),
+                                  EWireFormat::V1, header));
+  EXPECT_EQ(MAX_CHUNK_HEADER_SIZE,
+            encodeChunkHeader(makeChunk(1, 127, 127, 0, 1, 10),
+                              EWireFormat::V1, header));
+
+  // A 48 bit tracking id that is not a widened 40 bit one
+  const uint64_t words[2] = {0x123456789ABCull, 0x010000000000ull};
+  UdpChunk received;
+  memcpy(&received, words, sizeof(words));
+  EXPECT_EQ(-1, decodeChunk(received, UDP_CHUNK_SIZE, EWireFormat::V1));
+}
+
+TEST(WireFormatTest, ControlPacketsGoOutAsV1) {
+  UdpChunk sent;
+  memset(&sent, 0, sizeof(sent));
+  sent.sessionId = 0x123456789ABCull;
+  sent.isControlPacket = 1;
+  sent.ctrl.command = EUdpCommand::Probe;
+  sent.ctrl.chunkSize = 1232;
+
+  UdpChunk datagram = sent;
+  ASSERT_TRUE(encodeControlPacket(datagram));
+
+  // What a relay reads without decoding
+  EXPECT_EQ(0, memcmp(&sent, &datagram, CHUNK_ROUTING_SIZE));
+  EXPECT_EQ(1u, datagram.isControlPacket);
+  EXPECT_EQ(EUdpCommand::Probe, datagram.ctrl.command);
+
+  ASSERT_EQ(UDP_CHUNK_SIZE,
+            decodeChunk(datagram, UDP_CHUNK_SIZE, EWireFormat::V1));
+  EXPECT_EQ(0, memcmp(&sent, &datagram, UDP_CHUNK_SIZE));
+}
+
+TEST(WireFormatTest, DataChunksAreClearBeyondTheirPayload) {
+  PacketAssembly packetAssembly;
+  std::mt19937 random(3);
+  std::vector<unsigned char> frame(100000);
+
+  // Chunk buffers are reused, the first frame leaves them full of payload
+  for (size_t frameBytes : {frame.size(), static_cast<size_t>(777)}) {
+    for (auto &byte : frame) {
+      byte = static_cast<unsigned char>(random());
+    }
+    ASSERT_TRUE(packetAssembly.processFrame(
+        frame.data(), static_cast<int>(frameBytes), 0.1f));
+  }
+
+  ASSERT_EQ(2u, packetAssembly.data.size());
+  for (size_t i = 0; i < packetAssembly.data.size(); i++) {
+    const UdpChunk &chunk = packetAssembly.data[i];
+    const unsigned char *bytes =
+        reinterpret_cast<const unsigned char *>(&chunk);
+    const int end = CHUNK_PAYLOAD_OFFSET + chunk.data.size;
+
+    EXPECT_EQ(0u, chunk.isControlPacket);
+    EXPECT_EQ(0u, chunk.isEccChunk);
+    EXPECT_EQ(0u, chunk.sessionId);
+    EXPECT_EQ(0u, chunk.trackingId);
+    for (int j = end; j < UDP_CHUNK_SIZE; j++) {
+      ASSERT_EQ(0, bytes[j]) << "chunk " << i << ", byte " << j;
+    }
+  }
+  EXPECT_EQ(0, memcmp(packetAssembly.data[1].data.bytes,
+                      frame.data() + chunkPayloadSize(UDP_CHUNK_SIZE),
+                      777 - chunkPayloadSize(UDP_CHUNK_SIZE)));
+}
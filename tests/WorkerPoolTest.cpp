@@ -0,0 +1,56 @@
+/*
+
+Copyright (c) 2015 Christoph Husse
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "WorkerPool.h"
+
+using namespace DirectRemote;
+
+namespace {
+struct CountingTask : WorkerPool::Task {
+  std::atomic<int> *runs = nullptr;
+
+  void run(size_t) override { (*runs)++; }
+};
+}  // namespace
+
+TEST(WorkerPoolTest, QueuedTasksRunBeforeThePoolIsGone) {
+  std::atomic<int> runs(0);
+  std::vector<CountingTask> tasks(1000);
+
+  {
+    WorkerPool workers(1);
+    for (auto &task : tasks) {
+      task.runs = &runs;
+      workers.submit(&task);
+    }
+  }
+
+  EXPECT_EQ(1000, runs.load());
+}